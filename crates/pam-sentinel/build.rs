@@ -19,4 +19,46 @@ fn main() {
         .unwrap_or_else(|_| format!("{prefix}/{libexecdir}/sentinel-helper-kde"));
 
     println!("cargo:rustc-env=SENTINEL_HELPER_PATH={helper_path}");
+
+    // The `test-seam` feature lets environment variables stand in for
+    // the dialog, so a module built with it must not end up installed by
+    // accident. Enabling the feature alone is not enough: it also takes
+    // SENTINEL_ALLOW_TEST_SEAM=1, an optimized build also takes
+    // SENTINEL_BENCH_BUILD=1, and the config dir must be a private one
+    // whose parent becomes the only place the seam writes timings.
+    if std::env::var_os("CARGO_FEATURE_TEST_SEAM").is_some() {
+        println!("cargo:rerun-if-env-changed=SENTINEL_ALLOW_TEST_SEAM");
+        println!("cargo:rerun-if-env-changed=SENTINEL_BENCH_BUILD");
+        println!("cargo:rerun-if-env-changed=SENTINEL_SYSCONFDIR");
+        let set = |var: &str| std::env::var(var).is_ok_and(|v| v == "1");
+        if !set("SENTINEL_ALLOW_TEST_SEAM") {
+            panic!(
+                "the test-seam feature lets the environment answer for the dialog; \
+                 set SENTINEL_ALLOW_TEST_SEAM=1 to build it anyway"
+            );
+        }
+        if std::env::var("PROFILE").is_ok_and(|p| p == "release") && !set("SENTINEL_BENCH_BUILD") {
+            panic!(
+                "a release build with test-seam is for the PAM bench only; \
+                 set SENTINEL_BENCH_BUILD=1 as well"
+            );
+        }
+        let sysconfdir = std::env::var("SENTINEL_SYSCONFDIR").unwrap_or_else(|_| "/etc".into());
+        let sysconfdir = std::path::Path::new(&sysconfdir);
+        let bench_root = sysconfdir
+            .parent()
+            .filter(|root| sysconfdir.is_absolute() && !root.starts_with("/etc"))
+            .filter(|root| *root != std::path::Path::new("/"))
+            .unwrap_or_else(|| {
+                panic!(
+                    "the test-seam feature needs a private SENTINEL_SYSCONFDIR \
+                     (e.g. /tmp/sentinel-bench/etc); it must never read /etc"
+                )
+            });
+        println!(
+            "cargo:rustc-env=SENTINEL_BENCH_ROOT={}",
+            bench_root.display()
+        );
+        println!("cargo:warning=pam-sentinel built with test-seam: do not install this module");
+    }
 }
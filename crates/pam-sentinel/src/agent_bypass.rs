@@ -15,6 +15,15 @@
 //! passwordless auth. So talking to the agent over the system bus rides
 //! existing MAC policy with no custom SELinux/AppArmor rules, on any version.
 //!
+//! ## Who gets asked
+//! Only `polkit-agent-helper-1` (PAM service `polkit-1`) can have a pending
+//! approval — the agent only ever pre-approves the polkit auth it is
+//! itself driving. [`eligible`] gates on both the service name and the
+//! host binary, so terminal `sudo`/`su` never connect to the bus, and a
+//! `/etc/pam.d/polkit-1` stack borrowed by some other binary doesn't
+//! either. When the agent isn't running, the name lookup is the first
+//! pipelined call and fails with `NameHasNoOwner` after one round trip.
+//!
 //! ## Identifying the requesting user
 //! - `pamh.get_user()` returns `Err` for some PAM stacks (polkit-1 via
 //!   helper-1), so we fall back to `pamh.get_item::<User>()`.
@@ -24,34 +33,94 @@
 //! ## Trust model
 //! - Only root may call the agent's method (enforced by the D-Bus policy in
 //!   `packaging/dbus/org.sentinel.Agent.conf`), so a non-root local process
-//!   can't drain the approval queue.
-//! - Before trusting a reply we verify the `org.sentinel.Agent` bus name is
-//!   owned by the uid we're authenticating (`GetConnectionUnixUser`), so a
-//!   same-name squatter from another uid can't forge an approval.
+//!   can't take approvals.
+//! - Before trusting a reply we resolve `org.sentinel.Agent` to its unique
+//!   connection name (`GetNameOwner`) and verify that connection belongs to
+//!   the uid we're authenticating (`GetConnectionUnixUser`), so a same-name
+//!   squatter from another uid can't forge an approval. `TakeApprovalFor`
+//!   is then sent to that unique name, so an ownership change mid-exchange
+//!   can't redirect it.
+//! - The agent binds each approval to the helper-1 connection that its
+//!   own exchange opened; helper-1's stdin is that connection, and
+//!   `TakeApprovalFor` names its socket inode. So concurrent auths can't
+//!   take each other's approvals. polkit doesn't give PAM the cookie,
+//!   so the connection is how we say which auth we are. An agent from
+//!   before `TakeApprovalFor` gets the plain `TakeApproval`.
+//! - The bus is reached at its fixed socket path, never through
+//!   `$DBUS_SYSTEM_BUS_ADDRESS` (see [`crate::dbus_wire`]).
 //! - Fail-open: any error (no agent, wrong owner, refused) returns `None` and
 //!   the stack falls through to the normal dialog/password flow. We never
 //!   `PAM_AUTH_ERR` from here.
+//!
+//! ## Early helper-1
+//! With `[general].early_helper` the agent starts helper-1 as the dialog
+//! opens, and `TakeApprovalFor` doesn't answer until the user has. That
+//! one call gets `ServiceConfig::early_helper_wait` instead of
+//! [`QUERY_DEADLINE`]; everything before it keeps the short deadline, so
+//! a missing or wedged agent still costs at most that.
 
+use crate::dbus_wire::{Bus, DBUS_INTERFACE, DBUS_NAME, DBUS_PATH, SYSTEM_BUS_SOCKET};
 use pam::constants::PamResultCode;
 use pam::module::PamHandle;
+use sentinel_shared::POLKIT_PAM_SERVICE;
+use sentinel_shared::accounts::Accounts;
+use sentinel_shared::procfs::Snapshot;
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+/// Hard cap on the whole bypass exchange, connect through the
+/// `TakeApprovalFor` reply. The agent answers from memory; anything slower
+/// means it's wedged, and the user is better off with the dialog.
+const QUERY_DEADLINE: Duration = Duration::from_millis(500);
+
+/// Basename of polkit's PAM client, the only host the agent pre-approves
+/// for (`/usr/lib/polkit-1/…`, `/usr/libexec/…` depending on distro).
+const BYPASS_HOST: &str = "polkit-agent-helper-1";
+
+/// The D-Bus error for "nobody owns that name" — i.e. no agent running.
+const NAME_HAS_NO_OWNER: &str = "org.freedesktop.DBus.Error.NameHasNoOwner";
+
+/// What an agent that predates `TakeApprovalFor` answers to it.
+const UNKNOWN_METHOD: &str = "org.freedesktop.DBus.Error.UnknownMethod";
 
-pub fn check_agent_bypass(pamh: &mut PamHandle) -> Option<PamResultCode> {
+/// Whether this auth could possibly be agent-approved: PAM service
+/// `polkit-1` *and* the module loaded into `polkit-agent-helper-1`.
+pub fn eligible(service: &str, host: &Snapshot) -> bool {
+    eligible_for(service, host.exe())
+}
+
+fn eligible_for(service: &str, host_exe: Option<&str>) -> bool {
+    service == POLKIT_PAM_SERVICE
+        && host_exe.and_then(sentinel_shared::process_basename) == Some(BYPASS_HOST)
+}
+
+/// `wait` is how long the agent may hold `TakeApprovalFor` open for a
+/// dialog still on screen (`early_helper`); `None` when it never should.
+pub fn check_agent_bypass(
+    pamh: &mut PamHandle,
+    accounts: &Accounts,
+    wait: Option<Duration>,
+) -> Option<PamResultCode> {
     let user = resolve_user(pamh)?;
-    let uid = match nix::unistd::User::from_name(&user) {
-        Ok(Some(u)) => u.uid.as_raw(),
-        _ => {
+    let uid = match accounts.by_name(&user) {
+        Some(u) => u.uid,
+        None => {
             log::debug!("agent_bypass: PAM_USER={user} has no passwd entry; falling through");
             return None;
         }
     };
     log::debug!("agent_bypass: PAM_USER={user} uid={uid}");
 
-    match query_agent(uid) {
+    match query_agent(uid, wait) {
         Ok(true) => {
             log::info!("event=auth.allow source=bypass uid={uid}");
             Some(PamResultCode::PAM_SUCCESS)
         }
         Ok(false) => None,
+        Err(e) if e.to_string() == NAME_HAS_NO_OWNER => {
+            log::debug!("agent_bypass: no agent on the bus; falling through");
+            None
+        }
         Err(e) => {
             log::debug!("agent_bypass: query failed ({e}); falling through");
             None
@@ -61,15 +130,42 @@ pub fn check_agent_bypass(pamh: &mut PamHandle) -> Option<PamResultCode> {
 
 /// Query the user's agent over the system bus. Returns `Ok(true)` only when
 /// the `org.sentinel.Agent` name is owned by `uid` (anti-squat) AND the agent
-/// hands back a one-shot approval.
-fn query_agent(uid: u32) -> Result<bool, Box<dyn std::error::Error>> {
-    use zbus::blocking::{Connection, Proxy, fdo::DBusProxy};
+/// hands back the one-shot approval bound to our connection.
+///
+/// Three round trips: {auth, `Hello`, `GetNameOwner`} pipelined in one
+/// write, then `GetConnectionUnixUser` on the unique owner, then
+/// `TakeApprovalFor`. The last two can't be merged: sending the take
+/// before the uid check would consume another user's approval whenever
+/// their agent holds the name. An older agent costs a fourth, for the
+/// `TakeApproval` retry.
+fn query_agent(uid: u32, wait: Option<Duration>) -> std::io::Result<bool> {
+    let deadline = Instant::now() + QUERY_DEADLINE;
+    #[cfg(not(feature = "test-seam"))]
+    let bus_path = Path::new(SYSTEM_BUS_SOCKET);
+    #[cfg(feature = "test-seam")]
+    let bus_path = &crate::seam::system_bus(Path::new(SYSTEM_BUS_SOCKET));
+    let mut bus = Bus::connect(bus_path, deadline)?;
 
-    let conn = Connection::system()?;
+    let owner = bus.call(
+        DBUS_NAME,
+        DBUS_PATH,
+        DBUS_INTERFACE,
+        "GetNameOwner",
+        Some(sentinel_shared::AGENT_BUS_NAME),
+    );
+    bus.flush()?;
+    let owner = bus.reply(owner)?.string()?;
 
     // Anti-squat: the agent name must be owned by the user we're authing.
-    let name: zbus::names::BusName = sentinel_shared::AGENT_BUS_NAME.try_into()?;
-    let owner_uid = DBusProxy::new(&conn)?.get_connection_unix_user(name)?;
+    let owner_uid = bus.call(
+        DBUS_NAME,
+        DBUS_PATH,
+        DBUS_INTERFACE,
+        "GetConnectionUnixUser",
+        Some(&owner),
+    );
+    bus.flush()?;
+    let owner_uid = bus.reply(owner_uid)?.u32()?;
     if owner_uid != uid {
         log::warn!(
             "agent_bypass: {} owned by uid {owner_uid} != expected {uid}; refusing (squat?)",
@@ -78,14 +174,45 @@ fn query_agent(uid: u32) -> Result<bool, Box<dyn std::error::Error>> {
         return Ok(false);
     }
 
-    let proxy = Proxy::new(
-        &conn,
-        sentinel_shared::AGENT_BUS_NAME,
+    if let Some(connection) = stdin_connection() {
+        let take = bus.call(
+            &owner,
+            sentinel_shared::AGENT_OBJECT_PATH,
+            sentinel_shared::AGENT_INTERFACE,
+            "TakeApprovalFor",
+            Some(&connection),
+        );
+        bus.flush()?;
+        if let Some(wait) = wait {
+            bus.set_deadline(Instant::now() + wait);
+        }
+        match bus.reply(take) {
+            Err(e) if e.to_string() == UNKNOWN_METHOD => {
+                log::debug!("agent_bypass: agent predates TakeApprovalFor; retrying without");
+            }
+            reply => return reply?.boolean(),
+        }
+    }
+
+    let take = bus.call(
+        &owner,
         sentinel_shared::AGENT_OBJECT_PATH,
         sentinel_shared::AGENT_INTERFACE,
-    )?;
-    let approved: bool = proxy.call("TakeApproval", &())?;
-    Ok(approved)
+        "TakeApproval",
+        None,
+    );
+    bus.flush()?;
+    bus.reply(take)?.boolean()
+}
+
+/// The socket inode of our stdin, as `TakeApprovalFor` wants it.
+/// Socket-activated helper-1 runs with the agent's connection as stdin;
+/// `None` when stdin isn't a socket at all.
+fn stdin_connection() -> Option<String> {
+    use nix::sys::stat::{SFlag, fstat};
+    let st = fstat(std::io::stdin()).ok()?;
+    (SFlag::from_bits_truncate(st.st_mode) & SFlag::S_IFMT == SFlag::S_IFSOCK)
+        .then(|| st.st_ino.to_string())
 }
 
 fn resolve_user(pamh: &mut PamHandle) -> Option<String> {
@@ -97,3 +224,29 @@ fn resolve_user(pamh: &mut PamHandle) -> Option<String> {
         .flatten()
         .and_then(|s| s.to_str().ok().map(str::to_owned))
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn only_polkit_helper_on_polkit_service_is_eligible() {
+        let helper = Some("/usr/lib/polkit-1/polkit-agent-helper-1");
+        assert!(eligible_for("polkit-1", helper));
+        assert!(eligible_for(
+            "polkit-1",
+            Some("/usr/libexec/polkit-agent-helper-1")
+        ));
+        // Terminal services never reach the bus, whatever the host.
+        assert!(!eligible_for("sudo", helper));
+        assert!(!eligible_for("su", Some("/usr/bin/su")));
+        // polkit-1 stack borrowed by another binary.
+        assert!(!eligible_for("polkit-1", Some("/usr/bin/sudo")));
+        assert!(!eligible_for(
+            "polkit-1",
+            Some("/tmp/polkit-agent-helper-1-x")
+        ));
+        // Unreadable exe: fail towards "no bypass" (the dialog).
+        assert!(!eligible_for("polkit-1", None));
+    }
+}
@@ -9,14 +9,24 @@
 //!
 //! **Fail-closed is the whole contract.** If the broker is missing, down,
 //! hung, or misbehaving, `check_remember` returns `false` (→ show the
-//! dialog) and `record_remember` is a no-op. Auth never breaks because the
+//! dialog) and [`Session::record`] is a no-op. Auth never breaks because the
 //! broker is unavailable — the worst case is "you get prompted", never
 //! "you get let in". I/O is bounded by a short timeout so a hung broker
 //! can't stall the auth.
+//!
+//! A prompting auth is one connection (protocol 2): [`check_remember`]
+//! sends `SessionCheck` and keeps the stream in the returned
+//! [`Session`], held across the dialog; [`Session::record`] then sends
+//! `SessionRecord` on it, which the broker accepts only after that
+//! connection's miss. A broker that predates sessions drops the
+//! connection on the unknown request, and the shim repeats the check as
+//! a v1 `CheckRemember` and records with a v1 `RecordRemember`. Only that
+//! hang-up means v1: a broker that times out is not asked twice.
 
 use sentinel_broker_proto::{
-    RememberKey, RememberQuery, Request, Response, read_frame, write_frame,
+    ProtoError, RememberKey, RememberQuery, Request, Response, read_frame, write_frame,
 };
+use std::io::ErrorKind;
 use std::os::unix::net::UnixStream;
 use std::time::Duration;
 
@@ -32,32 +42,93 @@ fn sock_path() -> String {
     std::env::var("SENTINEL_BROKER_SOCK").unwrap_or_else(|_| DEFAULT_SOCK.to_string())
 }
 
+fn connect(sock: &str) -> Option<UnixStream> {
+    let s = UnixStream::connect(sock).ok()?;
+    s.set_read_timeout(Some(IO_TIMEOUT)).ok()?;
+    s.set_write_timeout(Some(IO_TIMEOUT)).ok()?;
+    Some(s)
+}
+
+/// One write → read exchange on an open connection.
+fn exchange(s: &mut UnixStream, req: &Request) -> Option<Response> {
+    try_exchange(s, req).ok()
+}
+
+fn try_exchange(s: &mut UnixStream, req: &Request) -> Result<Response, ProtoError> {
+    write_frame(s, req)?;
+    read_frame(s)
+}
+
+/// Whether `e` is how a v1 broker refuses a request it can't decode: it
+/// closes the connection without a reply. A timeout is not.
+fn is_hangup(e: &ProtoError) -> bool {
+    matches!(e, ProtoError::Io(io) if matches!(
+        io.kind(),
+        ErrorKind::UnexpectedEof | ErrorKind::ConnectionReset | ErrorKind::BrokenPipe
+    ))
+}
+
 /// One connect → write → read round-trip. `None` on *any* failure, so
 /// callers fail closed.
 fn roundtrip_at(sock: &str, req: &Request) -> Option<Response> {
-    let mut s = UnixStream::connect(sock).ok()?;
-    s.set_read_timeout(Some(IO_TIMEOUT)).ok()?;
-    s.set_write_timeout(Some(IO_TIMEOUT)).ok()?;
-    write_frame(&mut s, req).ok()?;
-    read_frame::<_, Response>(&mut s).ok()
+    exchange(&mut connect(sock)?, req)
+}
+
+/// What [`check_remember`] leaves for recording the grant after the
+/// dialog.
+pub struct Session {
+    sock: String,
+    how: Record,
+}
+
+enum Record {
+    /// The broker holds the missed key on this connection.
+    Held(UnixStream),
+    /// v1 broker (or the connection failed): one-shot record.
+    OneShot(RememberKey),
+}
+
+/// Ask the broker whether a fresh grant exists, and open the session a
+/// record would use. Fail-closed: only an explicit `Remember { fresh:
+/// true }` returns `true`; everything else (unreachable broker, error
+/// response, timeout) is `false`.
+pub fn check_remember(key: RememberKey, ttl_secs: u32) -> (bool, Session) {
+    check_remember_at(sock_path(), key, ttl_secs)
 }
 
-/// Ask the broker whether a fresh grant exists. Fail-closed: only an
-/// explicit `Remember { fresh: true }` returns `true`; everything else
-/// (unreachable broker, error response, timeout) is `false`.
-pub fn check_remember(key: RememberKey, ttl_secs: u32) -> bool {
-    let req = Request::CheckRemember(RememberQuery { key, ttl_secs });
-    matches!(
-        roundtrip_at(&sock_path(), &req),
-        Some(Response::Remember { fresh: true })
-    )
+fn check_remember_at(sock: String, key: RememberKey, ttl_secs: u32) -> (bool, Session) {
+    let query = RememberQuery { key, ttl_secs };
+    let mut stream = connect(&sock);
+    let reply = stream
+        .as_mut()
+        .map(|s| try_exchange(s, &Request::SessionCheck(query.clone())));
+    let (fresh, how) = match (reply, stream) {
+        (Some(Ok(Response::Remember { fresh })), Some(s)) => (fresh, Record::Held(s)),
+        // A v1 broker refusing the unknown request.
+        (Some(Err(e)), _) if is_hangup(&e) => {
+            let fresh = matches!(
+                roundtrip_at(&sock, &Request::CheckRemember(query.clone())),
+                Some(Response::Remember { fresh: true })
+            );
+            (fresh, Record::OneShot(query.key))
+        }
+        // Any other reply, a timeout or no connection: not fresh.
+        _ => (false, Record::OneShot(query.key)),
+    };
+    (fresh, Session { sock, how })
 }
 
-/// Record a grant (after an opt-in Allow). Best-effort: any failure is
-/// swallowed (the user simply re-prompts next time).
-pub fn record_remember(key: RememberKey) {
-    if let Some(Response::Error(e)) = roundtrip_at(&sock_path(), &Request::RecordRemember(key)) {
-        log::warn!("sentinel: broker rejected remember record: {e}");
+impl Session {
+    /// Record the grant (after an opt-in Allow). Best-effort: any failure
+    /// is swallowed (the user simply re-prompts next time).
+    pub fn record(self) {
+        let reply = match self.how {
+            Record::Held(mut s) => exchange(&mut s, &Request::SessionRecord),
+            Record::OneShot(key) => roundtrip_at(&self.sock, &Request::RecordRemember(key)),
+        };
+        if let Some(Response::Error(e)) = reply {
+            log::warn!("sentinel: broker rejected remember record: {e}");
+        }
     }
 }
 
@@ -144,6 +215,112 @@ mod tests {
         ));
     }
 
+    /// Mock broker that serves one connection: answers each request with
+    /// the next of `canned`, closing without a reply once they run out.
+    fn mock_session(
+        tag: &str,
+        canned: Vec<Response>,
+    ) -> (String, thread::JoinHandle<Vec<Request>>) {
+        let dir = std::env::temp_dir().join(format!("sentinel-bc-{}-{}", tag, std::process::id()));
+        let _ = std::fs::create_dir_all(&dir);
+        let sock = dir.join("b.sock");
+        let _ = std::fs::remove_file(&sock);
+        let listener = UnixListener::bind(&sock).unwrap();
+        let h = thread::spawn(move || {
+            let mut seen = Vec::new();
+            let Ok((mut stream, _)) = listener.accept() else {
+                return seen;
+            };
+            for reply in canned {
+                let Ok(req) = read_frame::<_, Request>(&mut stream) else {
+                    break;
+                };
+                seen.push(req);
+                write_frame(&mut stream, &reply).unwrap();
+            }
+            if let Ok(req) = read_frame::<_, Request>(&mut stream) {
+                seen.push(req);
+            }
+            seen
+        });
+        (sock.to_str().unwrap().to_string(), h)
+    }
+
+    #[test]
+    fn session_checks_and_records_on_one_connection() {
+        let (sock, h) = mock_session(
+            "session",
+            vec![Response::Remember { fresh: false }, Response::Recorded],
+        );
+        let (fresh, session) = check_remember_at(sock, key(), 60);
+        assert!(!fresh);
+        session.record();
+        let seen = h.join().unwrap();
+        assert!(matches!(
+            seen.as_slice(),
+            [Request::SessionCheck(_), Request::SessionRecord]
+        ));
+    }
+
+    #[test]
+    fn v1_broker_falls_back_to_one_shot_requests() {
+        let dir = std::env::temp_dir().join(format!("sentinel-bc-v1-{}", std::process::id()));
+        let _ = std::fs::create_dir_all(&dir);
+        let sock = dir.join("b.sock");
+        let _ = std::fs::remove_file(&sock);
+        let listener = UnixListener::bind(&sock).unwrap();
+        let h = thread::spawn(move || {
+            // A v1 broker can't decode SessionCheck: it hangs up...
+            let (mut s, _) = listener.accept().unwrap();
+            let first: Request = read_frame(&mut s).unwrap();
+            drop(s);
+            // ...and answers the repeated v1 check.
+            let (mut s, _) = listener.accept().unwrap();
+            let second: Request = read_frame(&mut s).unwrap();
+            write_frame(&mut s, &Response::Remember { fresh: true }).unwrap();
+            (first, second)
+        });
+        let (fresh, _) = check_remember_at(sock.to_str().unwrap().into(), key(), 60);
+        assert!(fresh);
+        assert!(matches!(
+            h.join().unwrap(),
+            (Request::SessionCheck(_), Request::CheckRemember(_))
+        ));
+    }
+
+    #[test]
+    fn silent_broker_is_not_asked_again() {
+        let dir = std::env::temp_dir().join(format!("sentinel-bc-mute-{}", std::process::id()));
+        let _ = std::fs::create_dir_all(&dir);
+        let sock = dir.join("b.sock");
+        let _ = std::fs::remove_file(&sock);
+        let listener = UnixListener::bind(&sock).unwrap();
+        let h = thread::spawn(move || {
+            // Accepts and reads, but never answers.
+            let (mut s, _) = listener.accept().unwrap();
+            let _: Request = read_frame(&mut s).unwrap();
+            listener.set_nonblocking(true).unwrap();
+            (listener, s)
+        });
+        let (fresh, _) = check_remember_at(sock.to_str().unwrap().into(), key(), 60);
+        assert!(!fresh);
+        let (listener, _held) = h.join().unwrap();
+        let again = listener.accept();
+        assert!(
+            matches!(&again, Err(e) if e.kind() == ErrorKind::WouldBlock),
+            "a timed-out SessionCheck must not be retried as v1"
+        );
+    }
+
+    #[test]
+    fn unreachable_broker_session_is_not_fresh() {
+        let (fresh, session) =
+            check_remember_at("/nonexistent/sentinel/broker.sock".into(), key(), 60);
+        assert!(!fresh);
+        // Recording is a harmless no-op.
+        session.record();
+    }
+
     #[test]
     fn decode_does_not_panic_on_garbage_reply() {
         // Defensive: a reply that isn't a valid frame must error, not panic.
@@ -0,0 +1,868 @@
+// SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Minimal synchronous D-Bus wire client for the agent bypass handshake.
+//!
+//! `pam_sentinel.so` makes at most four method calls per auth, all on the
+//! system bus, all with zero or one string argument. A general-purpose
+//! D-Bus library for that drags an async executor (and its thread) into
+//! `sudo` right before `helper::run` forks, costs a few hundred KiB of
+//! `.so`, and pays for SASL + `Hello` + each call as separate round
+//! trips. This module is the part of the spec we actually use:
+//!
+//! * **Transport:** the fixed system-bus socket path. Deliberately *not*
+//!   `$DBUS_SYSTEM_BUS_ADDRESS` — inside `sudo` the environment belongs
+//!   to the user asking for root.
+//! * **Auth:** `AUTH EXTERNAL` with our euid, pipelined with `BEGIN` and
+//!   the first messages in a single write (as sd-bus does).
+//! * **Messages:** little-endian method calls with an optional single
+//!   `s` argument; replies with `s`, `u` or `b` bodies. Both endiannesses
+//!   are accepted on the read side. Signals (`NameAcquired`) are skipped.
+//! * **Deadline:** one [`Instant`] for the whole exchange; every read and
+//!   write gets only what's left of it.
+//!
+//! No threads, no allocations beyond the two buffers, no `unsafe`.
+
+use std::io::{self, Read, Write};
+use std::os::unix::net::UnixStream;
+use std::path::Path;
+use std::time::Instant;
+
+/// Standard system-bus socket (`unix:path=` of the default address).
+pub const SYSTEM_BUS_SOCKET: &str = "/run/dbus/system_bus_socket";
+
+pub const DBUS_NAME: &str = "org.freedesktop.DBus";
+pub const DBUS_PATH: &str = "/org/freedesktop/DBus";
+pub const DBUS_INTERFACE: &str = "org.freedesktop.DBus";
+
+const METHOD_CALL: u8 = 1;
+const METHOD_RETURN: u8 = 2;
+const ERROR: u8 = 3;
+/// Only ever *received* (and skipped); the tests' fake bus sends one.
+#[cfg(test)]
+const SIGNAL: u8 = 4;
+
+const FIELD_PATH: u8 = 1;
+const FIELD_INTERFACE: u8 = 2;
+const FIELD_MEMBER: u8 = 3;
+const FIELD_ERROR_NAME: u8 = 4;
+const FIELD_REPLY_SERIAL: u8 = 5;
+const FIELD_DESTINATION: u8 = 6;
+const FIELD_SIGNATURE: u8 = 8;
+
+/// Cap on any single incoming message. Every reply we wait for is a few
+/// dozen bytes; this only bounds what a confused peer can make us buffer.
+const MAX_MESSAGE: usize = 64 * 1024;
+/// Cap on the SASL reply line (`OK <32 hex guid>\r\n` is 37 bytes).
+const MAX_AUTH_LINE: usize = 512;
+
+/// A blocking, single-threaded connection to one bus. Calls are queued
+/// with [`Bus::call`], sent together by [`Bus::flush`], and their replies
+/// collected in any order with [`Bus::reply`].
+pub struct Bus {
+    sock: UnixStream,
+    deadline: Instant,
+    serial: u32,
+    authed: bool,
+    hello: u32,
+    wbuf: Vec<u8>,
+    rbuf: Vec<u8>,
+    /// Replies that arrived while we were waiting for a different one.
+    pending: Vec<Message>,
+}
+
+impl Bus {
+    /// Connect to the bus at `path` and queue the SASL handshake plus
+    /// `Hello`. Nothing is sent until the first [`Bus::flush`], so the
+    /// caller can pipeline its own first calls into the same write.
+    pub fn connect(path: &Path, deadline: Instant) -> io::Result<Self> {
+        let sock = UnixStream::connect(path)?;
+        let mut bus = Self {
+            sock,
+            deadline,
+            serial: 0,
+            authed: false,
+            hello: 0,
+            wbuf: Vec::with_capacity(512),
+            rbuf: Vec::with_capacity(512),
+            pending: Vec::new(),
+        };
+        bus.wbuf.push(0);
+        bus.wbuf.extend_from_slice(b"AUTH EXTERNAL ");
+        for b in nix::unistd::geteuid().as_raw().to_string().bytes() {
+            let _ = write!(bus.wbuf, "{b:02x}");
+        }
+        bus.wbuf.extend_from_slice(b"\r\nBEGIN\r\n");
+        bus.hello = bus.call(DBUS_NAME, DBUS_PATH, DBUS_INTERFACE, "Hello", None);
+        Ok(bus)
+    }
+
+    /// Queue a method call; returns its serial for [`Bus::reply`].
+    pub fn call(
+        &mut self,
+        destination: &str,
+        path: &str,
+        interface: &str,
+        member: &str,
+        arg: Option<&str>,
+    ) -> u32 {
+        self.serial += 1;
+        let mut body = Vec::new();
+        if let Some(arg) = arg {
+            put_str(&mut body, arg);
+        }
+        encode(
+            &mut self.wbuf,
+            METHOD_CALL,
+            self.serial,
+            &Fields {
+                path: Some(path),
+                interface: Some(interface),
+                member: Some(member),
+                destination: Some(destination),
+                signature: if arg.is_some() { "s" } else { "" },
+                ..Fields::default()
+            },
+            &body,
+        );
+        self.serial
+    }
+
+    /// Move the deadline, e.g. to give one call that legitimately
+    /// blocks (a long poll) longer than the rest of the exchange.
+    pub fn set_deadline(&mut self, deadline: Instant) {
+        self.deadline = deadline;
+    }
+
+    /// Send everything queued so far in one write.
+    pub fn flush(&mut self) -> io::Result<()> {
+        self.sock.set_write_timeout(Some(self.remaining()?))?;
+        self.sock.write_all(&self.wbuf)?;
+        self.wbuf.clear();
+        Ok(())
+    }
+
+    /// Wait for the reply to `serial`. An `ERROR` reply becomes an
+    /// `Err` carrying the D-Bus error name.
+    pub fn reply(&mut self, serial: u32) -> io::Result<Message> {
+        if !self.authed {
+            self.read_auth()?;
+            self.authed = true;
+            // The daemon refuses everything until `Hello` succeeds, so
+            // its reply (our unique name) is the first one to look for.
+            let hello = self.hello;
+            if serial != hello {
+                self.reply(hello)?;
+            }
+        }
+        let msg = match self
+            .pending
+            .iter()
+            .position(|m| m.reply_serial == Some(serial))
+        {
+            Some(i) => self.pending.swap_remove(i),
+            None => loop {
+                let msg = self.next_message()?;
+                if msg.reply_serial == Some(serial) {
+                    break msg;
+                }
+                if matches!(msg.kind, METHOD_RETURN | ERROR) && self.pending.len() < 8 {
+                    self.pending.push(msg);
+                }
+            },
+        };
+        if msg.kind == ERROR {
+            return Err(io::Error::other(
+                msg.error_name
+                    .unwrap_or_else(|| "unnamed D-Bus error".into()),
+            ));
+        }
+        Ok(msg)
+    }
+
+    fn remaining(&self) -> io::Result<std::time::Duration> {
+        self.deadline
+            .checked_duration_since(Instant::now())
+            .filter(|d| !d.is_zero())
+            .ok_or_else(|| io::Error::new(io::ErrorKind::TimedOut, "D-Bus deadline exceeded"))
+    }
+
+    fn fill(&mut self) -> io::Result<()> {
+        self.sock.set_read_timeout(Some(self.remaining()?))?;
+        let mut chunk = [0u8; 1024];
+        let n = self.sock.read(&mut chunk)?;
+        if n == 0 {
+            return Err(io::ErrorKind::UnexpectedEof.into());
+        }
+        self.rbuf.extend_from_slice(&chunk[..n]);
+        Ok(())
+    }
+
+    fn read_auth(&mut self) -> io::Result<()> {
+        loop {
+            if let Some(end) = self.rbuf.windows(2).position(|w| w == b"\r\n") {
+                let ok = self.rbuf.starts_with(b"OK ");
+                self.rbuf.drain(..end + 2);
+                return if ok {
+                    Ok(())
+                } else {
+                    Err(io::Error::new(
+                        io::ErrorKind::PermissionDenied,
+                        "bus rejected AUTH EXTERNAL",
+                    ))
+                };
+            }
+            if self.rbuf.len() > MAX_AUTH_LINE {
+                return Err(io::ErrorKind::InvalidData.into());
+            }
+            self.fill()?;
+        }
+    }
+
+    fn next_message(&mut self) -> io::Result<Message> {
+        loop {
+            if let Some(len) = message_len(&self.rbuf)? {
+                if self.rbuf.len() >= len {
+                    let msg = Message::parse(&self.rbuf[..len])?;
+                    self.rbuf.drain(..len);
+                    return Ok(msg);
+                }
+            }
+            self.fill()?;
+        }
+    }
+}
+
+/// A parsed incoming message: just the header fields we route on and the
+/// raw body.
+#[derive(Debug)]
+pub struct Message {
+    pub kind: u8,
+    /// Sender's serial; only the tests' fake bus replies to us by it.
+    #[cfg_attr(not(test), allow(dead_code))]
+    pub serial: u32,
+    pub reply_serial: Option<u32>,
+    pub error_name: Option<String>,
+    pub member: Option<String>,
+    pub destination: Option<String>,
+    pub signature: String,
+    big_endian: bool,
+    body: Vec<u8>,
+}
+
+impl Message {
+    fn parse(buf: &[u8]) -> io::Result<Self> {
+        let bad = || io::Error::from(io::ErrorKind::InvalidData);
+        let mut r = Reader::new(buf, buf[0] == b'B');
+        r.pos = 1;
+        let kind = r.u8().ok_or_else(bad)?;
+        r.pos = 8;
+        let serial = r.u32().ok_or_else(bad)?;
+        let fields_len = r.u32().ok_or_else(bad)? as usize;
+        let fields_end = 16 + fields_len;
+
+        let mut msg = Self {
+            kind,
+            serial,
+            reply_serial: None,
+            error_name: None,
+            member: None,
+            destination: None,
+            signature: String::new(),
+            big_endian: r.big_endian,
+            body: Vec::new(),
+        };
+        while r.pos < fields_end {
+            r.align(8);
+            let code = r.u8().ok_or_else(bad)?;
+            let sig = r.sig().ok_or_else(bad)?;
+            match sig {
+                "s" | "o" => {
+                    let v = r.str().ok_or_else(bad)?.to_owned();
+                    match code {
+                        FIELD_ERROR_NAME => msg.error_name = Some(v),
+                        FIELD_MEMBER => msg.member = Some(v),
+                        FIELD_DESTINATION => msg.destination = Some(v),
+                        _ => {}
+                    }
+                }
+                "g" => {
+                    let v = r.sig().ok_or_else(bad)?.to_owned();
+                    if code == FIELD_SIGNATURE {
+                        msg.signature = v;
+                    }
+                }
+                "u" => {
+                    let v = r.u32().ok_or_else(bad)?;
+                    if code == FIELD_REPLY_SERIAL {
+                        msg.reply_serial = Some(v);
+                    }
+                }
+                _ => return Err(bad()),
+            }
+        }
+        if r.pos != fields_end {
+            return Err(bad());
+        }
+        r.align(8);
+        msg.body = buf.get(r.pos..).ok_or_else(bad)?.to_vec();
+        Ok(msg)
+    }
+
+    fn body(&self, signature: &str) -> io::Result<Reader<'_>> {
+        if self.signature != signature {
+            return Err(io::Error::new(
+                io::ErrorKind::InvalidData,
+                format!("expected body '{signature}', got '{}'", self.signature),
+            ));
+        }
+        Ok(Reader::new(&self.body, self.big_endian))
+    }
+
+    /// Body of signature `s` (or `o`).
+    pub fn string(&self) -> io::Result<String> {
+        let sig = if self.signature == "o" { "o" } else { "s" };
+        self.body(sig)?
+            .str()
+            .map(str::to_owned)
+            .ok_or_else(|| io::ErrorKind::InvalidData.into())
+    }
+
+    /// Body of signature `u`.
+    pub fn u32(&self) -> io::Result<u32> {
+        self.body("u")?
+            .u32()
+            .ok_or_else(|| io::ErrorKind::InvalidData.into())
+    }
+
+    /// Body of signature `b`. Anything but 0/1 is malformed.
+    pub fn boolean(&self) -> io::Result<bool> {
+        match self.body("b")?.u32() {
+            Some(0) => Ok(false),
+            Some(1) => Ok(true),
+            _ => Err(io::ErrorKind::InvalidData.into()),
+        }
+    }
+}
+
+/// Total length of the message at the front of `buf`, once its fixed
+/// 16-byte prefix has arrived.
+fn message_len(buf: &[u8]) -> io::Result<Option<usize>> {
+    if buf.len() < 16 {
+        return Ok(None);
+    }
+    let big_endian = match buf[0] {
+        b'l' => false,
+        b'B' => true,
+        _ => return Err(io::ErrorKind::InvalidData.into()),
+    };
+    let mut r = Reader::new(buf, big_endian);
+    r.pos = 4;
+    let body_len = r.u32().unwrap_or(u32::MAX) as usize;
+    r.pos = 12;
+    let fields_len = r.u32().unwrap_or(u32::MAX) as usize;
+    let len = (16usize.saturating_add(fields_len))
+        .next_multiple_of(8)
+        .saturating_add(body_len);
+    if len > MAX_MESSAGE {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "oversized D-Bus message",
+        ));
+    }
+    Ok(Some(len))
+}
+
+#[derive(Default)]
+struct Fields<'a> {
+    path: Option<&'a str>,
+    interface: Option<&'a str>,
+    member: Option<&'a str>,
+    error_name: Option<&'a str>,
+    reply_serial: Option<u32>,
+    destination: Option<&'a str>,
+    signature: &'a str,
+}
+
+/// Append one little-endian message to `out`. `body` must already be
+/// marshalled relative to its own (8-aligned) start.
+fn encode(out: &mut Vec<u8>, kind: u8, serial: u32, f: &Fields<'_>, body: &[u8]) {
+    let start = out.len();
+    let align = |out: &mut Vec<u8>, n: usize| {
+        while (out.len() - start) % n != 0 {
+            out.push(0);
+        }
+    };
+    let string_field = |out: &mut Vec<u8>, code: u8, ty: u8, v: &str| {
+        align(out, 8);
+        out.extend_from_slice(&[code, 1, ty, 0]);
+        align(out, 4);
+        out.extend_from_slice(&(v.len() as u32).to_le_bytes());
+        out.extend_from_slice(v.as_bytes());
+        out.push(0);
+    };
+
+    out.extend_from_slice(&[b'l', kind, 0, 1]);
+    out.extend_from_slice(&(body.len() as u32).to_le_bytes());
+    out.extend_from_slice(&serial.to_le_bytes());
+    let fields_len_at = out.len();
+    out.extend_from_slice(&[0; 4]);
+    let fields_start = out.len();
+    if let Some(v) = f.path {
+        string_field(out, FIELD_PATH, b'o', v);
+    }
+    if let Some(v) = f.interface {
+        string_field(out, FIELD_INTERFACE, b's', v);
+    }
+    if let Some(v) = f.member {
+        string_field(out, FIELD_MEMBER, b's', v);
+    }
+    if let Some(v) = f.error_name {
+        string_field(out, FIELD_ERROR_NAME, b's', v);
+    }
+    if let Some(v) = f.reply_serial {
+        align(out, 8);
+        out.extend_from_slice(&[FIELD_REPLY_SERIAL, 1, b'u', 0]);
+        out.extend_from_slice(&v.to_le_bytes());
+    }
+    if let Some(v) = f.destination {
+        string_field(out, FIELD_DESTINATION, b's', v);
+    }
+    if !f.signature.is_empty() {
+        align(out, 8);
+        out.extend_from_slice(&[FIELD_SIGNATURE, 1, b'g', 0, f.signature.len() as u8]);
+        out.extend_from_slice(f.signature.as_bytes());
+        out.push(0);
+    }
+    let fields_len = (out.len() - fields_start) as u32;
+    out[fields_len_at..fields_len_at + 4].copy_from_slice(&fields_len.to_le_bytes());
+    align(out, 8);
+    out.extend_from_slice(body);
+}
+
+/// Marshal a `s` value at the end of a body buffer.
+fn put_str(body: &mut Vec<u8>, s: &str) {
+    while body.len() % 4 != 0 {
+        body.push(0);
+    }
+    body.extend_from_slice(&(s.len() as u32).to_le_bytes());
+    body.extend_from_slice(s.as_bytes());
+    body.push(0);
+}
+
+/// Bounds-checked cursor over a message (offsets are relative to the
+/// message start, which is what D-Bus alignment is defined against).
+struct Reader<'a> {
+    buf: &'a [u8],
+    pos: usize,
+    big_endian: bool,
+}
+
+impl<'a> Reader<'a> {
+    fn new(buf: &'a [u8], big_endian: bool) -> Self {
+        Self {
+            buf,
+            pos: 0,
+            big_endian,
+        }
+    }
+    fn align(&mut self, n: usize) {
+        self.pos = self.pos.next_multiple_of(n);
+    }
+    fn take(&mut self, n: usize) -> Option<&'a [u8]> {
+        let s = self.buf.get(self.pos..self.pos.checked_add(n)?)?;
+        self.pos += n;
+        Some(s)
+    }
+    fn u8(&mut self) -> Option<u8> {
+        Some(self.take(1)?[0])
+    }
+    fn u32(&mut self) -> Option<u32> {
+        self.align(4);
+        let b: [u8; 4] = self.take(4)?.try_into().ok()?;
+        Some(if self.big_endian {
+            u32::from_be_bytes(b)
+        } else {
+            u32::from_le_bytes(b)
+        })
+    }
+    fn nul_terminated(&mut self, n: usize) -> Option<&'a str> {
+        let s = self.take(n)?;
+        (self.u8()? == 0).then_some(())?;
+        std::str::from_utf8(s).ok()
+    }
+    fn str(&mut self) -> Option<&'a str> {
+        let n = self.u32()? as usize;
+        self.nul_terminated(n)
+    }
+    fn sig(&mut self) -> Option<&'a str> {
+        let n = self.u8()? as usize;
+        self.nul_terminated(n)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::os::unix::net::UnixListener;
+    use std::thread;
+    use std::time::Duration;
+
+    fn reply(out: &mut Vec<u8>, to: &Message, sig: &str, body: &[u8]) {
+        encode(
+            out,
+            METHOD_RETURN,
+            1000 + to.serial,
+            &Fields {
+                reply_serial: Some(to.serial),
+                signature: sig,
+                ..Fields::default()
+            },
+            body,
+        );
+    }
+
+    fn str_body(s: &str) -> Vec<u8> {
+        let mut b = Vec::new();
+        put_str(&mut b, s);
+        b
+    }
+
+    /// One-connection fake bus daemon: checks the SASL preamble, then
+    /// answers `Hello`, `GetNameOwner`, `GetConnectionUnixUser` and
+    /// `TakeApproval`, and interleaves an unsolicited signal. Returns the
+    /// members it saw, in order.
+    fn fake_bus(path: &Path, owner_uid: u32, approved: bool) -> thread::JoinHandle<Vec<String>> {
+        let listener = UnixListener::bind(path).unwrap();
+        thread::spawn(move || {
+            let (mut s, _) = listener.accept().unwrap();
+            let mut buf = Vec::new();
+            let mut chunk = [0u8; 1024];
+            while !buf.windows(7).any(|w| w == b"BEGIN\r\n") {
+                let n = s.read(&mut chunk).unwrap();
+                buf.extend_from_slice(&chunk[..n]);
+            }
+            assert!(buf.starts_with(b"\0AUTH EXTERNAL "));
+            let begin = buf.windows(7).position(|w| w == b"BEGIN\r\n").unwrap();
+            buf.drain(..begin + 7);
+            s.write_all(b"OK 0123456789abcdef0123456789abcdef\r\n")
+                .unwrap();
+
+            let mut seen = Vec::new();
+            loop {
+                let msg = loop {
+                    if let Some(len) = message_len(&buf).unwrap()
+                        && buf.len() >= len
+                    {
+                        let m = Message::parse(&buf[..len]).unwrap();
+                        buf.drain(..len);
+                        break Some(m);
+                    }
+                    match s.read(&mut chunk) {
+                        Ok(0) | Err(_) => break None,
+                        Ok(n) => buf.extend_from_slice(&chunk[..n]),
+                    }
+                };
+                let Some(msg) = msg else { return seen };
+                let member = msg.member.clone().unwrap();
+                let mut out = Vec::new();
+                match member.as_str() {
+                    "Hello" => {
+                        reply(&mut out, &msg, "s", &str_body(":1.42"));
+                        encode(
+                            &mut out,
+                            SIGNAL,
+                            1,
+                            &Fields {
+                                path: Some(DBUS_PATH),
+                                interface: Some(DBUS_INTERFACE),
+                                member: Some("NameAcquired"),
+                                signature: "s",
+                                ..Fields::default()
+                            },
+                            &str_body(":1.42"),
+                        );
+                    }
+                    "GetNameOwner" => {
+                        assert_eq!(msg.string().unwrap(), sentinel_shared::AGENT_BUS_NAME);
+                        reply(&mut out, &msg, "s", &str_body(":1.7"));
+                    }
+                    "GetConnectionUnixUser" => {
+                        assert_eq!(msg.string().unwrap(), ":1.7");
+                        reply(&mut out, &msg, "u", &owner_uid.to_le_bytes());
+                    }
+                    "TakeApproval" => {
+                        assert_eq!(msg.destination.as_deref(), Some(":1.7"));
+                        reply(&mut out, &msg, "b", &u32::from(approved).to_le_bytes());
+                    }
+                    other => panic!("unexpected call {other}"),
+                }
+                s.write_all(&out).unwrap();
+                seen.push(member);
+            }
+        })
+    }
+
+    fn sock(tag: &str) -> std::path::PathBuf {
+        let p = std::env::temp_dir().join(format!("sentinel-dbus-{tag}-{}", std::process::id()));
+        let _ = std::fs::remove_file(&p);
+        p
+    }
+
+    #[test]
+    fn encode_parse_round_trip() {
+        let mut out = Vec::new();
+        encode(
+            &mut out,
+            METHOD_CALL,
+            7,
+            &Fields {
+                path: Some(DBUS_PATH),
+                interface: Some(DBUS_INTERFACE),
+                member: Some("GetNameOwner"),
+                destination: Some(DBUS_NAME),
+                signature: "s",
+                ..Fields::default()
+            },
+            &str_body("org.sentinel.Agent"),
+        );
+        assert_eq!(message_len(&out).unwrap(), Some(out.len()));
+        let m = Message::parse(&out).unwrap();
+        assert_eq!(m.kind, METHOD_CALL);
+        assert_eq!(m.serial, 7);
+        assert_eq!(m.member.as_deref(), Some("GetNameOwner"));
+        assert_eq!(m.destination.as_deref(), Some(DBUS_NAME));
+        assert_eq!(m.string().unwrap(), "org.sentinel.Agent");
+        assert!(m.u32().is_err(), "signature mismatch must not decode");
+    }
+
+    #[test]
+    fn parses_big_endian_replies() {
+        // METHOD_RETURN, reply_serial=3, signature "u", body 1000 (BE).
+        let mut m = vec![b'B', METHOD_RETURN, 0, 1, 0, 0, 0, 4, 0, 0, 0, 9];
+        m.extend_from_slice(&[0, 0, 0, 15]); // fields length
+        m.extend_from_slice(&[FIELD_REPLY_SERIAL, 1, b'u', 0, 0, 0, 0, 3]);
+        m.extend_from_slice(&[FIELD_SIGNATURE, 1, b'g', 0, 1, b'u', 0, 0]);
+        m.extend_from_slice(&1000u32.to_be_bytes());
+        assert_eq!(message_len(&m).unwrap(), Some(m.len()));
+        let msg = Message::parse(&m).unwrap();
+        assert_eq!(msg.reply_serial, Some(3));
+        assert_eq!(msg.u32().unwrap(), 1000);
+    }
+
+    #[test]
+    fn rejects_garbage_and_oversized() {
+        assert!(message_len(b"xxxxxxxxxxxxxxxx").is_err());
+        let mut huge = vec![b'l', METHOD_RETURN, 0, 1];
+        huge.extend_from_slice(&u32::MAX.to_le_bytes());
+        huge.extend_from_slice(&[0; 8]);
+        assert!(message_len(&huge).is_err());
+        // Truncated header fields.
+        let mut out = Vec::new();
+        encode(
+            &mut out,
+            METHOD_RETURN,
+            1,
+            &Fields {
+                reply_serial: Some(1),
+                signature: "s",
+                ..Fields::default()
+            },
+            &str_body("x"),
+        );
+        assert!(Message::parse(&out[..20]).is_err());
+    }
+
+    #[test]
+    fn full_exchange_against_fake_bus() {
+        let path = sock("full");
+        let server = fake_bus(&path, 1000, true);
+        let deadline = Instant::now() + Duration::from_secs(5);
+        let mut bus = Bus::connect(&path, deadline).unwrap();
+        let owner = bus.call(
+            DBUS_NAME,
+            DBUS_PATH,
+            DBUS_INTERFACE,
+            "GetNameOwner",
+            Some(sentinel_shared::AGENT_BUS_NAME),
+        );
+        bus.flush().unwrap();
+        let unique = bus.reply(owner).unwrap().string().unwrap();
+        assert_eq!(unique, ":1.7");
+        let uid = bus.call(
+            DBUS_NAME,
+            DBUS_PATH,
+            DBUS_INTERFACE,
+            "GetConnectionUnixUser",
+            Some(&unique),
+        );
+        bus.flush().unwrap();
+        assert_eq!(bus.reply(uid).unwrap().u32().unwrap(), 1000);
+        let take = bus.call(
+            &unique,
+            sentinel_shared::AGENT_OBJECT_PATH,
+            sentinel_shared::AGENT_INTERFACE,
+            "TakeApproval",
+            None,
+        );
+        bus.flush().unwrap();
+        assert!(bus.reply(take).unwrap().boolean().unwrap());
+        drop(bus);
+        assert_eq!(
+            server.join().unwrap(),
+            [
+                "Hello",
+                "GetNameOwner",
+                "GetConnectionUnixUser",
+                "TakeApproval"
+            ]
+        );
+        let _ = std::fs::remove_file(&path);
+    }
+
+    #[test]
+    fn error_reply_surfaces_error_name() {
+        let path = sock("err");
+        let listener = UnixListener::bind(&path).unwrap();
+        let server = thread::spawn(move || {
+            let (mut s, _) = listener.accept().unwrap();
+            let mut out = b"OK 0123456789abcdef0123456789abcdef\r\n".to_vec();
+            for serial in [1, 2] {
+                encode(
+                    &mut out,
+                    if serial == 1 { METHOD_RETURN } else { ERROR },
+                    100 + serial,
+                    &Fields {
+                        reply_serial: Some(serial),
+                        error_name: (serial == 2)
+                            .then_some("org.freedesktop.DBus.Error.NameHasNoOwner"),
+                        signature: "s",
+                        ..Fields::default()
+                    },
+                    &str_body(":1.1"),
+                );
+            }
+            s.write_all(&out).unwrap();
+            let _ = s.read(&mut [0u8; 4096]);
+        });
+        let mut bus = Bus::connect(&path, Instant::now() + Duration::from_secs(5)).unwrap();
+        let owner = bus.call(
+            DBUS_NAME,
+            DBUS_PATH,
+            DBUS_INTERFACE,
+            "GetNameOwner",
+            Some("x.y"),
+        );
+        bus.flush().unwrap();
+        let err = bus.reply(owner).unwrap_err();
+        assert_eq!(err.to_string(), "org.freedesktop.DBus.Error.NameHasNoOwner");
+        drop(bus);
+        server.join().unwrap();
+        let _ = std::fs::remove_file(&path);
+    }
+
+    #[test]
+    fn silent_bus_hits_the_deadline() {
+        let path = sock("silent");
+        let listener = UnixListener::bind(&path).unwrap();
+        let server = thread::spawn(move || {
+            let (s, _) = listener.accept().unwrap();
+            thread::sleep(Duration::from_millis(500));
+            drop(s);
+        });
+        let started = Instant::now();
+        let mut bus = Bus::connect(&path, started + Duration::from_millis(100)).unwrap();
+        bus.flush().unwrap();
+        let hello = bus.hello;
+        assert!(bus.reply(hello).is_err());
+        assert!(started.elapsed() < Duration::from_millis(450));
+        server.join().unwrap();
+        let _ = std::fs::remove_file(&path);
+    }
+
+    #[test]
+    fn extended_deadline_outlasts_a_slow_reply() {
+        let path = sock("slow");
+        let listener = UnixListener::bind(&path).unwrap();
+        let server = thread::spawn(move || {
+            let (mut s, _) = listener.accept().unwrap();
+            thread::sleep(Duration::from_millis(300));
+            let mut out = b"OK 0123456789abcdef0123456789abcdef\r\n".to_vec();
+            reply_to(&mut out, 1, ":1.1");
+            s.write_all(&out).unwrap();
+            let _ = s.read(&mut [0u8; 4096]);
+        });
+        let started = Instant::now();
+        let mut bus = Bus::connect(&path, started + Duration::from_millis(100)).unwrap();
+        bus.flush().unwrap();
+        bus.set_deadline(started + Duration::from_secs(5));
+        let hello = bus.hello;
+        assert_eq!(bus.reply(hello).unwrap().string().unwrap(), ":1.1");
+        drop(bus);
+        server.join().unwrap();
+        let _ = std::fs::remove_file(&path);
+    }
+
+    fn reply_to(out: &mut Vec<u8>, serial: u32, body: &str) {
+        encode(
+            out,
+            METHOD_RETURN,
+            100 + serial,
+            &Fields {
+                reply_serial: Some(serial),
+                signature: "s",
+                ..Fields::default()
+            },
+            &str_body(body),
+        );
+    }
+
+    /// Round-trip latency against the real system bus, this client vs.
+    /// the zbus blocking path it replaced. Neither side can reach a real
+    /// agent's `TakeApproval` here, so both stop at the anti-squat check,
+    /// run against `org.freedesktop.DBus` itself. Ours does connect, auth,
+    /// `Hello`, `GetNameOwner` and `GetConnectionUnixUser` (one call more
+    /// than the old code); zbus does `Connection::system()` and
+    /// `GetConnectionUnixUser`.
+    ///
+    /// `cargo test -p pam-sentinel --release -- --ignored --nocapture bench_`
+    #[test]
+    #[ignore = "benchmark; needs a system bus"]
+    fn bench_system_bus_round_trip() {
+        let iters = 200;
+        let started = Instant::now();
+        for _ in 0..iters {
+            let deadline = Instant::now() + Duration::from_secs(1);
+            let mut bus = Bus::connect(Path::new(SYSTEM_BUS_SOCKET), deadline).unwrap();
+            let owner = bus.call(
+                DBUS_NAME,
+                DBUS_PATH,
+                DBUS_INTERFACE,
+                "GetNameOwner",
+                Some(DBUS_NAME),
+            );
+            bus.flush().unwrap();
+            let unique = bus.reply(owner).unwrap().string().unwrap();
+            let uid = bus.call(
+                DBUS_NAME,
+                DBUS_PATH,
+                DBUS_INTERFACE,
+                "GetConnectionUnixUser",
+                Some(&unique),
+            );
+            bus.flush().unwrap();
+            bus.reply(uid).unwrap().u32().unwrap();
+        }
+        println!("dbus_wire: {:?}/exchange", started.elapsed() / iters);
+
+        let started = Instant::now();
+        for _ in 0..iters {
+            let conn = zbus::blocking::Connection::system().unwrap();
+            let name: zbus::names::BusName = DBUS_NAME.try_into().unwrap();
+            zbus::blocking::fdo::DBusProxy::new(&conn)
+                .unwrap()
+                .get_connection_unix_user(name)
+                .unwrap();
+        }
+        println!("zbus:      {:?}/exchange", started.elapsed() / iters);
+    }
+}
@@ -6,9 +6,11 @@ use nix::poll::{PollFd, PollFlags, PollTimeout, poll};
 use nix::sys::signal::{Signal, kill};
 use nix::sys::wait::waitpid;
 use nix::unistd::{
-    ForkResult, Pid, User, dup2_stdout, execv, fork, initgroups, pipe, setgid, setuid,
+    ForkResult, Gid, Pid, Uid, dup2_stdout, execv, fork, pipe, setgid, setgroups, setuid,
 };
+use sentinel_shared::accounts::{Account, Accounts};
 use sentinel_shared::{Outcome, ServiceConfig, Verdict};
+use std::collections::HashMap;
 use std::ffi::CString;
 use std::os::fd::{AsFd, OwnedFd};
 
@@ -35,13 +37,38 @@ pub struct HelperRequest<'a> {
     /// silent. Sourced from `[audio].sound_name` in the config.
     pub sound_name: &'a str,
     pub target_uid: u32,
+    /// This auth's account lookups; `target_uid` is resolved through it
+    /// (with its groups) before `fork`, only if a helper is spawned.
+    pub accounts: &'a Accounts,
     pub requesting_pid: i32,
+    /// Validated locale variables from the requesting process's
+    /// environ (see [`crate::locale::read_locale_env`]), read by the
+    /// parent before `fork`.
+    pub locale_env: &'a HashMap<&'static str, String>,
 }
 
 // `fork(2)` is unavoidably `unsafe`; contained here (crate is
 // `#![deny(unsafe_code)]`). See the SAFETY note at the call.
 #[allow(unsafe_code)]
 pub fn run(req: &HelperRequest<'_>) -> Result<Verdict, String> {
+    #[cfg(feature = "test-seam")]
+    if let Some(verdict) = crate::seam::helper_outcome() {
+        return Ok(verdict);
+    }
+
+    // Resolved here, not in the child: NSS may be SSSD/LDAP, and the
+    // answer is usually cached already from the bypass or the username.
+    let account = req
+        .accounts
+        .by_uid(req.target_uid)
+        .ok_or_else(|| format!("uid {} has no passwd entry", req.target_uid))?;
+    let groups: Vec<Gid> = account
+        .groups()
+        .ok_or_else(|| format!("getgrouplist for {}", account.name))?
+        .iter()
+        .map(|&g| Gid::from_raw(g))
+        .collect();
+
     let (read_fd, write_fd) = pipe().map_err(|e| format!("pipe: {e}"))?;
 
     // SAFETY: fork in a PAM module called from a process not yet using threads
@@ -49,7 +76,7 @@ pub fn run(req: &HelperRequest<'_>) -> Result<Verdict, String> {
     match unsafe { fork() }.map_err(|e| format!("fork: {e}"))? {
         ForkResult::Child => {
             drop(read_fd);
-            child_exec(req, write_fd);
+            child_exec(req, &account, &groups, write_fd);
         }
         ForkResult::Parent { child } => {
             drop(write_fd);
@@ -61,40 +88,30 @@ pub fn run(req: &HelperRequest<'_>) -> Result<Verdict, String> {
 // Post-`fork` child: `std::env::set_var` is `unsafe` (edition 2024);
 // safe here because the child is single-threaded before `exec`.
 #[allow(unsafe_code)]
-fn child_exec(req: &HelperRequest<'_>, write_fd: OwnedFd) -> ! {
-    let user = match User::from_uid(nix::unistd::Uid::from_raw(req.target_uid)) {
-        Ok(Some(u)) => u,
-        _ => std::process::exit(1),
-    };
-
-    if initgroups(
-        &CString::new(user.name.clone()).unwrap_or_else(|_| CString::new("").unwrap()),
-        user.gid,
-    )
-    .is_err()
-    {
+fn child_exec(req: &HelperRequest<'_>, user: &Account, groups: &[Gid], write_fd: OwnedFd) -> ! {
+    if setgroups(groups).is_err() {
         std::process::exit(1);
     }
-    if setgid(user.gid).is_err() {
+    if setgid(Gid::from_raw(user.gid)).is_err() {
         std::process::exit(1);
     }
-    if setuid(user.uid).is_err() {
+    if setuid(Uid::from_raw(user.uid)).is_err() {
         std::process::exit(1);
     }
 
     // SAFETY: setting env in the post-fork child before exec; no other threads.
     unsafe {
-        std::env::set_var("HOME", &user.dir);
+        std::env::set_var("HOME", &user.home);
         std::env::set_var("USER", &user.name);
         std::env::set_var("LOGNAME", &user.name);
 
         // Forward locale-relevant env vars from the requesting user's
         // own process so the helper picks the right translation. This
-        // env was scrubbed by sudo / polkit-agent-helper-1, so we have
-        // to recover it from /proc/<requesting_pid>/environ. Values
-        // are validated against a strict whitelist before use — see
-        // `crate::locale` for the threat model.
-        for (key, value) in crate::locale::read_locale_env(req.requesting_pid) {
+        // env was scrubbed by sudo / polkit-agent-helper-1, so the
+        // parent recovered it from /proc/<requesting_pid>/environ.
+        // Values are validated against a strict whitelist before use —
+        // see `crate::locale` for the threat model.
+        for (key, value) in req.locale_env {
             std::env::set_var(key, value);
         }
     }
@@ -197,8 +214,10 @@ fn parent_wait(child: Pid, read_fd: OwnedFd, req: &HelperRequest<'_>) -> Result<
         return Err("helper timeout".into());
     }
 
-    // Maximum legitimate output is "TIMEOUT\n" = 8 bytes; 16 leaves 2× margin.
-    let mut buf = [0u8; 16];
+    // Longest legitimate line: "ALLOW REMEMBER" plus a `TIMING=` token of
+    // four u64 readings, under 110 bytes. One read suffices: the helper
+    // writes it with a single write(2) well under PIPE_BUF.
+    let mut buf = [0u8; 128];
     let read_n = match read_pipe(&read_fd, &mut buf) {
         Ok(n) => n,
         Err(Errno::EINTR) => 0,
@@ -226,6 +245,7 @@ fn parent_wait(child: Pid, read_fd: OwnedFd, req: &HelperRequest<'_>) -> Result<
     Ok(s.parse::<Verdict>().unwrap_or(Verdict {
         outcome: Outcome::Deny,
         remember: false,
+        timings: None,
     }))
 }
 
@@ -9,8 +9,11 @@
 //! * **bypass**: the Sentinel polkit agent already pre-approved this
 //!   auth (we connect to its Unix socket and read "OK"). Return
 //!   `PAM_SUCCESS` immediately. See [`agent_bypass`].
-//! * **dialog**: spawn `sentinel-helper-kde` to render the confirmation UI;
-//!   return `PAM_SUCCESS` on Allow, `PAM_AUTH_ERR` on Deny / timeout.
+//! * **dialog**: fork + exec `sentinel-helper-kde` to render the
+//!   confirmation UI; return `PAM_SUCCESS` on Allow, `PAM_AUTH_ERR` on
+//!   Deny / timeout. See [`helper`]. Never the session's warm dialog
+//!   service: its socket is one the user can bind, so nothing read from
+//!   it could be trusted as root.
 //! * **headless**: no Wayland display; return whatever
 //!   `headless_action` says (default `PAM_IGNORE` so the next module
 //!   can prompt for a password).
@@ -31,21 +34,27 @@
 
 mod agent_bypass;
 mod broker_client;
+mod dbus_wire;
 mod display;
 mod helper;
 mod locale;
 mod proc_info;
+#[cfg(feature = "test-seam")]
+mod seam;
+mod timing;
 
 use helper::{HelperRequest, run as run_helper};
 use pam::constants::{PamFlag, PamResultCode};
 use pam::module::{PamHandle, PamHooks};
 use proc_info::ProcessInfo;
 use sentinel_broker_proto::RememberKey;
+use sentinel_shared::accounts::Accounts;
 use sentinel_shared::audit;
-use sentinel_shared::log_kv::quote as q;
-use sentinel_shared::logfmt_session_for_pid;
+use sentinel_shared::log_kv::Line;
+use sentinel_shared::procfs::Snapshot;
 use sentinel_shared::{
-    HeadlessAction, Outcome, PolicyDecision, ServiceConfig, format_message, load,
+    HeadlessAction, Outcome, PolicyDecision, SESSION_ENV_KEY, ServiceConfig, format_message, load,
+    logfmt_session,
 };
 use std::ffi::CStr;
 use std::time::Instant;
@@ -60,16 +69,8 @@ impl PamHooks for PamSentinel {
         let debug = args.iter().any(|a| a.to_bytes() == b"debug");
         init_logger(debug);
 
-        if let Some(rc) = agent_bypass::check_agent_bypass(pamh) {
-            return rc;
-        }
-
         let service = pam_service(pamh);
-        let cfg = load(&service);
-        if !cfg.enabled {
-            log::debug!("{MODULE_NAME}: disabled for service {service}");
-            return PamResultCode::PAM_IGNORE;
-        }
+        let mut timer = timing::AuthTimer::start(&service);
 
         // The PAM module is dlopen'd inside the privileged binary
         // (`sudo`, `polkit-agent-helper-1`, `su`). `getpid()` therefore
@@ -79,18 +80,55 @@ impl PamHooks for PamSentinel {
         // For loginuid lookup we still walk via the parent because the
         // loginuid is inherited from login, not set on the privileged
         // binary itself.
-        let process_pid = getpid();
-        let requesting_uid = caller_uid(getppid());
-        let user = resolve_user(pamh, requesting_uid);
+        //
+        // Each side is captured once as an anchored `/proc` snapshot:
+        // every later lookup for this auth reads through the same
+        // `/proc/<pid>` handle, so a pid that exits and gets reused
+        // mid-auth can't feed us another process's data, and no file is
+        // read twice.
+        let host = Snapshot::open(getpid(), locale::FORWARDED_VARS);
 
-        if !display::detect_for_user(requesting_uid) {
-            return handle_headless(&cfg, &service, &user);
+        let cfg = load(&service);
+        timer.mark("config");
+
+        // Every passwd/group lookup this auth makes goes through here,
+        // so each account is resolved from NSS at most once.
+        let accounts = Accounts::per_auth();
+
+        // Only `polkit-agent-helper-1` can ever hold a pending agent
+        // approval; every other service (terminal sudo/su/…) skips the
+        // system bus entirely.
+        if agent_bypass::eligible(&service, &host) {
+            let bypass = agent_bypass::check_agent_bypass(pamh, &accounts, cfg.early_helper_wait());
+            timer.mark("bypass");
+            if let Some(rc) = bypass {
+                return rc;
+            }
         }
 
-        let process = ProcessInfo::for_pid(process_pid);
+        if !cfg.enabled {
+            log::debug!("{MODULE_NAME}: disabled for service {service}");
+            return PamResultCode::PAM_IGNORE;
+        }
+
+        let caller = Snapshot::open(getppid(), &[SESSION_ENV_KEY]);
+        let requesting_uid = caller_uid(&caller);
+        let user = resolve_user(pamh, &accounts, requesting_uid);
+        timer.mark("proc");
+
+        let has_display = display::detect_for_user(requesting_uid);
+        timer.mark("display");
+        if !has_display {
+            return handle_headless(&cfg, &service, &user, &caller);
+        }
+
+        let process = ProcessInfo::for_snapshot(&host, &caller);
+        timer.mark("process");
 
         // Static [policy] allow/deny, evaluated before the dialog.
-        if let Some(rc) = check_policy(&cfg, &service, &user, &process, requesting_uid) {
+        let policy = check_policy(&cfg, &service, &user, &process, requesting_uid, &caller);
+        timer.mark("policy");
+        if let Some(rc) = policy {
             return rc;
         }
 
@@ -105,43 +143,60 @@ impl PamHooks for PamSentinel {
         // (see `ProcessInfo::remember_command`). `None` = not rememberable
         // (always dialog, never record). Fail-closed: an unreachable broker
         // means "show the dialog", never "let in".
-        let ppid = getppid();
+        // `u32::MAX` is the kernel's own "unset" value for both fields.
         let remember_key = process
             .remember_command
             .as_deref()
             .map(|command| RememberKey {
-                loginuid: read_proc_u32(ppid, "loginuid"),
-                sessionid: read_proc_u32(ppid, "sessionid"),
+                loginuid: caller.loginuid().unwrap_or(u32::MAX),
+                sessionid: caller.sessionid().unwrap_or(u32::MAX),
                 service: service.clone(),
                 command: command.to_string(),
             });
+        // The check's connection stays open across the dialog, so an
+        // opt-in record rides the same stream (see `broker_client`).
+        let mut remember_session = None;
         if cfg.remember_seconds > 0 {
-            if let Some(key) = &remember_key {
-                if broker_client::check_remember(key.clone(), cfg.remember_seconds) {
+            if let Some(key) = remember_key {
+                let (fresh, session) = broker_client::check_remember(key, cfg.remember_seconds);
+                remember_session = Some(session);
+                timer.mark("remember");
+                if fresh {
                     if cfg.log_attempts {
-                        log::info!(
-                            "event=auth.allow source=remember user={} service={} process={} exe={} uid={}",
-                            q(&user),
-                            q(&service),
-                            q(&process.name),
-                            q(&process.exe),
-                            requesting_uid
-                        );
+                        let mut line = Line::new("auth.allow");
+                        line.kv("source", "remember")
+                            .kv("user", &user)
+                            .kv("service", &service)
+                            .kv("process", &process.name)
+                            .kv("exe", &process.exe)
+                            .num("uid", requesting_uid);
+                        log::info!("{line}");
                     }
                     return PamResultCode::PAM_SUCCESS;
                 }
             }
         }
 
-        let (rc, remember) =
-            spawn_dialog(&cfg, &service, &user, &process, process_pid, requesting_uid);
+        let (rc, remember) = spawn_dialog(
+            &cfg,
+            &service,
+            &user,
+            &process,
+            &host,
+            requesting_uid,
+            &caller,
+            &accounts,
+        );
+        timer.mark("dialog");
         // Record the grant only when the user ticked the "remember"
         // checkbox (the helper sets this on an opt-in Allow), not on every
         // allow. `remember_seconds == 0` hides the checkbox, and a
-        // non-rememberable request has no key, so neither can record.
-        if remember && cfg.remember_seconds > 0 {
-            if let Some(key) = remember_key {
-                broker_client::record_remember(key);
+        // non-rememberable request has no key; neither opened a session,
+        // so neither can record.
+        if remember {
+            if let Some(session) = remember_session {
+                session.record();
+                timer.mark("record");
             }
         }
         rc
@@ -173,28 +228,33 @@ fn pam_service(pamh: &PamHandle) -> String {
 ///    the polkit-agent-helper-1 path the requesting user is set as
 ///    `PAM_USER` even though our `/proc/<ppid>/loginuid` walk would
 ///    collapse to root (helper-1's parent is systemd PID 1).
-/// 2. `User::from_uid(uid)` — for the sudo / su path where loginuid
+/// 2. `accounts.by_uid(uid)` — for the sudo / su path where loginuid
 ///    actually points at the human user, this still yields the right
 ///    name and is a useful sanity cross-check.
 /// 3. `"unknown"` literal — last-resort placeholder; shouldn't happen
 ///    in practice.
-fn resolve_user(pamh: &mut PamHandle, uid: u32) -> String {
+fn resolve_user(pamh: &mut PamHandle, accounts: &Accounts, uid: u32) -> String {
     if let Ok(name) = pamh.get_user(None) {
         if !name.is_empty() {
             return name;
         }
     }
-    if let Ok(Some(u)) = nix::unistd::User::from_uid(nix::unistd::Uid::from_raw(uid)) {
-        return u.name;
+    if let Some(u) = accounts.by_uid(uid) {
+        return u.name.clone();
     }
     "unknown".into()
 }
 
-fn handle_headless(cfg: &ServiceConfig, service: &str, user: &str) -> PamResultCode {
+fn handle_headless(
+    cfg: &ServiceConfig,
+    service: &str,
+    user: &str,
+    caller: &Snapshot,
+) -> PamResultCode {
     // The user's actual process (their shell, typically) is the
     // parent of the privileged binary that dlopened us. That's the
     // env we want for session enrichment.
-    let session = logfmt_session_for_pid(getppid());
+    let session = logfmt_session(caller);
 
     // Emit a `auth.headless` discriminator before the action-specific
     // line so journalctl filters distinguish "we tried to dialog the
@@ -202,34 +262,34 @@ fn handle_headless(cfg: &ServiceConfig, service: &str, user: &str) -> PamResultC
     // successfully dialoged and the user denied". Without this, both
     // produce `event=auth.deny source=...` and the cause is opaque.
     if cfg.log_attempts {
-        log::info!(
-            "event=auth.headless reason=no-wayland user={} service={}{}",
-            q(user),
-            q(service),
-            session
-        );
+        let mut line = Line::new("auth.headless");
+        line.kv("reason", "no-wayland")
+            .kv("user", user)
+            .kv("service", service)
+            .raw(&session);
+        log::info!("{line}");
     }
 
     match cfg.headless_action {
         HeadlessAction::Allow => {
             if cfg.log_attempts {
-                log::warn!(
-                    "event=auth.allow source=headless user={} service={}{}",
-                    q(user),
-                    q(service),
-                    session
-                );
+                let mut line = Line::new("auth.allow");
+                line.kv("source", "headless")
+                    .kv("user", user)
+                    .kv("service", service)
+                    .raw(&session);
+                log::warn!("{line}");
             }
             PamResultCode::PAM_SUCCESS
         }
         HeadlessAction::Deny => {
             if cfg.log_attempts {
-                log::info!(
-                    "event=auth.deny source=headless user={} service={}{}",
-                    q(user),
-                    q(service),
-                    session
-                );
+                let mut line = Line::new("auth.deny");
+                line.kv("source", "headless")
+                    .kv("user", user)
+                    .kv("service", service)
+                    .raw(&session);
+                log::info!("{line}");
             }
             PamResultCode::PAM_AUTH_ERR
         }
@@ -259,6 +319,7 @@ fn check_policy(
     user: &str,
     process: &ProcessInfo,
     requesting_uid: u32,
+    caller: &Snapshot,
 ) -> Option<PamResultCode> {
     let (event, rc) = match cfg.policy.decide(Some(&process.exe), None) {
         PolicyDecision::Allow => ("auth.allow", PamResultCode::PAM_SUCCESS),
@@ -266,31 +327,36 @@ fn check_policy(
         PolicyDecision::Ask => return None,
     };
     if cfg.log_attempts {
-        let session = logfmt_session_for_pid(getppid());
-        log::info!(
-            "event={event} source=policy user={} service={} process={} exe={} uid={}{}",
-            q(user),
-            q(service),
-            q(&process.name),
-            q(&process.exe),
-            requesting_uid,
-            session
-        );
+        let mut line = Line::new(event);
+        line.kv("source", "policy")
+            .kv("user", user)
+            .kv("service", service)
+            .kv("process", &process.name)
+            .kv("exe", &process.exe)
+            .num("uid", requesting_uid)
+            .raw(&logfmt_session(caller));
+        log::info!("{line}");
     }
     Some(rc)
 }
 
+#[allow(clippy::too_many_arguments)] // one call site, all per-auth state
 fn spawn_dialog(
     cfg: &ServiceConfig,
     service: &str,
     user: &str,
     process: &ProcessInfo,
-    requesting_pid: i32,
+    host: &Snapshot,
     requesting_uid: u32,
+    caller: &Snapshot,
+    accounts: &Accounts,
 ) -> (PamResultCode, bool) {
     let formatted_title = format_message(&cfg.title, user, service, &process.name);
     let formatted_message = format_message(&cfg.message, user, service, &process.name);
     let formatted_secondary = format_message(&cfg.secondary, user, service, &process.name);
+    // Recovered here, pre-fork, through the anchored snapshot — not in
+    // the helper child, which has already dropped to the user's uid.
+    let locale_env = locale::read_locale_env(host);
 
     let req = HelperRequest {
         cfg,
@@ -302,16 +368,19 @@ fn spawn_dialog(
         formatted_secondary: &formatted_secondary,
         sound_name: &cfg.sound_name,
         target_uid: requesting_uid,
-        requesting_pid,
+        accounts,
+        requesting_pid: host.pid(),
+        locale_env: &locale_env,
     };
 
     let dialog_started = Instant::now();
+    let dialog_started_us = sentinel_shared::monotonic_us();
     let result = run_helper(&req);
     let latency_ms = dialog_started.elapsed().as_millis();
     // Session enrichment via the user's process env (getppid() of
     // the privileged binary we're loaded into). Empty string on
-    // any failure — see logfmt_session_for_pid.
-    let session = logfmt_session_for_pid(getppid());
+    // any failure — see sentinel_shared::logfmt_session_for_pid.
+    let session = logfmt_session(caller);
 
     if cfg.log_attempts {
         match &result {
@@ -321,24 +390,33 @@ fn spawn_dialog(
                     Outcome::Deny => "auth.deny",
                     Outcome::Timeout => "auth.timeout",
                 };
-                log::info!(
-                    "event={event} source=dialog user={} service={} process={} uid={} latency_ms={}{}",
-                    q(user),
-                    q(service),
-                    q(&process.name),
-                    requesting_uid,
-                    latency_ms,
-                    session
-                );
+                // Helper startup milestones, so a slow prompt can be
+                // told apart from a slow answer.
+                let timings = v
+                    .timings
+                    .map(|t| t.logfmt(dialog_started_us))
+                    .unwrap_or_default();
+                let mut line = Line::new(event);
+                line.kv("source", "dialog")
+                    .kv("user", user)
+                    .kv("service", service)
+                    .kv("process", &process.name)
+                    .num("uid", requesting_uid)
+                    .num("latency_ms", latency_ms)
+                    .raw(&timings)
+                    .raw(&session);
+                log::info!("{line}");
+            }
+            Err(e) => {
+                let mut line = Line::new("auth.error");
+                line.kv("source", "dialog")
+                    .kv("user", user)
+                    .kv("service", service)
+                    .kv("error", e)
+                    .num("latency_ms", latency_ms)
+                    .raw(&session);
+                log::warn!("{line}");
             }
-            Err(e) => log::warn!(
-                "event=auth.error source=dialog user={} service={} error={} latency_ms={}{}",
-                q(user),
-                q(service),
-                q(&e.to_string()),
-                latency_ms,
-                session
-            ),
         }
     }
 
@@ -359,7 +437,7 @@ fn init_logger(debug: bool) {
         } else {
             log::LevelFilter::Info
         };
-        audit::init_syslog(MODULE_NAME, level)
+        audit::init(MODULE_NAME, level)
     });
 }
 
@@ -383,45 +461,18 @@ fn getuid() -> u32 {
 /// Identify the calling (human) user, even when the immediate PAM
 /// caller is a setuid binary or socket-activated systemd service.
 ///
-/// Strategy, in order:
-/// 1. `/proc/<ppid>/loginuid` — set by login/PAM at session start,
-///    inherited through forks, immune to setuid transitions. Returns
-///    `(uint32_t)-1` for processes not in a login session.
-/// 2. `/proc/<ppid>/status` — `Uid:` line, real-uid (first field).
-///    Works for non-login processes (e.g. systemd services).
+/// Strategy, in order, all read from the caller's (ppid's) snapshot:
+/// 1. `loginuid` — set by login/PAM at session start, inherited
+///    through forks, immune to setuid transitions. `(uint32_t)-1` for
+///    processes not in a login session.
+/// 2. `status` — `Uid:` line, real-uid (first field). Works for
+///    non-login processes (e.g. systemd services).
 /// 3. Fall back to our own real uid.
-pub(crate) fn caller_uid(ppid: i32) -> u32 {
-    if ppid > 0
-        && let Ok(s) = std::fs::read_to_string(format!("/proc/{ppid}/loginuid"))
-        && let Ok(uid) = s.trim().parse::<u32>()
+pub(crate) fn caller_uid(caller: &Snapshot) -> u32 {
+    if let Some(uid) = caller.loginuid()
         && uid != u32::MAX
     {
         return uid;
     }
-    if ppid > 0
-        && let Ok(s) = std::fs::read_to_string(format!("/proc/{ppid}/status"))
-    {
-        for line in s.lines() {
-            if let Some(rest) = line.strip_prefix("Uid:")
-                && let Some(real) = rest.split_whitespace().next()
-                && let Ok(uid) = real.parse::<u32>()
-            {
-                return uid;
-            }
-        }
-    }
-    getuid()
-}
-
-/// Read a single-`u32` `/proc/<ppid>/<field>` such as `loginuid` or
-/// `sessionid`. Returns `u32::MAX` (the kernel's "unset" sentinel) when
-/// absent or unparseable. Used to bind remember records to the session.
-fn read_proc_u32(ppid: i32, field: &str) -> u32 {
-    if ppid > 0
-        && let Ok(s) = std::fs::read_to_string(format!("/proc/{ppid}/{field}"))
-        && let Ok(v) = s.trim().parse::<u32>()
-    {
-        return v;
-    }
-    u32::MAX
+    caller.uid().unwrap_or_else(getuid)
 }
@@ -33,6 +33,7 @@
 //! single-threaded by then), but the values must be set BEFORE the
 //! child execs the helper so the helper sees them as inherited env.
 
+use sentinel_shared::procfs::Snapshot;
 use std::collections::HashMap;
 
 /// Variable names we forward into the helper child. Order doesn't
@@ -40,19 +41,21 @@ use std::collections::HashMap;
 /// the helper resolves the locale from them in its own priority order.
 pub const FORWARDED_VARS: &[&str] = &["LC_ALL", "LC_MESSAGES", "LANG"];
 
-/// Return the subset of [`FORWARDED_VARS`] set in `/proc/<pid>/environ`
-/// whose values pass [`is_safe_locale_value`].
+/// Return the subset of [`FORWARDED_VARS`] set in the snapshot's
+/// `/proc/<pid>/environ` whose values pass [`is_safe_locale_value`].
+/// The snapshot must have been opened with [`FORWARDED_VARS`] as its
+/// env keys; all of them come out of one `environ` pass.
 ///
 /// Returns an empty map on any error (unreadable, missing, permission
 /// denied) — locale propagation is best-effort and must never block
 /// auth.
-pub fn read_locale_env(pid: i32) -> HashMap<&'static str, String> {
+pub fn read_locale_env(snap: &Snapshot) -> HashMap<&'static str, String> {
     let mut out = HashMap::new();
     for var in FORWARDED_VARS {
-        if let Some(value) = sentinel_shared::procfs::read_environ_var(pid, var)
-            && is_safe_locale_value(&value)
+        if let Some(value) = snap.env(var)
+            && is_safe_locale_value(value)
         {
-            out.insert(*var, value);
+            out.insert(*var, value.to_owned());
         }
     }
     out
@@ -124,8 +127,8 @@ mod tests {
     #[test]
     fn read_locale_env_handles_missing_pid() {
         // pid -1 / 0 short-circuits before any /proc lookup.
-        assert!(read_locale_env(-1).is_empty());
-        assert!(read_locale_env(0).is_empty());
+        assert!(read_locale_env(&Snapshot::open(-1, FORWARDED_VARS)).is_empty());
+        assert!(read_locale_env(&Snapshot::open(0, FORWARDED_VARS)).is_empty());
     }
 
     #[test]
@@ -134,7 +137,7 @@ mod tests {
         // Whether LANG is set depends on the test runner's env, so this
         // test only asserts the function doesn't crash and that any
         // returned key is a known forwardable name.
-        let env = read_locale_env(std::process::id() as i32);
+        let env = read_locale_env(&Snapshot::open(std::process::id() as i32, FORWARDED_VARS));
         for key in env.keys() {
             assert!(FORWARDED_VARS.contains(key), "unexpected key {key}");
         }
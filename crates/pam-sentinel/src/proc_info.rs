@@ -2,19 +2,20 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 //! Eagerly-populated snapshot of a process's `/proc/<pid>/*` data.
 //!
-//! Just a typed bundle around `sentinel_shared::procfs::*` lookups
-//! with the unknown / empty defaults the dialog renderer expects.
-//! New /proc readers go in `sentinel_shared::procfs`, not here.
+//! Just a typed bundle around `sentinel_shared::procfs::Snapshot`
+//! lookups with the unknown / empty defaults the dialog renderer
+//! expects. New /proc readers go in `sentinel_shared::procfs`, not here.
 
-use sentinel_shared::{procfs, strip_elevation_prefix};
+use sentinel_shared::argv::Argv;
+use sentinel_shared::procfs::Snapshot;
 
 /// The full command a remember grant should bind to, or `None` if this
 /// request must never be remembered (empty, or an ineligible gateway — see
-/// [`sentinel_shared::remember_eligible_command`], the denylist shared with
-/// the polkit agent so both paths apply the same rule).
-fn remember_command_for(cmd: &str) -> Option<String> {
-    let cmd = cmd.trim();
-    (!cmd.is_empty() && sentinel_shared::remember_eligible_command(cmd)).then(|| cmd.to_string())
+/// [`Argv::remember_eligible`], the denylist shared with the polkit agent
+/// so both paths apply the same rule). `joined` is `argv` as displayed,
+/// kept verbatim: the key must name exactly the argv that was judged.
+fn remember_command_for(argv: Argv<'_>, joined: &str) -> Option<String> {
+    (!argv.is_empty() && argv.remember_eligible()).then(|| joined.to_owned())
 }
 
 pub struct ProcessInfo {
@@ -34,9 +35,12 @@ pub struct ProcessInfo {
 }
 
 impl ProcessInfo {
-    pub fn for_pid(pid: i32) -> Self {
-        let raw_exe = procfs::read_exe(pid).unwrap_or_else(|| "unknown".into());
-        let raw_cmdline = procfs::read_cmdline(pid).unwrap_or_default();
+    /// Resolve from the PAM host process's snapshot. `caller` is the
+    /// already-open snapshot of its parent, reused for the walk-up in
+    /// path 2 below.
+    pub fn for_snapshot(proc: &Snapshot, caller: &Snapshot) -> Self {
+        let raw_exe = proc.exe().unwrap_or("unknown").to_owned();
+        let argv = proc.argv().unwrap_or_default();
 
         // Resolve what to display. Three paths, in order:
         //
@@ -46,56 +50,70 @@ impl ProcessInfo {
         //
         // 2. The cmdline is just `sudo` with flags but NO target
         //    (e.g. `sudo -v` for credential caching, common in
-        //    `topgrade` and `paru`). `strip_elevation_prefix` returns
-        //    an empty string. Walk up to `PPid` and use the parent's
+        //    `topgrade` and `paru`). `Argv::elevated` returns an empty
+        //    command. Walk up to `PPid` and use the parent's
         //    exe/cmdline — the dialog shows the user-facing
         //    originator (`paru`, `topgrade`, the user's shell) rather
         //    than just `sudo-rs` which is uninformative.
         //
         // 3. Not an elevation tool at all (the PAM module loaded into
         //    something else). Use the binary's own /proc info as-is.
-        let stripped = strip_elevation_prefix(&raw_cmdline);
-        let was_elevation = !raw_cmdline.is_empty() && stripped != raw_cmdline;
-        let (exe, cmdline, remember_command) = if was_elevation && !stripped.is_empty() {
-            // Path 1: elevation wrapper with a target. The remember grant
-            // binds to the FULL elevated command, so `sudo pacman -Syu`
-            // can't later authorize `sudo pacman -U /tmp/evil`.
-            let target_exe = stripped
-                .split_whitespace()
-                .next()
-                .unwrap_or("unknown")
-                .to_string();
-            let remember = remember_command_for(&stripped);
-            (target_exe, stripped, remember)
-        } else if was_elevation {
-            // Path 2: elevation wrapper with NO target (`sudo -s`/`-i`/
-            // `-v`, `su`). That's an interactive root shell / cred cache
-            // — NEVER remembered (a grant would silently re-open root).
-            // Display still walks up to the user-facing originator.
-            let parent = procfs::read_ppid(pid).and_then(|ppid| {
-                let pexe = procfs::read_exe(ppid)?;
-                let pcmdline = procfs::read_cmdline(ppid).unwrap_or_default();
-                Some((pexe, pcmdline))
-            });
-            match parent {
-                Some((pexe, pcmdline)) => (pexe, pcmdline, None),
-                None => (raw_exe, raw_cmdline, None),
+        //
+        // The analysis runs on the argv itself (see `sentinel_shared::argv`);
+        // only the strings shown and keyed on are built.
+        let (exe, cmdline, remember_command) = match argv.elevated() {
+            Some(target) if !target.is_empty() => {
+                // Path 1: elevation wrapper with a target. The remember
+                // grant binds to the FULL elevated command, so `sudo
+                // pacman -Syu` can't later authorize `sudo pacman -U
+                // /tmp/evil`.
+                let target_exe = target.program().unwrap_or_default().into_owned();
+                let cmdline = target.to_string();
+                let remember = remember_command_for(target, &cmdline);
+                (target_exe, cmdline, remember)
+            }
+            Some(_) => {
+                // Path 2: elevation wrapper with NO target (`sudo -s`/`-i`/
+                // `-v`, `su`). That's an interactive root shell / cred cache
+                // — NEVER remembered (a grant would silently re-open root).
+                // Display still walks up to the user-facing originator.
+                let opened;
+                let parent = match proc.ppid() {
+                    Some(ppid) if ppid == caller.pid() => Some(caller),
+                    Some(ppid) => {
+                        opened = Snapshot::open(ppid, &[]);
+                        Some(&opened)
+                    }
+                    None => None,
+                }
+                .and_then(|p| {
+                    let pexe = p.exe()?.to_owned();
+                    let pcmdline = p.cmdline().unwrap_or_default().to_owned();
+                    Some((pexe, pcmdline))
+                });
+                match parent {
+                    Some((pexe, pcmdline)) => (pexe, pcmdline, None),
+                    None => (raw_exe, argv.to_string(), None),
+                }
+            }
+            None => {
+                // Path 3: not an elevation tool. Remember binds to the
+                // process's own full cmdline (still subject to the
+                // carve-out).
+                let cmdline = argv.to_string();
+                let remember = remember_command_for(argv, &cmdline);
+                (raw_exe, cmdline, remember)
             }
-        } else {
-            // Path 3: not an elevation tool. Remember binds to the
-            // process's own full cmdline (still subject to the carve-out).
-            let remember = remember_command_for(&raw_cmdline);
-            (raw_exe, raw_cmdline, remember)
         };
 
         Self {
             name: sentinel_shared::process_basename(&exe)
                 .map(str::to_owned)
-                .or_else(|| procfs::read_comm(pid))
+                .or_else(|| proc.comm().map(str::to_owned))
                 .unwrap_or_else(|| "unknown".into()),
             exe,
             cmdline,
-            cwd: procfs::read_cwd(pid).unwrap_or_default(),
+            cwd: proc.cwd().unwrap_or_default().to_owned(),
             remember_command,
         }
     }
@@ -105,21 +123,28 @@ impl ProcessInfo {
 mod tests {
     use super::*;
 
+    fn remember(raw: &[u8]) -> Option<String> {
+        let argv = Argv::new(raw);
+        remember_command_for(argv, &argv.to_string())
+    }
+
     // The eligibility denylist itself is tested in `sentinel-shared`;
-    // here we only cover the local trim/gate wrapper.
+    // here we only cover the local gate wrapper.
     #[test]
-    fn remember_command_for_trims_and_gates() {
+    fn remember_command_for_keys_the_judged_argv() {
+        // No trimming: `" pacman"` is not the program `pacman`, so its
+        // grant must not read as one.
         assert_eq!(
-            remember_command_for("  pacman -Syu "),
-            Some("pacman -Syu".to_string())
+            remember(b" pacman\0-Syu \0"),
+            Some(" pacman -Syu ".to_string())
         );
         assert_eq!(
-            remember_command_for("systemctl restart foo"),
+            remember(b"systemctl\0restart\0foo\0"),
             Some("systemctl restart foo".to_string())
         );
-        assert_eq!(remember_command_for(""), None);
-        assert_eq!(remember_command_for("   "), None);
-        assert_eq!(remember_command_for("bash"), None);
-        assert_eq!(remember_command_for("sudo bash"), None);
+        assert_eq!(remember(b""), None);
+        assert_eq!(remember(b"\0\0"), None);
+        assert_eq!(remember(b"bash\0"), None);
+        assert_eq!(remember(b"sudo\0bash\0"), None);
     }
 }
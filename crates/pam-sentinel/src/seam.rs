@@ -0,0 +1,165 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Test seam for benchmarking `sm_authenticate` without a desktop.
+//!
+//! Compiled only with the `test-seam` feature, which `build.rs` builds
+//! only on an explicit opt-in and against a private config directory.
+//! That keeps it out of an installed module by accident, not by
+//! construction, so the seam also refuses to act in a process that
+//! gained privileges on exec: under a setuid `sudo`/`su` the caller
+//! controls the environment, and every variable below is ignored.
+//! Driven by `scripts/pam_authtest.rs --bench`, which runs as root,
+//! through three environment variables:
+//!
+//! - `SENTINEL_TEST_HELPER_OUTCOME` — a wire verdict (`ALLOW`,
+//!   `ALLOW REMEMBER`, `DENY`, `TIMEOUT`) that [`crate::helper::run`]
+//!   returns in place of the dialog, like the agent's seam of the same
+//!   name;
+//! - `SENTINEL_TEST_SYSTEM_BUS` — the socket the agent bypass dials
+//!   instead of the system bus;
+//! - `SENTINEL_TEST_TIMING` — a file each auth's `event=auth.timing`
+//!   line is appended to, whatever the log level. Only a path inside the
+//!   bench root (the parent of the build's config dir) is opened, never
+//!   through a final symlink.
+
+use sentinel_shared::Verdict;
+use std::ffi::OsString;
+use std::fs::OpenOptions;
+use std::io::Write;
+use std::os::unix::fs::OpenOptionsExt;
+use std::path::{Component, Path, PathBuf};
+use std::sync::OnceLock;
+
+/// Baked by `build.rs`: the directory the bench owns.
+const BENCH_ROOT: &str = env!("SENTINEL_BENCH_ROOT");
+
+/// `AT_SECURE` in the auxiliary vector: the kernel's "this exec changed
+/// credentials" flag (setuid/setgid bits, file capabilities).
+const AT_SECURE: usize = 23;
+
+/// The canned verdict, if one is set and parses.
+pub fn helper_outcome() -> Option<Verdict> {
+    let canned = var("SENTINEL_TEST_HELPER_OUTCOME")?.into_string().ok()?;
+    let verdict = canned.parse().ok()?;
+    log::debug!("helper::run: short-circuit via SENTINEL_TEST_HELPER_OUTCOME={canned}");
+    Some(verdict)
+}
+
+/// The bus socket to dial: the override, else `default`.
+pub fn system_bus(default: &Path) -> PathBuf {
+    var("SENTINEL_TEST_SYSTEM_BUS").map_or_else(|| default.to_owned(), PathBuf::from)
+}
+
+/// Append one timing line to `$SENTINEL_TEST_TIMING`, if set.
+pub fn record_timing(line: &str) {
+    if let Some(path) = var("SENTINEL_TEST_TIMING") {
+        append_line(Path::new(&path), Path::new(BENCH_ROOT), line);
+    }
+}
+
+/// A seam variable, or `None` in a process that gained privileges.
+fn var(key: &str) -> Option<OsString> {
+    static TRUSTED: OnceLock<bool> = OnceLock::new();
+    let trusted = *TRUSTED.get_or_init(|| {
+        use nix::unistd::{getegid, geteuid, getgid, getuid};
+        getuid() == geteuid() && getgid() == getegid() && at_secure() == Some(false)
+    });
+    if trusted { std::env::var_os(key) } else { None }
+}
+
+/// `AT_SECURE` from `/proc/self/auxv`; `None` when it can't be read.
+fn at_secure() -> Option<bool> {
+    let auxv = std::fs::read("/proc/self/auxv").ok()?;
+    auxv_value(&auxv, AT_SECURE).map(|v| v != 0)
+}
+
+/// The value of entry `key` in a native-endian auxiliary vector.
+fn auxv_value(auxv: &[u8], key: usize) -> Option<usize> {
+    const WORD: usize = size_of::<usize>();
+    let word = |w: &[u8]| usize::from_ne_bytes(w.try_into().unwrap_or([0; WORD]));
+    auxv.chunks_exact(2 * WORD)
+        .map(|pair| (word(&pair[..WORD]), word(&pair[WORD..])))
+        .find(|&(k, _)| k == key)
+        .map(|(_, v)| v)
+}
+
+/// Whether `path` names something strictly inside `root`, with no `..`
+/// to climb back out.
+fn inside(path: &Path, root: &Path) -> bool {
+    path != root && path.starts_with(root) && !path.components().any(|c| c == Component::ParentDir)
+}
+
+/// One `write(2)` per line, so concurrent auths never interleave.
+fn append_line(path: &Path, root: &Path, line: &str) {
+    if !inside(path, root) {
+        return;
+    }
+    let opened = OpenOptions::new()
+        .create(true)
+        .append(true)
+        .mode(0o600)
+        .custom_flags(nix::fcntl::OFlag::O_NOFOLLOW.bits())
+        .open(path);
+    if let Ok(mut f) = opened {
+        let _ = f.write_all(format!("{line}\n").as_bytes());
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn scratch() -> PathBuf {
+        let dir = std::env::temp_dir().join(format!("sentinel-seam-{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        std::fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    #[test]
+    fn timing_lines_append_whole() {
+        let root = scratch();
+        let path = root.join("t.timing");
+        append_line(&path, &root, "event=auth.timing service=sudo total_us=7");
+        append_line(&path, &root, "event=auth.timing service=sudo total_us=9");
+        let written = std::fs::read_to_string(&path).unwrap();
+        let _ = std::fs::remove_dir_all(&root);
+        assert_eq!(
+            written,
+            "event=auth.timing service=sudo total_us=7\nevent=auth.timing service=sudo total_us=9\n"
+        );
+    }
+
+    #[test]
+    fn timing_file_stays_inside_the_root_and_off_symlinks() {
+        let root = scratch();
+        let outside =
+            std::env::temp_dir().join(format!("sentinel-seam-out-{}", std::process::id()));
+        let _ = std::fs::remove_file(&outside);
+        append_line(&outside, &root, "x");
+        append_line(&root.join("../escaped"), &root, "x");
+        let link = root.join("link.timing");
+        std::os::unix::fs::symlink(&outside, &link).unwrap();
+        append_line(&link, &root, "x");
+        let leaked = outside.exists() || root.parent().unwrap().join("escaped").exists();
+        let _ = std::fs::remove_dir_all(&root);
+        let _ = std::fs::remove_file(&outside);
+        assert!(
+            !leaked,
+            "the timing file must not be created outside the root"
+        );
+    }
+
+    #[test]
+    fn auxv_lookup_finds_at_secure() {
+        let mut auxv = Vec::new();
+        for (k, v) in [(6usize, 4096usize), (AT_SECURE, 1), (0, 0)] {
+            auxv.extend_from_slice(&k.to_ne_bytes());
+            auxv.extend_from_slice(&v.to_ne_bytes());
+        }
+        assert_eq!(auxv_value(&auxv, AT_SECURE), Some(1));
+        assert_eq!(auxv_value(&auxv, 99), None);
+        // This test binary wasn't exec'd setuid.
+        assert_eq!(at_secure(), Some(false));
+    }
+}
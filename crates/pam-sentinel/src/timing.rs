@@ -0,0 +1,108 @@
+// SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Per-auth stage timings.
+//!
+//! One [`AuthTimer`] lives for the duration of `sm_authenticate`; each
+//! stage calls [`AuthTimer::mark`] when it finishes, and the timer logs a
+//! single `event=auth.timing` line when it drops — on every return path,
+//! including the early ones. Stages that didn't run are simply absent, so
+//! e.g. a terminal `sudo` line with no `bypass_us=` is the proof that the
+//! auth never touched the system bus.
+//!
+//! Emitted at debug level only (the `debug` module argument), so the
+//! production journal isn't doubled in volume:
+//!
+//! ```text
+//! event=auth.timing service=sudo config_us=41 proc_us=63 display_us=12 process_us=55 policy_us=1 remember_us=210 dialog_us=1843112 total_us=1843494
+//! ```
+//!
+//! A `test-seam` build also appends every line to `$SENTINEL_TEST_TIMING`
+//! (see `seam`), which is where the end-to-end bench reads its stages.
+
+use sentinel_shared::log_kv::quote as q;
+use std::fmt::Write;
+use std::time::{Duration, Instant};
+
+/// Upper bound on stages per auth; `mark` past this is dropped rather
+/// than reallocating.
+const MAX_STAGES: usize = 12;
+
+pub struct AuthTimer {
+    service: String,
+    started: Instant,
+    last: Instant,
+    stages: Vec<(&'static str, Duration)>,
+}
+
+impl AuthTimer {
+    pub fn start(service: &str) -> Self {
+        let now = Instant::now();
+        Self {
+            service: service.to_owned(),
+            started: now,
+            last: now,
+            stages: Vec::with_capacity(MAX_STAGES),
+        }
+    }
+
+    /// Record that `stage` just finished; its duration is the time since
+    /// the previous mark (or since [`AuthTimer::start`]).
+    pub fn mark(&mut self, stage: &'static str) {
+        let now = Instant::now();
+        if self.stages.len() < MAX_STAGES {
+            self.stages.push((stage, now - self.last));
+        }
+        self.last = now;
+    }
+
+    fn logfmt(&self) -> String {
+        let mut out = format!("event=auth.timing service={}", q(&self.service));
+        for (stage, d) in &self.stages {
+            let _ = write!(out, " {stage}_us={}", d.as_micros());
+        }
+        let _ = write!(out, " total_us={}", self.started.elapsed().as_micros());
+        out
+    }
+}
+
+impl Drop for AuthTimer {
+    fn drop(&mut self) {
+        let debug = log::log_enabled!(log::Level::Debug);
+        if !debug && !cfg!(feature = "test-seam") {
+            return;
+        }
+        let line = self.logfmt();
+        #[cfg(feature = "test-seam")]
+        crate::seam::record_timing(&line);
+        if debug {
+            log::debug!("{line}");
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn logfmt_lists_only_marked_stages_in_order() {
+        let mut t = AuthTimer::start("sudo");
+        t.mark("config");
+        t.mark("dialog");
+        let line = t.logfmt();
+        assert!(line.starts_with("event=auth.timing service=sudo config_us="));
+        assert!(line.contains(" dialog_us="));
+        assert!(!line.contains("bypass_us"));
+        assert!(line.find("config_us").unwrap() < line.find("dialog_us").unwrap());
+        assert!(line.contains(" total_us="));
+    }
+
+    #[test]
+    fn stage_count_is_capped() {
+        let mut t = AuthTimer::start("x");
+        for _ in 0..MAX_STAGES + 5 {
+            t.mark("s");
+        }
+        assert_eq!(t.stages.len(), MAX_STAGES);
+    }
+}
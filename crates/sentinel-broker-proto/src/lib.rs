@@ -32,15 +32,32 @@
 //! OOM the root daemon. Decoding is fail-closed — the shim treats any
 //! [`Response::Error`] or transport error as "not fresh / not recorded",
 //! i.e. it falls back to showing the dialog.
+//!
+//! # Zero-copy
+//!
+//! The [`borrowed`] types are wire-identical views of the owned ones
+//! whose strings point into the frame buffer. [`split_frame`] (a buffer
+//! the caller already holds) and [`read_frame_in`] (a caller-provided
+//! buffer) hand out frame bodies, and [`decode_borrowed`] decodes them in
+//! place, so the broker's hot path copies nothing out of its input.
+//! [`write_frame`] encodes small bodies on the stack and emits header and
+//! body in one vectored write.
 
 #![forbid(unsafe_code)]
 
 use serde::de::DeserializeOwned;
 use serde::{Deserialize, Serialize};
+use std::io::{IoSlice, Read, Write};
 
-/// Wire protocol version. Bump on any breaking change to the message
-/// shapes; the broker reports its version in [`Response::Pong`].
-pub const PROTOCOL_VERSION: u16 = 1;
+/// Wire protocol version. Bump on any change to the message shapes; the
+/// broker reports its version in [`Response::Pong`].
+///
+/// - 1: one-shot [`Request::CheckRemember`] / [`Request::RecordRemember`].
+/// - 2: adds the remember session, [`Request::SessionCheck`] then
+///   [`Request::SessionRecord`] on one connection. New variants are
+///   appended, so every v1 frame still decodes the same.
+/// - 3: adds [`Request::Stats`] / [`Response::Stats`].
+pub const PROTOCOL_VERSION: u16 = 3;
 
 /// Hard cap on a single framed message. Messages are tiny (a couple of
 /// `u32`s plus a service name and a command line), so 64 KiB is already
@@ -52,7 +69,7 @@ pub const MAX_FRAME_LEN: usize = 64 * 1024;
 /// store's binding: the human `loginuid`, the kernel audit `sessionid`,
 /// the PAM `service`, and the **full** elevated command (not just the
 /// program — see `pam_sentinel::proc_info::ProcessInfo::remember_command`).
-#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash, Serialize, Deserialize)]
 pub struct RememberKey {
     pub loginuid: u32,
     pub sessionid: u32,
@@ -68,7 +85,17 @@ impl RememberKey {
     /// IPC-side mirror of the store's own `is_bindable`, so an unbound
     /// grant can't even be acted on.
     pub fn is_bindable(&self) -> bool {
-        self.loginuid != u32::MAX && self.sessionid != u32::MAX && !self.command.is_empty()
+        bindable(self.loginuid, self.sessionid, &self.command)
+    }
+
+    /// A borrowed view, e.g. to look the key up without cloning it.
+    pub fn as_borrowed(&self) -> borrowed::RememberKey<'_> {
+        borrowed::RememberKey {
+            loginuid: self.loginuid,
+            sessionid: self.sessionid,
+            service: &self.service,
+            command: &self.command,
+        }
     }
 
     /// Consume into a [`BoundKey`] iff bindable. This is the single
@@ -84,15 +111,32 @@ impl RememberKey {
 /// unbound grant" cannot compile — the runtime check happens once, at
 /// [`RememberKey::bind`], and the type then carries the proof. Not a wire
 /// type: it is only ever constructed locally from a deserialized
-/// [`RememberKey`].
+/// [`RememberKey`] (or, as `BoundKey<borrowed::RememberKey>`, from a
+/// key decoded in place).
 #[derive(Debug, Clone)]
-pub struct BoundKey(RememberKey);
+pub struct BoundKey<K = RememberKey>(K);
 
-impl BoundKey {
+impl<K> BoundKey<K> {
     /// The underlying validated key (for store keying / logging).
-    pub fn key(&self) -> &RememberKey {
+    pub fn key(&self) -> &K {
         &self.0
     }
+
+    /// Give up the proof and take the key (the store keeps it as-is).
+    pub fn into_key(self) -> K {
+        self.0
+    }
+}
+
+impl BoundKey<borrowed::RememberKey<'_>> {
+    /// Copy the key out of the frame buffer; the proof carries over.
+    pub fn to_owned_key(&self) -> BoundKey {
+        BoundKey(self.0.to_owned_key())
+    }
+}
+
+fn bindable(loginuid: u32, sessionid: u32, command: &str) -> bool {
+    loginuid != u32::MAX && sessionid != u32::MAX && !command.is_empty()
 }
 
 /// A freshness query: is there a live grant for `key` within `ttl_secs`?
@@ -111,20 +155,199 @@ pub enum Request {
     RecordRemember(RememberKey),
     /// Liveness/version probe.
     Ping,
+    /// Protocol 2: [`Request::CheckRemember`] that also opens a remember
+    /// session on this connection. On a miss the broker holds the key
+    /// until the connection closes, so the shim can keep it open across
+    /// the dialog and record on the same stream.
+    SessionCheck(RememberQuery),
+    /// Protocol 2: record the key of this connection's last missed
+    /// [`Request::SessionCheck`], once. Refused ([`Response::Error`])
+    /// without one, so a record can't follow a hit or a different check.
+    SessionRecord,
+    /// Protocol 3: the broker's counters and latency histograms.
+    Stats,
+}
+
+impl RememberQuery {
+    pub fn as_borrowed(&self) -> borrowed::RememberQuery<'_> {
+        borrowed::RememberQuery {
+            key: self.key.as_borrowed(),
+            ttl_secs: self.ttl_secs,
+        }
+    }
+}
+
+impl Request {
+    /// A borrowed view (what the broker decodes); wire-identical.
+    pub fn as_borrowed(&self) -> borrowed::Request<'_> {
+        match self {
+            Request::CheckRemember(q) => borrowed::Request::CheckRemember(q.as_borrowed()),
+            Request::RecordRemember(k) => borrowed::Request::RecordRemember(k.as_borrowed()),
+            Request::Ping => borrowed::Request::Ping,
+            Request::SessionCheck(q) => borrowed::Request::SessionCheck(q.as_borrowed()),
+            Request::SessionRecord => borrowed::Request::SessionRecord,
+            Request::Stats => borrowed::Request::Stats,
+        }
+    }
+}
+
+/// Zero-copy mirrors of the request types: same fields, same order, same
+/// variants, so they encode and decode exactly like the owned ones, but
+/// strings borrow from the frame they were decoded from.
+pub mod borrowed {
+    use serde::{Deserialize, Serialize};
+
+    /// See [`super::RememberKey`]. Hashes like it, too (the derived
+    /// `Hash` of `&str` and `String` agree), so it can look up an owned
+    /// key.
+    #[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, Serialize, Deserialize)]
+    pub struct RememberKey<'a> {
+        pub loginuid: u32,
+        pub sessionid: u32,
+        pub service: &'a str,
+        pub command: &'a str,
+    }
+
+    impl<'a> RememberKey<'a> {
+        /// See [`super::RememberKey::is_bindable`].
+        pub fn is_bindable(&self) -> bool {
+            super::bindable(self.loginuid, self.sessionid, self.command)
+        }
+
+        /// See [`super::RememberKey::bind`].
+        pub fn bind(self) -> Option<super::BoundKey<RememberKey<'a>>> {
+            self.is_bindable().then_some(super::BoundKey(self))
+        }
+
+        pub fn to_owned_key(&self) -> super::RememberKey {
+            super::RememberKey {
+                loginuid: self.loginuid,
+                sessionid: self.sessionid,
+                service: self.service.to_owned(),
+                command: self.command.to_owned(),
+            }
+        }
+    }
+
+    /// See [`super::RememberQuery`].
+    #[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+    pub struct RememberQuery<'a> {
+        #[serde(borrow)]
+        pub key: RememberKey<'a>,
+        pub ttl_secs: u32,
+    }
+
+    /// See [`super::Request`].
+    #[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+    pub enum Request<'a> {
+        CheckRemember(#[serde(borrow)] RememberQuery<'a>),
+        RecordRemember(#[serde(borrow)] RememberKey<'a>),
+        Ping,
+        SessionCheck(#[serde(borrow)] RememberQuery<'a>),
+        SessionRecord,
+        Stats,
+    }
 }
 
 /// Broker → shim.
 #[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
 pub enum Response {
-    /// Result of [`Request::CheckRemember`].
+    /// Result of [`Request::CheckRemember`] / [`Request::SessionCheck`].
     Remember { fresh: bool },
-    /// [`Request::RecordRemember`] acknowledged.
+    /// [`Request::RecordRemember`] / [`Request::SessionRecord`]
+    /// acknowledged.
     Recorded,
     /// [`Request::Ping`] reply, carrying the broker's [`PROTOCOL_VERSION`].
     Pong { protocol: u16 },
     /// The broker refused or failed. The shim treats this fail-closed
     /// (as not-fresh / not-recorded) and falls back to the dialog.
     Error(String),
+    /// [`Request::Stats`] reply.
+    Stats(BrokerStats),
+}
+
+/// Broker counters since it started, for `sentinel-broker stats`.
+#[derive(Debug, Clone, Default, PartialEq, Eq, Serialize, Deserialize)]
+pub struct BrokerStats {
+    pub uptime_secs: u64,
+    /// Live remember grants.
+    pub grants: u64,
+    /// `CheckRemember` + `SessionCheck` requests, and how many of them
+    /// found a fresh grant.
+    pub checks: u64,
+    pub hits: u64,
+    /// Grants recorded, and records refused (unbindable key, quota, or a
+    /// `SessionRecord` without a miss).
+    pub records: u64,
+    pub records_refused: u64,
+    pub connections_open: u64,
+    pub connections_accepted: u64,
+    /// Connections closed at accept: non-root peer, or the connection cap.
+    pub peers_rejected: u64,
+    /// Connections dropped for a bad frame, and for a missed deadline.
+    pub frame_errors: u64,
+    pub timeouts: u64,
+    /// Time to answer one request (decode, store, encode).
+    pub dispatch: Histogram,
+    /// Time in one read or write syscall batch on a client socket.
+    pub io: Histogram,
+}
+
+/// Log2 latency histogram: bucket `i` counts samples in
+/// `[2^(i-1), 2^i)` ns (bucket 0: zero), the last one everything above.
+#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+pub struct Histogram {
+    pub buckets: Vec<u64>,
+    pub sum_ns: u64,
+}
+
+impl Histogram {
+    /// 2^39 ns ≈ 9 min; anything slower shares the last bucket.
+    pub const BUCKETS: usize = 40;
+
+    pub fn record(&mut self, d: std::time::Duration) {
+        let ns = u64::try_from(d.as_nanos()).unwrap_or(u64::MAX);
+        let i = (u64::BITS - ns.leading_zeros()) as usize;
+        if let Some(b) = self.buckets.get_mut(i.min(Self::BUCKETS - 1)) {
+            *b += 1;
+        }
+        self.sum_ns = self.sum_ns.saturating_add(ns);
+    }
+
+    pub fn count(&self) -> u64 {
+        self.buckets.iter().sum()
+    }
+
+    pub fn mean(&self) -> Option<std::time::Duration> {
+        let n = self.count();
+        (n > 0).then(|| std::time::Duration::from_nanos(self.sum_ns / n))
+    }
+
+    /// Upper bound of the bucket holding quantile `q` (0.0–1.0).
+    pub fn quantile(&self, q: f64) -> Option<std::time::Duration> {
+        let n = self.count();
+        if n == 0 {
+            return None;
+        }
+        let rank = ((q.clamp(0.0, 1.0) * n as f64).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (i, b) in self.buckets.iter().enumerate() {
+            seen += b;
+            if seen >= rank {
+                return Some(std::time::Duration::from_nanos(1u64 << i.min(63)));
+            }
+        }
+        None
+    }
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            buckets: vec![0; Self::BUCKETS],
+            sum_ns: 0,
+        }
+    }
 }
 
 /// Protocol / transport errors.
@@ -150,34 +373,97 @@ pub fn decode<T: DeserializeOwned>(bytes: &[u8]) -> Result<T, ProtoError> {
     postcard::from_bytes(bytes).map_err(ProtoError::Decode)
 }
 
+/// Deserialize a message whose strings borrow from `bytes` (the
+/// [`borrowed`] types).
+pub fn decode_borrowed<'a, T: Deserialize<'a>>(bytes: &'a [u8]) -> Result<T, ProtoError> {
+    postcard::from_bytes(bytes).map_err(ProtoError::Decode)
+}
+
+/// Bodies up to this size are encoded on the stack. Real messages are a
+/// few hundred bytes at most; larger ones fall back to the heap.
+const INLINE_BODY: usize = 512;
+
 /// Write a length-prefixed frame: `u32` LE body length, then the body.
-/// Refuses to emit a body larger than [`MAX_FRAME_LEN`].
-pub fn write_frame<W: std::io::Write, T: Serialize>(w: &mut W, msg: &T) -> Result<(), ProtoError> {
-    let body = encode(msg)?;
+/// Refuses to emit a body larger than [`MAX_FRAME_LEN`]. Header and body
+/// go out in one vectored write (more only if the writer takes part).
+pub fn write_frame<W: Write, T: Serialize>(w: &mut W, msg: &T) -> Result<(), ProtoError> {
+    let mut inline = [0u8; INLINE_BODY];
+    let heap;
+    let body: &[u8] = match postcard::to_slice(msg, &mut inline) {
+        Ok(body) => body,
+        Err(_) => {
+            heap = encode(msg)?;
+            &heap
+        }
+    };
     if body.len() > MAX_FRAME_LEN {
         return Err(ProtoError::TooLarge(body.len()));
     }
-    w.write_all(&(body.len() as u32).to_le_bytes())?;
-    w.write_all(&body)?;
+    let header = (body.len() as u32).to_le_bytes();
+    let mut bufs = [IoSlice::new(&header), IoSlice::new(body)];
+    let mut bufs = &mut bufs[..];
+    while !bufs.is_empty() {
+        match w.write_vectored(bufs) {
+            Ok(0) => return Err(std::io::Error::from(std::io::ErrorKind::WriteZero).into()),
+            Ok(n) => IoSlice::advance_slices(&mut bufs, n),
+            Err(e) if e.kind() == std::io::ErrorKind::Interrupted => {}
+            Err(e) => return Err(e.into()),
+        }
+    }
     w.flush()?;
     Ok(())
 }
 
-/// Read one length-prefixed frame. The length is validated against
-/// [`MAX_FRAME_LEN`] **before** allocating the body buffer, so a hostile
-/// length prefix cannot OOM the reader.
-pub fn read_frame<R: std::io::Read, T: DeserializeOwned>(r: &mut R) -> Result<T, ProtoError> {
+/// Read the length prefix, validated against [`MAX_FRAME_LEN`].
+fn read_len<R: Read>(r: &mut R) -> Result<usize, ProtoError> {
     let mut len_buf = [0u8; 4];
     r.read_exact(&mut len_buf)?;
     let len = u32::from_le_bytes(len_buf) as usize;
     if len > MAX_FRAME_LEN {
         return Err(ProtoError::TooLarge(len));
     }
-    let mut body = vec![0u8; len];
+    Ok(len)
+}
+
+/// Read one length-prefixed frame. The length is validated against
+/// [`MAX_FRAME_LEN`] **before** allocating the body buffer, so a hostile
+/// length prefix cannot OOM the reader.
+pub fn read_frame<R: Read, T: DeserializeOwned>(r: &mut R) -> Result<T, ProtoError> {
+    let mut body = vec![0u8; read_len(r)?];
     r.read_exact(&mut body)?;
     decode(&body)
 }
 
+/// Read one frame into `buf` (a stack array or a reused arena) and decode
+/// it borrowing from there. No allocation; a body longer than `buf` is
+/// [`ProtoError::TooLarge`], checked before reading it.
+pub fn read_frame_in<'b, R: Read, T: Deserialize<'b>>(
+    r: &mut R,
+    buf: &'b mut [u8],
+) -> Result<T, ProtoError> {
+    let len = read_len(r)?;
+    let body = buf.get_mut(..len).ok_or(ProtoError::TooLarge(len))?;
+    r.read_exact(body)?;
+    decode_borrowed(body)
+}
+
+/// A frame body split off a buffer, and the bytes after it.
+pub type Split<'a> = (&'a [u8], &'a [u8]);
+
+/// Split the first complete frame off `buf`: `Some((body, rest))`, or
+/// `None` while it is still incomplete. An oversized length prefix is
+/// an error as soon as its 4 bytes are in, however little body follows.
+pub fn split_frame(buf: &[u8]) -> Result<Option<Split<'_>>, ProtoError> {
+    let Some((header, rest)) = buf.split_first_chunk::<4>() else {
+        return Ok(None);
+    };
+    let len = u32::from_le_bytes(*header) as usize;
+    if len > MAX_FRAME_LEN {
+        return Err(ProtoError::TooLarge(len));
+    }
+    Ok((rest.len() >= len).then(|| rest.split_at(len)))
+}
+
 #[cfg(test)]
 mod tests {
     use super::*;
@@ -193,14 +479,7 @@ mod tests {
 
     #[test]
     fn request_round_trips() {
-        for req in [
-            Request::CheckRemember(RememberQuery {
-                key: key(),
-                ttl_secs: 300,
-            }),
-            Request::RecordRemember(key()),
-            Request::Ping,
-        ] {
+        for req in requests() {
             let bytes = encode(&req).unwrap();
             assert_eq!(decode::<Request>(&bytes).unwrap(), req);
         }
@@ -216,12 +495,162 @@ mod tests {
                 protocol: PROTOCOL_VERSION,
             },
             Response::Error("nope".into()),
+            Response::Stats(BrokerStats {
+                checks: 3,
+                ..BrokerStats::default()
+            }),
         ] {
             let bytes = encode(&resp).unwrap();
             assert_eq!(decode::<Response>(&bytes).unwrap(), resp);
         }
     }
 
+    fn requests() -> Vec<Request> {
+        vec![
+            Request::CheckRemember(RememberQuery {
+                key: key(),
+                ttl_secs: 300,
+            }),
+            Request::RecordRemember(key()),
+            Request::Ping,
+            Request::SessionCheck(RememberQuery {
+                key: key(),
+                ttl_secs: 300,
+            }),
+            Request::SessionRecord,
+            Request::Stats,
+        ]
+    }
+
+    #[test]
+    fn borrowed_types_are_wire_identical() {
+        for req in requests() {
+            let owned = encode(&req).unwrap();
+            assert_eq!(encode(&req.as_borrowed()).unwrap(), owned);
+            let view: borrowed::Request<'_> = decode_borrowed(&owned).unwrap();
+            assert_eq!(view, req.as_borrowed());
+        }
+    }
+
+    #[test]
+    fn borrowed_key_hashes_like_owned() {
+        use std::hash::BuildHasher;
+        let h = std::collections::hash_map::RandomState::new();
+        assert_eq!(h.hash_one(key()), h.hash_one(key().as_borrowed()));
+    }
+
+    #[test]
+    fn borrowed_bind_carries_over() {
+        let k = key();
+        let bound = k.as_borrowed().bind().unwrap();
+        assert_eq!(bound.to_owned_key().key(), &k);
+        let mut k = key();
+        k.command.clear();
+        assert!(k.as_borrowed().bind().is_none());
+    }
+
+    #[test]
+    fn read_frame_in_decodes_from_the_callers_buffer() {
+        let mut wire = Vec::new();
+        for req in requests() {
+            write_frame(&mut wire, &req).unwrap();
+        }
+        let mut cur = std::io::Cursor::new(wire);
+        let mut buf = [0u8; 1024];
+        for req in requests() {
+            let got: borrowed::Request<'_> = read_frame_in(&mut cur, &mut buf).unwrap();
+            assert_eq!(got, req.as_borrowed());
+        }
+        // A body that doesn't fit the buffer is refused, not truncated.
+        let mut wire = Vec::new();
+        write_frame(&mut wire, &requests()[0]).unwrap();
+        let mut small = [0u8; 8];
+        let err =
+            read_frame_in::<_, borrowed::Request<'_>>(&mut std::io::Cursor::new(wire), &mut small)
+                .unwrap_err();
+        assert!(matches!(err, ProtoError::TooLarge(_)));
+    }
+
+    #[test]
+    fn split_frame_walks_a_buffer() {
+        let mut wire = Vec::new();
+        write_frame(&mut wire, &Request::Ping).unwrap();
+        write_frame(&mut wire, &Request::SessionRecord).unwrap();
+        let (body, rest) = split_frame(&wire).unwrap().unwrap();
+        assert_eq!(decode::<Request>(body).unwrap(), Request::Ping);
+        let (body, rest) = split_frame(rest).unwrap().unwrap();
+        assert_eq!(decode::<Request>(body).unwrap(), Request::SessionRecord);
+        assert!(split_frame(rest).unwrap().is_none());
+        // Incomplete header or body: wait for more.
+        assert!(split_frame(&wire[..3]).unwrap().is_none());
+        assert!(split_frame(&wire[..5]).unwrap().is_none());
+        // Oversized: refused on the header alone.
+        assert!(matches!(
+            split_frame(&u32::MAX.to_le_bytes()),
+            Err(ProtoError::TooLarge(_))
+        ));
+    }
+
+    #[test]
+    fn large_bodies_fall_back_to_the_heap() {
+        let mut k = key();
+        k.command = "x".repeat(4 * INLINE_BODY);
+        let req = Request::RecordRemember(k);
+        let mut wire = Vec::new();
+        write_frame(&mut wire, &req).unwrap();
+        let mut cur = std::io::Cursor::new(wire);
+        assert_eq!(read_frame::<_, Request>(&mut cur).unwrap(), req);
+    }
+
+    /// Takes at most 3 bytes per call, so a frame needs many writes.
+    struct Trickle(Vec<u8>);
+
+    impl Write for Trickle {
+        fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+            let n = buf.len().min(3);
+            self.0.extend_from_slice(&buf[..n]);
+            Ok(n)
+        }
+
+        fn flush(&mut self) -> std::io::Result<()> {
+            Ok(())
+        }
+    }
+
+    #[test]
+    fn short_writes_are_resumed() {
+        let req = Request::RecordRemember(key());
+        let mut w = Trickle(Vec::new());
+        write_frame(&mut w, &req).unwrap();
+        let mut cur = std::io::Cursor::new(w.0);
+        assert_eq!(read_frame::<_, Request>(&mut cur).unwrap(), req);
+    }
+
+    #[test]
+    fn histogram_buckets_and_quantiles() {
+        use std::time::Duration;
+        let mut h = Histogram::default();
+        assert_eq!(h.quantile(0.5), None);
+        for _ in 0..90 {
+            h.record(Duration::from_nanos(700)); // bucket 10: [512, 1024)
+        }
+        for _ in 0..10 {
+            h.record(Duration::from_micros(100)); // bucket 17
+        }
+        h.record(Duration::from_secs(100_000)); // clamps to the last
+        assert_eq!(h.count(), 101);
+        assert_eq!(h.buckets[Histogram::BUCKETS - 1], 1);
+        assert_eq!(h.quantile(0.5), Some(Duration::from_nanos(1024)));
+        assert_eq!(h.quantile(0.95), Some(Duration::from_nanos(1 << 17)));
+        assert_eq!(
+            h.quantile(1.0),
+            Some(Duration::from_nanos(1 << (Histogram::BUCKETS - 1)))
+        );
+        // A zero sample lands in bucket 0, it doesn't panic.
+        h.record(Duration::ZERO);
+        assert_eq!(h.buckets[0], 1);
+    }
+
     #[test]
     fn framed_round_trip() {
         let req = Request::CheckRemember(RememberQuery {
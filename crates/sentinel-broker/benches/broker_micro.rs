@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Per-operation broker costs, no sockets: `dispatch`, the remember
+//! store, and frame encode/decode.
+//!
+//! `cargo bench -p sentinel-broker --bench broker_micro`
+
+use sentinel_broker::server::{Session, dispatch};
+use sentinel_broker::stats::Stats;
+use sentinel_broker::store::RememberStore;
+use sentinel_broker_proto::{
+    RememberKey, RememberQuery, Request, borrowed, decode_borrowed, read_frame, split_frame,
+    write_frame,
+};
+use std::hint::black_box;
+use std::time::Instant;
+
+fn bench(name: &str, iters: u32, mut f: impl FnMut()) {
+    for _ in 0..iters / 10 {
+        f();
+    }
+    let start = Instant::now();
+    for _ in 0..iters {
+        f();
+    }
+    let per = start.elapsed() / iters;
+    println!("{name:<32} {:>10.2?}/iter", per);
+}
+
+fn key(command: &str) -> RememberKey {
+    RememberKey {
+        loginuid: 1000,
+        sessionid: 3,
+        service: "sudo".into(),
+        command: command.into(),
+    }
+}
+
+fn main() {
+    let iters = 200_000;
+    let store = RememberStore::new();
+    let hit = key("/usr/bin/pacman -Syu");
+    let miss = key("/usr/bin/pacman -U /tmp/pkg.tar.zst");
+    store.record(hit.clone().bind().unwrap());
+
+    bench("store: is_fresh (hit)", iters, || {
+        let k = black_box(&hit).as_borrowed().bind().unwrap();
+        black_box(store.is_fresh(&k, 300));
+    });
+    bench("store: is_fresh (miss)", iters, || {
+        let k = black_box(&miss).as_borrowed().bind().unwrap();
+        black_box(store.is_fresh(&k, 300));
+    });
+    bench("store: record (refresh)", iters, || {
+        black_box(store.record(black_box(&hit).clone().bind().unwrap()));
+    });
+
+    let mut stats = Stats::new();
+    let check = |k: &RememberKey| {
+        Request::CheckRemember(RememberQuery {
+            key: k.clone(),
+            ttl_secs: 300,
+        })
+    };
+    let (check_hit, check_miss) = (check(&hit), check(&miss));
+    let record = Request::RecordRemember(hit.clone());
+    let session_check = Request::SessionCheck(RememberQuery {
+        key: miss.clone(),
+        ttl_secs: 300,
+    });
+    for (name, req) in [
+        ("dispatch: check (hit)", &check_hit),
+        ("dispatch: check (miss)", &check_miss),
+        ("dispatch: record", &record),
+        ("dispatch: session check (miss)", &session_check),
+    ] {
+        let mut session = Session::default();
+        bench(name, iters, || {
+            let req = black_box(req).as_borrowed();
+            black_box(dispatch(req, &store, &mut session, &mut stats));
+        });
+    }
+
+    let mut wire = Vec::with_capacity(256);
+    bench("frame: write_frame", iters, || {
+        wire.clear();
+        write_frame(&mut wire, black_box(&check_hit)).unwrap();
+    });
+    bench("frame: split + decode_borrowed", iters, || {
+        let (body, _) = split_frame(black_box(&wire)).unwrap().unwrap();
+        black_box(decode_borrowed::<borrowed::Request<'_>>(body).unwrap());
+    });
+    bench("frame: read_frame (owned)", iters, || {
+        let mut cur = std::io::Cursor::new(black_box(&wire[..]));
+        black_box(read_frame::<_, Request>(&mut cur).unwrap());
+    });
+}
@@ -0,0 +1,217 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Broker load generator: the real event loop (`server::run`, peer-root
+//! check off) on a temp socket, driven by N client threads with a
+//! hit/miss/record mix. Reports requests/s and p50/p99/p999 latency per
+//! client count.
+//!
+//! `cargo bench -p sentinel-broker --bench loadgen -- [--clients 1,16,64]
+//! [--requests 200000] [--mix 80:15:5] [--oneshot]`
+//!
+//! `--requests` is the total across clients; `--mix` is hit:miss:record
+//! percentages; `--oneshot` connects per request (the PAM shim's v1
+//! pattern) instead of one persistent connection per client.
+
+use sentinel_broker::server;
+use sentinel_broker::store::RememberStore;
+use sentinel_broker_proto::{
+    RememberKey, RememberQuery, Request, Response, read_frame, write_frame,
+};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::Path;
+use std::sync::{Arc, Barrier};
+use std::thread;
+use std::time::{Duration, Instant};
+
+/// Grants recorded before the run; hits and records pick among them.
+const HOT_KEYS: usize = 1024;
+
+struct Opts {
+    clients: Vec<usize>,
+    requests: usize,
+    /// Percent hit, miss (record is the rest).
+    hit: u32,
+    miss: u32,
+    oneshot: bool,
+}
+
+impl Opts {
+    fn parse() -> Self {
+        let mut o = Opts {
+            clients: vec![1, 16, 64],
+            requests: 200_000,
+            hit: 80,
+            miss: 15,
+            oneshot: false,
+        };
+        let mut args = std::env::args().skip(1);
+        while let Some(a) = args.next() {
+            match a.as_str() {
+                "--clients" => {
+                    o.clients = args
+                        .next()
+                        .expect("--clients N[,N...]")
+                        .split(',')
+                        .map(|n| n.parse().expect("--clients: not a number"))
+                        .collect();
+                }
+                "--requests" => {
+                    o.requests = args
+                        .next()
+                        .and_then(|n| n.parse().ok())
+                        .expect("--requests N");
+                }
+                "--mix" => {
+                    let mix: Vec<u32> = args
+                        .next()
+                        .expect("--mix HIT:MISS:RECORD")
+                        .split(':')
+                        .map(|n| n.parse().expect("--mix: not a number"))
+                        .collect();
+                    assert!(
+                        mix.len() == 3 && mix.iter().sum::<u32>() == 100,
+                        "--mix wants three percentages summing to 100"
+                    );
+                    (o.hit, o.miss) = (mix[0], mix[1]);
+                }
+                "--oneshot" => o.oneshot = true,
+                // `cargo bench` passes `--bench`; ignore it and the like.
+                _ => {}
+            }
+        }
+        o
+    }
+}
+
+fn key(i: usize, command: String) -> RememberKey {
+    RememberKey {
+        loginuid: 1000 + (i % 64) as u32,
+        sessionid: 3,
+        service: "sudo".into(),
+        command,
+    }
+}
+
+fn hot(i: usize) -> RememberKey {
+    key(i, format!("/usr/bin/pacman -S --needed package-{i}"))
+}
+
+/// xorshift64: deterministic per client, no dependency.
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+}
+
+fn request(rng: &mut Rng, o: &Opts) -> (Request, bool) {
+    let roll = (rng.next() % 100) as u32;
+    let i = rng.next() as usize % HOT_KEYS;
+    let query = |key| RememberQuery { key, ttl_secs: 300 };
+    if roll < o.hit {
+        (Request::CheckRemember(query(hot(i))), true)
+    } else if roll < o.hit + o.miss {
+        let miss = key(i, format!("/usr/bin/pacman -U /tmp/miss-{}", rng.next()));
+        (Request::CheckRemember(query(miss)), false)
+    } else {
+        (Request::RecordRemember(hot(i)), false)
+    }
+}
+
+/// One client's run: its latencies, and how many replies were wrong.
+fn client(sock: &Path, o: &Opts, seed: u64, n: usize, start: &Barrier) -> (Vec<Duration>, usize) {
+    let mut rng = Rng(seed | 1);
+    let mut lat = Vec::with_capacity(n);
+    let mut wrong = 0;
+    let mut conn = (!o.oneshot).then(|| UnixStream::connect(sock).expect("connect"));
+    start.wait();
+    for _ in 0..n {
+        let (req, expect_hit) = request(&mut rng, o);
+        let t = Instant::now();
+        let mut fresh_conn;
+        let s = match conn.as_mut() {
+            Some(s) => s,
+            None => {
+                fresh_conn = UnixStream::connect(sock).expect("connect");
+                &mut fresh_conn
+            }
+        };
+        write_frame(s, &req).expect("write");
+        let resp: Response = read_frame(s).expect("read");
+        lat.push(t.elapsed());
+        let ok = match (&req, resp) {
+            (Request::CheckRemember(_), Response::Remember { fresh }) => fresh == expect_hit,
+            (Request::RecordRemember(_), Response::Recorded) => true,
+            _ => false,
+        };
+        wrong += usize::from(!ok);
+    }
+    (lat, wrong)
+}
+
+fn pct(sorted: &[Duration], q: f64) -> Duration {
+    let i = ((sorted.len() as f64 * q).ceil() as usize).clamp(1, sorted.len()) - 1;
+    sorted[i]
+}
+
+fn main() {
+    let o = Arc::new(Opts::parse());
+    let dir = std::env::temp_dir().join(format!("sentinel-loadgen-{}", std::process::id()));
+    std::fs::create_dir_all(&dir).unwrap();
+    let sock = dir.join("broker.sock");
+    let _ = std::fs::remove_file(&sock);
+    let listener = UnixListener::bind(&sock).unwrap();
+
+    let store: &'static RememberStore = Box::leak(Box::new(RememberStore::new()));
+    for i in 0..HOT_KEYS {
+        assert!(store.record(hot(i).bind().unwrap()));
+    }
+    thread::spawn(move || server::run(listener, store, false));
+
+    println!(
+        "mix {}:{}:{} (hit:miss:record), {} connections, {} requests per row",
+        o.hit,
+        o.miss,
+        100 - o.hit - o.miss,
+        if o.oneshot { "one-shot" } else { "persistent" },
+        o.requests
+    );
+    for &clients in &o.clients {
+        let per = (o.requests / clients).max(1);
+        let start = Arc::new(Barrier::new(clients + 1));
+        let handles: Vec<_> = (0..clients)
+            .map(|c| {
+                let (o, sock, start) = (Arc::clone(&o), sock.clone(), Arc::clone(&start));
+                thread::spawn(move || client(&sock, &o, 0x9E37_79B9 * (c as u64 + 1), per, &start))
+            })
+            .collect();
+        start.wait();
+        let t = Instant::now();
+        let mut lat = Vec::with_capacity(per * clients);
+        let mut wrong = 0;
+        for h in handles {
+            let (l, w) = h.join().unwrap();
+            lat.extend(l);
+            wrong += w;
+        }
+        let elapsed = t.elapsed();
+        lat.sort_unstable();
+        println!(
+            "clients={clients:<4} {:>9.0} req/s  p50={:>9.2?} p99={:>9.2?} p999={:>9.2?}{}",
+            lat.len() as f64 / elapsed.as_secs_f64(),
+            pct(&lat, 0.50),
+            pct(&lat, 0.99),
+            pct(&lat, 0.999),
+            if wrong > 0 {
+                format!("  ({wrong} unexpected replies)")
+            } else {
+                String::new()
+            }
+        );
+    }
+    let _ = std::fs::remove_dir_all(&dir);
+}
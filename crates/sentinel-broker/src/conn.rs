@@ -0,0 +1,378 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! One client connection on the event loop: a non-blocking socket plus
+//! its partial input and pending output.
+//!
+//! A connection carries any number of requests, pipelined or one after
+//! another. Each complete frame in the input buffer is dispatched in
+//! order and its response queued; responses leave in request order.
+//! Nothing here blocks: reads and writes stop at `WouldBlock`, and
+//! [`server`](crate::server) calls back in when epoll reports the
+//! socket ready again.
+//!
+//! Fail-closed like the one-shot handler it replaces: an oversized
+//! length prefix or an undecodable body drops the connection without
+//! touching the store. Responses already queued for earlier requests
+//! are discarded with it.
+
+use crate::server::{Session, dispatch};
+use crate::stats::Stats;
+use crate::store::RememberStore;
+use sentinel_broker_proto::{MAX_FRAME_LEN, borrowed, decode_borrowed, split_frame, write_frame};
+use std::io::{self, Read, Write};
+use std::os::unix::net::UnixStream;
+use std::time::{Duration, Instant};
+
+/// Bound on how long a peer may sit on a half-sent request or an unread
+/// response.
+pub const IO_TIMEOUT: Duration = Duration::from_secs(5);
+
+/// Bound on an idle connection between requests.
+pub const IDLE_TIMEOUT: Duration = Duration::from_secs(30);
+
+/// Bound on an idle connection holding an open remember session: the
+/// shim keeps it across the dialog. A dialog left up longer than this
+/// loses its record (the user is asked again next time), never more.
+pub const SESSION_TIMEOUT: Duration = Duration::from_secs(600);
+
+/// Stop reading (and dispatching) once this much output is waiting for
+/// a peer that doesn't drain its responses.
+const TX_HIGH_WATER: usize = 64 * 1024;
+
+/// Per-wakeup read budget, so one flooding peer can't starve the others
+/// (epoll is level-triggered; the rest is picked up next round).
+const READ_BUDGET: usize = 64 * 1024;
+
+const READ_CHUNK: usize = 16 * 1024;
+
+/// The connection must be dropped.
+#[derive(Debug)]
+pub struct Closed;
+
+pub struct Conn {
+    stream: UnixStream,
+    rx: Vec<u8>,
+    tx: Vec<u8>,
+    /// Bytes of `tx` already written.
+    tx_sent: usize,
+    /// The peer shut down its write side.
+    eof: bool,
+    session: Session,
+    deadline: Instant,
+}
+
+impl Conn {
+    pub fn new(stream: UnixStream, now: Instant) -> io::Result<Self> {
+        stream.set_nonblocking(true)?;
+        Ok(Self {
+            stream,
+            rx: Vec::new(),
+            tx: Vec::new(),
+            tx_sent: 0,
+            eof: false,
+            session: Session::default(),
+            deadline: now + IDLE_TIMEOUT,
+        })
+    }
+
+    pub fn stream(&self) -> &UnixStream {
+        &self.stream
+    }
+
+    /// When the connection times out.
+    pub fn deadline(&self) -> Instant {
+        self.deadline
+    }
+
+    /// Whether epoll should report readability.
+    pub fn wants_read(&self) -> bool {
+        !self.eof && self.pending_tx() < TX_HIGH_WATER && self.rx.len() < 4 + MAX_FRAME_LEN
+    }
+
+    /// Whether epoll should report writability.
+    pub fn wants_write(&self) -> bool {
+        self.pending_tx() > 0
+    }
+
+    /// Make all the progress possible without blocking: read what's
+    /// there, dispatch every complete request, write what the peer will
+    /// take. `Err` means the connection is done (cleanly or not).
+    pub fn pump(
+        &mut self,
+        store: &RememberStore,
+        stats: &mut Stats,
+        now: Instant,
+    ) -> Result<(), Closed> {
+        let mut progress = false;
+        if self.wants_read() {
+            let t = Instant::now();
+            let read = self.read_some();
+            stats.io(t.elapsed());
+            progress |= read?;
+        }
+        loop {
+            let dispatched = self.dispatch_ready(store, stats).inspect_err(|_| {
+                stats.counters.frame_errors += 1;
+            })?;
+            let wrote = if self.wants_write() {
+                let t = Instant::now();
+                let wrote = self.flush();
+                stats.io(t.elapsed());
+                wrote?
+            } else {
+                true
+            };
+            progress |= dispatched || wrote;
+            if !(dispatched && wrote) {
+                break;
+            }
+        }
+        if self.eof && self.pending_tx() == 0 {
+            // Leftover bytes after EOF are a truncated request.
+            return Err(Closed);
+        }
+        if progress {
+            let mid_request = !self.rx.is_empty() || self.pending_tx() > 0;
+            self.deadline = now
+                + if mid_request {
+                    IO_TIMEOUT
+                } else if self.session.is_open() {
+                    SESSION_TIMEOUT
+                } else {
+                    IDLE_TIMEOUT
+                };
+        }
+        Ok(())
+    }
+
+    fn pending_tx(&self) -> usize {
+        self.tx.len() - self.tx_sent
+    }
+
+    fn read_some(&mut self) -> Result<bool, Closed> {
+        let mut chunk = [0u8; READ_CHUNK];
+        let mut total = 0;
+        while total < READ_BUDGET && self.wants_read() {
+            match self.stream.read(&mut chunk) {
+                Ok(0) => {
+                    self.eof = true;
+                    break;
+                }
+                Ok(n) => {
+                    self.rx.extend_from_slice(&chunk[..n]);
+                    total += n;
+                }
+                Err(e) if e.kind() == io::ErrorKind::WouldBlock => break,
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(_) => return Err(Closed),
+            }
+        }
+        Ok(total > 0 || self.eof)
+    }
+
+    /// Dispatch the complete frames at the head of `rx` while there is
+    /// room to queue their responses. Returns whether any was. Requests
+    /// are decoded in place: their strings borrow from `rx`.
+    fn dispatch_ready(&mut self, store: &RememberStore, stats: &mut Stats) -> Result<bool, Closed> {
+        let mut rest = &self.rx[..];
+        while self.tx.len() - self.tx_sent < TX_HIGH_WATER {
+            let (body, tail) = match split_frame(rest) {
+                Ok(Some(frame)) => frame,
+                Ok(None) => break,
+                Err(e) => {
+                    eprintln!("sentinel-broker: read: {e}");
+                    return Err(Closed);
+                }
+            };
+            let t = Instant::now();
+            let req: borrowed::Request<'_> = decode_borrowed(body).map_err(|e| {
+                eprintln!("sentinel-broker: read: {e}");
+                Closed
+            })?;
+            let resp = dispatch(req, store, &mut self.session, stats);
+            write_frame(&mut self.tx, &resp).map_err(|e| {
+                eprintln!("sentinel-broker: write: {e}");
+                Closed
+            })?;
+            stats.dispatch(t.elapsed());
+            rest = tail;
+        }
+        let consumed = self.rx.len() - rest.len();
+        self.rx.drain(..consumed);
+        Ok(consumed > 0)
+    }
+
+    /// Write queued output until the socket is full. Returns whether
+    /// everything went out.
+    fn flush(&mut self) -> Result<bool, Closed> {
+        while self.pending_tx() > 0 {
+            match self.stream.write(&self.tx[self.tx_sent..]) {
+                Ok(0) => return Err(Closed),
+                Ok(n) => self.tx_sent += n,
+                Err(e) if e.kind() == io::ErrorKind::WouldBlock => return Ok(false),
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
+                Err(e) => {
+                    eprintln!("sentinel-broker: write: {e}");
+                    return Err(Closed);
+                }
+            }
+        }
+        self.tx.clear();
+        self.tx_sent = 0;
+        Ok(true)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use sentinel_broker_proto::{RememberKey, RememberQuery, Request, Response, read_frame};
+
+    fn key() -> RememberKey {
+        RememberKey {
+            loginuid: 1000,
+            sessionid: 3,
+            service: "sudo".into(),
+            command: "pacman -Syu".into(),
+        }
+    }
+
+    fn check() -> Request {
+        Request::CheckRemember(RememberQuery {
+            key: key(),
+            ttl_secs: 60,
+        })
+    }
+
+    fn framed(reqs: &[Request]) -> Vec<u8> {
+        let mut buf = Vec::new();
+        for r in reqs {
+            write_frame(&mut buf, r).unwrap();
+        }
+        buf
+    }
+
+    fn conn() -> (Conn, UnixStream) {
+        let (a, b) = UnixStream::pair().unwrap();
+        (Conn::new(a, Instant::now()).unwrap(), b)
+    }
+
+    #[test]
+    fn pipelined_requests_are_answered_in_order() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        peer.write_all(&framed(&[check(), Request::RecordRemember(key()), check()]))
+            .unwrap();
+        c.pump(&store, &mut Stats::new(), Instant::now()).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut peer).unwrap(),
+            Response::Remember { fresh: false }
+        ));
+        assert!(matches!(
+            read_frame::<_, Response>(&mut peer).unwrap(),
+            Response::Recorded
+        ));
+        assert!(matches!(
+            read_frame::<_, Response>(&mut peer).unwrap(),
+            Response::Remember { fresh: true }
+        ));
+    }
+
+    #[test]
+    fn partial_frame_waits_for_the_rest() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        let bytes = framed(&[Request::Ping]);
+        let now = Instant::now();
+        peer.write_all(&bytes[..3]).unwrap();
+        c.pump(&store, &mut Stats::new(), now).unwrap();
+        assert!(!c.wants_write());
+        // Mid-request: the short I/O timeout applies, not the idle one.
+        assert_eq!(c.deadline(), now + IO_TIMEOUT);
+        peer.write_all(&bytes[3..]).unwrap();
+        c.pump(&store, &mut Stats::new(), now).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut peer).unwrap(),
+            Response::Pong { .. }
+        ));
+        assert_eq!(c.deadline(), now + IDLE_TIMEOUT);
+    }
+
+    #[test]
+    fn open_session_extends_the_idle_deadline() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        let now = Instant::now();
+        let q = Request::SessionCheck(RememberQuery {
+            key: key(),
+            ttl_secs: 60,
+        });
+        peer.write_all(&framed(&[q])).unwrap();
+        c.pump(&store, &mut Stats::new(), now).unwrap();
+        assert_eq!(c.deadline(), now + SESSION_TIMEOUT);
+        peer.write_all(&framed(&[Request::SessionRecord])).unwrap();
+        c.pump(&store, &mut Stats::new(), now).unwrap();
+        assert_eq!(c.deadline(), now + IDLE_TIMEOUT);
+    }
+
+    #[test]
+    fn oversized_length_closes_before_buffering() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        peer.write_all(&u32::MAX.to_le_bytes()).unwrap();
+        assert!(c.pump(&store, &mut Stats::new(), Instant::now()).is_err());
+    }
+
+    #[test]
+    fn garbage_body_closes_without_recording() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        let mut bytes = framed(&[Request::RecordRemember(key())]);
+        // Corrupt the enum tag.
+        bytes[4] = 0xFF;
+        peer.write_all(&bytes).unwrap();
+        assert!(c.pump(&store, &mut Stats::new(), Instant::now()).is_err());
+        assert!(!store.is_fresh(&key().as_borrowed().bind().unwrap(), 60));
+    }
+
+    #[test]
+    fn peer_eof_after_answers_closes_cleanly() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        peer.write_all(&framed(&[Request::Ping])).unwrap();
+        peer.shutdown(std::net::Shutdown::Write).unwrap();
+        // The answer is still written before the connection is dropped.
+        assert!(c.pump(&store, &mut Stats::new(), Instant::now()).is_err());
+        assert!(matches!(
+            read_frame::<_, Response>(&mut peer).unwrap(),
+            Response::Pong { .. }
+        ));
+    }
+
+    #[test]
+    fn unread_responses_stop_dispatch_at_the_high_water_mark() {
+        let store = RememberStore::new();
+        let (mut c, mut peer) = conn();
+        peer.set_nonblocking(true).unwrap();
+        // Keep pinging until the connection stops reading; the peer never
+        // reads a response. (`off` wraps on a whole-frame boundary, so a
+        // short write never splits the stream mid-frame.)
+        let burst = framed(&vec![Request::Ping; 1024]);
+        let mut off = 0;
+        for _ in 0..100_000 {
+            match peer.write(&burst[off..]) {
+                Ok(n) => off = (off + n) % burst.len(),
+                Err(_) => {
+                    c.pump(&store, &mut Stats::new(), Instant::now()).unwrap();
+                    if !c.wants_read() {
+                        break;
+                    }
+                }
+            }
+        }
+        assert!(!c.wants_read());
+        assert!(c.wants_write());
+        // Overshoot is at most one response.
+        assert!(c.pending_tx() < TX_HIGH_WATER + 64);
+    }
+}
@@ -0,0 +1,20 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Library surface for `sentinel-broker`.
+//!
+//! The daemon ships as a `[[bin]]` (`src/main.rs`); this `lib.rs`
+//! exposes the event loop, dispatch and store so the benches in
+//! `benches/` can drive the real server over a temp socket (peer-root
+//! check off, as the tests do) without spawning the binary.
+//!
+//! `#![deny(unsafe_code)]`: the one exception is taking ownership of the
+//! descriptor systemd passes back from its FD store (`snapshot`), under
+//! a scoped `#[allow(unsafe_code)]` with a `SAFETY:` note.
+
+#![deny(unsafe_code)]
+
+pub mod conn;
+pub mod server;
+pub mod snapshot;
+pub mod stats;
+pub mod store;
@@ -16,18 +16,25 @@
 //!
 //! This is increment 2 of the broker (daemon + in-memory store). The PAM
 //! shim rewire that makes `pam_sentinel` relay here is increment 3.
+//!
+//! Grants outlive a clean restart: on SIGTERM they are handed to the
+//! next broker in a sealed memfd through systemd's FD store (see
+//! `sentinel_broker::snapshot`), still never touching disk.
+//!
+//! `sentinel-broker stats` is a client instead: it asks the running
+//! broker for its counters and latency histograms and prints them (as
+//! root, like any other client).
 
 #![forbid(unsafe_code)]
 
-mod server;
-mod store;
-
+use nix::sys::signal::{SigSet, Signal};
+use nix::sys::signalfd::{SfdFlags, SignalFd};
+use sentinel_broker::{server, snapshot, stats};
 use std::fs;
+use std::os::fd::AsFd;
 use std::os::unix::fs::PermissionsExt;
 use std::os::unix::net::UnixListener;
 use std::path::{Path, PathBuf};
-use std::sync::Arc;
-use std::thread;
 
 /// Default socket. Kept separate from the legacy `/run/sentinel/ts` store
 /// so the two can coexist during the shim-rewire transition. systemd
@@ -40,6 +47,24 @@ const DEFAULT_SOCK_PATH: &str = "/run/sentinel-broker/broker.sock";
 fn main() -> Result<(), Box<dyn std::error::Error>> {
     let sock_path =
         std::env::var("SENTINEL_BROKER_SOCK").unwrap_or_else(|_| DEFAULT_SOCK_PATH.to_string());
+    match std::env::args().nth(1).as_deref() {
+        None => {}
+        Some("stats") => return Ok(stats::print(&sock_path)?),
+        Some(other) => {
+            return Err(
+                format!("unknown command {other:?} (usage: sentinel-broker [stats])").into(),
+            );
+        }
+    }
+    // SIGTERM/SIGINT end the loop through a signalfd instead of killing
+    // the process, so the grants can be handed over first.
+    let mut stop = SigSet::empty();
+    stop.add(Signal::SIGTERM);
+    stop.add(Signal::SIGINT);
+    stop.thread_block()?;
+    let stop = SignalFd::with_flags(&stop, SfdFlags::SFD_CLOEXEC | SfdFlags::SFD_NONBLOCK)?;
+    let store = snapshot::restore();
+
     let sock_dir = Path::new(&sock_path)
         .parent()
         .map(Path::to_path_buf)
@@ -57,18 +82,11 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
     fs::set_permissions(&sock_path, fs::Permissions::from_mode(0o600))?;
     eprintln!("sentinel-broker: listening on {sock_path}");
 
-    let store = Arc::new(store::RememberStore::new());
-    for conn in listener.incoming() {
-        match conn {
-            Ok(stream) => {
-                let store = Arc::clone(&store);
-                // One thread per connection, each bounded by an I/O
-                // timeout (see `server::handle`), so a stuck client can't
-                // wedge the accept loop.
-                thread::spawn(move || server::handle(stream, &store, true));
-            }
-            Err(e) => eprintln!("sentinel-broker: accept failed: {e}"),
-        }
+    // One thread, one epoll loop, persistent connections; see `server`.
+    server::run_until(listener, &store, true, stop.as_fd())?;
+    match snapshot::save(&store) {
+        Ok(n) => eprintln!("sentinel-broker: handed {n} grants to the fd store"),
+        Err(e) => eprintln!("sentinel-broker: grants not handed over: {e}"),
     }
     Ok(())
 }
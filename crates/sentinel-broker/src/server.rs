@@ -1,45 +1,219 @@
 // SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
 // SPDX-License-Identifier: GPL-3.0-or-later
-//! Connection handling: peer-credential authentication + request dispatch.
+//! The event loop: peer-credential authentication + request dispatch.
+//!
+//! One thread serves every client. The listener and all connections sit
+//! on a single epoll instance (level-triggered); each ready connection
+//! makes whatever progress it can without blocking (see [`crate::conn`])
+//! and goes back to waiting. A connection carries any number of
+//! requests, so a burst of auths costs no thread spawns, and a slow or
+//! stalled peer only ever holds its own buffers until its deadline.
 //!
 //! Only **root** may talk to the broker — the PAM shim runs inside a
 //! privileged binary (`sudo`, `polkit-agent-helper-1`, `su`), so its peer
 //! uid is 0, vouched by the kernel via `SO_PEERCRED` (snapshotted at
-//! `connect()`, unspoofable). Everything is fail-closed: a non-root peer,
-//! a bad credential lookup, or any framing error drops the connection
-//! without touching the store.
+//! `connect()`, unspoofable). It is checked once per connection, at
+//! accept. Everything is fail-closed: a non-root peer, a bad credential
+//! lookup, or any framing error drops the connection without touching
+//! the store.
 
+use crate::conn::Conn;
+use crate::stats::Stats;
 use crate::store::RememberStore;
+use nix::errno::Errno;
+use nix::poll::PollTimeout;
+use nix::sys::epoll::{Epoll, EpollCreateFlags, EpollEvent, EpollFlags};
 use nix::sys::socket::{getsockopt, sockopt::PeerCredentials};
-use sentinel_broker_proto::{PROTOCOL_VERSION, Request, Response, read_frame, write_frame};
-use std::os::fd::AsFd;
-use std::os::unix::net::UnixStream;
-use std::time::Duration;
+use sentinel_broker_proto::borrowed::Request;
+use sentinel_broker_proto::{BoundKey, PROTOCOL_VERSION, Response};
+use std::collections::HashMap;
+use std::io;
+use std::os::fd::{AsFd, BorrowedFd};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::time::Instant;
+
+/// Cap on simultaneously open connections. Only root can reach the
+/// socket, so this is a sanity bound, not a defense; past it new
+/// connections are closed at accept.
+const MAX_CONNS: usize = 1024;
+
+/// epoll user data of the listener; connections count up from 1.
+const LISTENER: u64 = 0;
 
-/// Bound how long a slow or hostile client can tie up a handler thread.
-const IO_TIMEOUT: Duration = Duration::from_secs(5);
+/// epoll user data of [`run_until`]'s stop descriptor.
+const STOP: u64 = u64::MAX;
+
+/// Serve `listener` forever. `enforce_peer_root` is always `true` in
+/// production; tests set it `false` (the test process isn't root).
+pub fn run(
+    listener: UnixListener,
+    store: &RememberStore,
+    enforce_peer_root: bool,
+) -> io::Result<()> {
+    serve(listener, store, enforce_peer_root, None)
+}
 
-/// Handle one client connection: authenticate the peer, read one request,
-/// dispatch it, write one response, close. `enforce_peer_root` is always
-/// `true` in production; tests set it `false` (the test process isn't root).
-pub fn handle(mut stream: UnixStream, store: &RememberStore, enforce_peer_root: bool) {
-    let _ = stream.set_read_timeout(Some(IO_TIMEOUT));
-    let _ = stream.set_write_timeout(Some(IO_TIMEOUT));
+/// [`run`] until `stop` turns readable (the broker's SIGTERM signalfd),
+/// then return so the grants can be handed over. Open connections are
+/// dropped; a shim mid-session just fails its record.
+pub fn run_until(
+    listener: UnixListener,
+    store: &RememberStore,
+    enforce_peer_root: bool,
+    stop: BorrowedFd<'_>,
+) -> io::Result<()> {
+    serve(listener, store, enforce_peer_root, Some(stop))
+}
 
-    if enforce_peer_root && !peer_is_root(&stream) {
-        return;
+fn serve(
+    listener: UnixListener,
+    store: &RememberStore,
+    enforce_peer_root: bool,
+    stop: Option<BorrowedFd<'_>>,
+) -> io::Result<()> {
+    listener.set_nonblocking(true)?;
+    let epoll = Epoll::new(EpollCreateFlags::EPOLL_CLOEXEC)?;
+    epoll.add(&listener, EpollEvent::new(EpollFlags::EPOLLIN, LISTENER))?;
+    if let Some(stop) = stop {
+        epoll.add(stop, EpollEvent::new(EpollFlags::EPOLLIN, STOP))?;
     }
 
-    let req: Request = match read_frame(&mut stream) {
-        Ok(r) => r,
-        Err(e) => {
-            eprintln!("sentinel-broker: read: {e}");
-            return;
+    let mut stats = Stats::new();
+    let mut conns: HashMap<u64, (Conn, EpollFlags)> = HashMap::new();
+    let mut next_token = LISTENER + 1;
+    let mut events = [EpollEvent::empty(); 64];
+    loop {
+        let timeout =
+            conns
+                .values()
+                .map(|(c, _)| c.deadline())
+                .min()
+                .map_or(PollTimeout::NONE, |d| {
+                    let wait = d.saturating_duration_since(Instant::now());
+                    // Round up so a wakeup never lands just short of a deadline.
+                    PollTimeout::try_from(wait + std::time::Duration::from_millis(1))
+                        .unwrap_or(PollTimeout::MAX)
+                });
+        let n = match epoll.wait(&mut events, timeout) {
+            Ok(n) => n,
+            Err(Errno::EINTR) => continue,
+            Err(e) => return Err(e.into()),
+        };
+        let now = Instant::now();
+        for ev in &events[..n] {
+            if ev.data() == STOP {
+                return Ok(());
+            }
+            if ev.data() == LISTENER {
+                accept_ready(
+                    &listener,
+                    &epoll,
+                    &mut conns,
+                    &mut next_token,
+                    enforce_peer_root,
+                    &mut stats,
+                    now,
+                );
+                continue;
+            }
+            let token = ev.data();
+            let Some((conn, interest)) = conns.get_mut(&token) else {
+                continue;
+            };
+            let keep = conn.pump(store, &mut stats, now).is_ok()
+                && update_interest(&epoll, token, conn, interest);
+            if !keep {
+                close(&epoll, &mut conns, token, &mut stats);
+            }
         }
-    };
-    let resp = dispatch(req, store);
-    if let Err(e) = write_frame(&mut stream, &resp) {
-        eprintln!("sentinel-broker: write: {e}");
+        let expired: Vec<u64> = conns
+            .iter()
+            .filter(|(_, (c, _))| c.deadline() <= now)
+            .map(|(&t, _)| t)
+            .collect();
+        for token in expired {
+            stats.counters.timeouts += 1;
+            close(&epoll, &mut conns, token, &mut stats);
+        }
+    }
+}
+
+/// Accept every pending connection, keeping the ones from root.
+fn accept_ready(
+    listener: &UnixListener,
+    epoll: &Epoll,
+    conns: &mut HashMap<u64, (Conn, EpollFlags)>,
+    next_token: &mut u64,
+    enforce_peer_root: bool,
+    stats: &mut Stats,
+    now: Instant,
+) {
+    loop {
+        let stream = match listener.accept() {
+            Ok((stream, _)) => stream,
+            Err(e) if e.kind() == io::ErrorKind::WouldBlock => return,
+            Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+            Err(e) => {
+                eprintln!("sentinel-broker: accept failed: {e}");
+                return;
+            }
+        };
+        if enforce_peer_root && !peer_is_root(&stream) {
+            stats.counters.peers_rejected += 1;
+            continue;
+        }
+        if conns.len() >= MAX_CONNS {
+            eprintln!("sentinel-broker: {MAX_CONNS} connections open, dropping a new one");
+            stats.counters.peers_rejected += 1;
+            continue;
+        }
+        let conn = match Conn::new(stream, now) {
+            Ok(c) => c,
+            Err(e) => {
+                eprintln!("sentinel-broker: accept: {e}");
+                continue;
+            }
+        };
+        let token = *next_token;
+        *next_token += 1;
+        let interest = EpollFlags::EPOLLIN;
+        if let Err(e) = epoll.add(conn.stream(), EpollEvent::new(interest, token)) {
+            eprintln!("sentinel-broker: epoll add: {e}");
+            continue;
+        }
+        conns.insert(token, (conn, interest));
+        stats.counters.connections_accepted += 1;
+        stats.counters.connections_open += 1;
+    }
+}
+
+/// Re-arm the connection for what it now waits on. `false` if epoll
+/// refused (the connection is then dropped).
+fn update_interest(epoll: &Epoll, token: u64, conn: &Conn, interest: &mut EpollFlags) -> bool {
+    let mut want = EpollFlags::empty();
+    want.set(EpollFlags::EPOLLIN, conn.wants_read());
+    want.set(EpollFlags::EPOLLOUT, conn.wants_write());
+    if want != *interest {
+        if epoll
+            .modify(conn.stream(), &mut EpollEvent::new(want, token))
+            .is_err()
+        {
+            return false;
+        }
+        *interest = want;
+    }
+    true
+}
+
+fn close(
+    epoll: &Epoll,
+    conns: &mut HashMap<u64, (Conn, EpollFlags)>,
+    token: u64,
+    stats: &mut Stats,
+) {
+    if let Some((conn, _)) = conns.remove(&token) {
+        let _ = epoll.delete(conn.stream());
+        stats.counters.connections_open -= 1;
     }
 }
 
@@ -62,37 +236,94 @@ fn peer_is_root(stream: &UnixStream) -> bool {
     }
 }
 
-/// Pure request → response. Separated from I/O so it is trivially testable.
-/// The deserialized [`RememberKey`] is validated into a `BoundKey` here —
-/// the single boundary where an unbound grant is turned away — so the
-/// store only ever sees bindable keys.
-pub fn dispatch(req: Request, store: &RememberStore) -> Response {
-    match req {
+/// Per-connection protocol state: the key of the last missed
+/// [`Request::SessionCheck`], which the one [`Request::SessionRecord`]
+/// allowed after it records.
+#[derive(Default)]
+pub struct Session {
+    missed: Option<BoundKey>,
+}
+
+impl Session {
+    /// A record is still allowed on this connection.
+    pub fn is_open(&self) -> bool {
+        self.missed.is_some()
+    }
+}
+
+/// Request → response. Separated from I/O so it is trivially testable.
+/// The deserialized [`RememberKey`](sentinel_broker_proto::RememberKey)
+/// is validated into a `BoundKey` here — the single boundary where an
+/// unbound grant is turned away — so the store only ever sees bindable
+/// keys.
+///
+/// Requests arrive borrowed from the connection's input buffer; a check
+/// looks the store up in place, and only a key that gets stored (a
+/// record, or a session's missed check) is copied out.
+pub fn dispatch(
+    req: Request<'_>,
+    store: &RememberStore,
+    session: &mut Session,
+    stats: &mut Stats,
+) -> Response {
+    let resp = match req {
         Request::Ping => Response::Pong {
             protocol: PROTOCOL_VERSION,
         },
-        Request::CheckRemember(q) => {
-            let ttl = q.ttl_secs;
-            Response::Remember {
-                fresh: q.key.bind().is_some_and(|k| store.is_fresh(&k, ttl)),
-            }
-        }
+        Request::CheckRemember(q) => Response::Remember {
+            fresh: q.key.bind().is_some_and(|k| store.is_fresh(&k, q.ttl_secs)),
+        },
         Request::RecordRemember(key) => match key.bind() {
-            Some(k) => {
-                store.record(&k);
-                Response::Recorded
-            }
+            Some(k) => record(store, k.to_owned_key()),
             None => Response::Error("unbindable key".into()),
         },
+        Request::SessionCheck(q) => {
+            // Any check replaces what an earlier one left open.
+            session.missed = None;
+            match q.key.bind() {
+                Some(k) => {
+                    let fresh = store.is_fresh(&k, q.ttl_secs);
+                    if !fresh {
+                        session.missed = Some(k.to_owned_key());
+                    }
+                    Response::Remember { fresh }
+                }
+                None => Response::Remember { fresh: false },
+            }
+        }
+        Request::SessionRecord => match session.missed.take() {
+            Some(k) => record(store, k),
+            None => Response::Error("record without a missed check".into()),
+        },
+        Request::Stats => Response::Stats(stats.snapshot(store)),
+    };
+    let c = &mut stats.counters;
+    match (&req, &resp) {
+        (Request::CheckRemember(_) | Request::SessionCheck(_), Response::Remember { fresh }) => {
+            c.checks += 1;
+            c.hits += u64::from(*fresh);
+        }
+        (Request::RecordRemember(_) | Request::SessionRecord, Response::Recorded) => {
+            c.records += 1;
+        }
+        (Request::RecordRemember(_) | Request::SessionRecord, _) => c.records_refused += 1,
+        _ => {}
+    }
+    resp
+}
+
+fn record(store: &RememberStore, key: BoundKey) -> Response {
+    if store.record(key) {
+        Response::Recorded
+    } else {
+        Response::Error("remember quota exceeded".into())
     }
 }
 
 #[cfg(test)]
 mod tests {
     use super::*;
-    use sentinel_broker_proto::{RememberKey, RememberQuery};
-    use std::os::unix::net::UnixListener;
-    use std::sync::Arc;
+    use sentinel_broker_proto::{RememberKey, RememberQuery, Request, read_frame, write_frame};
     use std::thread;
 
     fn key() -> RememberKey {
@@ -104,6 +335,15 @@ mod tests {
         }
     }
 
+    fn dispatch(req: Request, store: &RememberStore) -> Response {
+        super::dispatch(
+            req.as_borrowed(),
+            store,
+            &mut Session::default(),
+            &mut Stats::new(),
+        )
+    }
+
     #[test]
     fn dispatch_ping_record_check() {
         let store = RememberStore::new();
@@ -150,27 +390,142 @@ mod tests {
         ));
     }
 
+    fn session_check() -> Request {
+        Request::SessionCheck(RememberQuery {
+            key: key(),
+            ttl_secs: 60,
+        })
+    }
+
     #[test]
-    fn socket_round_trip() {
-        // End-to-end over a real Unix socket (peer-root check disabled
-        // since the test process isn't root). Exercises framing + dispatch.
-        let dir = std::env::temp_dir().join(format!("sentinel-broker-test-{}", std::process::id()));
+    fn session_records_the_missed_key_once() {
+        let store = RememberStore::new();
+        let mut s = Session::default();
+        assert!(matches!(
+            super::dispatch(
+                session_check().as_borrowed(),
+                &store,
+                &mut s,
+                &mut Stats::new()
+            ),
+            Response::Remember { fresh: false }
+        ));
+        assert!(s.is_open());
+        assert!(matches!(
+            super::dispatch(
+                Request::SessionRecord.as_borrowed(),
+                &store,
+                &mut s,
+                &mut Stats::new()
+            ),
+            Response::Recorded
+        ));
+        assert!(store.is_fresh(&key().as_borrowed().bind().unwrap(), 60));
+        // One record per miss.
+        assert!(matches!(
+            super::dispatch(
+                Request::SessionRecord.as_borrowed(),
+                &store,
+                &mut s,
+                &mut Stats::new()
+            ),
+            Response::Error(_)
+        ));
+    }
+
+    #[test]
+    fn session_record_without_a_miss_is_refused() {
+        let store = RememberStore::new();
+        let mut s = Session::default();
+        // No check at all.
+        assert!(matches!(
+            super::dispatch(
+                Request::SessionRecord.as_borrowed(),
+                &store,
+                &mut s,
+                &mut Stats::new()
+            ),
+            Response::Error(_)
+        ));
+        // A hit leaves nothing to record.
+        store.record(key().bind().unwrap());
+        super::dispatch(
+            session_check().as_borrowed(),
+            &store,
+            &mut s,
+            &mut Stats::new(),
+        );
+        assert!(!s.is_open());
+        assert!(matches!(
+            super::dispatch(
+                Request::SessionRecord.as_borrowed(),
+                &store,
+                &mut s,
+                &mut Stats::new()
+            ),
+            Response::Error(_)
+        ));
+        // An unbindable key never opens a session.
+        let mut k = key();
+        k.command.clear();
+        let q = Request::SessionCheck(RememberQuery {
+            key: k,
+            ttl_secs: 60,
+        });
+        assert!(matches!(
+            super::dispatch(q.as_borrowed(), &store, &mut s, &mut Stats::new()),
+            Response::Remember { fresh: false }
+        ));
+        assert!(!s.is_open());
+    }
+
+    #[test]
+    fn dispatch_counts_checks_hits_and_records() {
+        let store = RememberStore::new();
+        let mut session = Session::default();
+        let mut stats = Stats::new();
+        let mut run =
+            |req: Request| super::dispatch(req.as_borrowed(), &store, &mut session, &mut stats);
+        run(session_check());
+        run(Request::SessionRecord);
+        run(Request::SessionRecord); // refused: no miss left
+        run(session_check());
+        let Response::Stats(s) = run(Request::Stats) else {
+            panic!("no stats");
+        };
+        assert_eq!((s.checks, s.hits), (2, 1));
+        assert_eq!((s.records, s.records_refused), (1, 1));
+        assert_eq!(s.grants, 1);
+    }
+
+    /// Start the event loop on a fresh temp socket (peer-root check
+    /// disabled since the test process isn't root). The loop thread is
+    /// left running; it dies with the test process.
+    fn serve(tag: &str) -> std::path::PathBuf {
+        let dir =
+            std::env::temp_dir().join(format!("sentinel-broker-test-{tag}-{}", std::process::id()));
         let _ = std::fs::create_dir_all(&dir);
         let sock = dir.join("b.sock");
         let _ = std::fs::remove_file(&sock);
         let listener = UnixListener::bind(&sock).unwrap();
-        let store = Arc::new(RememberStore::new());
-
-        let srv_store = Arc::clone(&store);
-        let srv = thread::spawn(move || {
-            // Serve exactly two connections: a record then a check.
-            for _ in 0..2 {
-                let (stream, _) = listener.accept().unwrap();
-                handle(stream, &srv_store, false);
-            }
-        });
+        thread::spawn(move || run(listener, &RememberStore::new(), false));
+        sock
+    }
+
+    fn check() -> Request {
+        Request::CheckRemember(RememberQuery {
+            key: key(),
+            ttl_secs: 60,
+        })
+    }
+
+    #[test]
+    fn socket_round_trip() {
+        // End-to-end over a real Unix socket: a record on one
+        // connection, then a check on another. Exercises framing +
+        // dispatch through the event loop.
+        let sock = serve("rt");
 
-        // 1) record
         let mut c = UnixStream::connect(&sock).unwrap();
         write_frame(&mut c, &Request::RecordRemember(key())).unwrap();
         assert!(matches!(
@@ -179,23 +534,161 @@ mod tests {
         ));
         drop(c);
 
-        // 2) check → fresh
         let mut c = UnixStream::connect(&sock).unwrap();
-        write_frame(
-            &mut c,
-            &Request::CheckRemember(RememberQuery {
-                key: key(),
-                ttl_secs: 60,
-            }),
-        )
-        .unwrap();
+        write_frame(&mut c, &check()).unwrap();
         assert!(matches!(
             read_frame::<_, Response>(&mut c).unwrap(),
             Response::Remember { fresh: true }
         ));
-        drop(c);
+    }
+
+    #[test]
+    fn run_until_returns_when_stop_is_readable() {
+        let dir =
+            std::env::temp_dir().join(format!("sentinel-broker-test-stop-{}", std::process::id()));
+        let _ = std::fs::create_dir_all(&dir);
+        let sock = dir.join("b.sock");
+        let _ = std::fs::remove_file(&sock);
+        let listener = UnixListener::bind(&sock).unwrap();
+        let (mut tx, rx) = UnixStream::pair().unwrap();
+        let (done_tx, done) = std::sync::mpsc::channel();
+        thread::spawn(move || {
+            let r = run_until(listener, &RememberStore::new(), false, rx.as_fd());
+            done_tx.send(r.is_ok()).unwrap();
+        });
+        let mut c = UnixStream::connect(&sock).unwrap();
+        write_frame(&mut c, &Request::Ping).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut c).unwrap(),
+            Response::Pong { .. }
+        ));
+        std::io::Write::write_all(&mut tx, b"x").unwrap();
+        let stopped = done.recv_timeout(std::time::Duration::from_secs(5));
+        assert_eq!(stopped, Ok(true));
+    }
+
+    #[test]
+    fn one_connection_carries_many_requests() {
+        let sock = serve("persist");
+        let mut c = UnixStream::connect(&sock).unwrap();
+        c.set_read_timeout(Some(std::time::Duration::from_secs(5)))
+            .unwrap();
+        // Sequential...
+        for _ in 0..3 {
+            write_frame(&mut c, &Request::Ping).unwrap();
+            assert!(matches!(
+                read_frame::<_, Response>(&mut c).unwrap(),
+                Response::Pong { .. }
+            ));
+        }
+        // ...and pipelined: all frames out before any reply is read.
+        let mut burst = Vec::new();
+        write_frame(&mut burst, &check()).unwrap();
+        write_frame(&mut burst, &Request::RecordRemember(key())).unwrap();
+        write_frame(&mut burst, &check()).unwrap();
+        std::io::Write::write_all(&mut c, &burst).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut c).unwrap(),
+            Response::Remember { fresh: false }
+        ));
+        assert!(matches!(
+            read_frame::<_, Response>(&mut c).unwrap(),
+            Response::Recorded
+        ));
+        assert!(matches!(
+            read_frame::<_, Response>(&mut c).unwrap(),
+            Response::Remember { fresh: true }
+        ));
+    }
 
-        srv.join().unwrap();
-        let _ = std::fs::remove_dir_all(&dir);
+    #[test]
+    fn session_is_bound_to_its_connection() {
+        let sock = serve("session");
+        let mut a = UnixStream::connect(&sock).unwrap();
+        write_frame(&mut a, &session_check()).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut a).unwrap(),
+            Response::Remember { fresh: false }
+        ));
+        // Another connection can't ride on `a`'s miss...
+        let mut b = UnixStream::connect(&sock).unwrap();
+        write_frame(&mut b, &Request::SessionRecord).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut b).unwrap(),
+            Response::Error(_)
+        ));
+        // ...`a` itself can.
+        write_frame(&mut a, &Request::SessionRecord).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut a).unwrap(),
+            Response::Recorded
+        ));
+        write_frame(&mut b, &check()).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut b).unwrap(),
+            Response::Remember { fresh: true }
+        ));
+    }
+
+    #[test]
+    fn stats_over_the_socket() {
+        let sock = serve("stats");
+        let mut c = UnixStream::connect(&sock).unwrap();
+        write_frame(&mut c, &check()).unwrap();
+        read_frame::<_, Response>(&mut c).unwrap();
+        write_frame(&mut c, &Request::Stats).unwrap();
+        let Response::Stats(s) = read_frame::<_, Response>(&mut c).unwrap() else {
+            panic!("no stats");
+        };
+        assert_eq!((s.checks, s.hits), (1, 0));
+        assert_eq!(s.connections_open, 1);
+        assert_eq!(s.connections_accepted, 1);
+        // The check's dispatch is in; the Stats request's own isn't yet.
+        assert_eq!(s.dispatch.count(), 1);
+        assert!(s.io.count() >= 1);
+    }
+
+    #[test]
+    fn stalled_peer_does_not_block_others() {
+        let sock = serve("stall");
+        // Half a frame, then silence: the old one-shot handler would park
+        // a thread on this for IO_TIMEOUT.
+        let mut stalled = UnixStream::connect(&sock).unwrap();
+        std::io::Write::write_all(&mut stalled, &[9, 0]).unwrap();
+
+        let clients: Vec<_> = (0..8)
+            .map(|_| {
+                let sock = sock.clone();
+                thread::spawn(move || {
+                    let mut c = UnixStream::connect(&sock).unwrap();
+                    c.set_read_timeout(Some(std::time::Duration::from_secs(2)))
+                        .unwrap();
+                    write_frame(&mut c, &Request::Ping).unwrap();
+                    matches!(read_frame::<_, Response>(&mut c), Ok(Response::Pong { .. }))
+                })
+            })
+            .collect();
+        for c in clients {
+            assert!(c.join().unwrap());
+        }
+        drop(stalled);
+    }
+
+    #[test]
+    fn bad_frame_drops_only_that_connection() {
+        let sock = serve("bad");
+        let mut bad = UnixStream::connect(&sock).unwrap();
+        bad.set_read_timeout(Some(std::time::Duration::from_secs(2)))
+            .unwrap();
+        std::io::Write::write_all(&mut bad, &u32::MAX.to_le_bytes()).unwrap();
+        // Closed without a reply.
+        assert!(read_frame::<_, Response>(&mut bad).is_err());
+
+        let mut good = UnixStream::connect(&sock).unwrap();
+        write_frame(&mut good, &Request::Ping).unwrap();
+        assert!(matches!(
+            read_frame::<_, Response>(&mut good).unwrap(),
+            Response::Pong { .. }
+        ));
     }
 }
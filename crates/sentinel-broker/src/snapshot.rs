@@ -0,0 +1,372 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Grants that survive a broker restart without ever touching disk.
+//!
+//! On a clean stop (SIGTERM: `systemctl restart`, a package upgrade) the
+//! broker writes its live grants into a memfd, seals it against any
+//! further change and hands it to systemd's file descriptor store
+//! (`FileDescriptorStoreMax=` in the unit). The next broker receives it
+//! in `LISTEN_FDS`, restores whatever is still live, and removes it from
+//! the store, so a snapshot is used at most once. A memfd is anonymous
+//! memory: the store's "no on-disk artifact" property holds, and a
+//! reboot or a stopped unit drops it like the rest of the broker's
+//! memory. A crash takes no snapshot; those users are prompted again.
+//!
+//! `Instant`s mean nothing to another process, so each grant is written
+//! with the `CLOCK_MONOTONIC` time it was recorded (the system-wide clock
+//! `Instant` reads on Linux) and turned back into an age on restore.
+//!
+//! Fail-closed: a snapshot that isn't fully sealed, is oversized or
+//! malformed, claims a time in the future, holds a key that doesn't bind
+//! or breaks a quota is discarded whole.
+
+use crate::store::RememberStore;
+use nix::fcntl::{FcntlArg, SealFlag, fcntl};
+use nix::sys::memfd::{MFdFlags, memfd_create};
+use nix::sys::socket::{
+    AddressFamily, ControlMessage, MsgFlags, SockFlag, SockType, UnixAddr, sendmsg, socket,
+};
+use nix::time::{ClockId, clock_gettime};
+use sentinel_broker_proto::RememberKey;
+use sentinel_shared::grants::{DEFAULT_TOTAL, MAX_REMEMBER};
+use serde::{Deserialize, Serialize};
+use std::fs::File;
+use std::io::{self, IoSlice, Write};
+use std::os::fd::{AsFd, AsRawFd, BorrowedFd, FromRawFd, OwnedFd, RawFd};
+use std::os::unix::fs::FileExt;
+use std::time::{Duration, Instant};
+
+/// `FDNAME=` of the snapshot in the FD store.
+const FD_NAME: &str = "grants";
+
+/// Leads every snapshot; the last byte is the format version.
+const MAGIC: [u8; 8] = *b"SNTLGRT\x01";
+
+/// Far above [`DEFAULT_TOTAL`] grants of any sane size.
+const MAX_SNAPSHOT: u64 = 32 << 20;
+
+/// `SD_LISTEN_FDS_START`: passed descriptors start here.
+const LISTEN_FDS_START: RawFd = 3;
+
+/// What makes the memfd immutable: nothing can write, resize or unseal it.
+fn seals() -> SealFlag {
+    SealFlag::F_SEAL_SEAL | SealFlag::F_SEAL_SHRINK | SealFlag::F_SEAL_GROW | SealFlag::F_SEAL_WRITE
+}
+
+#[derive(Serialize, Deserialize)]
+struct Snapshot {
+    /// `CLOCK_MONOTONIC` when it was taken, in ns.
+    taken_ns: u64,
+    grants: Vec<Saved>,
+}
+
+#[derive(Serialize, Deserialize)]
+struct Saved {
+    key: RememberKey,
+    /// `CLOCK_MONOTONIC` when the grant was recorded, in ns.
+    recorded_ns: u64,
+}
+
+fn invalid(why: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, why.to_string())
+}
+
+fn monotonic_ns() -> io::Result<u64> {
+    let t = clock_gettime(ClockId::CLOCK_MONOTONIC)?;
+    Ok(t.tv_sec() as u64 * 1_000_000_000 + t.tv_nsec() as u64)
+}
+
+/// The store as of `now`, which is `now_ns` on `CLOCK_MONOTONIC`, and
+/// how many grants that is.
+fn encode(store: &RememberStore, now: Instant, now_ns: u64) -> io::Result<(Vec<u8>, usize)> {
+    let grants: Vec<_> = store
+        .export(now)
+        .into_iter()
+        .map(|(key, age)| Saved {
+            key,
+            recorded_ns: now_ns.saturating_sub(age.as_nanos() as u64),
+        })
+        .collect();
+    let n = grants.len();
+    let body = postcard::to_allocvec(&Snapshot {
+        taken_ns: now_ns,
+        grants,
+    })
+    .map_err(io::Error::other)?;
+    Ok(([&MAGIC[..], &body].concat(), n))
+}
+
+/// A fresh store holding the snapshot's grants that are still live at
+/// `now` (`now_ns`), or an error if any part of it is off.
+fn decode(bytes: &[u8], now: Instant, now_ns: u64) -> io::Result<RememberStore> {
+    let body = bytes
+        .strip_prefix(&MAGIC[..])
+        .ok_or_else(|| invalid("bad magic"))?;
+    let snap: Snapshot = postcard::from_bytes(body).map_err(|e| invalid(&e.to_string()))?;
+    if snap.taken_ns > now_ns {
+        return Err(invalid("taken in the future"));
+    }
+    if snap.grants.len() > DEFAULT_TOTAL {
+        return Err(invalid("too many grants"));
+    }
+    let store = RememberStore::new();
+    for g in snap.grants {
+        if g.recorded_ns > snap.taken_ns {
+            return Err(invalid("grant recorded after the snapshot"));
+        }
+        let key = g.key.bind().ok_or_else(|| invalid("unbindable key"))?;
+        let age = Duration::from_nanos(now_ns - g.recorded_ns);
+        if age >= MAX_REMEMBER {
+            continue; // expired while no broker was running
+        }
+        if !store.restore(key, age, now) {
+            return Err(invalid("grant over quota"));
+        }
+    }
+    Ok(store)
+}
+
+/// `bytes` in a new memfd, sealed.
+fn seal(bytes: &[u8]) -> io::Result<OwnedFd> {
+    let fd = memfd_create(
+        c"sentinel-broker-grants",
+        MFdFlags::MFD_CLOEXEC | MFdFlags::MFD_ALLOW_SEALING,
+    )?;
+    let mut file = File::from(fd);
+    file.write_all(bytes)?;
+    fcntl(&file, FcntlArg::F_ADD_SEALS(seals()))?;
+    Ok(file.into())
+}
+
+/// Read back a memfd made by [`seal`], checking it is still sealed.
+fn load(fd: OwnedFd, now: Instant, now_ns: u64) -> io::Result<RememberStore> {
+    let held = SealFlag::from_bits_truncate(fcntl(&fd, FcntlArg::F_GET_SEALS)?);
+    if !held.contains(seals()) {
+        return Err(invalid("not sealed"));
+    }
+    let file = File::from(fd);
+    let len = file.metadata()?.len();
+    if len > MAX_SNAPSHOT {
+        return Err(invalid("oversized"));
+    }
+    let mut bytes = vec![0; len as usize];
+    file.read_exact_at(&mut bytes, 0)?;
+    decode(&bytes, now, now_ns)
+}
+
+/// Seal the store's live grants into a memfd and hand it to systemd's
+/// FD store. Returns how many grants went.
+pub fn save(store: &RememberStore) -> io::Result<usize> {
+    let (now, now_ns) = (Instant::now(), monotonic_ns()?);
+    let (bytes, n) = encode(store, now, now_ns)?;
+    let fd = seal(&bytes)?;
+    notify(&format!("FDSTORE=1\nFDNAME={FD_NAME}"), Some(fd.as_fd()))?;
+    Ok(n)
+}
+
+/// The store to start with: the previous broker's grants if it left a
+/// valid snapshot, else an empty one.
+pub fn restore() -> RememberStore {
+    let Some(fd) = stored_fd() else {
+        return RememberStore::new();
+    };
+    // Used at most once, valid or not.
+    if let Err(e) = notify(&format!("FDSTOREREMOVE=1\nFDNAME={FD_NAME}"), None) {
+        eprintln!("sentinel-broker: could not drop the grant snapshot: {e}");
+    }
+    let store = monotonic_ns().and_then(|now_ns| load(fd, Instant::now(), now_ns));
+    match store {
+        Ok(store) => {
+            eprintln!(
+                "sentinel-broker: restored {} grants from the fd store",
+                store.grants()
+            );
+            store
+        }
+        Err(e) => {
+            eprintln!("sentinel-broker: discarding the grant snapshot: {e}");
+            RememberStore::new()
+        }
+    }
+}
+
+/// The snapshot systemd passed in, if any.
+fn stored_fd() -> Option<OwnedFd> {
+    let pid: u32 = std::env::var("LISTEN_PID").ok()?.parse().ok()?;
+    if pid != std::process::id() {
+        return None;
+    }
+    let n: usize = std::env::var("LISTEN_FDS").ok()?.parse().ok()?;
+    let names = std::env::var("LISTEN_FDNAMES").ok()?;
+    let i = names.split(':').take(n).position(|name| name == FD_NAME)?;
+    let fd = LISTEN_FDS_START + RawFd::try_from(i).ok()?;
+    // SAFETY: systemd passed `fd` to this process (LISTEN_PID is ours)
+    // as the `grants` entry of LISTEN_FDS; nothing else in the broker
+    // knows it, and `stored_fd` runs once, so this is its only owner.
+    #[allow(unsafe_code)]
+    Some(unsafe { OwnedFd::from_raw_fd(fd) })
+}
+
+/// One `sd_notify` datagram, optionally carrying `fd`.
+fn notify(msg: &str, fd: Option<BorrowedFd<'_>>) -> io::Result<()> {
+    let path = std::env::var("NOTIFY_SOCKET")
+        .map_err(|_| io::Error::new(io::ErrorKind::NotFound, "NOTIFY_SOCKET is not set"))?;
+    let addr = match path.strip_prefix('@') {
+        Some(name) => UnixAddr::new_abstract(name.as_bytes())?,
+        None => UnixAddr::new(path.as_str())?,
+    };
+    let sock = socket(
+        AddressFamily::Unix,
+        SockType::Datagram,
+        SockFlag::SOCK_CLOEXEC,
+        None,
+    )?;
+    let fds = fd.map(|fd| [fd.as_raw_fd()]);
+    let cmsgs: Vec<_> = fds.iter().map(|f| ControlMessage::ScmRights(f)).collect();
+    sendmsg(
+        sock.as_raw_fd(),
+        &[IoSlice::new(msg.as_bytes())],
+        &cmsgs,
+        MsgFlags::empty(),
+        Some(&addr),
+    )?;
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const S: u64 = 1_000_000_000;
+
+    fn key(cmd: &str) -> RememberKey {
+        RememberKey {
+            loginuid: 1000,
+            sessionid: 3,
+            service: "sudo".into(),
+            command: cmd.into(),
+        }
+    }
+
+    fn fresh(s: &RememberStore, cmd: &str, ttl_secs: u32) -> bool {
+        s.is_fresh(&key(cmd).as_borrowed().bind().unwrap(), ttl_secs)
+    }
+
+    fn snapshot(taken_ns: u64, grants: Vec<Saved>) -> Vec<u8> {
+        let body = postcard::to_allocvec(&Snapshot { taken_ns, grants }).unwrap();
+        [&MAGIC[..], &body].concat()
+    }
+
+    #[test]
+    fn round_trip_keeps_grants_and_their_age() {
+        let (now, now_ns) = (Instant::now(), 5_000 * S);
+        let s = RememberStore::new();
+        s.record(key("pacman -Syu").bind().unwrap());
+        let (bytes, _) = encode(&s, now, now_ns).unwrap();
+        // Restored by a broker started 30 s later.
+        let restored = decode(&bytes, Instant::now(), now_ns + 30 * S).unwrap();
+        assert_eq!(restored.grants(), 1);
+        assert!(fresh(&restored, "pacman -Syu", 60));
+        assert!(!fresh(&restored, "pacman -Syu", 30), "30 s already passed");
+        assert!(!fresh(&restored, "pacman -U /tmp/x", 60));
+    }
+
+    #[test]
+    fn grants_that_expired_meanwhile_are_dropped() {
+        let now_ns = 5_000 * S;
+        let bytes = snapshot(
+            now_ns,
+            vec![
+                Saved {
+                    key: key("old"),
+                    recorded_ns: now_ns - 800 * S,
+                },
+                Saved {
+                    key: key("new"),
+                    recorded_ns: now_ns - 10 * S,
+                },
+            ],
+        );
+        let s = decode(&bytes, Instant::now(), now_ns + 200 * S).unwrap();
+        assert_eq!(s.grants(), 1);
+        assert!(fresh(&s, "new", 900));
+    }
+
+    #[test]
+    fn invalid_snapshots_are_discarded_whole() {
+        let now = Instant::now();
+        let ok = |cmd: &str, recorded_ns| Saved {
+            key: key(cmd),
+            recorded_ns,
+        };
+        let unbound = key("");
+        let cases = [
+            ("bad magic", {
+                let mut b = snapshot(100 * S, vec![ok("a", 90 * S)]);
+                b[0] ^= 1;
+                b
+            }),
+            ("truncated", {
+                let b = snapshot(100 * S, vec![ok("a", 90 * S)]);
+                b[..b.len() - 3].to_vec()
+            }),
+            (
+                "taken in the future",
+                snapshot(300 * S, vec![ok("a", 90 * S)]),
+            ),
+            (
+                "recorded after the snapshot",
+                snapshot(100 * S, vec![ok("a", 90 * S), ok("b", 110 * S)]),
+            ),
+            (
+                "unbindable key",
+                snapshot(
+                    100 * S,
+                    vec![
+                        ok("a", 90 * S),
+                        Saved {
+                            key: unbound,
+                            recorded_ns: 90 * S,
+                        },
+                    ],
+                ),
+            ),
+            (
+                "over quota",
+                snapshot(
+                    100 * S,
+                    (0..=sentinel_shared::grants::DEFAULT_PER_OWNER)
+                        .map(|i| ok(&format!("cmd {i}"), 90 * S))
+                        .collect(),
+                ),
+            ),
+        ];
+        for (what, bytes) in cases {
+            assert!(decode(&bytes, now, 200 * S).is_err(), "{what}");
+        }
+    }
+
+    #[test]
+    fn only_a_sealed_memfd_is_loaded() {
+        let s = RememberStore::new();
+        s.record(key("pacman -Syu").bind().unwrap());
+        let (now, now_ns) = (Instant::now(), monotonic_ns().unwrap());
+        let (bytes, _) = encode(&s, now, now_ns).unwrap();
+
+        let fd = seal(&bytes).unwrap();
+        assert!(
+            File::from(fd.try_clone().unwrap())
+                .write_at(b"X", 0)
+                .is_err(),
+            "sealed against writes"
+        );
+        let restored = load(fd, now, now_ns).unwrap();
+        assert!(fresh(&restored, "pacman -Syu", 60));
+
+        let unsealed = memfd_create(c"test", MFdFlags::MFD_CLOEXEC).unwrap();
+        File::from(unsealed.try_clone().unwrap())
+            .write_all(&bytes)
+            .unwrap();
+        assert!(load(unsealed, now, now_ns).is_err());
+    }
+}
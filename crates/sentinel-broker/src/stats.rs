@@ -0,0 +1,143 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Live counters, and the `sentinel-broker stats` client that prints
+//! them.
+//!
+//! The event loop owns one [`Stats`] and bumps it as it goes (it is the
+//! only thread, so plain integers). A root client asks for a snapshot
+//! with `Request::Stats` over the same socket as everything else; the
+//! hit ratio tells whether `remember_seconds` is long enough to matter,
+//! and the latency histograms show a degraded broker before extra
+//! prompts do.
+
+use crate::store::RememberStore;
+use sentinel_broker_proto::{BrokerStats, Histogram, Request, Response, read_frame, write_frame};
+use std::fmt::Write as _;
+use std::io;
+use std::os::unix::net::UnixStream;
+use std::time::{Duration, Instant};
+
+pub struct Stats {
+    started: Instant,
+    pub counters: BrokerStats,
+}
+
+impl Default for Stats {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Stats {
+    pub fn new() -> Self {
+        Self {
+            started: Instant::now(),
+            counters: BrokerStats::default(),
+        }
+    }
+
+    pub fn dispatch(&mut self, d: Duration) {
+        self.counters.dispatch.record(d);
+    }
+
+    pub fn io(&mut self, d: Duration) {
+        self.counters.io.record(d);
+    }
+
+    pub fn snapshot(&self, store: &RememberStore) -> BrokerStats {
+        BrokerStats {
+            uptime_secs: self.started.elapsed().as_secs(),
+            grants: store.grants() as u64,
+            ..self.counters.clone()
+        }
+    }
+}
+
+/// `sentinel-broker stats`: fetch a snapshot from the broker at `sock`
+/// and print it.
+pub fn print(sock: &str) -> io::Result<()> {
+    let mut s = UnixStream::connect(sock)?;
+    s.set_read_timeout(Some(Duration::from_secs(2)))?;
+    s.set_write_timeout(Some(Duration::from_secs(2)))?;
+    write_frame(&mut s, &Request::Stats).map_err(io::Error::other)?;
+    match read_frame::<_, Response>(&mut s).map_err(io::Error::other)? {
+        Response::Stats(stats) => {
+            print!("{}", render(&stats));
+            Ok(())
+        }
+        other => Err(io::Error::other(format!("unexpected reply: {other:?}"))),
+    }
+}
+
+fn render(s: &BrokerStats) -> String {
+    let mut out = String::new();
+    let ratio = if s.checks == 0 {
+        "-".to_string()
+    } else {
+        format!("{:.1}%", s.hits as f64 * 100.0 / s.checks as f64)
+    };
+    let _ = writeln!(out, "uptime          {}s", s.uptime_secs);
+    let _ = writeln!(out, "grants          {}", s.grants);
+    let _ = writeln!(
+        out,
+        "checks          {} ({} hits, {ratio})",
+        s.checks, s.hits
+    );
+    let _ = writeln!(
+        out,
+        "records         {} ({} refused)",
+        s.records, s.records_refused
+    );
+    let _ = writeln!(
+        out,
+        "connections     {} open, {} accepted, {} rejected",
+        s.connections_open, s.connections_accepted, s.peers_rejected
+    );
+    let _ = writeln!(
+        out,
+        "dropped         {} bad frames, {} timeouts",
+        s.frame_errors, s.timeouts
+    );
+    for (name, h) in [("dispatch", &s.dispatch), ("socket io", &s.io)] {
+        let _ = writeln!(out, "{name:<15} {}", summary(h));
+    }
+    out
+}
+
+fn summary(h: &Histogram) -> String {
+    let (Some(mean), Some(p50), Some(p99), Some(max)) =
+        (h.mean(), h.quantile(0.5), h.quantile(0.99), h.quantile(1.0))
+    else {
+        return "no samples".into();
+    };
+    // Quantiles are bucket upper bounds, hence the ≤.
+    format!(
+        "n={} mean={mean:.1?} p50≤{p50:.1?} p99≤{p99:.1?} max≤{max:.1?}",
+        h.count()
+    )
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn render_shows_ratio_and_latencies() {
+        let mut s = BrokerStats {
+            checks: 4,
+            hits: 1,
+            ..BrokerStats::default()
+        };
+        s.dispatch.record(Duration::from_micros(3));
+        let out = render(&s);
+        assert!(out.contains("checks          4 (1 hits, 25.0%)"), "{out}");
+        assert!(out.contains("dispatch        n=1 "), "{out}");
+        assert!(out.contains("socket io       no samples"), "{out}");
+    }
+
+    #[test]
+    fn render_without_checks_has_no_ratio() {
+        let out = render(&BrokerStats::default());
+        assert!(out.contains("checks          0 (0 hits, -)"), "{out}");
+    }
+}
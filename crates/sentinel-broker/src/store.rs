@@ -9,26 +9,25 @@
 //! than cryptographically patched. Freshness uses the monotonic
 //! [`Instant`] clock, so it is immune to wall-clock manipulation, and the
 //! whole store evaporates when the broker stops (fail-closed: clients
-//! re-prompt).
+//! re-prompt) — unless it stopped cleanly and handed its grants to the
+//! next broker through a sealed memfd in systemd's FD store, which is
+//! still memory, never a file (see [`crate::snapshot`]).
 //!
 //! The API accepts only a [`BoundKey`] — a [`RememberKey`] proven bindable
 //! — so "act on an unbound grant" is unrepresentable (the check happens
 //! once, at the [`RememberKey::bind`] boundary in `dispatch`).
 
-use sentinel_broker_proto::{BoundKey, RememberKey};
-use std::collections::HashMap;
-use std::sync::Mutex;
+use sentinel_broker_proto::{BoundKey, RememberKey, borrowed};
+use sentinel_shared::grants::{GrantStore, Probe};
+use std::hash::{Hash, Hasher};
 use std::time::{Duration, Instant};
 
-/// Hard ceiling on any remember window, regardless of the ttl a client
-/// requests — bounds the blast radius of an over-generous config (mirrors
-/// the former on-disk store's 900 s cap).
-pub const MAX_REMEMBER: Duration = Duration::from_secs(900);
-
-/// Process-local remember grants, keyed by the full [`RememberKey`].
+/// Process-local remember grants, keyed by the full [`RememberKey`] and
+/// owned by its `loginuid` (the per-user quota). A check hashes the key
+/// in place and allocates nothing.
 #[derive(Default)]
 pub struct RememberStore {
-    inner: Mutex<HashMap<String, Instant>>,
+    grants: GrantStore<RememberKey>,
 }
 
 impl RememberStore {
@@ -36,34 +35,64 @@ impl RememberStore {
         Self::default()
     }
 
-    /// NUL-separated so no field boundary can be spoofed by embedding a
-    /// separator in (say) the command.
-    fn keystr(k: &RememberKey) -> String {
-        format!(
-            "{}\0{}\0{}\0{}",
-            k.loginuid, k.sessionid, k.service, k.command
+    /// True iff a non-expired grant exists for `key` within `ttl_secs`
+    /// (capped at [`MAX_REMEMBER`](sentinel_shared::grants::MAX_REMEMBER),
+    /// the former on-disk store's 900 s). A zero ttl never matches.
+    /// Bindability is guaranteed by the [`BoundKey`] type.
+    pub fn is_fresh(&self, key: &BoundKey<borrowed::RememberKey<'_>>, ttl_secs: u32) -> bool {
+        let key = key.key();
+        self.grants.is_fresh(
+            key.loginuid,
+            &Lookup(key),
+            Duration::from_secs(ttl_secs.into()),
         )
     }
 
-    /// True iff a non-expired grant exists for `key` within its (capped)
-    /// ttl. A zero ttl never matches. Bindability is guaranteed by the
-    /// [`BoundKey`] type.
-    pub fn is_fresh(&self, key: &BoundKey, ttl_secs: u32) -> bool {
-        if ttl_secs == 0 {
+    /// Live grants (for `Request::Stats`).
+    pub fn grants(&self) -> usize {
+        self.grants.len()
+    }
+
+    /// Record/refresh a grant. `false` if the user (or the broker) is at
+    /// its grant quota; the client then simply prompts next time.
+    pub fn record(&self, key: BoundKey) -> bool {
+        let key = key.into_key();
+        self.grants.record(key.loginuid, key)
+    }
+
+    /// Every grant still live at `now`, with its age.
+    pub fn export(&self, now: Instant) -> Vec<(RememberKey, Duration)> {
+        let mut out = Vec::with_capacity(self.grants.len());
+        self.grants
+            .for_each_at(now, |_, key, age| out.push((key.clone(), age)));
+        out
+    }
+
+    /// Put back a grant that was `age` old at `now` (handed over by the
+    /// previous broker). `false` if it was refused by a quota, or is older
+    /// than the clock can represent.
+    pub fn restore(&self, key: BoundKey, age: Duration, now: Instant) -> bool {
+        let Some(recorded) = now.checked_sub(age) else {
             return false;
-        }
-        let ttl = Duration::from_secs(ttl_secs as u64).min(MAX_REMEMBER);
-        let map = self.inner.lock().expect("store mutex poisoned");
-        map.get(&Self::keystr(key.key()))
-            .is_some_and(|t| t.elapsed() < ttl)
+        };
+        let key = key.into_key();
+        self.grants.record_at(key.loginuid, key, recorded)
     }
+}
+
+/// A decoded-in-place key standing in for the owned one it matches.
+struct Lookup<'k, 'a>(&'k borrowed::RememberKey<'a>);
 
-    /// Record/refresh a grant. Opportunistically prunes entries past the
-    /// hard cap so the map can't grow unbounded.
-    pub fn record(&self, key: &BoundKey) {
-        let mut map = self.inner.lock().expect("store mutex poisoned");
-        map.retain(|_, t| t.elapsed() < MAX_REMEMBER);
-        map.insert(Self::keystr(key.key()), Instant::now());
+impl Hash for Lookup<'_, '_> {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        // Same derived field hashing as `RememberKey`.
+        self.0.hash(state);
+    }
+}
+
+impl Probe<RememberKey> for Lookup<'_, '_> {
+    fn matches(&self, k: &RememberKey) -> bool {
+        *self.0 == k.as_borrowed()
     }
 }
 
@@ -82,15 +111,18 @@ mod tests {
         .expect("test key is bindable")
     }
 
+    /// Check the way `dispatch` does: through a borrowed key.
+    fn fresh(s: &RememberStore, cmd: &str, ttl_secs: u32) -> bool {
+        let k = bound(cmd).into_key();
+        s.is_fresh(&k.as_borrowed().bind().unwrap(), ttl_secs)
+    }
+
     #[test]
     fn record_then_fresh() {
         let s = RememberStore::new();
-        assert!(
-            !s.is_fresh(&bound("pacman -Syu"), 60),
-            "nothing recorded yet"
-        );
-        s.record(&bound("pacman -Syu"));
-        assert!(s.is_fresh(&bound("pacman -Syu"), 60));
+        assert!(!fresh(&s, "pacman -Syu", 60), "nothing recorded yet");
+        s.record(bound("pacman -Syu"));
+        assert!(fresh(&s, "pacman -Syu", 60));
     }
 
     #[test]
@@ -98,14 +130,14 @@ mod tests {
         // The argv-binding guarantee at the broker layer: a different
         // command (same program) must not match.
         let s = RememberStore::new();
-        s.record(&bound("pacman -Syu"));
-        assert!(!s.is_fresh(&bound("pacman -U /tmp/evil"), 60));
+        s.record(bound("pacman -Syu"));
+        assert!(!fresh(&s, "pacman -U /tmp/evil", 60));
     }
 
     #[test]
     fn distinct_service_user_session_dont_match() {
         let s = RememberStore::new();
-        s.record(&bound("pacman -Syu"));
+        s.record(bound("pacman -Syu"));
         for mutate in [
             |k: &mut RememberKey| k.service = "su".into(),
             |k: &mut RememberKey| k.loginuid = 1001,
@@ -118,15 +150,28 @@ mod tests {
                 command: "pacman -Syu".into(),
             };
             mutate(&mut k);
-            assert!(!s.is_fresh(&k.bind().unwrap(), 60));
+            assert!(!s.is_fresh(&k.as_borrowed().bind().unwrap(), 60));
         }
     }
 
     #[test]
     fn zero_ttl_never_fresh() {
         let s = RememberStore::new();
-        s.record(&bound("pacman -Syu"));
-        assert!(!s.is_fresh(&bound("pacman -Syu"), 0));
+        s.record(bound("pacman -Syu"));
+        assert!(!fresh(&s, "pacman -Syu", 0));
+    }
+
+    #[test]
+    fn per_user_quota_refuses_new_grants() {
+        let s = RememberStore::new();
+        let n = sentinel_shared::grants::DEFAULT_PER_OWNER;
+        for i in 0..n {
+            assert!(s.record(bound(&format!("cmd {i}"))));
+        }
+        assert!(!s.record(bound("one too many")));
+        assert!(!fresh(&s, "one too many", 60));
+        // A refresh of a held grant still goes through.
+        assert!(s.record(bound("cmd 0")));
     }
 
     #[test]
@@ -1,15 +1,27 @@
 // SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
 // SPDX-License-Identifier: GPL-3.0-or-later
 //! Build script: generate + compile the C++ side of the `#[cxx_qt::bridge]`,
-//! register the `DialogController` QObject, and **embed the QML into the
+//! register the `DialogController` / `DialogService` QObjects, and **embed the QML into the
 //! binary** (qrc) so it can't be tampered with on disk to bypass the prompt.
 //!
 //! No C++ shim and no `layer-shell-qt6-devel` are needed: the layer-shell
 //! overlay is configured from QML via the installed `org.kde.layershell`
 //! plugin, and the Wayland integration is selected at runtime by the
 //! `QT_WAYLAND_SHELL_INTEGRATION=layer-shell` env var (see `main.rs`).
+//!
+//! The QML is also **compiled ahead of time**: when Qt's `qmlcachegen` is
+//! installed, cxx-qt-build runs it over every module file and links the
+//! result in, so a spawn loads precompiled units (bindings and functions
+//! as native code where the types are known, bytecode otherwise) instead
+//! of parsing and compiling the sources before the first frame. The qrc
+//! sources stay embedded next to the units, so the binary remains the
+//! only thing that defines the dialog. A build without `qmlcachegen`
+//! still works but compiles at runtime; set `SENTINEL_REQUIRE_QML_AOT=1`
+//! (release bundles and CI do) to make that a build error instead.
 
 use cxx_qt_build::{CxxQtBuilder, QmlModule};
+use std::path::PathBuf;
+use std::process::Command;
 
 fn main() {
     // GCC 16's -Wsfinae-incomplete fires inside Qt6's own headers (qchar.h)
@@ -26,10 +38,22 @@ fn main() {
     // cxx-qt-build doesn't reliably emit rerun-if-changed for the QML, so a
     // bare `.qml` edit wouldn't re-embed the qrc — you'd ship stale UI.
     // Declare them explicitly so editing a dialog file triggers a rebuild.
-    for f in ["Main", "Windowed", "DialogCard", "DetailRow"] {
+    for f in ["Main", "Windowed", "Service", "DialogCard", "DetailRow"] {
         println!("cargo:rerun-if-changed=qml/{f}.qml");
     }
 
+    println!("cargo:rerun-if-env-changed=SENTINEL_REQUIRE_QML_AOT");
+    println!("cargo:rerun-if-env-changed=QMAKE");
+    if find_qmlcachegen().is_none() {
+        let msg = "qmlcachegen not found next to qmake: the dialog QML will be \
+                   compiled at runtime on every spawn (install Qt's QML \
+                   development tools for ahead-of-time compilation)";
+        if std::env::var("SENTINEL_REQUIRE_QML_AOT").is_ok_and(|v| v == "1") {
+            panic!("{msg}");
+        }
+        println!("cargo:warning={msg}");
+    }
+
     CxxQtBuilder::new_qml_module(
         // The QML files are baked into the module's qrc (loaded as
         // `qrc:/qt/qml/org/sentinel/kde/qml/<file>`), so the installed
@@ -37,6 +61,7 @@ fn main() {
         QmlModule::new("org.sentinel.kde").qml_files([
             "qml/Main.qml",
             "qml/Windowed.qml",
+            "qml/Service.qml",
             "qml/DialogCard.qml",
             "qml/DetailRow.qml",
         ]),
@@ -48,6 +73,29 @@ fn main() {
     .qt_module("Qml")
     .qt_module("Quick")
     .qt_module("Widgets")
-    .files(["src/bridge.rs"])
+    .files(["src/bridge.rs", "src/service.rs"])
     .build();
 }
+
+/// Locate `qmlcachegen` the way cxx-qt-build does: through the `qmake`
+/// it builds against (`$QMAKE`, else `qmake6` / `qmake` on `PATH`),
+/// looking in Qt's libexec and bin directories.
+fn find_qmlcachegen() -> Option<PathBuf> {
+    let candidates = match std::env::var("QMAKE") {
+        Ok(qmake) => vec![qmake],
+        Err(_) => vec!["qmake6".to_owned(), "qmake".to_owned()],
+    };
+    let query = |qmake: &str, var: &str| -> Option<PathBuf> {
+        let out = Command::new(qmake).args(["-query", var]).output().ok()?;
+        let dir = String::from_utf8(out.stdout).ok()?;
+        let dir = dir.trim();
+        (out.status.success() && !dir.is_empty()).then(|| PathBuf::from(dir))
+    };
+    candidates.iter().find_map(|qmake| {
+        ["QT_HOST_LIBEXECS", "QT_INSTALL_LIBEXECS", "QT_INSTALL_BINS"]
+            .iter()
+            .filter_map(|var| query(qmake, var))
+            .map(|dir| dir.join("qmlcachegen"))
+            .find(|tool| tool.is_file())
+    })
+}
@@ -3,6 +3,9 @@
 //
 // One labelled row in the expandable process-details section. The value is
 // attacker-influenceable (/proc data), so it's forced to Text.PlainText.
+// Properties are read through `row.` rather than unqualified so
+// qmlcachegen can compile the bindings instead of leaving them to the
+// runtime's scope lookup.
 
 import QtQuick
 import QtQuick.Layouts
@@ -10,6 +13,8 @@ import QtQuick.Controls as QQC2
 import org.kde.kirigami as Kirigami
 
 ColumnLayout {
+    id: row
+
     property string label: ""
     property string value: ""
 
@@ -17,13 +22,13 @@ ColumnLayout {
     spacing: 0
 
     QQC2.Label {
-        text: label
+        text: row.label
         textFormat: Text.PlainText
         opacity: 0.7
         font: Kirigami.Theme.smallFont
     }
     QQC2.Label {
-        text: value
+        text: row.value
         textFormat: Text.PlainText
         Layout.fillWidth: true
         wrapMode: Text.Wrap
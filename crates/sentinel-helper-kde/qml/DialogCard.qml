@@ -26,10 +26,26 @@ Item {
     // overridden theme makes qqc2-desktop-style recompute forever).
     readonly property color destructiveColor: Kirigami.Theme.negativeTextColor
 
+    // Set once the first frame is reported (see the Connections below).
+    property bool framed: false
+
     DialogController {
         id: ctrl
     }
 
+    // Startup timings reported with the verdict: instantiated, then first
+    // frame on screen. `trackFrames` is only set under the basic render
+    // loop, where frameSwapped arrives on the GUI thread.
+    Component.onCompleted: ctrl.markLoaded()
+    Connections {
+        target: rootItem.Window.window
+        enabled: ctrl.trackFrames && !rootItem.framed
+        function onFrameSwapped() {
+            rootItem.framed = true
+            ctrl.markFrame()
+        }
+    }
+
     // 100 ms clock. The min-time gate, countdown and auto-deny timeout all
     // live in Rust; QML just ticks the controller.
     Timer {
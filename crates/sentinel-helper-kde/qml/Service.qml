@@ -0,0 +1,37 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// `--serve` entry point: owns no window of its own. The dialog component
+// (Main.qml or Windowed.qml, per DialogService.entry) is compiled once at
+// startup; each request only instantiates it, so a prompt paints without
+// reloading QML, Kirigami or the style. Its DialogController picks up
+// the parked request as its initial state.
+
+import QtQuick
+import org.sentinel.kde 1.0
+
+QtObject {
+    id: root
+
+    property Component dialog
+    property var current: null
+
+    property DialogService service: DialogService {
+        onPromptRequested: {
+            if (root.current !== null)
+                root.current.destroy()
+            root.current = root.dialog.status === Component.Ready
+                ? root.dialog.createObject(null) : null
+            if (root.current === null)
+                root.service.failPrompt()
+        }
+        onPromptClosed: {
+            if (root.current !== null) {
+                root.current.destroy()
+                root.current = null
+            }
+        }
+    }
+
+    Component.onCompleted: dialog = Qt.createComponent(service.entry)
+}
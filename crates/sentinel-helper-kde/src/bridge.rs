@@ -6,10 +6,12 @@
 //! All the state QML binds to lives here as Q_PROPERTYs. The countdown /
 //! min-display gate is driven by a QML `Timer` calling [`tick`](qobject::DialogController::tick)
 //! every 100 ms — the thresholds stay in Rust so the two helpers behave
-//! identically. The terminal actions print the verdict to stdout and
-//! exit the process directly (the PAM module / polkit agent read that
-//! single `ALLOW`/`DENY`/`TIMEOUT` line), so there's no need to thread a
-//! return value back out of the Qt event loop.
+//! identically. In one-shot mode the terminal actions print the verdict
+//! to stdout and exit the process directly (the PAM module / polkit agent
+//! read that single `ALLOW`/`DENY`/`TIMEOUT` line), so there's no need to
+//! thread a return value back out of the Qt event loop. Under `--serve`
+//! they hand the verdict to [`crate::service`] instead, which answers the
+//! requester and closes this dialog's window.
 
 #[cxx_qt::bridge]
 pub mod qobject {
@@ -50,6 +52,9 @@ pub mod qobject {
         #[qproperty(bool, remember_offered, cxx_name = "rememberOffered")]
         #[qproperty(QString, remember_label, cxx_name = "rememberLabel")]
         #[qproperty(bool, remember_checked, cxx_name = "rememberChecked")]
+        // Startup timings: whether QML may report swapped frames (only
+        // under the GUI-thread `basic` render loop).
+        #[qproperty(bool, track_frames, cxx_name = "trackFrames")]
         type DialogController = super::DialogControllerRust;
 
         /// 100 ms clock tick from the QML `Timer`: advances elapsed time,
@@ -76,10 +81,22 @@ pub mod qobject {
         /// `sentinel_shared::ui_i18n`.
         #[qinvokable]
         fn translate(&self, key: &QString) -> QString;
+
+        /// The dialog component finished instantiating (startup timing).
+        #[qinvokable]
+        #[cxx_name = "markLoaded"]
+        fn mark_loaded(&self);
+
+        /// The dialog's window swapped a frame (startup timing; only the
+        /// first one counts).
+        #[qinvokable]
+        #[cxx_name = "markFrame"]
+        fn mark_frame(&self);
     }
 }
 
 use core::pin::Pin;
+use cxx_qt::CxxQtType;
 use cxx_qt_lib::QString;
 use sentinel_shared::{Outcome, Verdict};
 
@@ -89,7 +106,8 @@ const TICK_MS: i32 = 100;
 
 /// Backing data for the `DialogController` QObject. Field values become
 /// the initial Q_PROPERTY values via [`Default`], which pulls from the
-/// process-wide parsed CLI args.
+/// current prompt ([`crate::prompt`]): the parsed CLI args, or the
+/// service request being shown.
 pub struct DialogControllerRust {
     title: QString,
     message: QString,
@@ -113,11 +131,16 @@ pub struct DialogControllerRust {
     remember_offered: bool,
     remember_label: QString,
     remember_checked: bool,
+    track_frames: bool,
+    /// UI language (2-letter code) for [`translate`](qobject::DialogController::translate).
+    /// Per dialog, since a service renders prompts for callers with
+    /// different locales.
+    lang: String,
 }
 
 impl Default for DialogControllerRust {
     fn default() -> Self {
-        let a = crate::args();
+        let crate::Prompt { args: a, lang } = crate::prompt();
 
         let has_details = a.process_cmdline.is_some()
             || a.process_pid.is_some()
@@ -149,7 +172,7 @@ impl Default for DialogControllerRust {
             } else {
                 format!("{secs} s")
             };
-            let tmpl = sentinel_shared::ui_i18n::remember_label_template(ui_lang());
+            let tmpl = sentinel_shared::ui_i18n::remember_label_template(&lang);
             QString::from(tmpl.replace("%1", &dur).as_str())
         } else {
             QString::default()
@@ -186,6 +209,8 @@ impl Default for DialogControllerRust {
             remember_offered,
             remember_label,
             remember_checked: false,
+            track_frames: std::env::var("QSG_RENDER_LOOP").is_ok_and(|v| v == "basic"),
+            lang,
         }
     }
 }
@@ -227,6 +252,7 @@ impl qobject::DialogController {
             finish(Verdict {
                 outcome: Outcome::Allow,
                 remember,
+                timings: None,
             });
         }
     }
@@ -242,30 +268,46 @@ impl qobject::DialogController {
         self.as_mut().set_show_details(!shown);
     }
 
-    /// Localized UI string for `key` in the process UI language. Called
+    /// Localized UI string for `key` in this dialog's UI language. Called
     /// from QML in place of `qsTr()`.
     pub fn translate(&self, key: &QString) -> QString {
         QString::from(sentinel_shared::ui_i18n::translate(
             &key.to_string(),
-            ui_lang(),
+            &self.rust().lang,
         ))
     }
+
+    pub fn mark_loaded(&self) {
+        crate::timing::qml_loaded();
+    }
+
+    pub fn mark_frame(&self) {
+        crate::timing::first_frame();
+    }
 }
 
-/// Process UI language (2-letter code), resolved once from the locale
-/// env. Cached so the per-string `translate` calls don't re-read env.
-fn ui_lang() -> &'static str {
-    use std::sync::OnceLock;
-    static LANG: OnceLock<String> = OnceLock::new();
-    LANG.get_or_init(sentinel_shared::ui_i18n::ui_lang).as_str()
+/// Deliver the verdict: to the waiting requester under `--serve`,
+/// otherwise on stdout followed by exit. Under `--serve` a second call
+/// for the same dialog (a late tick after Allow) is a no-op.
+fn finish(verdict: Verdict) {
+    if crate::service::is_serving() {
+        crate::service::complete(verdict);
+    } else {
+        exit_with(verdict);
+    }
 }
 
-/// Write the verdict the PAM module / polkit agent read, then exit with
+/// Write the verdict the PAM module / polkit agent read (with this
+/// process's startup timings attached), then exit with
 /// the matching code. We flush explicitly because `process::exit` does
 /// not flush Rust's (block-buffered when piped) stdout, and the parent
 /// reads exactly this one line.
-fn finish(verdict: Verdict) -> ! {
+fn exit_with(verdict: Verdict) -> ! {
     use std::io::Write;
+    let verdict = Verdict {
+        timings: crate::timing::snapshot(),
+        ..verdict
+    };
     let mut out = std::io::stdout();
     let _ = writeln!(out, "{verdict}");
     let _ = out.flush();
@@ -273,17 +315,22 @@ fn finish(verdict: Verdict) -> ! {
 }
 
 /// Write a bare outcome (no "remember" opt-in) — used by Deny / Timeout.
-fn finish_outcome(outcome: Outcome) -> ! {
+fn finish_outcome(outcome: Outcome) {
     finish(Verdict {
         outcome,
         remember: false,
+        timings: None,
     })
 }
 
 /// Fail-safe used by `main` if the event loop ever returns without a
 /// verdict (e.g. the surface was closed by the compositor).
 pub fn finish_deny() -> ! {
-    finish_outcome(Outcome::Deny)
+    exit_with(Verdict {
+        outcome: Outcome::Deny,
+        remember: false,
+        timings: None,
+    })
 }
 
 /// Clamp untrusted text to `max` characters. The requesting process's
@@ -8,8 +8,14 @@
 //! `zwlr-layer-shell-v1` overlay (fullscreen, exclusive keyboard) on
 //! Plasma/wlroots compositors, falling back to a normal window on
 //! Mutter-based desktops.
+//!
+//! With `--serve` it instead stays resident as the session's dialog
+//! service (see [`service`]), rendering one dialog per socket request
+//! from an already-initialized Qt/QML stack.
 
 mod bridge;
+mod service;
+mod timing;
 
 use cxx_qt_lib::{QQmlApplicationEngine, QQuickStyle, QString, QUrl};
 use cxx_qt_lib_extras::QApplication;
@@ -25,19 +31,45 @@ pub fn args() -> &'static cli::Args {
     ARGS.get_or_init(cli::parse)
 }
 
+/// What one dialog renders: its arguments plus the UI language.
+#[derive(Clone)]
+pub struct Prompt {
+    pub args: cli::Args,
+    pub lang: String,
+}
+
+/// The dialog being instantiated: the service's parked request under
+/// `--serve`, otherwise the CLI args and the process locale.
+pub fn prompt() -> Prompt {
+    service::current_prompt().unwrap_or_else(|| Prompt {
+        args: args().clone(),
+        lang: sentinel_shared::ui_i18n::ui_lang(),
+    })
+}
+
 fn main() {
+    timing::start();
     let a = args();
+    if a.serve {
+        service::reexec_sanitized();
+    }
     let mode = a.effective_render_mode(std::env::var("XDG_CURRENT_DESKTOP").ok().as_deref());
 
     // Fail safe: this helper is Wayland-only. With no display we can't paint
     // the confirmation, so deny rather than proceed blindly or hang.
     if std::env::var_os("WAYLAND_DISPLAY").is_none() {
         eprintln!("sentinel-helper-kde: WAYLAND_DISPLAY not set; Wayland-only — denying");
+        if a.serve {
+            std::process::exit(1);
+        }
         bridge::finish_deny();
     }
 
-    // Fire the UAC-style audio cue before the GUI spins up.
-    play_sound(&a.sound_name);
+    // Fire the UAC-style audio cue before the GUI spins up. The service
+    // plays it per request instead.
+    if !a.serve {
+        play_sound(&a.sound_name);
+    }
 
     if mode == RenderMode::LayerShell {
         // `LayerShellQt::Shell::useLayerShell()` is exactly this qputenv,
@@ -57,6 +89,8 @@ fn main() {
     //  - Render on the GUI thread (`basic`): we exit the process directly
     //    after the verdict, which otherwise tears down the scene-graph render
     //    thread mid-flight and spews "QThreadStorage destroyed" warnings.
+    //    It also delivers `frameSwapped` on the GUI thread, which the
+    //    first-frame timing mark relies on (see `DialogCard.qml`).
     unsafe {
         if std::env::var_os("QT_LOGGING_RULES").is_none() {
             std::env::set_var("QT_LOGGING_RULES", "kf.iconthemes.warning=false");
@@ -67,6 +101,7 @@ fn main() {
     }
 
     let mut app = QApplication::new();
+    timing::app_ready();
 
     // Native Breeze styling for QtQuick.Controls. qqc2-desktop-style needs
     // the QApplication created above; the explicit style keeps the look
@@ -82,21 +117,45 @@ fn main() {
         engine
             .on_object_creation_failed(|_engine, _url| {
                 eprintln!("sentinel-helper-kde: QML failed to load — denying");
+                if args().serve {
+                    std::process::exit(1);
+                }
                 bridge::finish_deny();
             })
             .release();
     }
 
-    let entry = match mode {
+    let dialog = match mode {
         RenderMode::LayerShell => "Main.qml",
         RenderMode::Windowed => "Windowed.qml",
     };
+    let entry = if a.serve {
+        service::set_entry(dialog);
+        "Service.qml"
+    } else {
+        dialog
+    };
     // QML is embedded in the binary (qrc) — tamper-proof and self-contained.
     let url = format!("qrc:/qt/qml/org/sentinel/kde/qml/{entry}");
     if let Some(engine) = engine.as_mut() {
         engine.load(&QUrl::from(url.as_str()));
     }
 
+    if a.serve {
+        if let Err(e) = service::listen() {
+            eprintln!("sentinel-helper-kde: dialog service: {e}");
+            std::process::exit(1);
+        }
+        // Re-enter the loop whenever it returns: with Qt's default
+        // quit-on-last-window-closed, destroying a dialog window can end
+        // it, and the service has no window of its own.
+        loop {
+            if let Some(app) = app.as_mut() {
+                app.exec();
+            }
+        }
+    }
+
     if let Some(app) = app.as_mut() {
         app.exec();
     }
@@ -111,7 +170,7 @@ fn main() {
 /// installed, resolves the freedesktop sound *name* to a file ourselves and
 /// plays it with whatever PipeWire / PulseAudio / ALSA player is present
 /// (so the cue still fires on a stock system without libcanberra).
-fn play_sound(name: &str) {
+pub(crate) fn play_sound(name: &str) {
     if name.is_empty() {
         return;
     }
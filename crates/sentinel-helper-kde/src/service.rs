@@ -0,0 +1,323 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! `--serve`: the persistent per-session dialog service.
+//!
+//! One process per graphical session keeps `QApplication`, the QML engine,
+//! Kirigami and the Breeze style loaded, and renders one dialog per
+//! request on `sentinel_shared::dialog::socket_path` — the polkit agent
+//! no longer pays a cold Qt start per prompt.
+//!
+//! Threads: an accept thread hands each connection to a thread of its
+//! own, which reads the request, parks it in [`PENDING`] and queues
+//! `promptRequested` onto the Qt thread through the
+//! `DialogService` QObject (`Service.qml` instantiates it once). The
+//! dialog's `DialogController` reads the parked request as its initial
+//! state, and its terminal action calls [`complete`], which answers the
+//! requester and queues `promptClosed` so `Service.qml` destroys the
+//! window. One prompt is shown at a time: a request that arrives while
+//! one is up is answered [`Response::Busy`] at once, and its requester
+//! spawns a helper instead of waiting out its reply deadline.
+//!
+//! Trust: the service re-executes itself once with the
+//! [`UNTRUSTED_ENV`] variables removed and [`SERVICE_MARKER_ENV`] set,
+//! then marks itself non-dumpable so no same-uid process can ptrace it
+//! or pull its socket out with `pidfd_getfd`. The agent that spawned it
+//! only talks to the socket while the listener is that child. Only the
+//! session's own uid may connect; the root PAM module never does.
+
+#[cxx_qt::bridge]
+pub mod qobject {
+    unsafe extern "C++" {
+        include!("cxx-qt-lib/qstring.h");
+        /// An alias to the QString type from cxx-qt-lib.
+        type QString = cxx_qt_lib::QString;
+    }
+
+    extern "RustQt" {
+        #[qobject]
+        #[qml_element]
+        // QML file one dialog is instantiated from (`Main.qml` or
+        // `Windowed.qml`), fixed at startup by the render mode.
+        #[qproperty(QString, entry)]
+        type DialogService = super::DialogServiceRust;
+
+        /// A request is parked: instantiate one dialog window.
+        #[qsignal]
+        #[cxx_name = "promptRequested"]
+        fn prompt_requested(self: Pin<&mut Self>);
+
+        /// The current prompt is over (answered, or the requester hung
+        /// up): destroy its window.
+        #[qsignal]
+        #[cxx_name = "promptClosed"]
+        fn prompt_closed(self: Pin<&mut Self>);
+
+        /// QML couldn't instantiate the dialog. Answers Deny.
+        #[qinvokable]
+        #[cxx_name = "failPrompt"]
+        fn fail_prompt(self: Pin<&mut Self>);
+    }
+
+    impl cxx_qt::Threading for DialogService {}
+    impl cxx_qt::Initialize for DialogService {}
+}
+
+use core::pin::Pin;
+use cxx_qt::{CxxQtThread, Threading};
+use cxx_qt_lib::QString;
+use nix::errno::Errno;
+use nix::sys::socket::{MsgFlags, getsockopt, recv, sockopt::PeerCredentials};
+use sentinel_shared::dialog::{
+    self, PROTOCOL_VERSION, Request, Response, SERVICE_MARKER_ENV, UNTRUSTED_ENV, read_frame,
+    write_frame,
+};
+use sentinel_shared::{Outcome, Verdict};
+use std::io;
+use std::os::fd::AsRawFd;
+use std::os::unix::fs::{FileTypeExt, PermissionsExt};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Mutex, OnceLock, mpsc};
+use std::time::Duration;
+
+/// Cap on reading a request and writing its answer. Both are one small
+/// frame; only a wedged peer hits it.
+const IO_TIMEOUT: Duration = Duration::from_secs(2);
+
+/// How often the connection thread checks whether the requester of the
+/// showing prompt has gone away (agent killed mid-prompt).
+const HANGUP_POLL: Duration = Duration::from_millis(250);
+
+/// The prompt being shown: what the dialog renders, and who gets the
+/// answer.
+struct Pending {
+    prompt: crate::Prompt,
+    stream: UnixStream,
+    done: mpsc::Sender<()>,
+}
+
+static PENDING: Mutex<Option<Pending>> = Mutex::new(None);
+static HOST: OnceLock<CxxQtThread<qobject::DialogService>> = OnceLock::new();
+static ENTRY: OnceLock<&'static str> = OnceLock::new();
+static SERVING: AtomicBool = AtomicBool::new(false);
+/// A prompt is claimed, from reading its request until it is answered
+/// or cancelled.
+static SHOWING: AtomicBool = AtomicBool::new(false);
+
+pub struct DialogServiceRust {
+    entry: QString,
+}
+
+impl Default for DialogServiceRust {
+    fn default() -> Self {
+        Self {
+            entry: QString::from(ENTRY.get().copied().unwrap_or("Main.qml")),
+        }
+    }
+}
+
+impl cxx_qt::Initialize for qobject::DialogService {
+    fn initialize(self: Pin<&mut Self>) {
+        let _ = HOST.set(self.qt_thread());
+    }
+}
+
+impl qobject::DialogService {
+    pub fn fail_prompt(self: Pin<&mut Self>) {
+        eprintln!("sentinel-helper-kde: dialog failed to instantiate — denying");
+        complete(Verdict {
+            outcome: Outcome::Deny,
+            remember: false,
+            timings: None,
+        });
+    }
+}
+
+/// Whether this process is the dialog service (set once listening).
+pub fn is_serving() -> bool {
+    SERVING.load(Ordering::Relaxed)
+}
+
+/// The parked request, for the dialog being instantiated.
+pub fn current_prompt() -> Option<crate::Prompt> {
+    let pending = PENDING.lock().unwrap_or_else(|e| e.into_inner());
+    pending.as_ref().map(|p| p.prompt.clone())
+}
+
+/// Record the QML file each dialog is instantiated from. Call before
+/// loading `Service.qml`.
+pub fn set_entry(entry: &'static str) {
+    let _ = ENTRY.set(entry);
+}
+
+/// Answer the parked request with `verdict` (plus this prompt's
+/// timings) and close its dialog. Runs on the Qt thread; a no-op once
+/// the prompt is already answered or cancelled.
+pub fn complete(verdict: Verdict) {
+    let Some(mut p) = PENDING.lock().unwrap_or_else(|e| e.into_inner()).take() else {
+        return;
+    };
+    let verdict = Verdict {
+        timings: crate::timing::snapshot(),
+        ..verdict
+    };
+    if let Err(e) = write_frame(&mut p.stream, &Response::Verdict(verdict)) {
+        eprintln!("sentinel-helper-kde: reply: {e}");
+    }
+    // Queue the close before releasing the connection thread, so it lands
+    // on the Qt thread ahead of the next `promptRequested`.
+    close_prompt();
+    let _ = p.done.send(());
+}
+
+/// Drop the parked request unanswered (its requester is gone) and close
+/// its dialog.
+fn cancel() {
+    if PENDING
+        .lock()
+        .unwrap_or_else(|e| e.into_inner())
+        .take()
+        .is_some()
+    {
+        close_prompt();
+    }
+}
+
+fn close_prompt() {
+    if let Some(host) = HOST.get() {
+        let _ = host.queue(|host| host.prompt_closed());
+    }
+}
+
+/// Re-execute with the sanitized environment unless already running in
+/// it. Must run first thing in `main`, before Qt (or anything the
+/// untrusted variables could have injected) gets further.
+pub fn reexec_sanitized() {
+    use std::os::unix::process::CommandExt;
+    let clean = std::env::var(SERVICE_MARKER_ENV).is_ok_and(|v| v == "1")
+        && UNTRUSTED_ENV.iter().all(|k| std::env::var_os(k).is_none());
+    if !clean {
+        let mut cmd = std::process::Command::new("/proc/self/exe");
+        cmd.arg0("sentinel-helper-kde")
+            .arg("--serve")
+            .env(SERVICE_MARKER_ENV, "1");
+        for key in UNTRUSTED_ENV {
+            cmd.env_remove(key);
+        }
+        let err = cmd.exec();
+        eprintln!("sentinel-helper-kde: re-exec with a clean environment: {err}");
+        std::process::exit(1);
+    }
+    if let Err(e) = nix::sys::prctl::set_dumpable(false) {
+        eprintln!("sentinel-helper-kde: PR_SET_DUMPABLE: {e}");
+        std::process::exit(1);
+    }
+}
+
+/// Bind the session socket and start answering requests. `Service.qml`
+/// must already be loaded (it registers the Qt-thread handle).
+pub fn listen() -> io::Result<()> {
+    if HOST.get().is_none() {
+        return Err(io::Error::other("DialogService was not instantiated"));
+    }
+    let uid = nix::unistd::getuid().as_raw();
+    let path = dialog::socket_path(uid);
+    // A leftover socket (ours from a previous run, or a squatter's) is
+    // replaced; the agent verifies whoever listens, so taking the path
+    // over is safe and a squatter only ever costs the warm path.
+    if std::fs::symlink_metadata(&path).is_ok_and(|m| m.file_type().is_socket()) {
+        std::fs::remove_file(&path)?;
+    }
+    let listener = UnixListener::bind(&path)?;
+    std::fs::set_permissions(&path, std::fs::Permissions::from_mode(0o600))?;
+    SERVING.store(true, Ordering::Relaxed);
+    std::thread::spawn(move || {
+        for conn in listener.incoming() {
+            let Ok(stream) = conn else { continue };
+            std::thread::spawn(move || {
+                if let Err(e) = serve_one(stream, uid) {
+                    eprintln!("sentinel-helper-kde: request: {e}");
+                }
+            });
+        }
+    });
+    Ok(())
+}
+
+/// Read one request, then show it and wait until it is answered or its
+/// requester leaves — or answer `Busy` if another prompt is up.
+fn serve_one(mut stream: UnixStream, own_uid: u32) -> io::Result<()> {
+    let peer = getsockopt(&stream, PeerCredentials).map_err(io::Error::from)?;
+    if peer.uid() != own_uid {
+        return Err(io::Error::new(
+            io::ErrorKind::PermissionDenied,
+            format!("peer uid {}", peer.uid()),
+        ));
+    }
+    stream.set_read_timeout(Some(IO_TIMEOUT))?;
+    stream.set_write_timeout(Some(IO_TIMEOUT))?;
+    let req: Request = read_frame(&mut stream)?;
+    if req.protocol != PROTOCOL_VERSION {
+        return write_frame(
+            &mut stream,
+            &Response::Unsupported {
+                protocol: PROTOCOL_VERSION,
+            },
+        );
+    }
+    if SHOWING.swap(true, Ordering::AcqRel) {
+        return write_frame(&mut stream, &Response::Busy);
+    }
+    let shown = show(req, stream);
+    SHOWING.store(false, Ordering::Release);
+    shown
+}
+
+/// Park `req` for the Qt thread and wait for its end.
+fn show(req: Request, stream: UnixStream) -> io::Result<()> {
+    crate::timing::start();
+    crate::play_sound(&req.sound_name);
+    let lang = sentinel_shared::ui_i18n::ui_lang_from(|k| req.locale_var(k));
+    let watch = stream.try_clone()?;
+    let (done, done_rx) = mpsc::channel();
+    *PENDING.lock().unwrap_or_else(|e| e.into_inner()) = Some(Pending {
+        prompt: crate::Prompt {
+            args: req.into(),
+            lang,
+        },
+        stream,
+        done,
+    });
+    let queued = HOST
+        .get()
+        .map(|host| host.queue(|host| host.prompt_requested()).is_ok());
+    if queued != Some(true) {
+        cancel();
+        return Err(io::Error::other("Qt thread is gone"));
+    }
+
+    loop {
+        match done_rx.recv_timeout(HANGUP_POLL) {
+            Err(mpsc::RecvTimeoutError::Timeout) if !hung_up(&watch) => {}
+            Err(mpsc::RecvTimeoutError::Timeout) => {
+                cancel();
+                return Ok(());
+            }
+            _ => return Ok(()),
+        }
+    }
+}
+
+/// Whether the requester closed its end: a zero-byte peek, or any
+/// error but "nothing to read yet" (it never sends after the request).
+fn hung_up(stream: &UnixStream) -> bool {
+    let mut byte = [0u8; 1];
+    match recv(
+        stream.as_raw_fd(),
+        &mut byte,
+        MsgFlags::MSG_PEEK | MsgFlags::MSG_DONTWAIT,
+    ) {
+        Ok(n) => n == 0,
+        Err(e) => e != Errno::EAGAIN,
+    }
+}
@@ -0,0 +1,55 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Startup milestones of the current dialog, reported to the caller with
+//! the verdict as [`sentinel_shared::Timings`].
+//!
+//! Each mark is a [`monotonic_us`] reading (0 = not reached yet). The
+//! one-shot helper starts the clock in `main`; the service restarts it
+//! for every request, which also clears the `QApplication` mark that
+//! belongs to its own startup.
+
+use sentinel_shared::{Timings, monotonic_us};
+use std::sync::atomic::{AtomicU64, Ordering};
+
+static START: AtomicU64 = AtomicU64::new(0);
+static APP: AtomicU64 = AtomicU64::new(0);
+static QML: AtomicU64 = AtomicU64::new(0);
+static FRAME: AtomicU64 = AtomicU64::new(0);
+
+/// Start (or restart) the clock: process start, or a service request.
+pub fn start() {
+    for mark in [&APP, &QML, &FRAME] {
+        mark.store(0, Ordering::Relaxed);
+    }
+    START.store(monotonic_us(), Ordering::Relaxed);
+}
+
+/// `QApplication` is constructed.
+pub fn app_ready() {
+    APP.store(monotonic_us(), Ordering::Relaxed);
+}
+
+/// The dialog's QML component finished instantiating.
+pub fn qml_loaded() {
+    first(&QML);
+}
+
+/// The dialog's first frame was swapped. Later frames don't move it.
+pub fn first_frame() {
+    first(&FRAME);
+}
+
+fn first(mark: &AtomicU64) {
+    let _ = mark.compare_exchange(0, monotonic_us(), Ordering::Relaxed, Ordering::Relaxed);
+}
+
+/// The marks so far; `None` if the clock never started.
+pub fn snapshot() -> Option<Timings> {
+    let read = |mark: &AtomicU64| Some(mark.load(Ordering::Relaxed)).filter(|&us| us != 0);
+    Some(Timings {
+        start_us: read(&START)?,
+        app_us: read(&APP),
+        qml_us: read(&QML),
+        first_frame_us: read(&FRAME),
+    })
+}
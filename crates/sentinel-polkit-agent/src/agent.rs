@@ -2,40 +2,57 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 //! `org.freedesktop.PolicyKit1.AuthenticationAgent` server side.
 
-use crate::approval_queue::ApprovalQueue;
+use crate::approvals::Approvals;
+use crate::coalesce::Dialogs;
 use crate::identity::{self, Identity};
+use crate::live_config::LiveConfig;
+use crate::metrics::Metrics;
 use crate::session::{self, AuthInputs};
 use log::{error, info, warn};
-use sentinel_shared::POLKIT_PAM_SERVICE;
+use sentinel_shared::accounts::Accounts;
+use sentinel_shared::procfs::Snapshot;
+use sentinel_shared::{POLKIT_PAM_SERVICE, SESSION_ENV_KEY, ServiceConfig};
+use std::borrow::Cow;
 use std::collections::HashMap;
 use std::sync::Arc;
+use std::time::Duration;
 use tokio::sync::{Mutex, oneshot};
 use tokio::task::JoinHandle;
 use zbus::fdo;
 
 pub struct Agent {
     own_uid: u32,
-    queue: ApprovalQueue,
+    approvals: Approvals,
     sessions: Arc<Mutex<HashMap<String, JoinHandle<()>>>>,
-    /// Serializes BeginAuthentication so only one dialog + helper-1
-    /// handoff is in flight at any time. This bounds the bypass-queue
-    /// race window: the approval pushed by a given session can only be
-    /// consumed by that session's helper-1 invocation, because no other
-    /// `session::run` can push a competing approval until we drop the
-    /// guard. Polkit doesn't pipeline BeginAuthentication in practice,
-    /// so this is invisible to the user.
-    inflight: Arc<Mutex<()>>,
+    /// Open dialogs, so identical concurrent requests share one (see
+    /// `coalesce`). Requests otherwise run concurrently, hand-offs
+    /// included: each approval is bound to its own cookie (`approvals`).
+    dialogs: Dialogs,
     /// In-memory remember cache for the polkit path (see `remember`).
     remember: crate::remember::RememberCache,
+    /// The `polkit-1` config, kept current by inotify (see `live_config`).
+    config: LiveConfig,
+    /// passwd lookups, cached for [`ACCOUNT_TTL`].
+    accounts: Arc<Accounts>,
+    /// Outcome counters and latency histograms (see `metrics`).
+    metrics: Metrics,
 }
 
+/// How long a uid → name answer is reused. Requests come in bursts (a
+/// package manager asking for several actions); this spans a burst
+/// without hiding a directory edit for long.
+const ACCOUNT_TTL: Duration = Duration::from_secs(30);
+
 impl Agent {
-    pub fn new(own_uid: u32, queue: ApprovalQueue) -> Self {
+    pub fn new(own_uid: u32, approvals: Approvals, config: LiveConfig, metrics: Metrics) -> Self {
         Self {
             own_uid,
-            queue,
+            approvals,
+            config,
+            metrics,
+            accounts: Arc::new(Accounts::with_ttl(ACCOUNT_TTL)),
             sessions: Arc::new(Mutex::new(HashMap::new())),
-            inflight: Arc::new(Mutex::new(())),
+            dialogs: Dialogs::new(),
             remember: crate::remember::RememberCache::new(),
         }
     }
@@ -68,98 +85,30 @@ impl Agent {
             log::debug!("  details[{k}] = {v:?}");
         }
 
-        // Serialize: only one dialog + helper-1 handoff at a time. See
-        // the field comment on `Agent::inflight` for why.
-        let _serialize_guard = self.inflight.lock().await;
-
         let Some(uid) = identity::pick(&identities, self.own_uid) else {
             warn!("no usable unix-user identity in BeginAuthentication");
             return Err(fdo::Error::Failed("no acceptable identities".to_string()));
         };
-        let username = match nix::unistd::User::from_uid(nix::unistd::Uid::from_raw(uid)) {
-            Ok(Some(u)) => u.name,
-            _ => {
-                error!("uid {uid} has no passwd entry");
-                return Err(fdo::Error::Failed(format!("uid {uid} unknown")));
-            }
-        };
-
-        // `polkit.subject-pid` is the user-facing process that
-        // requested the action (the GUI app, the user's shell).
-        // `polkit.caller-pid` is whichever polkit-mediated tool got
-        // there first — for `pkexec foo`, the caller is pkexec
-        // itself with `foo` as argv[1]. We display info about the
-        // PROGRAM-TO-BE-ELEVATED, not the requester, because that's
-        // the UAC question the user is answering.
-        let subject_pid = details
-            .get("polkit.subject-pid")
-            .and_then(|s| s.parse::<i32>().ok());
-        let caller_pid = details
-            .get("polkit.caller-pid")
-            .and_then(|s| s.parse::<i32>().ok());
-
-        // Polkit defines `details["program"]` / `details["command_line"]`
-        // for `org.freedesktop.policykit.exec`, but in practice (polkit
-        // 0.130 + polkit-kde) doesn't forward them to the agent.
-        // Independently of action_id, we try to recover the elevated
-        // command from the caller's `/proc/<pid>/cmdline` — when the
-        // caller is an elevation tool (pkexec, sudo, etc), stripping
-        // its prefix yields the program-to-be-elevated.
-        //
-        // This covers two important cases that don't go through
-        // `org.freedesktop.policykit.exec`:
-        //   - GUI apps using their own action_id that internally call
-        //     pkexec (gparted = `org.gnome.gparted`, the launcher
-        //     script does `pkexec /usr/bin/gparted`).
-        //   - Apps using polkit-mediated wrappers we haven't anticipated.
-        let elevated_program = details.get("program").filter(|s| !s.is_empty()).cloned();
-        let elevated_command_line = details
-            .get("command_line")
-            .filter(|s| !s.is_empty())
-            .cloned();
-        let recovered_from_caller = if elevated_command_line.is_none() {
-            caller_pid
-                .and_then(sentinel_shared::procfs::read_cmdline)
-                .and_then(|raw| {
-                    let stripped = sentinel_shared::strip_elevation_prefix(&raw);
-                    // `strip_elevation_prefix` returns the input
-                    // unchanged when the caller isn't a recognised
-                    // elevation tool (so a polkitd-only flow doesn't
-                    // accidentally adopt polkitd's cmdline). Only take
-                    // the result when it actually changed.
-                    if stripped != raw && !stripped.is_empty() {
-                        Some(stripped)
-                    } else {
-                        None
-                    }
-                })
-        } else {
-            None
-        };
-
-        let process_cmdline = elevated_command_line.or(recovered_from_caller);
-        let process_exe = elevated_program.or_else(|| {
-            // Prefer the first whitespace-separated token of the
-            // recovered/forwarded cmdline; falls back to the subject's
-            // exe (typically the user's shell) only when we have
-            // nothing better.
-            process_cmdline
-                .as_deref()
-                .and_then(|s| s.split_whitespace().next().map(String::from))
-                .or_else(|| subject_pid.and_then(sentinel_shared::procfs::read_exe))
-        });
-        let process_cwd = subject_pid.and_then(sentinel_shared::procfs::read_cwd);
+        // NSS, `/proc` and (without inotify) the config file can all
+        // block; they run on the blocking pool so a slow LDAP lookup or
+        // a wedged `/proc` read doesn't hold up every other D-Bus call on
+        // this connection (`TakeApprovalFor`, `CancelAuthentication`).
+        let Gathered {
+            username,
+            subject_pid,
+            process_cmdline,
+            process_exe,
+            process_cwd,
+            session,
+            cfg,
+        } = gather_off_thread(
+            uid,
+            details,
+            Arc::clone(&self.accounts),
+            self.config.clone(),
+        )
+        .await?;
         let username_for_task = username.clone();
-
-        // Re-read config per call so an admin's edit to
-        // /etc/security/sentinel.conf takes effect on the next polkit
-        // auth, no agent restart required. Same per-call discipline as
-        // pam_sentinel.so. `enabled = false` on `polkit-1` is logged
-        // but not honoured here: the agent has already registered with
-        // polkitd so we can't disable ourselves mid-session, and a
-        // refusal would leave polkit with no agent at all. Rendering
-        // the dialog is the safer default.
-        let cfg = sentinel_shared::load(POLKIT_PAM_SERVICE);
         if !cfg.enabled {
             warn!(
                 "[services.{POLKIT_PAM_SERVICE}].enabled = false in config — \
@@ -167,7 +116,7 @@ impl Agent {
             );
         }
 
-        let queue = self.queue.clone();
+        let approvals = self.approvals.clone();
         let cookie_for_task = cookie.clone();
         let action_for_task = action_id.clone();
         let exe_for_task = process_exe.clone();
@@ -181,10 +130,14 @@ impl Agent {
         let (done_tx, done_rx) = oneshot::channel::<()>();
 
         let remember = self.remember.clone();
+        let dialogs = self.dialogs.clone();
+        let metrics = self.metrics.clone();
         let handle = tokio::spawn(async move {
             let _ = session::run(
-                queue,
+                approvals,
                 remember,
+                dialogs,
+                metrics,
                 AuthInputs {
                     action_id: &action_for_task,
                     cookie: &cookie_for_task,
@@ -194,6 +147,7 @@ impl Agent {
                     process_cmdline: cmdline_for_task.as_deref(),
                     process_pid: subject_pid,
                     process_cwd: cwd_for_task.as_deref(),
+                    session: &session,
                     requesting_user: Some(&username_for_task),
                 },
             )
@@ -225,11 +179,10 @@ impl Agent {
 
     async fn cancel_authentication(&self, cookie: String) -> fdo::Result<()> {
         info!("CancelAuthentication cookie={}", cookie_prefix(&cookie));
-        // Invalidate any pre-approval queued by `session::run` for the
-        // cookie we're canceling. Otherwise the approval lives on for
-        // up to 1 s and could be claimed by the *next* polkit auth that
-        // races in. See `ApprovalQueue::drain` for the threat model.
-        self.queue.drain().await;
+        // Aborting the session also withdraws its pre-approval, if it
+        // has one: the hand-off removes its cookie's approval as it is
+        // dropped (`Approvals::hand_off`). Other auths' approvals are
+        // left alone.
         let mut sessions = self.sessions.lock().await;
         if let Some(handle) = sessions.remove(&cookie) {
             handle.abort();
@@ -238,10 +191,150 @@ impl Agent {
     }
 }
 
+/// What `BeginAuthentication` learns from NSS, `/proc` and the config
+/// before it can show anything.
+struct Gathered {
+    username: String,
+    subject_pid: Option<i32>,
+    process_cmdline: Option<String>,
+    process_exe: Option<String>,
+    process_cwd: Option<String>,
+    /// logfmt session fields for the subject (see
+    /// `sentinel_shared::logfmt_session`), empty if unknown.
+    session: String,
+    cfg: Arc<ServiceConfig>,
+}
+
+/// [`gather`] on the blocking pool.
+async fn gather_off_thread(
+    uid: u32,
+    details: HashMap<String, String>,
+    accounts: Arc<Accounts>,
+    config: LiveConfig,
+) -> fdo::Result<Gathered> {
+    tokio::task::spawn_blocking(move || gather(uid, &details, &accounts, &config))
+        .await
+        .map_err(|e| fdo::Error::Failed(format!("gather request details: {e}")))?
+}
+
+/// The blocking half of `BeginAuthentication`.
+fn gather(
+    uid: u32,
+    details: &HashMap<String, String>,
+    accounts: &Accounts,
+    config: &LiveConfig,
+) -> fdo::Result<Gathered> {
+    let username = match accounts.by_uid(uid) {
+        Some(u) => u.name.clone(),
+        None => {
+            error!("uid {uid} has no passwd entry");
+            return Err(fdo::Error::Failed(format!("uid {uid} unknown")));
+        }
+    };
+
+    // `polkit.subject-pid` is the user-facing process that
+    // requested the action (the GUI app, the user's shell).
+    // `polkit.caller-pid` is whichever polkit-mediated tool got
+    // there first — for `pkexec foo`, the caller is pkexec
+    // itself with `foo` as argv[1]. We display info about the
+    // PROGRAM-TO-BE-ELEVATED, not the requester, because that's
+    // the UAC question the user is answering.
+    let subject_pid = details
+        .get("polkit.subject-pid")
+        .and_then(|s| s.parse::<i32>().ok());
+    let caller_pid = details
+        .get("polkit.caller-pid")
+        .and_then(|s| s.parse::<i32>().ok());
+
+    // Polkit defines `details["program"]` / `details["command_line"]`
+    // for `org.freedesktop.policykit.exec`, but in practice (polkit
+    // 0.130 + polkit-kde) doesn't forward them to the agent.
+    // Independently of action_id, we try to recover the elevated
+    // command from the caller's `/proc/<pid>/cmdline` — when the
+    // caller is an elevation tool (pkexec, sudo, etc), stripping
+    // its prefix yields the program-to-be-elevated.
+    //
+    // This covers two important cases that don't go through
+    // `org.freedesktop.policykit.exec`:
+    //   - GUI apps using their own action_id that internally call
+    //     pkexec (gparted = `org.gnome.gparted`, the launcher
+    //     script does `pkexec /usr/bin/gparted`).
+    //   - Apps using polkit-mediated wrappers we haven't anticipated.
+    //
+    // Both pids are read through anchored `procfs::Snapshot`s (one
+    // `/proc/<pid>` open each) scoped to this block: they must not
+    // outlive the reads.
+    let (process_cmdline, process_exe, process_cwd, session) = {
+        let subject = subject_pid.map(|pid| Snapshot::open(pid, &[SESSION_ENV_KEY]));
+        let caller = caller_pid.map(|pid| Snapshot::open(pid, &[]));
+        let elevated_program = details.get("program").filter(|s| !s.is_empty()).cloned();
+        let elevated_command_line = details
+            .get("command_line")
+            .filter(|s| !s.is_empty())
+            .cloned();
+        // `Argv::elevated` is `None` when the caller isn't a
+        // recognised elevation tool (so a polkitd-only flow doesn't
+        // accidentally adopt polkitd's cmdline), and empty when the
+        // tool was given no command; neither is taken.
+        let recovered_from_caller = if elevated_command_line.is_none() {
+            caller
+                .as_ref()
+                .and_then(Snapshot::argv)
+                .and_then(|argv| argv.elevated())
+                .filter(|target| !target.is_empty())
+        } else {
+            None
+        };
+
+        // Prefer the forwarded command's first word, or the recovered
+        // command's argv[0]; fall back to the subject's exe (typically
+        // the user's shell) only when we have nothing better.
+        let process_exe = elevated_program.or_else(|| {
+            match &elevated_command_line {
+                Some(line) => line.split_whitespace().next().map(String::from),
+                None => recovered_from_caller
+                    .and_then(|target| target.program())
+                    .map(Cow::into_owned),
+            }
+            .or_else(|| subject.as_ref().and_then(Snapshot::exe).map(String::from))
+        });
+        let process_cmdline =
+            elevated_command_line.or_else(|| recovered_from_caller.map(|t| t.to_string()));
+        let process_cwd = subject.as_ref().and_then(Snapshot::cwd).map(String::from);
+        // Session enrichment for the `event=auth.*` lines, via the
+        // subject's env: the user's actual process (the GUI app or
+        // shell requesting the privileged action).
+        let session = subject
+            .as_ref()
+            .map(sentinel_shared::logfmt_session)
+            .unwrap_or_default();
+        (process_cmdline, process_exe, process_cwd, session)
+    };
+
+    // The config as of the last good load; an admin's edit to
+    // /etc/security/sentinel.conf takes effect on the next polkit auth,
+    // no agent restart required. `enabled = false` on `polkit-1` is
+    // logged (by the caller) but not honoured: the agent has already
+    // registered with polkitd so we can't disable ourselves
+    // mid-session, and a refusal would leave polkit with no agent at
+    // all. Rendering the dialog is the safer default.
+    let cfg = config.current();
+
+    Ok(Gathered {
+        username,
+        subject_pid,
+        process_cmdline,
+        process_exe,
+        process_cwd,
+        session,
+        cfg,
+    })
+}
+
 /// First-8-character prefix for log output. Iterates by `chars()` rather
 /// than byte-slicing so a non-ASCII cookie (polkit emits hex in practice,
 /// but this is defensive) doesn't panic on a UTF-8 boundary mid-multi-byte.
-fn cookie_prefix(cookie: &str) -> String {
+pub(crate) fn cookie_prefix(cookie: &str) -> String {
     cookie.chars().take(8).collect()
 }
 
@@ -254,6 +347,68 @@ fn cookie_prefix(cookie: &str) -> String {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use sentinel_shared::accounts::{Account, Query};
+    use std::time::Instant;
+
+    /// A directory server that takes its time.
+    fn stuck_lookup(_: &Query<'_>) -> Option<Account> {
+        std::thread::sleep(Duration::from_millis(500));
+        Some(Account::new("slow".into(), 4242, 4242, "/".into()))
+    }
+
+    /// The `TakeApprovalFor` path stays as fast as ever while several
+    /// `BeginAuthentication`s sit in a slow NSS lookup: the lookups
+    /// are on the blocking pool, not the runtime thread the bus calls
+    /// share.
+    #[tokio::test]
+    async fn take_approval_is_not_stalled_by_a_stuck_lookup() {
+        async fn takes(a: &Approvals, rounds: u64) -> Vec<Duration> {
+            let mut samples = Vec::new();
+            for i in 0..rounds {
+                let started = Instant::now();
+                let slot = a.open("c1", "stress");
+                slot.ticket().bind(i);
+                slot.decide(true);
+                // Yield first, as a bus call would: a stalled runtime
+                // shows up right here.
+                tokio::task::yield_now().await;
+                assert!(a.take_for(i).await.is_some());
+                samples.push(started.elapsed());
+            }
+            samples
+        }
+        let worst = |v: &[Duration]| v.iter().copied().max().unwrap();
+        let a = Approvals::new();
+        let idle = worst(&takes(&a, 200).await);
+
+        let accounts = Arc::new(Accounts::with_lookup(None, stuck_lookup));
+        let config = LiveConfig::fixed(
+            sentinel_shared::Document::defaults().for_service(POLKIT_PAM_SERVICE),
+        );
+        let stuck: Vec<_> = (0..4)
+            .map(|_| {
+                tokio::spawn(gather_off_thread(
+                    4242,
+                    HashMap::new(),
+                    Arc::clone(&accounts),
+                    config.clone(),
+                ))
+            })
+            .collect();
+        tokio::time::sleep(Duration::from_millis(20)).await;
+        let busy = worst(&takes(&a, 200).await);
+        assert!(
+            stuck.iter().all(|t| !t.is_finished()),
+            "lookups were meant to be in flight throughout"
+        );
+        assert!(
+            busy < Duration::from_millis(50),
+            "take latency {busy:?} under a stuck lookup (idle: {idle:?})"
+        );
+        for t in stuck {
+            assert_eq!(t.await.unwrap().unwrap().username, "slow");
+        }
+    }
 
     #[test]
     fn cookie_prefix_short_cookie() {
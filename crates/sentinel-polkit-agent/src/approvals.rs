@@ -0,0 +1,406 @@
+// SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Pre-approved auths, one per polkit cookie.
+//!
+//! On user-Allow click, the session calls [`Approvals::hand_off`], which
+//! registers an approval under its cookie and runs the helper-1 exchange
+//! that consumes it. The exchange binds the approval to its connection:
+//! the socket inode of helper-1's end of the agent-helper socket (see
+//! `helper1::run`). `pam_sentinel.so`, running inside that helper-1 with
+//! the same socket as its stdin, names the inode in `TakeApprovalFor`,
+//! and gets this cookie's approval and no other.
+//!
+//! An approval lives exactly as long as its exchange: it is removed when
+//! `hand_off` returns, or when its task is aborted by
+//! `CancelAuthentication`, however long helper-1 took to reach PAM. So
+//! concurrent auths each hold their own approval, run their exchanges in
+//! parallel, and can't take or cancel each other's.
+//!
+//! polkit doesn't tell PAM the cookie, which is why the connection, not
+//! the cookie itself, is what `pam_sentinel` presents.
+//!
+//! With `early_helper`, helper-1 is started as the dialog opens, from an
+//! undecided [`Slot`]: its `TakeApprovalFor` waits in
+//! [`Approvals::take_for`] until the click settles it.
+
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::{Arc, Mutex, MutexGuard};
+use tokio::sync::watch;
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Approval {
+    pub action_id: String,
+    pub cookie: String,
+}
+
+struct Pending {
+    action_id: String,
+    /// helper-1's socket inode, once the exchange has connected.
+    connection: Option<u64>,
+    taken: bool,
+    /// `None` while the dialog is still up (`early_helper`), then
+    /// whether the user allowed.
+    allowed: watch::Receiver<Option<bool>>,
+}
+
+/// Approvals in flight, by cookie. Cheap to clone (shared handle).
+#[derive(Clone, Default)]
+pub struct Approvals {
+    inner: Arc<Mutex<HashMap<String, Pending>>>,
+}
+
+/// An exchange's handle on its approval, to bind it to the helper-1
+/// connection once there is one.
+#[derive(Clone)]
+pub struct Ticket {
+    approvals: Approvals,
+    cookie: String,
+}
+
+impl Ticket {
+    /// Let the `pam_sentinel` whose stdin is socket inode `connection`
+    /// take this approval.
+    pub fn bind(&self, connection: u64) {
+        if let Some(p) = self.approvals.lock().get_mut(&self.cookie) {
+            p.connection = Some(connection);
+        }
+    }
+}
+
+/// One cookie's registered approval. Dropping it (the exchange ended,
+/// or its task was aborted) withdraws the approval, taken or not, and
+/// wakes anyone still waiting on it.
+pub struct Slot {
+    approvals: Approvals,
+    cookie: String,
+    allowed: watch::Sender<Option<bool>>,
+}
+
+impl Slot {
+    pub fn ticket(&self) -> Ticket {
+        Ticket {
+            approvals: self.approvals.clone(),
+            cookie: self.cookie.clone(),
+        }
+    }
+
+    /// Settle an approval opened undecided: `pam_sentinel` waiting in
+    /// [`Approvals::take_for`] gets it if `allow`, and `false` if not.
+    pub fn decide(&self, allow: bool) {
+        self.allowed.send_replace(Some(allow));
+    }
+}
+
+impl Drop for Slot {
+    fn drop(&mut self) {
+        let mut inner = self.approvals.lock();
+        // Ours unless a later slot for the same cookie replaced it.
+        if inner
+            .get(&self.cookie)
+            .is_some_and(|p| p.allowed.same_channel(&self.allowed.subscribe()))
+        {
+            inner.remove(&self.cookie);
+        }
+    }
+}
+
+impl Approvals {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    fn lock(&self) -> MutexGuard<'_, HashMap<String, Pending>> {
+        self.inner.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Register an undecided approval for `cookie`, for a helper-1
+    /// started before the user has answered. Takers wait until
+    /// [`Slot::decide`] or the slot is dropped.
+    ///
+    /// polkit never has two live requests with the same cookie, so a
+    /// second slot for one would be a bug; it replaces the first's
+    /// approval rather than sharing it.
+    pub fn open(&self, cookie: &str, action_id: &str) -> Slot {
+        let (allowed, rx) = watch::channel(None);
+        self.lock().insert(
+            cookie.to_string(),
+            Pending {
+                action_id: action_id.to_string(),
+                connection: None,
+                taken: false,
+                allowed: rx,
+            },
+        );
+        Slot {
+            approvals: self.clone(),
+            cookie: cookie.to_string(),
+            allowed,
+        }
+    }
+
+    /// Approve `cookie` for `action_id`, then run `exchange` — the
+    /// helper-1 round trip whose `pam_sentinel` consumes the approval.
+    /// The approval is withdrawn when the exchange ends.
+    pub async fn hand_off<T, F, Fut>(&self, cookie: &str, action_id: &str, exchange: F) -> T
+    where
+        F: FnOnce(Ticket) -> Fut,
+        Fut: Future<Output = T>,
+    {
+        let slot = self.open(cookie, action_id);
+        slot.decide(true);
+        exchange(slot.ticket()).await
+    }
+
+    /// Consume the approval bound to helper-1 connection `connection`.
+    /// An undecided one is waited for: this is the long poll an early
+    /// helper-1 sits in while the dialog is up. `None` if there is none,
+    /// it was taken, denied, or withdrawn.
+    pub async fn take_for(&self, connection: u64) -> Option<Approval> {
+        loop {
+            let mut allowed = {
+                let mut inner = self.lock();
+                let (cookie, p) = inner
+                    .iter_mut()
+                    .find(|(_, p)| p.connection == Some(connection))?;
+                let decided = *p.allowed.borrow();
+                match decided {
+                    _ if p.taken => return None,
+                    Some(false) => return None,
+                    Some(true) => {
+                        p.taken = true;
+                        return Some(Approval {
+                            action_id: p.action_id.clone(),
+                            cookie: cookie.clone(),
+                        });
+                    }
+                    None => p.allowed.clone(),
+                }
+            };
+            // A closed channel means the slot was dropped: withdrawn.
+            allowed.wait_for(Option::is_some).await.ok()?;
+        }
+    }
+
+    /// Consume the only untaken approval, for a `pam_sentinel` that
+    /// can't name its connection (an older module, or one whose stdin
+    /// isn't the helper socket). With two or more in flight there's no
+    /// telling whose it is, so nothing is handed out; nor is an
+    /// undecided one, which such a caller couldn't wait for anyway.
+    pub fn take_only(&self) -> Option<Approval> {
+        let mut inner = self.lock();
+        let mut untaken = inner.iter_mut().filter(|(_, p)| !p.taken);
+        let (cookie, p) = untaken.next()?;
+        if untaken.next().is_some() || *p.allowed.borrow() != Some(true) {
+            return None;
+        }
+        p.taken = true;
+        Some(Approval {
+            action_id: p.action_id.clone(),
+            cookie: cookie.clone(),
+        })
+    }
+
+    /// Approvals currently in flight, taken or not.
+    pub fn pending(&self) -> usize {
+        self.lock().len()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::Duration;
+    use tokio::sync::Notify;
+
+    fn approval(action_id: &str, cookie: &str) -> Option<Approval> {
+        Some(Approval {
+            action_id: action_id.into(),
+            cookie: cookie.into(),
+        })
+    }
+
+    #[tokio::test]
+    async fn bound_approval_is_taken_once_by_its_connection() {
+        let a = &Approvals::new();
+        let got = a
+            .hand_off("c1", "org.example.foo", |t| async move {
+                assert!(a.take_for(7).await.is_none(), "not bound yet");
+                t.bind(7);
+                assert!(a.take_for(8).await.is_none(), "someone else's connection");
+                (a.take_for(7).await, a.take_for(7).await)
+            })
+            .await;
+        assert_eq!(got, (approval("org.example.foo", "c1"), None));
+        assert_eq!(a.pending(), 0, "withdrawn when the exchange ends");
+    }
+
+    #[tokio::test]
+    async fn approval_outlives_any_fixed_ttl() {
+        let a = &Approvals::new();
+        let got = a
+            .hand_off("c1", "slow", |t| async move {
+                t.bind(7);
+                tokio::time::sleep(Duration::from_millis(1500)).await;
+                a.take_for(7).await
+            })
+            .await;
+        assert_eq!(got, approval("slow", "c1"));
+    }
+
+    #[tokio::test]
+    async fn concurrent_hand_offs_keep_their_own_approvals() {
+        let a = Approvals::new();
+        let both = Arc::new(tokio::sync::Barrier::new(2));
+        let run = |cookie: &'static str, conn: u64| {
+            let (a, both) = (a.clone(), Arc::clone(&both));
+            async move {
+                let a = &a;
+                a.hand_off(cookie, cookie, |t| async move {
+                    t.bind(conn);
+                    // Both approvals are in flight at once.
+                    both.wait().await;
+                    assert!(a.take_only().is_none(), "ambiguous");
+                    both.wait().await;
+                    a.take_for(conn).await
+                })
+                .await
+            }
+        };
+        let (x, y) = tokio::join!(run("x", 1), run("y", 2));
+        assert_eq!((x, y), (approval("x", "x"), approval("y", "y")));
+    }
+
+    #[tokio::test]
+    async fn aborted_hand_off_withdraws_only_its_own() {
+        let a = Approvals::new();
+        let started = Arc::new(Notify::new());
+        let stuck = {
+            let (a, started) = (a.clone(), Arc::clone(&started));
+            tokio::spawn(async move {
+                a.hand_off("canceled", "canceled", |t| async move {
+                    t.bind(1);
+                    started.notify_one();
+                    std::future::pending::<()>().await
+                })
+                .await
+            })
+        };
+        started.notified().await;
+        let live = a.clone();
+        let got = a
+            .hand_off("live", "live", |t| async move {
+                t.bind(2);
+                stuck.abort();
+                let _ = stuck.await;
+                assert!(
+                    live.take_for(1).await.is_none(),
+                    "canceled approval withdrawn"
+                );
+                live.take_for(2).await
+            })
+            .await;
+        assert_eq!(got, approval("live", "live"));
+    }
+
+    #[tokio::test]
+    async fn take_only_serves_a_lone_approval_once() {
+        let a = Approvals::new();
+        assert!(a.take_only().is_none());
+        let got = a
+            .hand_off("c1", "legacy", |_| async { (a.take_only(), a.take_only()) })
+            .await;
+        assert_eq!(got, (approval("legacy", "c1"), None));
+    }
+
+    #[tokio::test]
+    async fn undecided_approval_is_waited_for() {
+        let a = Approvals::new();
+        let slot = a.open("c1", "early");
+        slot.ticket().bind(7);
+        let taker = {
+            let a = a.clone();
+            tokio::spawn(async move { a.take_for(7).await })
+        };
+        for _ in 0..10 {
+            tokio::task::yield_now().await;
+        }
+        assert!(!taker.is_finished(), "waits for the click");
+        assert!(a.take_only().is_none(), "legacy callers can't wait");
+        slot.decide(true);
+        let got = tokio::time::timeout(Duration::from_secs(5), taker).await;
+        assert_eq!(got.unwrap().unwrap(), approval("early", "c1"));
+    }
+
+    #[tokio::test]
+    async fn denied_or_withdrawn_waiters_get_nothing() {
+        let a = Approvals::new();
+        for deny in [true, false] {
+            let slot = a.open("c1", "early");
+            slot.ticket().bind(7);
+            let taker = {
+                let a = a.clone();
+                tokio::spawn(async move { a.take_for(7).await })
+            };
+            tokio::task::yield_now().await;
+            if deny {
+                slot.decide(false);
+            }
+            drop(slot);
+            let got = tokio::time::timeout(Duration::from_secs(5), taker).await;
+            assert_eq!(got.unwrap().unwrap(), None);
+            assert_eq!(a.pending(), 0);
+        }
+    }
+
+    #[tokio::test]
+    async fn replaced_slot_does_not_withdraw_its_successor() {
+        let a = Approvals::new();
+        let early = a.open("c1", "early");
+        let taker = a.clone();
+        let again = a
+            .hand_off("c1", "again", |t| async move {
+                t.bind(3);
+                drop(early);
+                taker.take_for(3).await
+            })
+            .await;
+        assert_eq!(again, approval("again", "c1"));
+    }
+
+    /// What's left on the click path of an early hand-off, agent side:
+    /// `decide` until the waiting `TakeApprovalFor` has its approval.
+    ///
+    /// `cargo test -p sentinel-polkit-agent --release -- --ignored --nocapture bench_`
+    #[tokio::test]
+    #[ignore = "benchmark"]
+    async fn bench_decide_to_take() {
+        let a = Approvals::new();
+        let mut samples = Vec::new();
+        for i in 0..2000u64 {
+            let slot = a.open("c1", "bench");
+            slot.ticket().bind(i);
+            let taker = {
+                let a = a.clone();
+                tokio::spawn(async move {
+                    let got = a.take_for(i).await;
+                    (got, std::time::Instant::now())
+                })
+            };
+            tokio::time::sleep(Duration::from_micros(50)).await;
+            let clicked = std::time::Instant::now();
+            slot.decide(true);
+            let (got, taken) = taker.await.unwrap();
+            assert!(got.is_some());
+            samples.push(taken - clicked);
+        }
+        samples.sort();
+        let q = |p: f64| samples[((samples.len() - 1) as f64 * p) as usize];
+        println!(
+            "decide -> take: p50 {:?}  p99 {:?}  max {:?}",
+            q(0.5),
+            q(0.99),
+            q(1.0)
+        );
+    }
+}
@@ -14,37 +14,69 @@
 //! - Callers are restricted to root by the D-Bus policy shipped at
 //!   `packaging/dbus/org.sentinel.Agent.conf` (only root may
 //!   `send_destination=org.sentinel.Agent`), so a non-root local process
-//!   can't drain the queue.
+//!   can't take approvals.
+//! - Each approval is bound to the helper-1 connection of the exchange
+//!   that made it (see `approvals`), and `TakeApprovalFor` only hands it
+//!   to the `pam_sentinel` on that connection.
 //! - `pam_sentinel` independently verifies that this service's bus name is
 //!   owned by the uid it's authenticating before trusting a reply, so a
 //!   same-name squatter can't forge an approval. See `agent_bypass.rs`.
 
-use crate::approval_queue::ApprovalQueue;
+use crate::agent::cookie_prefix;
+use crate::approvals::{Approval, Approvals};
+use crate::metrics::{Decision, Metrics, Source};
 use log::{info, warn};
 use sentinel_shared::log_kv::quote as q;
 
 pub struct BypassService {
-    pub queue: ApprovalQueue,
+    pub approvals: Approvals,
+    pub metrics: Metrics,
 }
 
 // NOTE: the interface name must equal `sentinel_shared::AGENT_INTERFACE`
 // ("org.sentinel.Agent"); the macro needs a string literal.
 #[zbus::interface(name = "org.sentinel.Agent")]
 impl BypassService {
-    /// Consume one non-expired pre-approval (pushed when the user clicked
-    /// Allow). Returns `true` and consumes it, or `false` if none is pending.
+    /// Consume the pre-approval bound to `connection`: the socket inode
+    /// of the caller's stdin, i.e. of the `polkit-agent-helper-1` the
+    /// approving exchange connected to. Returns `true` and consumes it,
+    /// or `false` if that helper-1 has no approval pending. When helper-1
+    /// was started with the dialog (`early_helper`), the reply waits for
+    /// the user's verdict; the caller sets its own deadline.
     /// The D-Bus policy restricts callers to root, so we don't re-check here.
+    async fn take_approval_for(&self, connection: String) -> bool {
+        let Ok(inode) = connection.parse::<u64>() else {
+            warn!(
+                "agent.bypass: TakeApprovalFor with malformed connection {connection:?}; replying false"
+            );
+            return false;
+        };
+        self.granted(self.approvals.take_for(inode).await, "TakeApprovalFor")
+    }
+
+    /// Consume the pre-approval for a caller that can't name its
+    /// connection (an older `pam_sentinel`). Only succeeds while exactly
+    /// one approval is pending; with more, whose it is can't be told.
     async fn take_approval(&self) -> bool {
-        match self.queue.take_one().await {
+        self.granted(self.approvals.take_only(), "TakeApproval")
+    }
+}
+
+impl BypassService {
+    fn granted(&self, approval: Option<Approval>, method: &str) -> bool {
+        match approval {
             Some(a) => {
                 info!(
-                    "event=auth.allow source=agent.bypass action={}",
-                    q(&a.action_id)
+                    "event=auth.allow source=agent.bypass action={} cookie={}",
+                    q(&a.action_id),
+                    cookie_prefix(&a.cookie)
                 );
+                self.metrics.auth(Source::Bypass, Decision::Allow);
                 true
             }
             None => {
-                warn!("agent.bypass: TakeApproval with no pending approval; replying false");
+                warn!("agent.bypass: {method} with no matching approval; replying false");
+                self.metrics.auth(Source::Bypass, Decision::Miss);
                 false
             }
         }
@@ -0,0 +1,267 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! One dialog for identical concurrent requests.
+//!
+//! A package manager or desktop app often fires the same polkit action
+//! several times at once. Requests that arrive while a dialog for the
+//! same `(action, command, subject, user)` is on screen wait for that
+//! dialog instead of queueing their own; its verdict is then fanned out,
+//! and each request still satisfies its own cookie through
+//! `helper1::run`.
+//!
+//! Only requests *concurrent* with the dialog join it: the entry is
+//! removed before the verdict is published, so a request arriving after
+//! the click gets a dialog of its own. If the dialog fails or its
+//! request is cancelled, the waiters start over (one of them shows the
+//! next dialog).
+
+use crate::helper_ui::HelperError;
+use crate::session::AuthInputs;
+use sentinel_shared::Verdict;
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use tokio::sync::watch;
+
+/// What makes two requests the same question to the user.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct DialogKey {
+    action_id: String,
+    command: Option<String>,
+    subject_pid: Option<i32>,
+    username: String,
+}
+
+impl DialogKey {
+    pub fn of(inputs: &AuthInputs<'_>) -> Self {
+        Self {
+            action_id: inputs.action_id.to_string(),
+            command: inputs.process_cmdline.map(String::from),
+            subject_pid: inputs.process_pid,
+            username: inputs.username.to_string(),
+        }
+    }
+}
+
+/// `None` until the dialog ends; then `Some(None)` if it produced no
+/// verdict (error, cancelled).
+type Outcome = Option<Option<Verdict>>;
+
+/// Dialogs on screen, by key. Cheap to clone (shared handle).
+#[derive(Clone, Default)]
+pub struct Dialogs {
+    open: Arc<Mutex<HashMap<DialogKey, watch::Receiver<Outcome>>>>,
+    shown: Arc<AtomicU64>,
+    saved: Arc<AtomicU64>,
+}
+
+/// How a request got its verdict.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Via {
+    /// It showed the dialog.
+    Shown,
+    /// It waited for an identical request's dialog.
+    Coalesced,
+}
+
+impl Dialogs {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Dialogs actually shown.
+    pub fn shown(&self) -> u64 {
+        self.shown.load(Ordering::Relaxed)
+    }
+
+    /// Dialogs not shown because an identical one was already open.
+    pub fn saved(&self) -> u64 {
+        self.saved.load(Ordering::Relaxed)
+    }
+
+    /// The verdict for `key`: from the dialog already open for it, else
+    /// from `show` (run at most once).
+    pub async fn verdict<F, Fut>(
+        &self,
+        key: DialogKey,
+        show: F,
+    ) -> Result<(Verdict, Via), HelperError>
+    where
+        F: FnOnce() -> Fut,
+        Fut: Future<Output = Result<Verdict, HelperError>>,
+    {
+        loop {
+            let joined = {
+                let mut open = lock(&self.open);
+                match open.get(&key) {
+                    Some(rx) => Err(rx.clone()),
+                    None => {
+                        let (tx, rx) = watch::channel(None);
+                        open.insert(key.clone(), rx);
+                        Ok(tx)
+                    }
+                }
+            };
+            let mut rx = match joined {
+                Ok(tx) => {
+                    let lead = Lead {
+                        dialogs: self,
+                        key: &key,
+                        tx,
+                    };
+                    self.shown.fetch_add(1, Ordering::Relaxed);
+                    let result = show().await;
+                    lead.finish(result.as_ref().ok().copied());
+                    return result.map(|v| (v, Via::Shown));
+                }
+                Err(rx) => rx,
+            };
+            // A closed channel means the leader was dropped mid-dialog.
+            if let Ok(outcome) = rx.wait_for(Option::is_some).await
+                && let Some(Some(verdict)) = *outcome
+            {
+                self.saved.fetch_add(1, Ordering::Relaxed);
+                return Ok((verdict, Via::Coalesced));
+            }
+        }
+    }
+}
+
+/// The request showing a dialog. Unregisters it when dropped, so an
+/// aborted leader releases its waiters.
+struct Lead<'a> {
+    dialogs: &'a Dialogs,
+    key: &'a DialogKey,
+    tx: watch::Sender<Outcome>,
+}
+
+impl Lead<'_> {
+    fn finish(self, verdict: Option<Verdict>) {
+        // Unregister before publishing, so no newcomer can join a
+        // dialog that has already been answered.
+        lock(&self.dialogs.open).remove(self.key);
+        let _ = self.tx.send(Some(verdict));
+    }
+}
+
+impl Drop for Lead<'_> {
+    fn drop(&mut self) {
+        let mut open = lock(&self.dialogs.open);
+        // Ours unless `finish` already removed it and a newcomer has
+        // since opened the next dialog under the same key.
+        if open
+            .get(self.key)
+            .is_some_and(|rx| rx.same_channel(&self.tx.subscribe()))
+        {
+            open.remove(self.key);
+        }
+    }
+}
+
+fn lock<T>(m: &Mutex<T>) -> std::sync::MutexGuard<'_, T> {
+    m.lock().unwrap_or_else(|e| e.into_inner())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use sentinel_shared::Outcome as Decision;
+    use std::time::Duration;
+    use tokio::sync::Notify;
+
+    fn key(action: &str) -> DialogKey {
+        DialogKey {
+            action_id: action.into(),
+            command: Some("/usr/bin/pacman -Syu".into()),
+            subject_pid: Some(42),
+            username: "alice".into(),
+        }
+    }
+
+    fn allow() -> Verdict {
+        Verdict {
+            outcome: Decision::Allow,
+            remember: false,
+            timings: None,
+        }
+    }
+
+    #[tokio::test]
+    async fn concurrent_identical_requests_share_one_dialog() {
+        let dialogs = Dialogs::new();
+        let click = Arc::new(Notify::new());
+        let leader = {
+            let (dialogs, click) = (dialogs.clone(), Arc::clone(&click));
+            tokio::spawn(async move {
+                dialogs
+                    .verdict(key("a"), || async move {
+                        click.notified().await;
+                        Ok(allow())
+                    })
+                    .await
+            })
+        };
+        while dialogs.shown() == 0 {
+            tokio::task::yield_now().await;
+        }
+        let followers: Vec<_> = (0..3)
+            .map(|_| {
+                let dialogs = dialogs.clone();
+                tokio::spawn(async move {
+                    dialogs
+                        .verdict(key("a"), || async { panic!("second dialog shown") })
+                        .await
+                })
+            })
+            .collect();
+        for _ in 0..10 {
+            tokio::task::yield_now().await;
+        }
+        click.notify_one();
+        assert_eq!(leader.await.unwrap().unwrap(), (allow(), Via::Shown));
+        for f in followers {
+            assert_eq!(f.await.unwrap().unwrap(), (allow(), Via::Coalesced));
+        }
+        assert_eq!((dialogs.shown(), dialogs.saved()), (1, 3));
+    }
+
+    #[tokio::test]
+    async fn different_keys_and_later_requests_get_their_own_dialog() {
+        let dialogs = Dialogs::new();
+        let (a, b) = tokio::join!(
+            dialogs.verdict(key("a"), || async { Ok(allow()) }),
+            dialogs.verdict(key("b"), || async { Ok(allow()) }),
+        );
+        assert_eq!(a.unwrap().1, Via::Shown);
+        assert_eq!(b.unwrap().1, Via::Shown);
+        // The dialog for "a" is over: a new request is asked again.
+        let again = dialogs.verdict(key("a"), || async { Ok(allow()) }).await;
+        assert_eq!(again.unwrap().1, Via::Shown);
+        assert_eq!((dialogs.shown(), dialogs.saved()), (3, 0));
+    }
+
+    #[tokio::test]
+    async fn waiters_retry_when_the_dialog_is_cancelled() {
+        let dialogs = Dialogs::new();
+        let leader = {
+            let dialogs = dialogs.clone();
+            tokio::spawn(async move { dialogs.verdict(key("a"), std::future::pending).await })
+        };
+        while dialogs.shown() == 0 {
+            tokio::task::yield_now().await;
+        }
+        let follower = {
+            let dialogs = dialogs.clone();
+            tokio::spawn(async move { dialogs.verdict(key("a"), || async { Ok(allow()) }).await })
+        };
+        tokio::task::yield_now().await;
+        leader.abort();
+        let got = tokio::time::timeout(Duration::from_secs(5), follower)
+            .await
+            .unwrap()
+            .unwrap();
+        assert_eq!(got.unwrap(), (allow(), Via::Shown));
+        assert!(lock(&dialogs.open).is_empty());
+    }
+}
@@ -0,0 +1,240 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! The agent's warm dialog service: one `sentinel-helper-kde --serve`
+//! child per session, kept running so a prompt paints from an
+//! already-loaded Qt/QML stack instead of a fresh helper process.
+//!
+//! The agent owns the service's lifecycle ([`start`] at startup, [`stop`]
+//! at shutdown, a lazy respawn if it dies), which is also how it trusts
+//! it: a listener on the socket is only used when its `SO_PEERCRED` pid
+//! is the child the agent itself spawned from `SENTINEL_HELPER_PATH`.
+//! Nothing crosses a privilege boundary here: the agent and the service
+//! run as the same user, which is also why `pam_sentinel` never uses the
+//! socket (see `sentinel_shared::dialog`).
+//!
+//! Every failure before the request is delivered returns `None`, and
+//! [`crate::helper_ui::run`] falls back to spawning the helper.
+
+use crate::helper_ui::{HELPER_PATH, HelperError};
+use sentinel_shared::Verdict;
+use sentinel_shared::dialog::{
+    self, PROTOCOL_VERSION, Request, Response, SERVICE_MARKER_ENV, UNTRUSTED_ENV,
+};
+use std::process::{Child, Command, Stdio};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::UnixStream;
+
+/// Minimum gap between spawns, so a service that can't start (no
+/// Wayland display, broken Qt install) doesn't cost a Qt startup on
+/// every prompt.
+const RESPAWN_BACKOFF: Duration = Duration::from_secs(60);
+
+/// Cap on delivering the request to the service.
+const WRITE_TIMEOUT: Duration = Duration::from_secs(1);
+
+/// Slack on top of the dialog's own auto-deny before the agent gives
+/// up on a reply (same role as the PAM module's `HELPER_GRACE_SECS`).
+const REPLY_GRACE: Duration = Duration::from_secs(5);
+
+struct Supervised {
+    child: Child,
+    spawned: Instant,
+}
+
+static SERVICE: Mutex<Option<Supervised>> = Mutex::new(None);
+
+/// Spawn the service now so it is warm by the first prompt. Best-effort.
+pub fn start() {
+    let _ = live_pid();
+}
+
+/// Terminate the service (agent shutdown).
+pub fn stop() {
+    let mut slot = SERVICE.lock().unwrap_or_else(|e| e.into_inner());
+    if let Some(mut s) = slot.take() {
+        let _ = s.child.kill();
+        let _ = s.child.wait();
+    }
+}
+
+/// Pid of the running service, (re)spawning it if it isn't running and
+/// the backoff has passed. `None` while it's down.
+fn live_pid() -> Option<u32> {
+    let mut slot = SERVICE.lock().unwrap_or_else(|e| e.into_inner());
+    if let Some(s) = slot.as_mut() {
+        match s.child.try_wait() {
+            Ok(None) => return Some(s.child.id()),
+            Ok(Some(status)) => log::debug!("event=dialog.service_exited status={status}"),
+            Err(e) => log::debug!("event=dialog.service_exited error={e}"),
+        }
+        if s.spawned.elapsed() < RESPAWN_BACKOFF {
+            return None;
+        }
+    }
+    // Same sanitized environment the service would re-exec itself into,
+    // so it starts in one exec.
+    let mut cmd = Command::new(HELPER_PATH);
+    cmd.arg("--serve")
+        .env(SERVICE_MARKER_ENV, "1")
+        .stdin(Stdio::null())
+        .stdout(Stdio::null())
+        .stderr(Stdio::null());
+    for key in UNTRUSTED_ENV {
+        cmd.env_remove(key);
+    }
+    let spawned = Instant::now();
+    match cmd.spawn() {
+        Ok(child) => {
+            let pid = child.id();
+            log::debug!("event=dialog.service_spawned pid={pid}");
+            *slot = Some(Supervised { child, spawned });
+            // Not `Some(pid)`: the socket isn't bound until Qt is up, so
+            // this prompt takes the CLI path and the next one is warm.
+            None
+        }
+        Err(e) => {
+            log::warn!("event=dialog.service_spawn_failed error={e}");
+            None
+        }
+    }
+}
+
+/// Show `req` through the service. `None` = nothing was shown.
+pub async fn request(req: &Request) -> Option<Result<Verdict, HelperError>> {
+    let pid = live_pid()?;
+    let uid = nix::unistd::getuid().as_raw();
+    let stream = UnixStream::connect(dialog::socket_path(uid)).await.ok()?;
+    let peer = stream.peer_cred().ok()?.pid();
+    if peer != i32::try_from(pid).ok() {
+        log::warn!("event=dialog.untrusted pid={peer:?} service_pid={pid}");
+        return None;
+    }
+    let deadline = (req.timeout != 0).then(|| Duration::from_secs(req.timeout) + REPLY_GRACE);
+    exchange(stream, req, deadline).await
+}
+
+/// Send one request and wait up to `deadline` (`None` = forever) for the
+/// verdict. Once the request is out, failures are errors (the dialog
+/// may be on screen), not fallbacks; `Unsupported` and `Busy` say
+/// nothing was shown.
+async fn exchange(
+    mut stream: UnixStream,
+    req: &Request,
+    deadline: Option<Duration>,
+) -> Option<Result<Verdict, HelperError>> {
+    let frame = dialog::encode_frame(req).ok()?;
+    tokio::time::timeout(WRITE_TIMEOUT, stream.write_all(&frame))
+        .await
+        .ok()?
+        .ok()?;
+
+    let read = async {
+        let mut header = [0u8; 4];
+        stream.read_exact(&mut header).await?;
+        let mut body = vec![0u8; dialog::frame_len(header)?];
+        stream.read_exact(&mut body).await?;
+        dialog::decode_body::<Response>(&body)
+    };
+    let reply = match deadline {
+        Some(d) => tokio::time::timeout(d, read)
+            .await
+            .unwrap_or_else(|_| Err(std::io::ErrorKind::TimedOut.into())),
+        None => read.await,
+    };
+    match reply {
+        Ok(Response::Verdict(v)) => Some(Ok(v)),
+        Ok(Response::Unsupported { protocol }) => {
+            log::debug!(
+                "event=dialog.unsupported service_protocol={protocol} ours={PROTOCOL_VERSION}"
+            );
+            None
+        }
+        Ok(Response::Busy) => {
+            log::debug!("event=dialog.busy");
+            None
+        }
+        Err(e) => Some(Err(HelperError::Io(e))),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use sentinel_shared::Outcome;
+
+    fn request() -> Request {
+        Request {
+            protocol: PROTOCOL_VERSION,
+            title: "T".into(),
+            message: "M".into(),
+            secondary: String::new(),
+            timeout: 0,
+            min_time: 0,
+            randomize: false,
+            sound_name: String::new(),
+            remember_secs: 0,
+            process_exe: None,
+            process_cmdline: None,
+            process_pid: None,
+            process_cwd: None,
+            requesting_user: None,
+            action: Some("org.example.test".into()),
+            locale: Vec::new(),
+        }
+    }
+
+    /// Service end of a pair: read one request, answer with `reply`.
+    fn fake_service(mut service: std::os::unix::net::UnixStream, reply: Option<Response>) {
+        std::thread::spawn(move || {
+            let got: Request = dialog::read_frame(&mut service).unwrap();
+            assert_eq!(got, request());
+            if let Some(r) = reply {
+                dialog::write_frame(&mut service, &r).unwrap();
+            }
+        });
+    }
+
+    fn pair() -> (UnixStream, std::os::unix::net::UnixStream) {
+        let (a, b) = std::os::unix::net::UnixStream::pair().unwrap();
+        a.set_nonblocking(true).unwrap();
+        (UnixStream::from_std(a).unwrap(), b)
+    }
+
+    #[tokio::test]
+    async fn verdict_round_trip() {
+        let (client, service) = pair();
+        let v = Verdict {
+            outcome: Outcome::Deny,
+            remember: false,
+            timings: None,
+        };
+        fake_service(service, Some(Response::Verdict(v)));
+        let got = exchange(client, &request(), None).await;
+        assert!(matches!(got, Some(Ok(got)) if got == v));
+    }
+
+    #[tokio::test]
+    async fn unsupported_falls_back() {
+        let (client, service) = pair();
+        fake_service(service, Some(Response::Unsupported { protocol: 2 }));
+        assert!(exchange(client, &request(), None).await.is_none());
+    }
+
+    #[tokio::test]
+    async fn busy_falls_back() {
+        let (client, service) = pair();
+        fake_service(service, Some(Response::Busy));
+        let got = exchange(client, &request(), Some(Duration::from_secs(5))).await;
+        assert!(got.is_none());
+    }
+
+    #[tokio::test]
+    async fn hangup_after_delivery_is_an_error() {
+        let (client, service) = pair();
+        fake_service(service, None);
+        let got = exchange(client, &request(), Some(Duration::from_secs(5))).await;
+        assert!(matches!(got, Some(Err(_))));
+    }
+}
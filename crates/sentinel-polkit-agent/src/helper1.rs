@@ -19,11 +19,21 @@
 //! ```
 //!
 //! Because `pam_sentinel.so` short-circuits to `PAM_SUCCESS` via the
-//! agent socket bypass, the PAM stack inside helper-1 should never
-//! prompt — we just consume the stream until `SUCCESS`/`FAILURE`.
+//! agent bypass, the PAM stack inside helper-1 should never prompt — we
+//! just consume the stream until `SUCCESS`/`FAILURE`.
+//!
+//! helper-1's stdin is the accepted end of our connection, so
+//! `pam_sentinel` identifies itself by that socket's inode. Before
+//! sending the cookie we look the inode up (the peer of our end, via
+//! `NETLINK_SOCK_DIAG`) and bind this exchange's approval to it.
 
+use crate::approvals::Ticket;
 use anyhow::{Context, Result};
 use log::{debug, warn};
+use nix::sys::socket::{AddressFamily, SockFlag, SockProtocol, SockType};
+use std::fs::File;
+use std::io::{self, Read, Write};
+use std::os::fd::AsFd;
 use std::path::Path;
 use std::time::Duration;
 use tokio::io::{AsyncBufReadExt, AsyncWriteExt, BufReader};
@@ -42,6 +52,12 @@ const HELPER1_TIMEOUT: Duration = Duration::from_secs(10);
 pub struct Run<'a> {
     pub username: &'a str,
     pub cookie: &'a str,
+    /// This exchange's approval, bound once we know helper-1's end.
+    pub ticket: Ticket,
+    /// How long helper-1 may wait for the user on top of
+    /// [`HELPER1_TIMEOUT`]: zero after the click, the dialog's span when
+    /// it was started with the dialog (`early_helper`).
+    pub wait: Duration,
 }
 
 pub async fn run(args: Run<'_>) -> Result<bool> {
@@ -53,13 +69,13 @@ pub async fn run(args: Run<'_>) -> Result<bool> {
         log::debug!("helper1::run: short-circuit via SENTINEL_TEST_HELPER1_OUTCOME={canned}");
         return Ok(canned == "SUCCESS");
     }
-    match tokio::time::timeout(HELPER1_TIMEOUT, run_inner(args)).await {
+    let limit = HELPER1_TIMEOUT + args.wait;
+    match tokio::time::timeout(limit, run_inner(args)).await {
         Ok(res) => res,
         Err(_) => {
             warn!(
-                "polkit-agent-helper-1 did not produce a verdict within {:?}; \
-                 treating as FAILURE",
-                HELPER1_TIMEOUT
+                "polkit-agent-helper-1 did not produce a verdict within {limit:?}; \
+                 treating as FAILURE"
             );
             Ok(false)
         }
@@ -78,6 +94,14 @@ async fn run_inner(args: Run<'_>) -> Result<bool> {
         .await
         .with_context(|| format!("connect {HELPER_SOCKET_PATH}"))?;
 
+    // Bind before helper-1 has the cookie, so the approval is there by
+    // the time PAM runs. Without it only an unambiguous legacy
+    // `TakeApproval` can succeed.
+    match peer_inode(&stream) {
+        Ok(inode) => args.ticket.bind(inode),
+        Err(e) => warn!("helper1: can't identify helper-1's socket ({e}); approval left unbound"),
+    }
+
     let (reader, mut writer) = stream.into_split();
     writer
         .write_all(format!("{}\n{}\n", args.username, args.cookie).as_bytes())
@@ -123,3 +147,113 @@ async fn run_inner(args: Run<'_>) -> Result<bool> {
 
     Ok(verdict.unwrap_or(false))
 }
+
+// <linux/sock_diag.h>, <linux/unix_diag.h>
+const SOCK_DIAG_BY_FAMILY: u16 = 20;
+const NLM_F_REQUEST: u16 = 1;
+const NLMSG_ERROR: u16 = 2;
+const UDIAG_SHOW_PEER: u32 = 1 << 2;
+const UNIX_DIAG_PEER: u16 = 2;
+const NLMSG_HDRLEN: usize = 16;
+const UNIX_DIAG_MSG_LEN: usize = 16;
+
+/// Inode of the socket at the other end of `stream`.
+fn peer_inode(stream: &impl AsFd) -> io::Result<u64> {
+    let own = nix::sys::stat::fstat(stream)?.st_ino;
+    let own = u32::try_from(own).map_err(|_| io::Error::other("socket inode out of range"))?;
+    let nl = nix::sys::socket::socket(
+        AddressFamily::Netlink,
+        SockType::Raw,
+        SockFlag::SOCK_CLOEXEC,
+        SockProtocol::NetlinkSockDiag,
+    )?;
+    // Unconnected netlink sends go to the kernel, which answers before
+    // `write` returns.
+    let mut nl = File::from(nl);
+    nl.write_all(&diag_request(own))?;
+    let mut buf = [0u8; 512];
+    let n = nl.read(&mut buf)?;
+    parse_peer(&buf[..n])
+}
+
+/// `nlmsghdr` + `unix_diag_req` asking for `inode`'s peer.
+fn diag_request(inode: u32) -> Vec<u8> {
+    let mut m = Vec::with_capacity(NLMSG_HDRLEN + 24);
+    m.extend_from_slice(&(NLMSG_HDRLEN as u32 + 24).to_ne_bytes());
+    m.extend_from_slice(&SOCK_DIAG_BY_FAMILY.to_ne_bytes());
+    m.extend_from_slice(&NLM_F_REQUEST.to_ne_bytes());
+    m.extend_from_slice(&[0; 8]); // seq, pid
+    // family, protocol, pad
+    m.extend_from_slice(&[AddressFamily::Unix as i32 as u8, 0, 0, 0]);
+    m.extend_from_slice(&u32::MAX.to_ne_bytes()); // every state
+    m.extend_from_slice(&inode.to_ne_bytes());
+    m.extend_from_slice(&UDIAG_SHOW_PEER.to_ne_bytes());
+    m.extend_from_slice(&[0xff; 8]); // any cookie
+    m
+}
+
+/// The `UNIX_DIAG_PEER` attribute of a `unix_diag_msg` reply.
+fn parse_peer(reply: &[u8]) -> io::Result<u64> {
+    let u16_at = |i: usize| {
+        reply
+            .get(i..i + 2)
+            .map(|b| u16::from_ne_bytes([b[0], b[1]]))
+    };
+    let u32_at = |i: usize| {
+        reply
+            .get(i..i + 4)
+            .map(|b| u32::from_ne_bytes([b[0], b[1], b[2], b[3]]))
+    };
+    let short = || io::Error::other("short sock_diag reply");
+    let len = (u32_at(0).ok_or_else(short)? as usize).min(reply.len());
+    match u16_at(4).ok_or_else(short)? {
+        NLMSG_ERROR => {
+            let errno = u32_at(NLMSG_HDRLEN).ok_or_else(short)? as i32;
+            return Err(io::Error::from_raw_os_error(-errno));
+        }
+        SOCK_DIAG_BY_FAMILY => {}
+        other => return Err(io::Error::other(format!("sock_diag reply type {other}"))),
+    }
+    let mut at = NLMSG_HDRLEN + UNIX_DIAG_MSG_LEN;
+    while at + 4 <= len {
+        let rta_len = usize::from(u16_at(at).ok_or_else(short)?);
+        if rta_len < 4 {
+            break;
+        }
+        if u16_at(at + 2) == Some(UNIX_DIAG_PEER) {
+            return u32_at(at + 4).map(u64::from).ok_or_else(short);
+        }
+        at += rta_len.next_multiple_of(4);
+    }
+    Err(io::Error::other("socket has no peer"))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::os::unix::net::UnixStream as StdStream;
+
+    fn inode(s: &StdStream) -> u64 {
+        nix::sys::stat::fstat(s).unwrap().st_ino
+    }
+
+    #[test]
+    fn finds_the_other_end_of_a_socket() {
+        let (a, b) = StdStream::pair().unwrap();
+        assert_eq!(peer_inode(&a).unwrap(), inode(&b));
+        assert_eq!(peer_inode(&b).unwrap(), inode(&a));
+    }
+
+    #[test]
+    fn error_replies_surface_the_errno() {
+        let mut reply = Vec::new();
+        reply.extend_from_slice(&36u32.to_ne_bytes());
+        reply.extend_from_slice(&NLMSG_ERROR.to_ne_bytes());
+        reply.extend_from_slice(&[0; 10]);
+        reply.extend_from_slice(&(-2i32).to_ne_bytes());
+        reply.extend_from_slice(&[0; 16]);
+        let err = parse_peer(&reply).unwrap_err();
+        assert_eq!(err.raw_os_error(), Some(2));
+        assert!(parse_peer(&[0; 8]).is_err());
+    }
+}
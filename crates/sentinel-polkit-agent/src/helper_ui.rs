@@ -5,14 +5,17 @@
 //!
 //! Unlike `pam-sentinel`'s helper.rs, the agent already runs as the
 //! requesting user — no fork/setuid dance needed. Just `tokio::process`.
+//!
+//! The agent's warm dialog service ([`crate::dialog_service`]) is asked
+//! first; spawning the helper is the fallback when it isn't up.
 
-use sentinel_shared::{POLKIT_PAM_SERVICE, ServiceConfig, Verdict, format_message};
+use sentinel_shared::{POLKIT_PAM_SERVICE, ServiceConfig, Verdict, dialog, format_message};
 use std::process::Stdio;
 use thiserror::Error;
 use tokio::io::{AsyncBufReadExt, BufReader};
 use tokio::process::Command;
 
-const HELPER_PATH: &str = env!("SENTINEL_HELPER_PATH");
+pub(crate) const HELPER_PATH: &str = env!("SENTINEL_HELPER_PATH");
 
 #[derive(Debug, Error)]
 pub enum HelperError {
@@ -122,9 +125,36 @@ impl Request {
             action: Some(args.action_id.to_string()),
         }
     }
+
+    /// The dialog-service form of this request. The CLI path lets the
+    /// helper inherit the agent's locale; the service gets it forwarded.
+    fn to_dialog(&self) -> dialog::Request {
+        dialog::Request {
+            protocol: dialog::PROTOCOL_VERSION,
+            title: self.title.clone(),
+            message: self.message.clone(),
+            secondary: self.secondary.clone(),
+            timeout: self.timeout,
+            min_time: self.min_time,
+            randomize: self.randomize,
+            sound_name: self.sound_name.clone(),
+            remember_secs: self.remember_secs,
+            process_exe: self.process_exe.clone(),
+            process_cmdline: self.process_cmdline.clone(),
+            process_pid: self.process_pid,
+            process_cwd: self.process_cwd.clone(),
+            requesting_user: self.requesting_user.clone(),
+            action: self.action.clone(),
+            locale: ["LC_ALL", "LC_MESSAGES", "LANG"]
+                .into_iter()
+                .filter_map(|k| Some((k.to_owned(), std::env::var(k).ok()?)))
+                .collect(),
+        }
+    }
 }
 
-/// Spawn the helper, await its outcome.
+/// Show the dialog through the warm service, or spawn the helper and
+/// await its outcome.
 ///
 /// Test seam: if `SENTINEL_TEST_HELPER_OUTCOME` is set to one of
 /// `ALLOW` / `DENY` / `TIMEOUT`, short-circuit the spawn and return
@@ -139,6 +169,9 @@ pub async fn run(req: Request) -> Result<Verdict, HelperError> {
             return Ok(v);
         }
     }
+    if let Some(result) = crate::dialog_service::request(&req.to_dialog()).await {
+        return result;
+    }
     let mut cmd = Command::new(HELPER_PATH);
     cmd.arg("--title")
         .arg(&req.title)
@@ -13,12 +13,16 @@
 //! duplication when both targets share `src/`).
 
 pub mod agent;
-pub mod approval_queue;
+pub mod approvals;
 pub mod authority;
 pub mod bypass_service;
+pub mod coalesce;
+pub mod dialog_service;
 pub mod helper1;
 pub mod helper_ui;
 pub mod identity;
+pub mod live_config;
+pub mod metrics;
 pub mod remember;
 pub mod session;
 pub mod subject;
@@ -0,0 +1,247 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! The `polkit-1` config, parsed once and kept current.
+//!
+//! `BeginAuthentication` used to call `sentinel_shared::load` for every
+//! request: a stat and a file read, and a TOML parse whenever the root
+//! snapshot wasn't there to trust. A broken edit also meant the built-in
+//! defaults for every request until it was fixed. Instead the agent
+//! resolves the config at startup and watches the config's directory
+//! with inotify. Editors replace the file by rename, which a watch on the
+//! file itself would lose. On a change it re-reads the file and
+//! publishes the result through a `watch` channel, so a request costs an
+//! `Arc` clone.
+//!
+//! A reload that fails keeps the last good config and logs
+//! `event=config.reload_failed`. A deleted file is not a failure: it
+//! means the built-in defaults, as it does everywhere else. If inotify
+//! is unavailable the agent goes back to loading per request.
+
+use log::{debug, info, warn};
+use nix::sys::inotify::{AddWatchFlags, InitFlags, Inotify};
+use sentinel_shared::log_kv::quote as q;
+use sentinel_shared::{Document, POLKIT_PAM_SERVICE, ServiceConfig};
+use std::ffi::OsString;
+use std::io;
+use std::os::fd::{AsFd, AsRawFd, RawFd};
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::Duration;
+use tokio::io::unix::AsyncFd;
+use tokio::sync::watch;
+
+/// Wait after the first event before re-reading, so a save that takes
+/// several steps (truncate + write, or write temp + rename) is read
+/// once it is complete.
+const SETTLE: Duration = Duration::from_millis(50);
+
+/// Cheap to clone (shared handle).
+#[derive(Clone)]
+pub struct LiveConfig {
+    source: Source,
+}
+
+#[derive(Clone)]
+enum Source {
+    Watched(watch::Receiver<Arc<ServiceConfig>>),
+    /// No inotify: read the config per request, as before.
+    PerRequest,
+}
+
+impl LiveConfig {
+    /// Load the config at `path` and follow its edits. Must be called
+    /// inside the tokio runtime.
+    pub fn watch(path: &Path) -> Self {
+        let watcher = match Watcher::new(path) {
+            Ok(w) => w,
+            Err(e) => {
+                warn!(
+                    "event=config.watch_failed path={} error={} note=\"loading per request\"",
+                    q(&path.display().to_string()),
+                    q(&e.to_string())
+                );
+                return Self {
+                    source: Source::PerRequest,
+                };
+            }
+        };
+        // Watch first, then load, so no edit falls in between.
+        let (doc, _) = Document::load_checked(path);
+        let (tx, rx) = watch::channel(Arc::new(doc.for_service(POLKIT_PAM_SERVICE)));
+        tokio::spawn(follow(path.to_path_buf(), watcher, tx));
+        Self {
+            source: Source::Watched(rx),
+        }
+    }
+
+    /// A config that never changes, for tests.
+    pub fn fixed(cfg: ServiceConfig) -> Self {
+        let (_, rx) = watch::channel(Arc::new(cfg));
+        Self {
+            source: Source::Watched(rx),
+        }
+    }
+
+    /// The config as of the last good load.
+    pub fn current(&self) -> Arc<ServiceConfig> {
+        match &self.source {
+            Source::Watched(rx) => Arc::clone(&rx.borrow()),
+            Source::PerRequest => Arc::new(sentinel_shared::load(POLKIT_PAM_SERVICE)),
+        }
+    }
+}
+
+/// An inotify watch on the directory holding the config.
+struct Watcher {
+    fd: AsyncFd<Fd>,
+    name: OsString,
+}
+
+/// `AsyncFd` wants `AsRawFd`, which `Inotify` doesn't implement.
+struct Fd(Inotify);
+
+impl AsRawFd for Fd {
+    fn as_raw_fd(&self) -> RawFd {
+        self.0.as_fd().as_raw_fd()
+    }
+}
+
+impl Watcher {
+    fn new(path: &Path) -> io::Result<Self> {
+        let (Some(dir), Some(name)) = (path.parent(), path.file_name()) else {
+            return Err(io::Error::from(io::ErrorKind::InvalidInput));
+        };
+        let inotify = Inotify::init(InitFlags::IN_NONBLOCK | InitFlags::IN_CLOEXEC)?;
+        inotify.add_watch(
+            dir,
+            AddWatchFlags::IN_CLOSE_WRITE
+                | AddWatchFlags::IN_MOVED_TO
+                | AddWatchFlags::IN_MOVED_FROM
+                | AddWatchFlags::IN_CREATE
+                | AddWatchFlags::IN_DELETE
+                | AddWatchFlags::IN_ATTRIB,
+        )?;
+        Ok(Self {
+            fd: AsyncFd::new(Fd(inotify))?,
+            name: name.to_os_string(),
+        })
+    }
+
+    /// Wait for an event on the config file. Events for its neighbours
+    /// are skipped.
+    async fn changed(&self) -> io::Result<()> {
+        loop {
+            let mut ready = self.fd.readable().await?;
+            match ready.try_io(|fd| fd.get_ref().0.read_events().map_err(io::Error::from)) {
+                Ok(events) => {
+                    if events?.iter().any(|e| e.name.as_ref() == Some(&self.name)) {
+                        return Ok(());
+                    }
+                }
+                Err(_would_block) => continue,
+            }
+        }
+    }
+
+    /// Discard events that are already queued.
+    fn drain(&self) {
+        while self.fd.get_ref().0.read_events().is_ok() {}
+    }
+}
+
+async fn follow(path: PathBuf, watcher: Watcher, tx: watch::Sender<Arc<ServiceConfig>>) {
+    loop {
+        if let Err(e) = watcher.changed().await {
+            warn!(
+                "event=config.watch_failed path={} error={} note=\"keeping the current config\"",
+                q(&path.display().to_string()),
+                q(&e.to_string())
+            );
+            return;
+        }
+        tokio::time::sleep(SETTLE).await;
+        watcher.drain();
+        reload(&path, &tx);
+    }
+}
+
+/// Re-read `path` into `tx`, or log why not and leave `tx` alone.
+fn reload(path: &Path, tx: &watch::Sender<Arc<ServiceConfig>>) {
+    let shown = path.display().to_string();
+    match Document::try_load_from(path) {
+        Ok(doc) => {
+            let cfg = doc.for_service(POLKIT_PAM_SERVICE);
+            if **tx.borrow() == cfg {
+                debug!("live_config: {shown} changed on disk but not in effect");
+                return;
+            }
+            tx.send_replace(Arc::new(cfg));
+            info!("event=config.reload path={}", q(&shown));
+        }
+        Err(e) => warn!(
+            "event=config.reload_failed path={} error={} note=\"keeping the last good config\"",
+            q(&shown),
+            q(&e.to_string())
+        ),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn dir(tag: &str) -> PathBuf {
+        let d = std::env::temp_dir().join(format!("sentinel-live-{tag}-{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&d);
+        std::fs::create_dir_all(&d).unwrap();
+        d
+    }
+
+    /// Poll until `cfg` satisfies `pred`, or fail after 5 s.
+    async fn until(cfg: &LiveConfig, pred: impl Fn(&ServiceConfig) -> bool) {
+        let deadline = tokio::time::Instant::now() + Duration::from_secs(5);
+        while !pred(&cfg.current()) {
+            assert!(
+                tokio::time::Instant::now() < deadline,
+                "config never updated"
+            );
+            tokio::time::sleep(Duration::from_millis(10)).await;
+        }
+    }
+
+    #[tokio::test]
+    async fn edits_are_picked_up_and_broken_ones_ignored() {
+        let d = dir("edit");
+        let path = d.join("sentinel.conf");
+        std::fs::write(&path, "[general]\ntimeout = 11\n").unwrap();
+        let cfg = LiveConfig::watch(&path);
+        assert_eq!(cfg.current().timeout, 11);
+
+        std::fs::write(&path, "[general]\ntimeout = 12\n").unwrap();
+        until(&cfg, |c| c.timeout == 12).await;
+
+        // A broken edit keeps the last good config, not the defaults.
+        std::fs::write(&path, "[general\ntimeout = 13\n").unwrap();
+        tokio::time::sleep(SETTLE * 4).await;
+        assert_eq!(cfg.current().timeout, 12);
+
+        // Replace by rename, as editors do.
+        let tmp = d.join(".sentinel.conf.swp");
+        std::fs::write(&tmp, "[general]\ntimeout = 14\n").unwrap();
+        std::fs::rename(&tmp, &path).unwrap();
+        until(&cfg, |c| c.timeout == 14).await;
+
+        // Neighbours don't matter; removal means the defaults.
+        std::fs::write(d.join("other.conf"), "junk").unwrap();
+        std::fs::remove_file(&path).unwrap();
+        let defaults = Document::defaults().for_service(POLKIT_PAM_SERVICE);
+        until(&cfg, |c| *c == defaults).await;
+        let _ = std::fs::remove_dir_all(&d);
+    }
+
+    #[tokio::test]
+    async fn unwatchable_path_falls_back_to_per_request_loads() {
+        let cfg = LiveConfig::watch(Path::new("/nonexistent-sentinel-dir/sentinel.conf"));
+        assert!(matches!(cfg.source, Source::PerRequest));
+    }
+}
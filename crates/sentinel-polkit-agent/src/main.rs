@@ -1,10 +1,13 @@
 // SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
 // SPDX-License-Identifier: GPL-3.0-or-later
 use anyhow::{Context, Result};
-use clap::{CommandFactory, Parser, Subcommand};
+use clap::{CommandFactory, Parser, Subcommand, ValueEnum};
 use log::{info, warn};
-use sentinel_polkit_agent::{agent, approval_queue, authority, bypass_service, subject};
+use sentinel_polkit_agent::{
+    agent, approvals, authority, bypass_service, dialog_service, live_config, metrics, subject,
+};
 use sentinel_shared::audit;
+use std::path::Path;
 use zbus::Connection;
 
 const BIN: &str = "sentinel-polkit-agent";
@@ -26,8 +29,25 @@ struct Args {
     /// Verbose logging.
     #[arg(long)]
     debug: bool,
+
+    /// Tokio runtime flavor. Blocking `/proc`, NSS and config work runs
+    /// on the blocking pool either way; `multi-thread` also spreads the
+    /// async side (D-Bus dispatch, dialogs) over one worker per CPU.
+    #[arg(long, value_enum, default_value_t = Flavor::CurrentThread)]
+    runtime: Flavor,
+}
+
+#[derive(ValueEnum, Debug, Clone, Copy)]
+enum Flavor {
+    CurrentThread,
+    MultiThread,
 }
 
+/// Cap on the blocking pool. Each in-flight `BeginAuthentication` holds
+/// one thread at most while it gathers; more than this many stuck at
+/// once (a dead LDAP server) queue rather than pile up threads.
+const MAX_BLOCKING_THREADS: usize = 16;
+
 #[derive(Subcommand, Debug, Clone)]
 #[command(hide = true)]
 enum GenSubcommand {
@@ -41,7 +61,7 @@ enum GenSubcommand {
 }
 
 fn init_logger(debug: bool) {
-    audit::init_syslog(
+    audit::init(
         BIN,
         if debug {
             log::LevelFilter::Debug
@@ -60,8 +80,13 @@ fn main() -> Result<()> {
 
     init_logger(args.debug);
 
-    let rt = tokio::runtime::Builder::new_current_thread()
+    let mut builder = match args.runtime {
+        Flavor::CurrentThread => tokio::runtime::Builder::new_current_thread(),
+        Flavor::MultiThread => tokio::runtime::Builder::new_multi_thread(),
+    };
+    let rt = builder
         .enable_all()
+        .max_blocking_threads(MAX_BLOCKING_THREADS)
         .build()
         .context("build tokio runtime")?;
     rt.block_on(run(args))
@@ -82,15 +107,19 @@ fn run_gen(g: &GenSubcommand) -> Result<()> {
 
 async fn run(args: Args) -> Result<()> {
     let uid = nix::unistd::getuid().as_raw();
-    let queue = approval_queue::ApprovalQueue::new();
-    let bypass_queue = queue.clone();
+    let approvals = approvals::Approvals::new();
+    let bypass_approvals = approvals.clone();
 
     let conn = Connection::system().await.context("connect system bus")?;
 
     let subject =
         subject::current(args.session_id.as_deref()).context("build unix-session subject")?;
 
-    let agent = agent::Agent::new(uid, queue);
+    let config = live_config::LiveConfig::watch(Path::new(sentinel_shared::CONFIG_PATH));
+    let metrics = metrics::Metrics::new();
+    let metrics_path = metrics::file_path(uid);
+    metrics.export(metrics_path.clone());
+    let agent = agent::Agent::new(uid, approvals, config, metrics.clone());
     conn.object_server()
         .at(AGENT_OBJECT_PATH, agent)
         .await
@@ -104,7 +133,8 @@ async fn run(args: Args) -> Result<()> {
         .at(
             sentinel_shared::AGENT_OBJECT_PATH,
             bypass_service::BypassService {
-                queue: bypass_queue,
+                approvals: bypass_approvals,
+                metrics,
             },
         )
         .await
@@ -170,6 +200,10 @@ async fn run(args: Args) -> Result<()> {
         .context("Authority.RegisterAuthenticationAgent");
     }
 
+    // Warm the dialog service in the background; the first prompt falls
+    // back to a one-shot helper if it isn't listening yet.
+    dialog_service::start();
+
     let mut sigterm = tokio::signal::unix::signal(tokio::signal::unix::SignalKind::terminate())
         .context("install SIGTERM handler")?;
     let mut sigint = tokio::signal::unix::signal(tokio::signal::unix::SignalKind::interrupt())
@@ -186,6 +220,9 @@ async fn run(args: Args) -> Result<()> {
         warn!("UnregisterAuthenticationAgent failed: {e}");
     }
 
+    dialog_service::stop();
+    // Stale numbers are worse than none to a scraper.
+    let _ = std::fs::remove_file(&metrics_path);
     info!("shutdown complete");
     Ok(())
 }
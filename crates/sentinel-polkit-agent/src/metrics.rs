@@ -0,0 +1,384 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! In-process counters and latency histograms, exported as OpenMetrics.
+//!
+//! Before this, the only timing data was the `latency_ms` field on single
+//! audit lines, so a dashboard had to grep the journal. The agent now
+//! counts auths by source and outcome and records three latencies:
+//! - `dialog`: request to verdict, the `latency_ms` of the audit line;
+//! - `helper_spawn`: request to the dialog helper running (`spawn_ms`);
+//! - `helper1`: the `polkit-agent-helper-1` exchange from the verdict to
+//!   its answer (`handoff_ms`), i.e. what the user waits after deciding.
+//!
+//! The histograms are log-linear in the style of HDR histograms: four
+//! buckets per power of two, so a reading is off by at most 25% of its
+//! value anywhere between 128 µs and several minutes. Recording is a few
+//! relaxed atomic adds.
+//!
+//! The text is rewritten to [`file_path`] shortly after each change, for
+//! a node exporter's textfile collector. Only the session's user can read
+//! it: `$XDG_RUNTIME_DIR` is theirs alone and the file is `0600`. It is
+//! deliberately not a property on `org.sentinel.Agent`, whose system-bus
+//! policy can't limit a read to the agent's own user.
+
+use log::warn;
+use sentinel_shared::log_kv::quote as q;
+use std::fmt::Write as _;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, Ordering::Relaxed};
+use std::time::Duration;
+use tokio::sync::Notify;
+
+/// File name under `$XDG_RUNTIME_DIR`.
+pub const FILE_NAME: &str = "sentinel-agent.metrics";
+
+/// Wait after a change before rewriting the file, so a burst of requests
+/// costs one write.
+const WRITE_DELAY: Duration = Duration::from_millis(500);
+
+/// Where an auth was decided.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Source {
+    /// The user answered the dialog.
+    Dialog,
+    /// A remembered grant, no dialog.
+    Remember,
+    /// A `[policy]` rule, no dialog.
+    Policy,
+    /// `pam_sentinel` asking for its approval (`TakeApprovalFor`).
+    Bypass,
+}
+
+/// How it ended. `Miss` is a bypass call with no approval to take.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Decision {
+    Allow,
+    Deny,
+    Timeout,
+    Miss,
+}
+
+/// The (source, outcome) pairs that can happen, in exposition order.
+/// Listing them up front exports a zero instead of no series at all.
+const SERIES: [(Source, Decision); 8] = [
+    (Source::Dialog, Decision::Allow),
+    (Source::Dialog, Decision::Deny),
+    (Source::Dialog, Decision::Timeout),
+    (Source::Remember, Decision::Allow),
+    (Source::Policy, Decision::Allow),
+    (Source::Policy, Decision::Deny),
+    (Source::Bypass, Decision::Allow),
+    (Source::Bypass, Decision::Miss),
+];
+
+impl Source {
+    fn label(self) -> &'static str {
+        match self {
+            Self::Dialog => "dialog",
+            Self::Remember => "remember",
+            Self::Policy => "policy",
+            Self::Bypass => "bypass",
+        }
+    }
+}
+
+impl Decision {
+    fn label(self) -> &'static str {
+        match self {
+            Self::Allow => "allow",
+            Self::Deny => "deny",
+            Self::Timeout => "timeout",
+            Self::Miss => "miss",
+        }
+    }
+}
+
+/// Cheap to clone (shared handle).
+#[derive(Clone, Default)]
+pub struct Metrics {
+    inner: Arc<Inner>,
+}
+
+#[derive(Default)]
+struct Inner {
+    auth: [AtomicU64; SERIES.len()],
+    dialog: Histogram,
+    helper_spawn: Histogram,
+    helper1: Histogram,
+    changed: Notify,
+}
+
+impl Metrics {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    pub fn auth(&self, source: Source, decision: Decision) {
+        match SERIES.iter().position(|&s| s == (source, decision)) {
+            Some(i) => self.inner.auth[i].fetch_add(1, Relaxed),
+            None => {
+                debug_assert!(false, "no series for {source:?}/{decision:?}");
+                return;
+            }
+        };
+        self.inner.changed.notify_one();
+    }
+
+    /// Request to verdict.
+    pub fn dialog(&self, took: Duration) {
+        self.inner.dialog.record(took);
+        self.inner.changed.notify_one();
+    }
+
+    /// Request to the dialog helper running.
+    pub fn helper_spawn(&self, took: Duration) {
+        self.inner.helper_spawn.record(took);
+        self.inner.changed.notify_one();
+    }
+
+    /// Verdict to helper-1's answer.
+    pub fn helper1(&self, took: Duration) {
+        self.inner.helper1.record(took);
+        self.inner.changed.notify_one();
+    }
+
+    /// The OpenMetrics text exposition.
+    pub fn render(&self) -> String {
+        let mut out = String::with_capacity(16 * 1024);
+        out.push_str(
+            "# TYPE sentinel_agent_auth counter\n\
+             # HELP sentinel_agent_auth Authentications by where they were decided and how.\n",
+        );
+        for (&(source, decision), n) in SERIES.iter().zip(&self.inner.auth) {
+            let _ = writeln!(
+                out,
+                "sentinel_agent_auth_total{{source=\"{}\",outcome=\"{}\"}} {}",
+                source.label(),
+                decision.label(),
+                n.load(Relaxed)
+            );
+        }
+        self.inner.dialog.render(
+            &mut out,
+            "sentinel_agent_dialog_latency_seconds",
+            "Request to the user's verdict (or the timeout).",
+        );
+        self.inner.helper_spawn.render(
+            &mut out,
+            "sentinel_agent_helper_spawn_seconds",
+            "Request to the dialog helper running.",
+        );
+        self.inner.helper1.render(
+            &mut out,
+            "sentinel_agent_helper1_seconds",
+            "polkit-agent-helper-1 exchange, from the verdict to its answer.",
+        );
+        out.push_str("# EOF\n");
+        out
+    }
+
+    /// Keep [`file_path`] current: write it now, then again shortly
+    /// after each change. Must be called inside the tokio runtime.
+    pub fn export(&self, path: PathBuf) {
+        let metrics = self.clone();
+        tokio::spawn(async move {
+            loop {
+                if let Err(e) = write_atomically(&path, &metrics.render()).await {
+                    warn!(
+                        "event=metrics.write_failed path={} error={}",
+                        q(&path.display().to_string()),
+                        q(&e.to_string())
+                    );
+                    return;
+                }
+                metrics.inner.changed.notified().await;
+                tokio::time::sleep(WRITE_DELAY).await;
+            }
+        });
+    }
+}
+
+/// `$XDG_RUNTIME_DIR/sentinel-agent.metrics`, or under `/run/user/<uid>`
+/// when the variable is unset.
+pub fn file_path(uid: u32) -> PathBuf {
+    let dir = std::env::var_os("XDG_RUNTIME_DIR")
+        .filter(|d| !d.is_empty())
+        .map_or_else(|| PathBuf::from(format!("/run/user/{uid}")), PathBuf::from);
+    dir.join(FILE_NAME)
+}
+
+/// Write via a temp file and rename, so a scrape never reads half a file.
+async fn write_atomically(path: &Path, text: &str) -> std::io::Result<()> {
+    use tokio::io::AsyncWriteExt;
+    let mut tmp = path.as_os_str().to_owned();
+    tmp.push(".tmp");
+    let mut f = tokio::fs::OpenOptions::new()
+        .write(true)
+        .create(true)
+        .truncate(true)
+        .mode(0o600)
+        .open(&tmp)
+        .await?;
+    f.write_all(text.as_bytes()).await?;
+    f.flush().await?;
+    drop(f);
+    tokio::fs::rename(&tmp, path).await
+}
+
+/// Lowest bucket bound, in microseconds.
+const BASE_US: u64 = 128;
+/// Buckets per power of two.
+const SUB: u64 = 4;
+/// Powers of two covered: 128 µs << 22 is about 9 minutes.
+const OCTAVES: u64 = 22;
+const BUCKETS: usize = (OCTAVES * SUB) as usize;
+
+/// Upper bounds, in microseconds: `BASE_US · 2^octave · (SUB + sub) / SUB`.
+const BOUNDS: [u64; BUCKETS] = {
+    let mut b = [0; BUCKETS];
+    let mut i = 0;
+    while i < BUCKETS {
+        let (octave, sub) = (i as u64 / SUB, i as u64 % SUB);
+        b[i] = (BASE_US << octave) * (SUB + sub) / SUB;
+        i += 1;
+    }
+    b
+};
+
+/// Counts per bucket of [`BOUNDS`], the last one for anything above.
+struct Histogram {
+    counts: [AtomicU64; BUCKETS + 1],
+    sum_us: AtomicU64,
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            counts: std::array::from_fn(|_| AtomicU64::new(0)),
+            sum_us: AtomicU64::new(0),
+        }
+    }
+}
+
+impl Histogram {
+    fn record(&self, took: Duration) {
+        let us = u64::try_from(took.as_micros()).unwrap_or(u64::MAX);
+        self.counts[bucket(us)].fetch_add(1, Relaxed);
+        self.sum_us.fetch_add(us, Relaxed);
+    }
+
+    fn render(&self, out: &mut String, name: &str, help: &str) {
+        let _ = writeln!(
+            out,
+            "# TYPE {name} histogram\n# UNIT {name} seconds\n# HELP {name} {help}"
+        );
+        // Cumulative, as OpenMetrics wants; `_count` is the running total
+        // so it always matches the `+Inf` bucket.
+        let mut total = 0;
+        for (bound, n) in BOUNDS.iter().zip(&self.counts) {
+            total += n.load(Relaxed);
+            let _ = writeln!(out, "{name}_bucket{{le=\"{}\"}} {total}", seconds(*bound));
+        }
+        total += self.counts[BUCKETS].load(Relaxed);
+        let _ = writeln!(out, "{name}_bucket{{le=\"+Inf\"}} {total}");
+        let _ = writeln!(out, "{name}_count {total}");
+        let _ = writeln!(out, "{name}_sum {}", seconds(self.sum_us.load(Relaxed)));
+    }
+}
+
+/// Index of the first bucket whose bound is at least `us`.
+fn bucket(us: u64) -> usize {
+    BOUNDS.partition_point(|&b| b < us)
+}
+
+fn seconds(us: u64) -> f64 {
+    us as f64 / 1e6
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn buckets_are_log_linear_and_bounded_by_a_quarter() {
+        assert_eq!(&BOUNDS[..6], &[128, 160, 192, 224, 256, 320]);
+        assert!(BOUNDS.windows(2).all(|w| w[0] < w[1]));
+        assert!(
+            BOUNDS[BUCKETS - 1] > 5 * 60 * 1_000_000,
+            "covers a long dialog"
+        );
+        assert_eq!(bucket(0), 0);
+        assert_eq!(bucket(128), 0);
+        assert_eq!(bucket(129), 1);
+        assert_eq!(bucket(u64::MAX), BUCKETS);
+        for us in [300, 4_000, 1_234_567, 60_000_000] {
+            let i = bucket(us);
+            assert!(BOUNDS[i] >= us && BOUNDS[i] - us <= us / 4, "{us} in {i}");
+        }
+    }
+
+    #[test]
+    fn render_is_openmetrics() {
+        let m = Metrics::new();
+        m.auth(Source::Dialog, Decision::Allow);
+        m.auth(Source::Dialog, Decision::Allow);
+        m.auth(Source::Bypass, Decision::Miss);
+        m.dialog(Duration::from_millis(3));
+        m.dialog(Duration::from_secs(2));
+        m.dialog(Duration::from_secs(3600));
+        let text = m.render();
+        let has = |line: &str| text.lines().any(|l| l == line);
+
+        assert!(has(
+            "sentinel_agent_auth_total{source=\"dialog\",outcome=\"allow\"} 2"
+        ));
+        assert!(has(
+            "sentinel_agent_auth_total{source=\"bypass\",outcome=\"miss\"} 1"
+        ));
+        assert!(has(
+            "sentinel_agent_auth_total{source=\"policy\",outcome=\"deny\"} 0"
+        ));
+        // 3 ms lands in (2.56 ms, 3.072 ms]; buckets are cumulative.
+        assert!(has(
+            "sentinel_agent_dialog_latency_seconds_bucket{le=\"0.00256\"} 0"
+        ));
+        assert!(has(
+            "sentinel_agent_dialog_latency_seconds_bucket{le=\"0.003072\"} 1"
+        ));
+        assert!(has(
+            "sentinel_agent_dialog_latency_seconds_bucket{le=\"+Inf\"} 3"
+        ));
+        assert!(has("sentinel_agent_dialog_latency_seconds_count 3"));
+        assert!(has("sentinel_agent_dialog_latency_seconds_sum 3602.003"));
+        assert!(has("sentinel_agent_helper1_seconds_count 0"));
+        assert!(has("# UNIT sentinel_agent_helper_spawn_seconds seconds"));
+        assert!(text.ends_with("\n# EOF\n"));
+    }
+
+    #[tokio::test]
+    async fn export_rewrites_the_file_after_a_change() {
+        let dir = std::env::temp_dir().join(format!("sentinel-metrics-{}", std::process::id()));
+        let _ = std::fs::remove_dir_all(&dir);
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join(FILE_NAME);
+        let m = Metrics::new();
+        m.export(path.clone());
+
+        let line = "sentinel_agent_auth_total{source=\"policy\",outcome=\"allow\"} 1";
+        m.auth(Source::Policy, Decision::Allow);
+        let deadline = tokio::time::Instant::now() + Duration::from_secs(5);
+        loop {
+            let text = std::fs::read_to_string(&path).unwrap_or_default();
+            if text.lines().any(|l| l == line) {
+                break;
+            }
+            assert!(tokio::time::Instant::now() < deadline, "file never updated");
+            tokio::time::sleep(Duration::from_millis(20)).await;
+        }
+        use std::os::unix::fs::PermissionsExt;
+        let mode = std::fs::metadata(&path).unwrap().permissions().mode();
+        assert_eq!(mode & 0o777, 0o600, "metrics are the session owner's only");
+        let _ = std::fs::remove_dir_all(&dir);
+    }
+}
@@ -16,17 +16,38 @@
 //! (the agent restarts with the session). The window is hard-capped to
 //! bound risk, matching the PAM store.
 
-use std::collections::HashMap;
+use sentinel_shared::grants::{GrantStore, Probe};
+use sentinel_shared::log_kv::quote as q;
 use std::sync::Arc;
-use std::time::{Duration, Instant};
-use tokio::sync::Mutex;
+use std::time::Duration;
 
-/// Hard ceiling on the remember window, matching the PAM store's cap.
-const MAX_REMEMBER: Duration = Duration::from_secs(900);
+/// The agent serves one user, so every grant has the same owner (one
+/// quota).
+const OWNER: u32 = 0;
+
+/// A remembered `(action_id, full command)`.
+#[derive(Hash, PartialEq, Eq)]
+struct Grant {
+    action_id: String,
+    command: String,
+}
+
+/// Borrowed form of [`Grant`] for lookups; hashes identically.
+#[derive(Hash)]
+struct GrantRef<'a> {
+    action_id: &'a str,
+    command: &'a str,
+}
+
+impl Probe<Grant> for GrantRef<'_> {
+    fn matches(&self, g: &Grant) -> bool {
+        self.action_id == g.action_id && self.command == g.command
+    }
+}
 
 #[derive(Clone, Default)]
 pub struct RememberCache {
-    inner: Arc<Mutex<HashMap<String, Instant>>>,
+    inner: Arc<GrantStore<Grant>>,
 }
 
 impl RememberCache {
@@ -34,33 +55,27 @@ impl RememberCache {
         Self::default()
     }
 
-    /// Keyed by `(action_id, full command)`. NUL-separated so a command
-    /// can't be crafted to collide across the field boundary.
-    fn key(action_id: &str, command: &str) -> String {
-        format!("{action_id}\0{command}")
-    }
-
     /// True iff a non-expired grant exists for `(action_id, command)`
-    /// within `ttl_secs` (capped at [`MAX_REMEMBER`]). `command` is the
+    /// within `ttl_secs` (capped at
+    /// [`MAX_REMEMBER`](sentinel_shared::grants::MAX_REMEMBER)). `command` is the
     /// **full** elevated command, so a grant for one invocation never
-    /// matches a different one of the same program.
-    pub async fn is_fresh(&self, action_id: &str, command: &str, ttl_secs: u32) -> bool {
-        if ttl_secs == 0 {
-            return false;
-        }
-        let ttl = Duration::from_secs(ttl_secs as u64).min(MAX_REMEMBER);
-        let key = Self::key(action_id, command);
-        let map = self.inner.lock().await;
-        map.get(&key).is_some_and(|t| t.elapsed() < ttl)
+    /// matches a different one of the same program. Allocation-free.
+    pub fn is_fresh(&self, action_id: &str, command: &str, ttl_secs: u32) -> bool {
+        let probe = GrantRef { action_id, command };
+        self.inner
+            .is_fresh(OWNER, &probe, Duration::from_secs(ttl_secs.into()))
     }
 
-    /// Record/refresh a grant for `(action_id, command)`. Opportunistically
-    /// prunes entries past the cap so the map can't grow unbounded.
-    pub async fn remember(&self, action_id: &str, command: &str) {
-        let key = Self::key(action_id, command);
-        let mut map = self.inner.lock().await;
-        map.retain(|_, t| t.elapsed() < MAX_REMEMBER);
-        map.insert(key, Instant::now());
+    /// Record/refresh a grant for `(action_id, command)`. Past the grant
+    /// quota the grant is dropped and the next request prompts again.
+    pub fn remember(&self, action_id: &str, command: &str) {
+        let grant = Grant {
+            action_id: action_id.to_owned(),
+            command: command.to_owned(),
+        };
+        if !self.inner.record(OWNER, grant) {
+            log::warn!("event=remember.quota_exceeded action={}", q(action_id));
+        }
     }
 }
 
@@ -68,30 +83,30 @@ impl RememberCache {
 mod tests {
     use super::*;
 
-    #[tokio::test]
-    async fn remembers_exact_command_and_isolates_others() {
+    #[test]
+    fn remembers_exact_command_and_isolates_others() {
         let c = RememberCache::new();
-        assert!(!c.is_fresh("act", "pacman -Syu", 60).await);
-        c.remember("act", "pacman -Syu").await;
-        assert!(c.is_fresh("act", "pacman -Syu", 60).await);
+        assert!(!c.is_fresh("act", "pacman -Syu", 60));
+        c.remember("act", "pacman -Syu");
+        assert!(c.is_fresh("act", "pacman -Syu", 60));
         // SAME program, DIFFERENT args must NOT match — the core fix.
-        assert!(!c.is_fresh("act", "pacman -U /tmp/evil", 60).await);
+        assert!(!c.is_fresh("act", "pacman -U /tmp/evil", 60));
         // different command / different action id must not match
-        assert!(!c.is_fresh("act", "id", 60).await);
-        assert!(!c.is_fresh("other", "pacman -Syu", 60).await);
+        assert!(!c.is_fresh("act", "id", 60));
+        assert!(!c.is_fresh("other", "pacman -Syu", 60));
         // ttl=0 disables
-        assert!(!c.is_fresh("act", "pacman -Syu", 0).await);
+        assert!(!c.is_fresh("act", "pacman -Syu", 0));
     }
 
-    #[tokio::test]
-    async fn pkexec_grant_does_not_blanket_other_commands() {
+    #[test]
+    fn pkexec_grant_does_not_blanket_other_commands() {
         // The exact incident: one remembered pkexec must not silently
         // authorize a different pkexec command.
         let c = RememberCache::new();
         let exec = "org.freedesktop.policykit.exec";
-        c.remember(exec, "true").await;
-        assert!(c.is_fresh(exec, "true", 300).await);
-        assert!(!c.is_fresh(exec, "rm -rf /", 300).await);
-        assert!(!c.is_fresh(exec, "id", 300).await);
+        c.remember(exec, "true");
+        assert!(c.is_fresh(exec, "true", 300));
+        assert!(!c.is_fresh(exec, "rm -rf /", 300));
+        assert!(!c.is_fresh(exec, "id", 300));
     }
 }
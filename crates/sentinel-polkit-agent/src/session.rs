@@ -1,39 +1,46 @@
 // SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
 // SPDX-License-Identifier: GPL-3.0-or-later
 //! One in-flight authentication: drive `sentinel-helper-kde` for the user
-//! decision, then satisfy polkit's cookie validation by enqueueing an
-//! approval (consumed by `pam_sentinel.so` via the agent's Unix
-//! socket) and connecting to `/run/polkit/agent-helper.socket`.
+//! decision, then satisfy polkit's cookie validation by approving the
+//! cookie (consumed by `pam_sentinel.so` over the system bus) and
+//! connecting to `/run/polkit/agent-helper.socket`.
 
-use crate::approval_queue::ApprovalQueue;
+use crate::approvals::{Approvals, Slot};
+use crate::coalesce::{DialogKey, Dialogs, Via};
 use crate::helper_ui;
 use crate::helper1;
+use crate::metrics::{Decision, Metrics, Source};
 use crate::remember::RememberCache;
 use anyhow::{Context, Result};
-use log::{info, warn};
-use sentinel_shared::log_kv::quote as q;
-use sentinel_shared::logfmt_session_for_pid;
+use log::{debug, info, warn};
+use sentinel_shared::log_kv::{Line, quote as q};
 use sentinel_shared::{Outcome, PolicyDecision, ServiceConfig};
-use std::time::Instant;
+use std::future::Future;
+use std::time::{Duration, Instant};
 
 pub struct AuthInputs<'a> {
     pub action_id: &'a str,
     pub cookie: &'a str,
     pub username: &'a str,
-    /// Effective `polkit-1` config loaded by the caller (per-call, so
-    /// edits to `/etc/security/sentinel.conf` take effect on the next
-    /// auth without restarting the agent).
+    /// Effective `polkit-1` config as of the caller's request (see
+    /// `live_config`: edits to `/etc/security/sentinel.conf` take effect
+    /// on the next auth without restarting the agent).
     pub cfg: &'a ServiceConfig,
     pub process_exe: Option<&'a str>,
     pub process_cmdline: Option<&'a str>,
     pub process_pid: Option<i32>,
     pub process_cwd: Option<&'a str>,
+    /// logfmt session fields for the subject, appended to the
+    /// `event=auth.*` lines; read by the caller, empty if unknown.
+    pub session: &'a str,
     pub requesting_user: Option<&'a str>,
 }
 
 pub async fn run(
-    queue: ApprovalQueue,
+    approvals: Approvals,
     remember: RememberCache,
+    dialogs: Dialogs,
+    metrics: Metrics,
     inputs: AuthInputs<'_>,
 ) -> Result<bool> {
     // Static [policy] allow/deny, evaluated before the dialog. Matches
@@ -50,17 +57,11 @@ pub async fn run(
                 .process_exe
                 .and_then(sentinel_shared::process_basename)
                 .unwrap_or("unknown");
-            let session = inputs
-                .process_pid
-                .map(logfmt_session_for_pid)
-                .unwrap_or_default();
             info!(
-                "event=auth.deny source=policy user={} action={} process={}{}",
-                q(inputs.username),
-                q(inputs.action_id),
-                q(process_name),
-                session
+                "{}",
+                auth_line("auth.deny", "policy", &inputs, process_name).raw(inputs.session)
             );
+            metrics.auth(Source::Policy, Decision::Deny);
             if inputs.cfg.notify_on_deny {
                 sentinel_shared::desktop_notify(
                     "Privilege request blocked",
@@ -74,24 +75,12 @@ pub async fn run(
                 .process_exe
                 .and_then(sentinel_shared::process_basename)
                 .unwrap_or("unknown");
-            let session = inputs
-                .process_pid
-                .map(logfmt_session_for_pid)
-                .unwrap_or_default();
             info!(
-                "event=auth.allow source=policy user={} action={} process={}{}",
-                q(inputs.username),
-                q(inputs.action_id),
-                q(process_name),
-                session
+                "{}",
+                auth_line("auth.allow", "policy", &inputs, process_name).raw(inputs.session)
             );
-            queue.push(inputs.action_id.to_string()).await;
-            let success = helper1::run(helper1::Run {
-                username: inputs.username,
-                cookie: inputs.cookie,
-            })
-            .await
-            .context("run polkit-agent-helper-1")?;
+            metrics.auth(Source::Policy, Decision::Allow);
+            let success = hand_off(&approvals, &metrics, &inputs).await?;
             if !success {
                 warn!(
                     "event=auth.error source=agent.helper1 action={} note=\"helper-1 reported FAILURE — PAM stack rejected policy approval?\"",
@@ -120,34 +109,17 @@ pub async fn run(
     // In-memory "remember" cache (the polkit-path complement to the root
     // timestamp store, which the PAM module owns for sudo/su). A fresh
     // grant for this (action, full command) auto-allows without a dialog.
-    if remember_secs > 0
-        && remember
-            .is_fresh(inputs.action_id, remember_command, remember_secs)
-            .await
-    {
+    if remember_secs > 0 && remember.is_fresh(inputs.action_id, remember_command, remember_secs) {
         let process_name = inputs
             .process_exe
             .and_then(sentinel_shared::process_basename)
             .unwrap_or("unknown");
-        let session = inputs
-            .process_pid
-            .map(logfmt_session_for_pid)
-            .unwrap_or_default();
         info!(
-            "event=auth.allow source=remember user={} action={} process={}{}",
-            q(inputs.username),
-            q(inputs.action_id),
-            q(process_name),
-            session
+            "{}",
+            auth_line("auth.allow", "remember", &inputs, process_name).raw(inputs.session)
         );
-        queue.push(inputs.action_id.to_string()).await;
-        let success = helper1::run(helper1::Run {
-            username: inputs.username,
-            cookie: inputs.cookie,
-        })
-        .await
-        .context("run polkit-agent-helper-1")?;
-        return Ok(success);
+        metrics.auth(Source::Remember, Decision::Allow);
+        return hand_off(&approvals, &metrics, &inputs).await;
     }
 
     let req = helper_ui::Request::for_action(helper_ui::ForAction {
@@ -162,33 +134,71 @@ pub async fn run(
         requesting_user: inputs.requesting_user,
     });
     let dialog_started = Instant::now();
-    let verdict = helper_ui::run(req)
-        .await
-        .context("run sentinel-helper-kde")?;
+    let dialog_started_us = sentinel_shared::monotonic_us();
+    // `early_helper`: start helper-1 now, from an undecided approval its
+    // pam_sentinel waits on, so the PAM handshake overlaps the dialog
+    // and completes right after the click.
+    let early = inputs.cfg.early_helper_wait().map(|wait| {
+        let slot = approvals.open(inputs.cookie, inputs.action_id);
+        let exchange = Box::pin(helper1::run(helper1::Run {
+            username: inputs.username,
+            cookie: inputs.cookie,
+            ticket: slot.ticket(),
+            wait,
+        }));
+        (slot, exchange)
+    });
+    // An identical request already on screen answers this one too.
+    let dialog = dialogs.verdict(DialogKey::of(&inputs), || helper_ui::run(req));
+    let (answer, early) = alongside(dialog, early).await;
+    let (verdict, via) = answer.context("run sentinel-helper-kde")?;
+    if via == Via::Coalesced {
+        info!(
+            "event=dialog.coalesced action={} cookie={} saved_total={} shown_total={}",
+            q(inputs.action_id),
+            crate::agent::cookie_prefix(inputs.cookie),
+            dialogs.saved(),
+            dialogs.shown()
+        );
+    }
     let outcome = verdict.outcome;
-    let latency_ms = dialog_started.elapsed().as_millis();
+    let latency = dialog_started.elapsed();
+    let latency_ms = latency.as_millis();
+    metrics.dialog(latency);
+    metrics.auth(
+        Source::Dialog,
+        match outcome {
+            Outcome::Allow => Decision::Allow,
+            Outcome::Deny => Decision::Deny,
+            Outcome::Timeout => Decision::Timeout,
+        },
+    );
+    // Helper startup milestones (spawn_ms, qml_ms, first_frame_ms, ...),
+    // separating dialog latency from the user's think time.
+    let timings = verdict
+        .timings
+        .map(|t| t.logfmt(dialog_started_us))
+        .unwrap_or_default();
+    // A coalesced request spawned nothing; the timings are the first
+    // request's.
+    if let (Some(t), Via::Shown) = (verdict.timings, via) {
+        metrics.helper_spawn(Duration::from_micros(
+            t.start_us.saturating_sub(dialog_started_us),
+        ));
+    }
 
     let process_name = inputs
         .process_exe
         .and_then(sentinel_shared::process_basename)
         .unwrap_or("unknown");
-    // Session enrichment via the polkit subject's process env. The
-    // subject is the user's actual process (the GUI app or shell
-    // requesting the privileged action), which is what we want.
-    let session = inputs
-        .process_pid
-        .map(logfmt_session_for_pid)
-        .unwrap_or_default();
-
     match outcome {
         Outcome::Deny => {
             info!(
-                "event=auth.deny source=agent user={} action={} process={} latency_ms={}{}",
-                q(inputs.username),
-                q(inputs.action_id),
-                q(process_name),
-                latency_ms,
-                session
+                "{}",
+                auth_line("auth.deny", "agent", &inputs, process_name)
+                    .num("latency_ms", latency_ms)
+                    .raw(&timings)
+                    .raw(inputs.session)
             );
             if inputs.cfg.notify_on_deny {
                 sentinel_shared::desktop_notify(
@@ -200,12 +210,11 @@ pub async fn run(
         }
         Outcome::Timeout => {
             info!(
-                "event=auth.timeout source=agent user={} action={} process={} latency_ms={}{}",
-                q(inputs.username),
-                q(inputs.action_id),
-                q(process_name),
-                latency_ms,
-                session
+                "{}",
+                auth_line("auth.timeout", "agent", &inputs, process_name)
+                    .num("latency_ms", latency_ms)
+                    .raw(&timings)
+                    .raw(inputs.session)
             );
             if inputs.cfg.notify_on_timeout {
                 sentinel_shared::desktop_notify(
@@ -219,12 +228,11 @@ pub async fn run(
         }
         Outcome::Allow => {
             info!(
-                "event=auth.allow source=agent user={} action={} process={} latency_ms={}{}",
-                q(inputs.username),
-                q(inputs.action_id),
-                q(process_name),
-                latency_ms,
-                session
+                "{}",
+                auth_line("auth.allow", "agent", &inputs, process_name)
+                    .num("latency_ms", latency_ms)
+                    .raw(&timings)
+                    .raw(inputs.session)
             );
         }
     }
@@ -233,20 +241,31 @@ pub async fn run(
     // within the window skips the dialog — but only if the user ticked
     // the "remember" checkbox (verdict.remember), not on every allow.
     if verdict.remember && remember_secs > 0 {
-        remember.remember(inputs.action_id, remember_command).await;
+        remember.remember(inputs.action_id, remember_command);
     }
 
-    // Pre-approve before handing off to helper-1. helper-1 → PAM →
-    // pam_sentinel.so will dequeue this from our socket within a few
-    // milliseconds.
-    queue.push(inputs.action_id.to_string()).await;
-
-    let success = helper1::run(helper1::Run {
-        username: inputs.username,
-        cookie: inputs.cookie,
-    })
-    .await
-    .context("run polkit-agent-helper-1")?;
+    // Pre-approve and hand off to helper-1. helper-1 → PAM →
+    // pam_sentinel.so takes the approval bound to its connection. An
+    // early helper-1 is already waiting for it.
+    let handoff_started = Instant::now();
+    let is_early = early.is_some();
+    let success = match early {
+        Some((slot, exchange)) => {
+            slot.decide(true);
+            let success = exchange.await.context("run polkit-agent-helper-1")?;
+            metrics.helper1(handoff_started.elapsed());
+            success
+        }
+        None => hand_off(&approvals, &metrics, &inputs).await?,
+    };
+    info!(
+        "event=auth.handoff action={} cookie={} early={} handoff_ms={} success={}",
+        q(inputs.action_id),
+        crate::agent::cookie_prefix(inputs.cookie),
+        is_early,
+        handoff_started.elapsed().as_millis(),
+        success
+    );
 
     if !success {
         warn!(
@@ -256,3 +275,60 @@ pub async fn run(
     }
     Ok(success)
 }
+
+/// The common head of this request's `event=auth.*` lines; the caller
+/// appends what else it knows.
+fn auth_line(event: &str, source: &str, inputs: &AuthInputs<'_>, process_name: &str) -> Line {
+    let mut line = Line::new(event);
+    line.kv("source", source)
+        .kv("user", inputs.username)
+        .kv("action", inputs.action_id)
+        .kv("process", process_name);
+    line
+}
+
+/// Run the dialog while an early helper-1 exchange gets as far as it can
+/// (`pam_sentinel` waiting for the verdict). The exchange is handed back
+/// for the click to finish, unless it already ended — failed, or gave up
+/// waiting — in which case an Allow gets an ordinary hand-off instead.
+async fn alongside<D, E>(dialog: D, early: Option<(Slot, E)>) -> (D::Output, Option<(Slot, E)>)
+where
+    D: Future,
+    E: Future<Output = Result<bool>> + Unpin,
+{
+    let Some((slot, mut exchange)) = early else {
+        return (dialog.await, None);
+    };
+    let mut dialog = std::pin::pin!(dialog);
+    tokio::select! {
+        answer = &mut dialog => (answer, Some((slot, exchange))),
+        ended = &mut exchange => {
+            debug!("helper1: early exchange ended before the verdict ({ended:?}); handing off after it");
+            drop(slot);
+            (dialog.await, None)
+        }
+    }
+}
+
+/// Satisfy this request's cookie: approve it for as long as its
+/// helper-1 exchange runs (see [`Approvals::hand_off`]).
+async fn hand_off(
+    approvals: &Approvals,
+    metrics: &Metrics,
+    inputs: &AuthInputs<'_>,
+) -> Result<bool> {
+    let started = Instant::now();
+    let success = approvals
+        .hand_off(inputs.cookie, inputs.action_id, |ticket| {
+            helper1::run(helper1::Run {
+                username: inputs.username,
+                cookie: inputs.cookie,
+                ticket,
+                wait: Duration::ZERO,
+            })
+        })
+        .await
+        .context("run polkit-agent-helper-1")?;
+    metrics.helper1(started.elapsed());
+    Ok(success)
+}
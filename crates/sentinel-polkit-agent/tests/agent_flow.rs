@@ -14,7 +14,7 @@
 //! threads sharing process env, so the path-coverage cases live in
 //! a single `serialised_session_paths` test that walks Allow → Deny
 //! → Timeout sequentially with explicit env var rotation. The
-//! cancel-drain test runs in parallel because it doesn't touch env
+//! cancel test runs in parallel because it doesn't touch env
 //! vars.
 //!
 //! What's NOT covered (deferred to v0.8 with python-dbusmock):
@@ -23,7 +23,9 @@
 //! - Polkit's session-equality check at registration.
 
 use sentinel_polkit_agent::{
-    approval_queue::ApprovalQueue,
+    approvals::Approvals,
+    coalesce::Dialogs,
+    metrics::Metrics,
     remember::RememberCache,
     session::{self, AuthInputs},
 };
@@ -46,6 +48,7 @@ fn cfg() -> ServiceConfig {
         notify_on_deny: false,
         notify_on_timeout: false,
         remember_seconds: 0,
+        early_helper: false,
     }
 }
 
@@ -59,6 +62,7 @@ fn inputs<'a>(action_id: &'a str, cookie: &'a str, cfg: &'a ServiceConfig) -> Au
         process_cmdline: Some("true"),
         process_pid: Some(1),
         process_cwd: Some("/"),
+        session: "",
         requesting_user: Some("testuser"),
     }
 }
@@ -67,25 +71,58 @@ fn inputs<'a>(action_id: &'a str, cookie: &'a str, cfg: &'a ServiceConfig) -> Au
 /// the shared process env-var test seams don't race.
 #[tokio::test(flavor = "current_thread")]
 async fn serialised_session_paths() {
-    // ---- Allow: dialog → push → helper-1 SUCCESS → Ok(true) ----
+    // ---- Allow: dialog → approve → helper-1 SUCCESS → Ok(true) ----
     unsafe {
         std::env::set_var("SENTINEL_TEST_HELPER_OUTCOME", "ALLOW");
         std::env::set_var("SENTINEL_TEST_HELPER1_OUTCOME", "SUCCESS");
     }
     let cfg = cfg();
     {
-        let queue = ApprovalQueue::new();
+        let approvals = Approvals::new();
+        let metrics = Metrics::new();
         let result = session::run(
-            queue.clone(),
+            approvals.clone(),
             RememberCache::new(),
+            Dialogs::new(),
+            metrics.clone(),
             inputs("a.allow", "ck-a", &cfg),
         )
         .await;
         assert!(result.is_ok(), "allow path: session::run should succeed");
         assert!(result.unwrap(), "allow path returns Ok(true)");
+        assert_eq!(approvals.pending(), 0, "approval withdrawn after helper-1");
+        let text = metrics.render();
+        for line in [
+            "sentinel_agent_auth_total{source=\"dialog\",outcome=\"allow\"} 1",
+            "sentinel_agent_dialog_latency_seconds_count 1",
+            "sentinel_agent_helper1_seconds_count 1",
+        ] {
+            assert!(text.lines().any(|l| l == line), "missing {line:?}");
+        }
     }
 
-    // ---- Deny: dialog → no push, no helper-1 → Ok(false) ----
+    // ---- Allow with early_helper: helper-1 started with the dialog.
+    // The canned helper-1 answers before the verdict, so this walks the
+    // fallback: the click gets an ordinary hand-off. ----
+    {
+        let early = ServiceConfig {
+            early_helper: true,
+            ..cfg.clone()
+        };
+        let approvals = Approvals::new();
+        let result = session::run(
+            approvals.clone(),
+            RememberCache::new(),
+            Dialogs::new(),
+            Metrics::new(),
+            inputs("a.early", "ck-e", &early),
+        )
+        .await;
+        assert!(result.unwrap(), "early allow path returns Ok(true)");
+        assert_eq!(approvals.pending(), 0, "early approval withdrawn too");
+    }
+
+    // ---- Deny: dialog → no approval, no helper-1 → Ok(false) ----
     unsafe {
         std::env::set_var("SENTINEL_TEST_HELPER_OUTCOME", "DENY");
         // Leave HELPER1 set; if a regression accidentally calls
@@ -94,18 +131,21 @@ async fn serialised_session_paths() {
         std::env::remove_var("SENTINEL_TEST_HELPER1_OUTCOME");
     }
     {
-        let queue = ApprovalQueue::new();
+        let approvals = Approvals::new();
         let result = session::run(
-            queue.clone(),
+            approvals.clone(),
             RememberCache::new(),
+            Dialogs::new(),
+            Metrics::new(),
             inputs("a.deny", "ck-d", &cfg),
         )
         .await;
         assert!(result.is_ok(), "deny path: session::run should succeed");
         assert!(!result.unwrap(), "deny path returns Ok(false)");
-        assert!(
-            queue.take_one().await.is_none(),
-            "deny path must not enqueue an approval"
+        assert_eq!(
+            approvals.pending(),
+            0,
+            "deny path must not leave an approval"
         );
     }
 
@@ -114,18 +154,21 @@ async fn serialised_session_paths() {
         std::env::set_var("SENTINEL_TEST_HELPER_OUTCOME", "TIMEOUT");
     }
     {
-        let queue = ApprovalQueue::new();
+        let approvals = Approvals::new();
         let result = session::run(
-            queue.clone(),
+            approvals.clone(),
             RememberCache::new(),
+            Dialogs::new(),
+            Metrics::new(),
             inputs("a.timeout", "ck-t", &cfg),
         )
         .await;
         assert!(result.is_ok(), "timeout path: session::run should succeed");
         assert!(!result.unwrap(), "timeout path returns Ok(false)");
-        assert!(
-            queue.take_one().await.is_none(),
-            "timeout path must not enqueue an approval"
+        assert_eq!(
+            approvals.pending(),
+            0,
+            "timeout path must not leave an approval"
         );
     }
 
@@ -139,25 +182,29 @@ async fn serialised_session_paths() {
             std::env::set_var("SENTINEL_TEST_HELPER1_OUTCOME", "SUCCESS");
         }
         let _ = session::run(
-            ApprovalQueue::new(),
+            Approvals::new(),
             remember.clone(),
+            Dialogs::new(),
+            Metrics::new(),
             inputs("a.rem", "ck-r1", &rcfg),
         )
         .await;
         assert!(
-            !remember.is_fresh("a.rem", "true", 60).await,
+            !remember.is_fresh("a.rem", "true", 60),
             "plain ALLOW must NOT remember"
         );
 
         unsafe { std::env::set_var("SENTINEL_TEST_HELPER_OUTCOME", "ALLOW REMEMBER") };
         let _ = session::run(
-            ApprovalQueue::new(),
+            Approvals::new(),
             remember.clone(),
+            Dialogs::new(),
+            Metrics::new(),
             inputs("a.rem", "ck-r2", &rcfg),
         )
         .await;
         assert!(
-            remember.is_fresh("a.rem", "true", 60).await,
+            remember.is_fresh("a.rem", "true", 60),
             "ALLOW REMEMBER must record the grant"
         );
     }
@@ -172,17 +219,19 @@ async fn serialised_session_paths() {
         let exec = "org.freedesktop.policykit.exec";
         unsafe { std::env::set_var("SENTINEL_TEST_HELPER_OUTCOME", "ALLOW REMEMBER") };
         let _ = session::run(
-            ApprovalQueue::new(),
+            Approvals::new(),
             remember.clone(),
+            Dialogs::new(),
+            Metrics::new(),
             inputs(exec, "ck-px", &rcfg), // fixture cmdline = "true"
         )
         .await;
         assert!(
-            remember.is_fresh(exec, "true", 60).await,
+            remember.is_fresh(exec, "true", 60),
             "pkexec true was remembered → it should auto-allow pkexec true"
         );
         assert!(
-            !remember.is_fresh(exec, "rm -rf /", 60).await,
+            !remember.is_fresh(exec, "rm -rf /", 60),
             "a remembered pkexec command must NOT blanket other pkexec commands"
         );
     }
@@ -195,16 +244,28 @@ async fn serialised_session_paths() {
 }
 
 #[tokio::test(flavor = "current_thread")]
-async fn cancel_drains_pending_approval() {
-    // Direct test of `ApprovalQueue::drain` — the API
-    // `Agent::cancel_authentication` uses to invalidate stale
-    // approvals when polkit cancels mid-auth. No env vars needed,
-    // so this is parallel-safe.
-    let queue = ApprovalQueue::new();
-    queue.push("org.example.test".to_string()).await;
-    queue.drain().await;
-    assert!(
-        queue.take_one().await.is_none(),
-        "drain must clear pending approvals"
-    );
+async fn cancel_withdraws_pending_approval() {
+    // What `Agent::cancel_authentication` does to a session mid
+    // hand-off: abort its task. The approval goes with it, so no stale
+    // approval outlives the exchange. No env vars needed, so this is
+    // parallel-safe.
+    let approvals = Approvals::new();
+    let task = {
+        let approvals = approvals.clone();
+        tokio::spawn(async move {
+            approvals
+                .hand_off("cookie-1", "org.example.test", |ticket| async move {
+                    ticket.bind(42);
+                    std::future::pending::<()>().await
+                })
+                .await
+        })
+    };
+    while approvals.pending() == 0 {
+        tokio::task::yield_now().await;
+    }
+    task.abort();
+    let _ = task.await;
+    assert_eq!(approvals.pending(), 0, "abort must withdraw the approval");
+    assert!(approvals.take_for(42).await.is_none());
 }
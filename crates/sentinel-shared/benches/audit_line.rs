@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Cost of building one `event=auth.*` line: `log_kv::Line` vs. the
+//! `format!` of `log_kv::quote`d values it replaced on the auth path
+//! (one `String` per field, then the line).
+//!
+//! `cargo bench -p sentinel-shared --bench audit_line`
+
+use sentinel_shared::log_kv::{Line, quote as q};
+use std::hint::black_box;
+use std::time::Instant;
+
+fn bench(name: &str, iters: u32, mut f: impl FnMut()) {
+    for _ in 0..iters / 10 {
+        f();
+    }
+    let start = Instant::now();
+    for _ in 0..iters {
+        f();
+    }
+    let per = start.elapsed() / iters;
+    println!("{name:<36} {:>10.2?}/iter", per);
+}
+
+fn main() {
+    let (user, service, process) = ("alice", "sudo", "Disk Utility");
+    let session = " session_type=wayland session_class=user session_remote=0";
+    let (uid, latency_ms) = (1000u32, 2210u128);
+
+    bench("format! + quote", 1_000_000, || {
+        black_box(format!(
+            "event=auth.allow source=dialog user={} service={} process={} uid={} latency_ms={}{}",
+            q(black_box(user)),
+            q(black_box(service)),
+            q(black_box(process)),
+            uid,
+            latency_ms,
+            session
+        ));
+    });
+    bench("log_kv::Line", 1_000_000, || {
+        let mut line = Line::new("auth.allow");
+        line.kv("source", "dialog")
+            .kv("user", black_box(user))
+            .kv("service", black_box(service))
+            .kv("process", black_box(process))
+            .num("uid", uid)
+            .num("latency_ms", latency_ms)
+            .raw(session);
+        black_box(line.as_str());
+    });
+}
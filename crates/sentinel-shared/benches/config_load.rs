@@ -0,0 +1,81 @@
+// SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Config load cost per auth: full TOML parse + resolve vs. compiled
+//! snapshot decode + resolve.
+//!
+//! `cargo bench -p sentinel-shared --bench config_load`
+
+use sentinel_shared::Document;
+use sentinel_shared::snapshot::{Snapshot, Stamp};
+use std::hint::black_box;
+use std::time::Instant;
+
+const CONFIG: &str = r#"
+[general]
+timeout = 30
+headless_action = "password"
+remember_seconds = 300
+
+[appearance]
+title = "Authentication Required"
+message = "%p wants to run as root"
+secondary = "Requested by %u via %s"
+
+[policy]
+allow = ["/usr/bin/pacman", "/usr/bin/flatpak", "org.freedesktop.packagekit.package-install"]
+deny = ["/usr/bin/dd", "org.freedesktop.systemd1.manage-units"]
+
+[notifications]
+on_deny = true
+
+[services.sudo]
+timeout = 20
+remember_seconds = 60
+
+[services.su]
+enabled = false
+
+[services."polkit-1"]
+timeout = 45
+"#;
+
+fn bench(name: &str, iters: u32, mut f: impl FnMut()) {
+    for _ in 0..iters / 10 {
+        f();
+    }
+    let start = Instant::now();
+    for _ in 0..iters {
+        f();
+    }
+    let per = start.elapsed() / iters;
+    println!("{name:<28} {:>10.2?}/iter", per);
+}
+
+fn main() {
+    let iters = 20_000;
+    let doc: Document = toml::from_str(CONFIG).unwrap();
+    let blob = Snapshot::compile(&doc, Stamp::Absent).encode();
+    println!(
+        "snapshot size: {} bytes (toml {} bytes)",
+        blob.len(),
+        CONFIG.len()
+    );
+
+    bench("toml parse + for_service", iters, || {
+        let doc: Document = toml::from_str(black_box(CONFIG)).unwrap();
+        black_box(doc.for_service(black_box("sudo")));
+    });
+    bench("snapshot decode + lookup", iters, || {
+        let snap = Snapshot::decode(black_box(&blob)).unwrap();
+        black_box(snap.for_service(black_box("sudo")));
+    });
+
+    // The real hot path also stats the config and reads the blob; time
+    // the stamp so the comparison isn't flattering.
+    let path = std::env::temp_dir().join("sentinel-bench.conf");
+    std::fs::write(&path, CONFIG).unwrap();
+    bench("stat (stamp)", iters, || {
+        black_box(Stamp::of(black_box(&path)));
+    });
+    let _ = std::fs::remove_file(&path);
+}
@@ -0,0 +1,117 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Remember-store cost per auth at 10k and 100k live grants:
+//! `grants::GrantStore` vs. the string-keyed `Mutex<HashMap>` it
+//! replaced in the broker and the agent (format the key, lock, look up;
+//! `retain` the whole map on every record).
+//!
+//! `cargo bench -p sentinel-shared --bench grants`
+
+use sentinel_shared::grants::{GrantStore, MAX_REMEMBER};
+use std::collections::HashMap;
+use std::hint::black_box;
+use std::sync::Mutex;
+use std::time::Instant;
+
+#[derive(Hash, PartialEq, Eq)]
+struct Key {
+    loginuid: u32,
+    sessionid: u32,
+    service: String,
+    command: String,
+}
+
+fn key(i: usize) -> Key {
+    Key {
+        loginuid: 1000 + (i % 1000) as u32,
+        sessionid: 3,
+        service: "sudo".into(),
+        command: format!("/usr/bin/pacman -S --needed package-{i}"),
+    }
+}
+
+/// The replaced store, verbatim in shape.
+#[derive(Default)]
+struct Baseline {
+    inner: Mutex<HashMap<String, Instant>>,
+}
+
+impl Baseline {
+    fn keystr(k: &Key) -> String {
+        format!(
+            "{}\0{}\0{}\0{}",
+            k.loginuid, k.sessionid, k.service, k.command
+        )
+    }
+
+    fn is_fresh(&self, k: &Key) -> bool {
+        let map = self.inner.lock().unwrap();
+        map.get(&Self::keystr(k))
+            .is_some_and(|t| t.elapsed() < MAX_REMEMBER)
+    }
+
+    fn record(&self, k: &Key) {
+        let mut map = self.inner.lock().unwrap();
+        map.retain(|_, t| t.elapsed() < MAX_REMEMBER);
+        map.insert(Self::keystr(k), Instant::now());
+    }
+}
+
+fn bench(name: &str, iters: u32, mut f: impl FnMut()) {
+    for _ in 0..iters / 10 {
+        f();
+    }
+    let start = Instant::now();
+    for _ in 0..iters {
+        f();
+    }
+    let per = start.elapsed() / iters;
+    println!("{name:<36} {:>10.2?}/iter", per);
+}
+
+fn main() {
+    for live in [10_000, 100_000] {
+        println!("-- {live} live grants");
+        let keys: Vec<Key> = (0..live).map(key).collect();
+        let miss = key(live + 1);
+
+        let store = GrantStore::with_limits(live, live * 2);
+        let base = Baseline::default();
+        for (i, k) in keys.iter().enumerate() {
+            store.record(k.loginuid, key(i));
+            base.record(k);
+        }
+        assert_eq!(store.len(), live);
+
+        let mut i = 0;
+        bench("grants: check (hit)", 200_000, || {
+            let k = &keys[i % live];
+            i += 1;
+            black_box(store.is_fresh(k.loginuid, black_box(k), MAX_REMEMBER));
+        });
+        bench("grants: check (miss)", 200_000, || {
+            black_box(store.is_fresh(miss.loginuid, black_box(&miss), MAX_REMEMBER));
+        });
+        let mut i = 0;
+        bench("grants: record (refresh)", 200_000, || {
+            let n = i % live;
+            i += 1;
+            black_box(store.record(keys[n].loginuid, key(n)));
+        });
+
+        let mut i = 0;
+        bench("baseline: check (hit)", 200_000, || {
+            let k = &keys[i % live];
+            i += 1;
+            black_box(base.is_fresh(black_box(k)));
+        });
+        bench("baseline: check (miss)", 200_000, || {
+            black_box(base.is_fresh(black_box(&miss)));
+        });
+        let mut i = 0;
+        bench("baseline: record (refresh)", 2_000, || {
+            base.record(&keys[i % live]);
+            i += 1;
+        });
+    }
+}
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! `[policy]` decision cost at 10, 100 and 1000 entries per list: the
+//! compiled `Policy::decide` vs. the linear scan it replaced (every
+//! entry compared against the action id, checked for `/`, and the exe's
+//! basename taken again). Each decision misses both lists, the common
+//! case and the worst one for the scan; the agent path's exe + action id
+//! is what both the PAM module and the agent pay.
+//!
+//! `cargo bench -p sentinel-shared --bench policy_match`
+
+use sentinel_shared::{Policy, process_basename};
+use std::hint::black_box;
+use std::time::Instant;
+
+/// A generated fleet list: a third full paths, a third basenames, a
+/// third action ids.
+fn entries(n: usize, tag: &str) -> Vec<String> {
+    (0..n)
+        .map(|i| match i % 3 {
+            0 => format!("/usr/lib/{tag}/tool-{i}"),
+            1 => format!("{tag}-tool-{i}"),
+            _ => format!("com.example.{tag}.action-{i}"),
+        })
+        .collect()
+}
+
+/// The replaced matcher, verbatim in shape.
+fn linear(list: &[String], exe: Option<&str>, action: Option<&str>) -> bool {
+    list.iter().any(|entry| {
+        if action == Some(entry.as_str()) {
+            return true;
+        }
+        match exe {
+            Some(path) => {
+                if entry.contains('/') {
+                    entry == path
+                } else {
+                    process_basename(path) == Some(entry.as_str())
+                }
+            }
+            None => false,
+        }
+    })
+}
+
+fn bench(name: &str, iters: u32, mut f: impl FnMut()) {
+    for _ in 0..iters / 10 {
+        f();
+    }
+    let start = Instant::now();
+    for _ in 0..iters {
+        f();
+    }
+    let per = start.elapsed() / iters;
+    println!("{name:<36} {:>10.2?}/iter", per);
+}
+
+fn main() {
+    let exe = "/usr/bin/gparted";
+    let action = "org.gnome.gparted";
+    for n in [10, 100, 1000] {
+        let (allow, deny) = (entries(n, "allow"), entries(n, "deny"));
+        let iters = 10_000_000 / n as u32;
+        bench(&format!("linear scan, {n} entries"), iters, || {
+            let (exe, action) = (black_box(Some(exe)), black_box(Some(action)));
+            black_box(linear(&deny, exe, action) || linear(&allow, exe, action));
+        });
+        let policy = Policy::new(allow, deny);
+        bench(&format!("compiled, {n} entries"), iters, || {
+            black_box(policy.decide(black_box(Some(exe)), black_box(Some(action))));
+        });
+    }
+}
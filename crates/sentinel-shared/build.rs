@@ -4,10 +4,16 @@
 // time so both `pam-sentinel` (running inside privileged binaries
 // where env-based path resolution would be a security concern) and
 // `sentinel-polkit-agent` (running as the user) reach the same file.
+// The compiled config snapshot path is baked the same way.
 
 fn main() {
     let sysconfdir = std::env::var("SENTINEL_SYSCONFDIR").unwrap_or_else(|_| "/etc".into());
     let config_path = format!("{sysconfdir}/security/sentinel.conf");
     println!("cargo:rustc-env=SENTINEL_CONFIG_PATH={config_path}");
     println!("cargo:rerun-if-env-changed=SENTINEL_SYSCONFDIR");
+
+    let snapshot_path = std::env::var("SENTINEL_SNAPSHOT_PATH")
+        .unwrap_or_else(|_| "/run/sentinel/config.snap".into());
+    println!("cargo:rustc-env=SENTINEL_SNAPSHOT_PATH={snapshot_path}");
+    println!("cargo:rerun-if-env-changed=SENTINEL_SNAPSHOT_PATH");
 }
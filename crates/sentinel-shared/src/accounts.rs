@@ -0,0 +1,228 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! passwd/group resolution through NSS, done once and reused.
+//!
+//! One auth used to resolve the same account several times. The PAM
+//! module looked the user up by name for the bypass, by uid for the log
+//! line, and by uid again in the helper child, followed by `initgroups`.
+//! With SSSD/LDAP-backed accounts each of those can be a network round
+//! trip, and `initgroups` can enumerate every group on the directory.
+//!
+//! [`Accounts`] memoizes lookups by uid and by name. A hit on either key
+//! fills both, so the bypass's name lookup also answers the helper's uid
+//! lookup. Unknown accounts are remembered too.
+//! - [`Accounts::per_auth`] never expires anything. The PAM module makes
+//!   one per `pam_sm_authenticate` and drops it at the end.
+//! - [`Accounts::with_ttl`] expires entries after a short ttl, for the
+//!   long-lived polkit agent. An edit to the directory shows up within
+//!   the ttl.
+//!
+//! Supplementary groups come from `getgrouplist(3)`, fetched lazily (only
+//! the helper's `setgroups` needs them) and at most once per
+//! [`Account`].
+
+use nix::unistd::{Gid, Uid, User, getgrouplist};
+use std::collections::HashMap;
+use std::ffi::CString;
+use std::path::PathBuf;
+use std::sync::{Arc, Mutex, OnceLock};
+use std::time::{Duration, Instant};
+
+/// Entries kept before a ttl cache is flushed. The agent serves one
+/// seat; anything past this is churn not worth remembering.
+const MAX_ENTRIES: usize = 64;
+
+/// The passwd fields Sentinel uses, plus the lazily fetched group list.
+#[derive(Debug)]
+pub struct Account {
+    pub name: String,
+    pub uid: u32,
+    pub gid: u32,
+    pub home: PathBuf,
+    groups: OnceLock<Option<Vec<u32>>>,
+}
+
+impl Account {
+    pub fn new(name: String, uid: u32, gid: u32, home: PathBuf) -> Self {
+        Self {
+            name,
+            uid,
+            gid,
+            home,
+            groups: OnceLock::new(),
+        }
+    }
+
+    /// Supplementary groups, primary gid included, as `initgroups(3)`
+    /// would set them. `None` if NSS failed.
+    pub fn groups(&self) -> Option<&[u32]> {
+        self.groups
+            .get_or_init(|| {
+                let name = CString::new(self.name.as_str()).ok()?;
+                let list = getgrouplist(&name, Gid::from_raw(self.gid)).ok()?;
+                Some(list.into_iter().map(Gid::as_raw).collect())
+            })
+            .as_deref()
+    }
+}
+
+impl From<User> for Account {
+    fn from(u: User) -> Self {
+        Self::new(u.name, u.uid.as_raw(), u.gid.as_raw(), u.dir)
+    }
+}
+
+/// One NSS question, as handed to a custom lookup
+/// ([`Accounts::with_lookup`]).
+pub enum Query<'a> {
+    Uid(u32),
+    Name(&'a str),
+}
+
+/// Memoized account lookups. See the module docs.
+pub struct Accounts {
+    ttl: Option<Duration>,
+    lookup: fn(&Query<'_>) -> Option<Account>,
+    inner: Mutex<Inner>,
+}
+
+#[derive(Default)]
+struct Inner {
+    by_uid: HashMap<u32, Entry>,
+    by_name: HashMap<String, Entry>,
+}
+
+#[derive(Clone)]
+struct Entry {
+    account: Option<Arc<Account>>,
+    at: Instant,
+}
+
+impl Accounts {
+    /// Lookups for one auth: nothing expires.
+    pub fn per_auth() -> Self {
+        Self::with_lookup(None, nss)
+    }
+
+    /// Lookups for a long-lived process: entries expire after `ttl`.
+    pub fn with_ttl(ttl: Duration) -> Self {
+        Self::with_lookup(Some(ttl), nss)
+    }
+
+    /// Answer misses with `lookup` instead of NSS; `ttl` as above, or
+    /// `None` for no expiry. For tests that need a slow or counted
+    /// directory.
+    pub fn with_lookup(ttl: Option<Duration>, lookup: fn(&Query<'_>) -> Option<Account>) -> Self {
+        Self {
+            ttl,
+            lookup,
+            inner: Mutex::new(Inner::default()),
+        }
+    }
+
+    pub fn by_uid(&self, uid: u32) -> Option<Arc<Account>> {
+        if let Some(hit) = self.cached(|i| i.by_uid.get(&uid)) {
+            return hit;
+        }
+        self.fill(&Query::Uid(uid))
+    }
+
+    pub fn by_name(&self, name: &str) -> Option<Arc<Account>> {
+        if let Some(hit) = self.cached(|i| i.by_name.get(name)) {
+            return hit;
+        }
+        self.fill(&Query::Name(name))
+    }
+
+    fn cached(&self, get: impl FnOnce(&Inner) -> Option<&Entry>) -> Option<Option<Arc<Account>>> {
+        let inner = self.inner.lock().unwrap_or_else(|e| e.into_inner());
+        let entry = get(&inner)?;
+        match self.ttl {
+            Some(ttl) if entry.at.elapsed() >= ttl => None,
+            _ => Some(entry.account.clone()),
+        }
+    }
+
+    /// Ask NSS (without holding the lock: it can take a while) and
+    /// remember the answer under every key it answers.
+    fn fill(&self, query: &Query<'_>) -> Option<Arc<Account>> {
+        let account = (self.lookup)(query).map(Arc::new);
+        let entry = Entry {
+            account: account.clone(),
+            at: Instant::now(),
+        };
+        let mut inner = self.inner.lock().unwrap_or_else(|e| e.into_inner());
+        if self.ttl.is_some() && inner.by_uid.len() + inner.by_name.len() >= MAX_ENTRIES {
+            *inner = Inner::default();
+        }
+        match (query, &account) {
+            (_, Some(a)) => {
+                inner.by_uid.insert(a.uid, entry.clone());
+                inner.by_name.insert(a.name.clone(), entry);
+            }
+            (Query::Uid(uid), None) => {
+                inner.by_uid.insert(*uid, entry);
+            }
+            (Query::Name(name), None) => {
+                inner.by_name.insert((*name).to_owned(), entry);
+            }
+        }
+        account
+    }
+}
+
+fn nss(query: &Query<'_>) -> Option<Account> {
+    let user = match query {
+        Query::Uid(uid) => User::from_uid(Uid::from_raw(*uid)),
+        Query::Name(name) => User::from_name(name),
+    };
+    user.ok().flatten().map(Account::from)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+
+    static CALLS: AtomicUsize = AtomicUsize::new(0);
+
+    fn fake(query: &Query<'_>) -> Option<Account> {
+        CALLS.fetch_add(1, Ordering::SeqCst);
+        let alice = || Account::new("alice".into(), 1000, 1000, "/home/alice".into());
+        match query {
+            Query::Uid(1000) | Query::Name("alice") => Some(alice()),
+            _ => None,
+        }
+    }
+
+    // One test, so the shared call counter isn't raced by another.
+    #[test]
+    fn lookups_are_shared_across_keys_and_expire_with_ttl() {
+        let a = Accounts::with_lookup(None, fake);
+        let before = CALLS.load(Ordering::SeqCst);
+        assert_eq!(a.by_name("alice").unwrap().uid, 1000);
+        assert_eq!(a.by_uid(1000).unwrap().name, "alice");
+        assert!(a.by_uid(4242).is_none());
+        assert!(a.by_uid(4242).is_none());
+        assert_eq!(CALLS.load(Ordering::SeqCst) - before, 2, "one per miss");
+
+        let a = Accounts::with_lookup(Some(Duration::ZERO), fake);
+        let before = CALLS.load(Ordering::SeqCst);
+        a.by_uid(1000);
+        a.by_uid(1000);
+        assert_eq!(
+            CALLS.load(Ordering::SeqCst) - before,
+            2,
+            "expired entries refetch"
+        );
+    }
+
+    #[test]
+    fn root_resolves_with_its_groups() {
+        let a = Accounts::per_auth();
+        let root = a.by_uid(0).expect("root in passwd");
+        assert_eq!(root.name, "root");
+        assert!(Arc::ptr_eq(&root, &a.by_name("root").unwrap()));
+        assert!(root.groups().unwrap().contains(&0));
+    }
+}
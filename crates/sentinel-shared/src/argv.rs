@@ -0,0 +1,338 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! `/proc/<pid>/cmdline` as an argument vector, analysed in place.
+//!
+//! [`crate::procfs::read_cmdline`] joins argv with spaces, which loses
+//! where one argument ends and the next begins. [`crate::strip_elevation_prefix`]
+//! then split that string again into a `Vec`, tested each word against
+//! the elevation tables one entry at a time, and joined the rest into a
+//! new `String`. [`crate::remember_eligible_command`] split it a third
+//! time. [`Argv`] borrows the raw NUL-separated bytes instead:
+//! - [`Argv::elevated`] returns the elevated command as a sub-slice of
+//!   the same bytes;
+//! - [`Argv::remember_eligible`] looks at the real `argv[0]`, not the
+//!   first word of a joined line;
+//! - the tables are perfect hash sets built at compile time, so each
+//!   test is one hash and at most one comparison.
+//!
+//! None of that allocates. Text is made once, by `Display`, for the
+//! dialog and the remember key. It is the same space-joined line as
+//! before.
+//!
+//! Results differ from the string functions only when an argument
+//! contains whitespace. `sudo "-u root" x` used to be split into `-u`
+//! and `root`, a flag and its value. It is now one argument starting
+//! with `-` that isn't in the flag table, so it is skipped alone. Both
+//! leave `x`, which is what sudo runs: its getopt reads that argument as
+//! `-u` with the attached value `" root"`.
+
+use std::borrow::Cow;
+use std::ffi::OsStr;
+use std::fmt;
+use std::os::unix::ffi::OsStrExt;
+use std::path::Path;
+
+/// [`crate::ELEVATION_TOOLS`], hashed.
+pub(crate) static ELEVATION_TOOLS: PerfectSet<16> = PerfectSet::new(crate::ELEVATION_TOOLS);
+/// [`crate::ELEVATION_FLAGS_WITH_VALUE`], hashed.
+pub(crate) static ELEVATION_FLAGS_WITH_VALUE: PerfectSet<128> =
+    PerfectSet::new(crate::ELEVATION_FLAGS_WITH_VALUE);
+/// [`crate::REMEMBER_INELIGIBLE`], hashed.
+pub(crate) static REMEMBER_INELIGIBLE: PerfectSet<512> =
+    PerfectSet::new(crate::REMEMBER_INELIGIBLE);
+
+/// A borrowed `/proc/<pid>/cmdline`: arguments separated (or terminated)
+/// by NULs. Empty arguments are skipped, as the joined form always did.
+#[derive(Clone, Copy, Default, PartialEq, Eq)]
+pub struct Argv<'a> {
+    raw: &'a [u8],
+}
+
+impl<'a> Argv<'a> {
+    pub fn new(raw: &'a [u8]) -> Self {
+        Self { raw }
+    }
+
+    /// The arguments, in order.
+    pub fn iter(&self) -> impl Iterator<Item = &'a [u8]> + 'a {
+        let mut rest = self.raw;
+        std::iter::from_fn(move || {
+            let (arg, tail) = next_arg(rest)?;
+            rest = tail;
+            Some(arg)
+        })
+    }
+
+    pub fn is_empty(&self) -> bool {
+        next_arg(self.raw).is_none()
+    }
+
+    /// `argv[0]`; borrowed unless it isn't UTF-8.
+    pub fn program(&self) -> Option<Cow<'a, str>> {
+        next_arg(self.raw).map(|(first, _)| String::from_utf8_lossy(first))
+    }
+
+    /// The command an elevation tool (`sudo`, `pkexec`, …; matched by
+    /// `argv[0]`'s basename) was asked to run: everything after its own
+    /// flags and their values. Empty when there is none (`sudo -i`).
+    /// `None` when `argv[0]` isn't an elevation tool.
+    pub fn elevated(&self) -> Option<Argv<'a>> {
+        let (first, mut rest) = next_arg(self.raw)?;
+        if !ELEVATION_TOOLS.contains(basename(first)) {
+            return None;
+        }
+        while let Some((arg, tail)) = next_arg(rest) {
+            if ELEVATION_FLAGS_WITH_VALUE.contains(arg) {
+                rest = next_arg(tail).map_or(&[][..], |(_, after)| after);
+            } else if arg.starts_with(b"-") {
+                rest = tail;
+            } else {
+                return Some(Argv::new(rest));
+            }
+        }
+        Some(Argv::default())
+    }
+
+    /// Whether this command may be remembered: not empty, and `argv[0]`'s
+    /// basename isn't in [`crate::REMEMBER_INELIGIBLE`]. The argv
+    /// counterpart of [`crate::remember_eligible_command`].
+    pub fn remember_eligible(&self) -> bool {
+        next_arg(self.raw).is_some_and(|(first, _)| !REMEMBER_INELIGIBLE.contains(basename(first)))
+    }
+}
+
+/// Space-joined, lossily decoded: what [`crate::procfs::read_cmdline`]
+/// returns for the same bytes.
+impl fmt::Display for Argv<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        for (i, arg) in self.iter().enumerate() {
+            if i > 0 {
+                f.write_str(" ")?;
+            }
+            for chunk in arg.utf8_chunks() {
+                f.write_str(chunk.valid())?;
+                if !chunk.invalid().is_empty() {
+                    f.write_str("\u{FFFD}")?;
+                }
+            }
+        }
+        Ok(())
+    }
+}
+
+impl fmt::Debug for Argv<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.debug_list()
+            .entries(self.iter().map(String::from_utf8_lossy))
+            .finish()
+    }
+}
+
+/// The first non-empty argument of `raw`, and what follows it.
+fn next_arg(mut raw: &[u8]) -> Option<(&[u8], &[u8])> {
+    while !raw.is_empty() {
+        let end = memchr::memchr(0, raw).unwrap_or(raw.len());
+        let (arg, tail) = (&raw[..end], raw.get(end + 1..).unwrap_or_default());
+        if !arg.is_empty() {
+            return Some((arg, tail));
+        }
+        raw = tail;
+    }
+    None
+}
+
+/// [`crate::process_basename`] on bytes; the argument itself when it
+/// has no file name (`/`, `..`).
+fn basename(arg: &[u8]) -> &[u8] {
+    Path::new(OsStr::from_bytes(arg))
+        .file_name()
+        .map_or(arg, OsStr::as_bytes)
+}
+
+/// A fixed set of strings with a collision-free hash, found by
+/// [`PerfectSet::new`] at compile time. `SLOTS` must be a power of two;
+/// a few times the key count keeps the seed search short. Lookup is one
+/// hash, one table read and at most one comparison.
+pub(crate) struct PerfectSet<const SLOTS: usize> {
+    keys: &'static [&'static str],
+    seed: u64,
+    /// Index into `keys`, or [`EMPTY`].
+    slots: [u8; SLOTS],
+}
+
+const EMPTY: u8 = u8::MAX;
+
+impl<const SLOTS: usize> PerfectSet<SLOTS> {
+    /// Search seeds until every key lands in its own slot. Fails the
+    /// build if none does (a duplicate key, or too few slots).
+    pub(crate) const fn new(keys: &'static [&'static str]) -> Self {
+        assert!(SLOTS.is_power_of_two() && keys.len() < EMPTY as usize);
+        let mut seed = 0;
+        while seed < 10_000 {
+            let mut slots = [EMPTY; SLOTS];
+            let mut i = 0;
+            while i < keys.len() {
+                let slot = (hash(seed, keys[i].as_bytes()) as usize) & (SLOTS - 1);
+                if slots[slot] != EMPTY {
+                    break;
+                }
+                slots[slot] = i as u8;
+                i += 1;
+            }
+            if i == keys.len() {
+                return Self { keys, seed, slots };
+            }
+            seed += 1;
+        }
+        panic!("no perfect hash seed: duplicate key, or raise SLOTS");
+    }
+
+    pub(crate) fn contains(&self, key: &[u8]) -> bool {
+        let slot = self.slots[(hash(self.seed, key) as usize) & (SLOTS - 1)];
+        slot != EMPTY && self.keys[slot as usize].as_bytes() == key
+    }
+}
+
+/// FNV-1a from a seeded basis, folded so the low bits see the high ones.
+const fn hash(seed: u64, bytes: &[u8]) -> u64 {
+    let mut h = 0xcbf2_9ce4_8422_2325 ^ seed.wrapping_mul(0x9e37_79b9_7f4a_7c15);
+    let mut i = 0;
+    while i < bytes.len() {
+        h = (h ^ bytes[i] as u64).wrapping_mul(0x0000_0100_0000_01b3);
+        i += 1;
+    }
+    h ^ (h >> 29)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn argv(words: &[&str]) -> Vec<u8> {
+        words
+            .iter()
+            .flat_map(|w| [w.as_bytes(), b"\0"].concat())
+            .collect()
+    }
+
+    #[test]
+    fn perfect_sets_hold_exactly_their_lists() {
+        for (set, list) in [
+            (&ELEVATION_TOOLS as &dyn Lookup, crate::ELEVATION_TOOLS),
+            (
+                &ELEVATION_FLAGS_WITH_VALUE,
+                crate::ELEVATION_FLAGS_WITH_VALUE,
+            ),
+            (&REMEMBER_INELIGIBLE, crate::REMEMBER_INELIGIBLE),
+        ] {
+            for key in list {
+                assert!(set.has(key), "{key}");
+                assert!(!set.has(&format!("{key}x")), "{key}x");
+            }
+            for miss in ["", "pacman", "sud", "-x", "--users"] {
+                assert!(!set.has(miss), "{miss}");
+            }
+        }
+    }
+
+    trait Lookup {
+        fn has(&self, key: &str) -> bool;
+    }
+
+    impl<const N: usize> Lookup for PerfectSet<N> {
+        fn has(&self, key: &str) -> bool {
+            self.contains(key.as_bytes())
+        }
+    }
+
+    #[test]
+    fn elevated_borrows_the_command_after_the_flags() {
+        let raw = argv(&[
+            "/usr/bin/sudo",
+            "-E",
+            "-u",
+            "root",
+            "systemctl",
+            "restart",
+            "x",
+        ]);
+        let a = Argv::new(&raw);
+        let cmd = a.elevated().unwrap();
+        assert_eq!(cmd.to_string(), "systemctl restart x");
+        assert_eq!(cmd.program().as_deref(), Some("systemctl"));
+        assert!(std::ptr::eq(cmd.raw.as_ptr(), raw[25..].as_ptr()));
+        assert!(cmd.remember_eligible());
+
+        assert!(
+            Argv::new(&argv(&["sudo", "-i"]))
+                .elevated()
+                .unwrap()
+                .is_empty()
+        );
+        assert_eq!(Argv::new(&argv(&["ls", "-la"])).elevated(), None);
+        assert_eq!(Argv::new(b"").elevated(), None);
+        assert!(
+            !Argv::new(&argv(&["pkexec", "bash"]))
+                .elevated()
+                .unwrap()
+                .remember_eligible()
+        );
+        assert!(!Argv::new(b"\0\0").remember_eligible());
+    }
+
+    #[test]
+    fn argument_boundaries_survive() {
+        // One argument with a space is one argument, not a flag and its value.
+        let raw = argv(&["sudo", "-u root", "sh -c", "id"]);
+        let cmd = Argv::new(&raw).elevated().unwrap();
+        assert_eq!(cmd.iter().collect::<Vec<_>>(), [&b"sh -c"[..], b"id"]);
+        // "sh -c" is not `sh`: the program sudo will look up has that name.
+        assert!(cmd.remember_eligible());
+    }
+
+    #[test]
+    fn display_matches_the_joined_cmdline() {
+        let raw = b"\0pac\xffman\0\0-Syu\0";
+        assert_eq!(Argv::new(raw).to_string(), "pac\u{FFFD}man -Syu");
+        assert_eq!(
+            format!("{:?}", Argv::new(raw)),
+            "[\"pac\u{FFFD}man\", \"-Syu\"]"
+        );
+    }
+
+    /// Without whitespace inside arguments, the argv view agrees with the
+    /// string functions on every example they document and then some.
+    #[test]
+    fn agrees_with_the_string_functions() {
+        for words in [
+            &["sudo", "true"][..],
+            &["sudo-rs", "systemctl", "restart", "foo"],
+            &["sudo", "-u", "root", "/bin/sh"],
+            &["pkexec", "--user", "root", "/usr/bin/cat", "/e"],
+            &["ls", "-la"],
+            &["sudo", "-i"],
+            &["sudo", "-u"],
+            &["/usr/bin/doas", "-", "vim", "/etc/x"],
+            &["su"],
+            &["..", "x"],
+            &["/", "x"],
+            &[],
+        ] {
+            let raw = argv(words);
+            let a = Argv::new(&raw);
+            let joined = words.join(" ");
+            assert_eq!(a.to_string(), joined);
+            let stripped = crate::strip_elevation_prefix(&joined);
+            assert_eq!(
+                a.elevated().map_or(joined.clone(), |c| c.to_string()),
+                stripped,
+                "{words:?}"
+            );
+            assert_eq!(
+                a.remember_eligible(),
+                crate::remember_eligible_command(&joined),
+                "{words:?}"
+            );
+        }
+    }
+}
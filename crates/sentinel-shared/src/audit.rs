@@ -1,9 +1,11 @@
 // SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
 // SPDX-License-Identifier: GPL-3.0-or-later
-//! Shared syslog initialization for the PAM module and the polkit agent.
+//! Shared log initialization for the PAM module and the polkit agent.
 //!
-//! Both consumers ship the same `Formatter3164` boilerplate; this module
-//! is the single source of truth.
+//! Under systemd, audit lines go to journald over its native protocol,
+//! with the fields of each `event=` line filed as journal fields (see
+//! [`crate::journal`]). Without a journald socket they go to syslog
+//! (`/dev/log`, RFC 3164) as before. Both consumers share this module.
 //!
 //! ## Logger fallback (A13)
 //!
@@ -14,8 +16,8 @@
 //! the host registered, our `log::info!` calls land somewhere we don't
 //! control or get dropped silently.
 //!
-//! To stay observable in that case, we keep a side-channel `syslog::Logger`
-//! around (`FALLBACK`). When the global registration succeeds, this is
+//! To stay observable in that case, we keep a side-channel logger (journal
+//! or syslog) around (`FALLBACK`). When the global registration succeeds, this is
 //! `None` and `log::info!` etc. work as expected. When it fails, the
 //! caller can use [`audit_emit`] which writes to the fallback handle
 //! directly.
@@ -25,23 +27,42 @@
 //! a single-line addition here protects future consumers from going
 //! silent.
 
+use crate::journal::Journal;
 use std::sync::Mutex;
 use std::sync::OnceLock;
 use syslog::{BasicLogger, Facility, Formatter3164, Logger, LoggerBackend};
 
 /// Side-channel logger used when `log::set_boxed_logger` fails because
 /// the host already installed one.
-static FALLBACK: OnceLock<Mutex<Logger<LoggerBackend, Formatter3164>>> = OnceLock::new();
+static FALLBACK: OnceLock<Sink> = OnceLock::new();
 
-/// Initialize syslog for the AUTH facility under the given identifier.
+enum Sink {
+    Journal(Journal),
+    Syslog(Mutex<Logger<LoggerBackend, Formatter3164>>),
+}
+
+/// Initialize logging for the AUTH facility under the given identifier:
+/// journald if its socket is there, syslog otherwise.
 ///
 /// Idempotent: repeated calls are no-ops. Safe to call from
 /// `Once::call_once` blocks. Both `pam_sentinel.so` and
 /// `sentinel-polkit-agent` use this.
 ///
 /// On global-registration failure, falls back to a side-channel logger
-/// stored in [`FALLBACK`] so [`audit_emit`] still reaches syslog.
-pub fn init_syslog(ident: &str, level: log::LevelFilter) {
+/// stored in [`FALLBACK`] so [`audit_emit`] still reaches the log.
+pub fn init(ident: &str, level: log::LevelFilter) {
+    if let Ok(journal) = Journal::connect(ident) {
+        if log::set_boxed_logger(Box::new(journal)).is_ok() {
+            log::set_max_level(level);
+        } else if let Ok(fallback) = Journal::connect(ident) {
+            let _ = FALLBACK.set(Sink::Journal(fallback));
+        }
+        return;
+    }
+    init_syslog(ident, level);
+}
+
+fn init_syslog(ident: &str, level: log::LevelFilter) {
     let formatter = Formatter3164 {
         facility: Facility::LOG_AUTH,
         hostname: None,
@@ -61,7 +82,7 @@ pub fn init_syslog(ident: &str, level: log::LevelFilter) {
 
     // Host registered its own logger first; keep a side-channel handle.
     if let Ok(fallback_logger) = syslog::unix(formatter) {
-        let _ = FALLBACK.set(Mutex::new(fallback_logger));
+        let _ = FALLBACK.set(Sink::Syslog(Mutex::new(fallback_logger)));
     }
 }
 
@@ -77,15 +98,21 @@ pub fn audit_emit(level: log::Level, msg: &str) {
     // If the fallback exists, the global registration failed; write
     // directly so we don't lose audit lines when the host has its own
     // log facade.
-    if let Some(fb) = FALLBACK.get() {
-        if let Ok(mut logger) = fb.lock() {
-            let _ = match level {
-                log::Level::Error => logger.err(msg),
-                log::Level::Warn => logger.warning(msg),
-                log::Level::Info => logger.info(msg),
-                log::Level::Debug => logger.debug(msg),
-                log::Level::Trace => logger.debug(msg),
-            };
+    match FALLBACK.get() {
+        Some(Sink::Journal(journal)) => {
+            let _ = journal.send(level, format_args!("{msg}"));
+        }
+        Some(Sink::Syslog(fb)) => {
+            if let Ok(mut logger) = fb.lock() {
+                let _ = match level {
+                    log::Level::Error => logger.err(msg),
+                    log::Level::Warn => logger.warning(msg),
+                    log::Level::Info => logger.info(msg),
+                    log::Level::Debug => logger.debug(msg),
+                    log::Level::Trace => logger.debug(msg),
+                };
+            }
         }
+        None => {}
     }
 }
@@ -110,6 +110,13 @@ pub struct Args {
     /// `REMEMBER` to its verdict so the backend records the grant.
     #[arg(long, default_value_t = 0)]
     pub remember_secs: u32,
+
+    /// Run as the persistent per-session dialog service instead of
+    /// showing one dialog: keep Qt/QML loaded and answer requests on
+    /// the socket from [`crate::dialog::socket_path`]. Every other flag
+    /// is ignored; each request carries its own.
+    #[arg(long)]
+    pub serve: bool,
 }
 
 impl Args {
@@ -179,6 +186,7 @@ mod tests {
             layer_shell,
             sound_name: String::new(),
             remember_secs: 0,
+            serve: false,
         }
     }
 
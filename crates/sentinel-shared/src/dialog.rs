@@ -0,0 +1,289 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Typed contract for the persistent per-session dialog service.
+//!
+//! Spawning `sentinel-helper-kde` per prompt cold-starts `QApplication`,
+//! the QML engine and Kirigami every time. `sentinel-helper-kde --serve`
+//! runs once per graphical session (spawned and supervised by the polkit
+//! agent), keeps that stack loaded, and renders a dialog per [`Request`]
+//! received on [`socket_path`]. The polkit agent tries it first and falls
+//! back to the one-shot CLI contract ([`crate::cli`]) whenever it is
+//! absent, not its own child, busy or speaks another [`PROTOCOL_VERSION`].
+//!
+//! # Framing
+//!
+//! Same shape as `sentinel-broker-proto`: a `u32` LE body length, then a
+//! postcard body, capped at [`MAX_FRAME_LEN`] before allocating. One
+//! request and one response per connection.
+//!
+//! # Trust
+//!
+//! The socket lives in the user's own runtime directory, so *any* process
+//! of that user can bind it. The agent only talks to a listener whose
+//! `SO_PEERCRED` pid is the child it spawned. The root PAM module never
+//! uses the service: no property of a listener's pid proves who answers,
+//! because `SO_PEERCRED` is fixed at `listen()` and survives `fork` and
+//! `execve`. A user could listen, hand the socket to a child that always
+//! answers Allow, then exec the genuine helper in the listening pid.
+//! `sudo`/`su` keep the fork + exec CLI path, whose pipe root creates.
+
+use crate::Verdict;
+use serde::de::DeserializeOwned;
+use serde::{Deserialize, Serialize};
+use std::io::{self, Read, Write};
+
+/// Wire protocol version. A service that doesn't speak the sender's
+/// version answers [`Response::Unsupported`] without showing anything.
+///
+/// - 1: initial.
+/// - 2: [`Verdict`] carries the dialog's `timings`.
+/// - 3: [`Response::Busy`].
+pub const PROTOCOL_VERSION: u16 = 3;
+
+/// Hard cap on a single framed message. A request is a handful of
+/// dialog strings, each already clamped by the backend.
+pub const MAX_FRAME_LEN: usize = 64 * 1024;
+
+/// Socket file name inside the user's runtime directory.
+pub const SOCKET_NAME: &str = "sentinel-dialog.sock";
+
+/// Set (to `"1"`) by the service in the environment it re-executes
+/// itself with, and by the agent when it spawns the service, so the
+/// service starts in one exec.
+pub const SERVICE_MARKER_ENV: &str = "SENTINEL_DIALOG_SERVICE";
+
+/// Variables that make the dynamic loader or Qt pull code from outside
+/// the installed tree. The service strips them before re-executing.
+pub const UNTRUSTED_ENV: &[&str] = &[
+    "LD_PRELOAD",
+    "LD_LIBRARY_PATH",
+    "LD_AUDIT",
+    "QT_PLUGIN_PATH",
+    "QT_QPA_PLATFORM_PLUGIN_PATH",
+    "QML_IMPORT_PATH",
+    "QML2_IMPORT_PATH",
+    "QML_DISK_CACHE_PATH",
+    "QT_QUICK_CONTROLS_STYLE_PATH",
+];
+
+/// The service socket for `uid`: `/run/user/<uid>/sentinel-dialog.sock`.
+/// Derived from the uid rather than `$XDG_RUNTIME_DIR` because the PAM
+/// module runs inside a root binary whose environment was scrubbed.
+pub fn socket_path(uid: u32) -> String {
+    format!("/run/user/{uid}/{SOCKET_NAME}")
+}
+
+/// One dialog to show. The fields mirror the CLI flags in
+/// [`crate::cli::Args`] one-to-one, so a request renders exactly as the
+/// equivalent helper invocation would.
+#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+pub struct Request {
+    pub protocol: u16,
+    pub title: String,
+    pub message: String,
+    pub secondary: String,
+    pub timeout: u64,
+    pub min_time: u64,
+    pub randomize: bool,
+    pub sound_name: String,
+    pub remember_secs: u32,
+    pub process_exe: Option<String>,
+    pub process_cmdline: Option<String>,
+    pub process_pid: Option<i32>,
+    pub process_cwd: Option<String>,
+    pub requesting_user: Option<String>,
+    pub action: Option<String>,
+    /// Already-validated `LC_ALL` / `LC_MESSAGES` / `LANG` values of the
+    /// requesting process. The CLI path exports these into the helper's
+    /// environment; the service resolves the UI language from them.
+    pub locale: Vec<(String, String)>,
+}
+
+impl Request {
+    /// Value of locale variable `key`, if the sender forwarded it.
+    pub fn locale_var(&self, key: &str) -> Option<String> {
+        self.locale
+            .iter()
+            .find(|(k, _)| k == key)
+            .map(|(_, v)| v.clone())
+    }
+}
+
+/// Service → backend.
+#[derive(Debug, Clone, PartialEq, Eq, Serialize, Deserialize)]
+pub enum Response {
+    /// The user's answer (or the dialog's own timeout).
+    Verdict(Verdict),
+    /// The request's `protocol` isn't the service's. Nothing was shown;
+    /// the backend falls back to the CLI path.
+    Unsupported { protocol: u16 },
+    /// Another prompt is on screen. Nothing was shown; the backend falls
+    /// back to the CLI path rather than queue behind it.
+    Busy,
+}
+
+#[cfg(feature = "cli")]
+impl From<Request> for crate::cli::Args {
+    /// The CLI view of a request, for the helper's dialog code. Render
+    /// mode is the service's own (decided once at startup), so both
+    /// override flags stay off.
+    fn from(r: Request) -> Self {
+        Self {
+            title: r.title,
+            message: r.message,
+            secondary: r.secondary,
+            process_exe: r.process_exe,
+            process_cmdline: r.process_cmdline,
+            process_pid: r.process_pid,
+            process_cwd: r.process_cwd,
+            requesting_user: r.requesting_user,
+            action: r.action,
+            timeout: r.timeout,
+            min_time: r.min_time,
+            randomize: r.randomize,
+            windowed: false,
+            layer_shell: false,
+            sound_name: r.sound_name,
+            remember_secs: r.remember_secs,
+            serve: false,
+        }
+    }
+}
+
+/// Serialize `msg` as one length-prefixed frame: `u32` LE body length,
+/// then the body.
+pub fn encode_frame<T: Serialize>(msg: &T) -> io::Result<Vec<u8>> {
+    let body =
+        postcard::to_stdvec(msg).map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))?;
+    if body.len() > MAX_FRAME_LEN {
+        return Err(too_large(body.len()));
+    }
+    let mut frame = Vec::with_capacity(4 + body.len());
+    frame.extend_from_slice(&(body.len() as u32).to_le_bytes());
+    frame.extend_from_slice(&body);
+    Ok(frame)
+}
+
+/// Body length announced by a frame header, checked against
+/// [`MAX_FRAME_LEN`] so the caller can allocate the body safely. Split
+/// out for async readers that can't use [`read_frame`].
+pub fn frame_len(header: [u8; 4]) -> io::Result<usize> {
+    let len = u32::from_le_bytes(header) as usize;
+    if len > MAX_FRAME_LEN {
+        return Err(too_large(len));
+    }
+    Ok(len)
+}
+
+/// Deserialize a frame body (without its header).
+pub fn decode_body<T: DeserializeOwned>(body: &[u8]) -> io::Result<T> {
+    postcard::from_bytes(body).map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))
+}
+
+/// Write `msg` as one frame (see [`encode_frame`]).
+pub fn write_frame<W: Write, T: Serialize>(w: &mut W, msg: &T) -> io::Result<()> {
+    w.write_all(&encode_frame(msg)?)?;
+    w.flush()
+}
+
+/// Read one frame. The length is checked against [`MAX_FRAME_LEN`]
+/// before the body buffer is allocated.
+pub fn read_frame<R: Read, T: DeserializeOwned>(r: &mut R) -> io::Result<T> {
+    let mut header = [0u8; 4];
+    r.read_exact(&mut header)?;
+    let mut body = vec![0u8; frame_len(header)?];
+    r.read_exact(&mut body)?;
+    decode_body(&body)
+}
+
+fn too_large(len: usize) -> io::Error {
+    io::Error::new(
+        io::ErrorKind::InvalidData,
+        format!("frame too large: {len} bytes (max {MAX_FRAME_LEN})"),
+    )
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::Outcome;
+
+    fn request() -> Request {
+        Request {
+            protocol: PROTOCOL_VERSION,
+            title: "Authentication Required".into(),
+            message: "pacman wants to run as root".into(),
+            secondary: String::new(),
+            timeout: 30,
+            min_time: 500,
+            randomize: true,
+            sound_name: "dialog-warning".into(),
+            remember_secs: 300,
+            process_exe: Some("/usr/bin/pacman".into()),
+            process_cmdline: Some("pacman -Syu".into()),
+            process_pid: Some(4242),
+            process_cwd: None,
+            requesting_user: Some("alice".into()),
+            action: Some("sudo".into()),
+            locale: vec![("LANG".into(), "de_DE.UTF-8".into())],
+        }
+    }
+
+    #[test]
+    fn framed_request_round_trips() {
+        let mut buf = Vec::new();
+        write_frame(&mut buf, &request()).unwrap();
+        let back: Request = read_frame(&mut io::Cursor::new(buf)).unwrap();
+        assert_eq!(back, request());
+    }
+
+    #[test]
+    fn framed_response_round_trips() {
+        for resp in [
+            Response::Verdict(Verdict {
+                outcome: Outcome::Allow,
+                remember: true,
+                timings: None,
+            }),
+            Response::Verdict(Verdict {
+                outcome: Outcome::Timeout,
+                remember: false,
+                timings: Some(crate::Timings {
+                    start_us: 10,
+                    app_us: None,
+                    qml_us: Some(20),
+                    first_frame_us: Some(30),
+                }),
+            }),
+            Response::Unsupported { protocol: 7 },
+            Response::Busy,
+        ] {
+            let mut buf = Vec::new();
+            write_frame(&mut buf, &resp).unwrap();
+            let back: Response = read_frame(&mut io::Cursor::new(buf)).unwrap();
+            assert_eq!(back, resp);
+        }
+    }
+
+    #[test]
+    fn oversized_length_is_rejected_before_alloc() {
+        let mut framed = u32::MAX.to_le_bytes().to_vec();
+        framed.extend_from_slice(b"junk");
+        let err = read_frame::<_, Request>(&mut io::Cursor::new(framed)).unwrap_err();
+        assert_eq!(err.kind(), io::ErrorKind::InvalidData);
+    }
+
+    #[test]
+    fn garbage_body_errors_not_panics() {
+        let mut framed = 4u32.to_le_bytes().to_vec();
+        framed.extend_from_slice(&[0xFF; 4]);
+        assert!(read_frame::<_, Response>(&mut io::Cursor::new(framed)).is_err());
+    }
+
+    #[test]
+    fn locale_var_looks_up_forwarded_values() {
+        let r = request();
+        assert_eq!(r.locale_var("LANG").as_deref(), Some("de_DE.UTF-8"));
+        assert_eq!(r.locale_var("LC_ALL"), None);
+    }
+}
@@ -0,0 +1,637 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! In-memory, expiring store of "remember" grants, shared by the broker
+//! (sudo/su grants, keyed by `RememberKey`) and the polkit agent (keyed
+//! by action id + full command).
+//!
+//! - **Structural keys.** Entries are found by the key's own [`Hash`] +
+//!   [`Eq`], never by a formatted string. A lookup can use a borrowed
+//!   [`Probe`] (e.g. two `&str`s standing in for an owned key), so a
+//!   check allocates nothing.
+//! - **Bounded.** Every grant belongs to an *owner* (the broker uses the
+//!   human `loginuid`). Each owner holds at most `per_owner` grants, and
+//!   the store at most `total`. A record that would exceed either is
+//!   refused, and the user is simply prompted again next time.
+//! - **Timer-wheel expiry.** Every grant dies [`MAX_REMEMBER`] after it
+//!   was recorded, whatever ttl a check asks for. Expiry is scheduled on
+//!   a two-level hashed timer wheel (1 s ticks), so a record only touches
+//!   the grants actually due, never scans the map.
+//! - **Sharded by owner** behind `RwLock`s. Checks take a read lock and
+//!   never contend with each other; a record write-locks one owner's
+//!   shard.
+//!
+//! Freshness itself stays exact: a grant is fresh while less than
+//! `min(ttl, MAX_REMEMBER)` has passed since it was recorded, on the
+//! monotonic clock.
+
+use std::collections::HashMap;
+use std::collections::hash_map::RandomState;
+use std::hash::{BuildHasher, BuildHasherDefault, Hash, Hasher};
+use std::sync::RwLock;
+use std::time::{Duration, Instant};
+
+/// Hard ceiling on any remember window, regardless of the ttl a caller
+/// asks for. Bounds the blast radius of an over-generous config.
+pub const MAX_REMEMBER: Duration = Duration::from_secs(900);
+
+/// Default cap on one owner's live grants.
+pub const DEFAULT_PER_OWNER: usize = 256;
+
+/// Default cap on all live grants.
+pub const DEFAULT_TOTAL: usize = 64 * 1024;
+
+const SHARDS: usize = 16;
+
+/// A key, or a borrowed stand-in for one, that can look up grants stored
+/// under `K`. Its [`Hash`] must agree with `K`'s for keys it
+/// [`matches`](Probe::matches), the same contract as `Borrow`.
+pub trait Probe<K>: Hash {
+    fn matches(&self, key: &K) -> bool;
+}
+
+impl<K: Hash + Eq> Probe<K> for K {
+    fn matches(&self, key: &K) -> bool {
+        self == key
+    }
+}
+
+/// The expiring grant store. See the module docs.
+pub struct GrantStore<K> {
+    shards: Box<[RwLock<Shard<K>>]>,
+    hasher: RandomState,
+    per_owner: usize,
+    per_shard: usize,
+}
+
+impl<K: Hash + Eq> Default for GrantStore<K> {
+    fn default() -> Self {
+        Self::with_limits(DEFAULT_PER_OWNER, DEFAULT_TOTAL)
+    }
+}
+
+impl<K: Hash + Eq> GrantStore<K> {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// A store holding at most `per_owner` grants per owner and about
+    /// `total` overall (enforced per shard, as `total / 16`).
+    pub fn with_limits(per_owner: usize, total: usize) -> Self {
+        let epoch = Instant::now();
+        Self {
+            shards: (0..SHARDS)
+                .map(|_| RwLock::new(Shard::new(epoch)))
+                .collect(),
+            hasher: RandomState::new(),
+            per_owner,
+            per_shard: total.div_ceil(SHARDS),
+        }
+    }
+
+    /// Whether `owner` holds a grant for `key` recorded less than `ttl`
+    /// (capped at [`MAX_REMEMBER`]) ago. A zero ttl never matches.
+    pub fn is_fresh<Q: Probe<K> + ?Sized>(&self, owner: u32, key: &Q, ttl: Duration) -> bool {
+        self.is_fresh_at(owner, key, ttl, Instant::now())
+    }
+
+    /// Record or refresh `owner`'s grant for `key`. `false` if it was
+    /// refused because the owner or the store is full.
+    pub fn record(&self, owner: u32, key: K) -> bool {
+        self.record_at(owner, key, Instant::now())
+    }
+
+    /// Live (not yet expired) grants plus any that are due but not yet
+    /// swept.
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|s| read(s).len).sum()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    pub fn is_fresh_at<Q: Probe<K> + ?Sized>(
+        &self,
+        owner: u32,
+        key: &Q,
+        ttl: Duration,
+        now: Instant,
+    ) -> bool {
+        let ttl = ttl.min(MAX_REMEMBER);
+        if ttl.is_zero() {
+            return false;
+        }
+        let hash = self.hasher.hash_one(key);
+        let shard = read(self.shard(owner));
+        shard
+            .find(hash, owner, key)
+            .is_some_and(|e| now.saturating_duration_since(e.recorded) < ttl)
+    }
+
+    /// Record at `now`, which may be in the past: a grant handed over
+    /// from another process keeps its original age and expiry.
+    pub fn record_at(&self, owner: u32, key: K, now: Instant) -> bool {
+        let hash = self.hasher.hash_one(&key);
+        let mut shard = write(self.shard(owner));
+        shard.expire(now);
+        shard.insert(hash, owner, key, now, self.per_owner, self.per_shard)
+    }
+
+    /// Call `f` with every grant still live at `now` and its age.
+    pub fn for_each_at(&self, now: Instant, mut f: impl FnMut(u32, &K, Duration)) {
+        for shard in &self.shards {
+            for e in read(shard).buckets.values().flatten() {
+                let age = now.saturating_duration_since(e.recorded);
+                if age < MAX_REMEMBER {
+                    f(e.owner, &e.key, age);
+                }
+            }
+        }
+    }
+
+    fn shard(&self, owner: u32) -> &RwLock<Shard<K>> {
+        // Owners are small consecutive integers (uids); spread them
+        // without hashing.
+        &self.shards[owner as usize % SHARDS]
+    }
+}
+
+fn read<T>(l: &RwLock<T>) -> std::sync::RwLockReadGuard<'_, T> {
+    l.read().unwrap_or_else(|e| e.into_inner())
+}
+
+fn write<T>(l: &RwLock<T>) -> std::sync::RwLockWriteGuard<'_, T> {
+    l.write().unwrap_or_else(|e| e.into_inner())
+}
+
+struct Entry<K> {
+    key: K,
+    owner: u32,
+    recorded: Instant,
+    /// Matches the one live wheel handle for this entry; handles left
+    /// behind by earlier records of the same key are ignored.
+    generation: u32,
+}
+
+/// The map is keyed by the key's hash (already a SipHash output, so it
+/// is used as-is), and each bucket holds the — almost always one —
+/// entries with that hash.
+type Buckets<K> = HashMap<u64, Vec<Entry<K>>, BuildHasherDefault<PrehashedHasher>>;
+
+struct Shard<K> {
+    buckets: Buckets<K>,
+    owners: HashMap<u32, usize>,
+    len: usize,
+    next_generation: u32,
+    wheel: Wheel,
+    fired: Vec<Handle>,
+}
+
+impl<K> Shard<K> {
+    fn new(epoch: Instant) -> Self {
+        Self {
+            buckets: Buckets::default(),
+            owners: HashMap::new(),
+            len: 0,
+            next_generation: 0,
+            wheel: Wheel::new(epoch),
+            fired: Vec::new(),
+        }
+    }
+
+    fn find<Q: Probe<K> + ?Sized>(&self, hash: u64, owner: u32, key: &Q) -> Option<&Entry<K>> {
+        self.buckets
+            .get(&hash)?
+            .iter()
+            .find(|e| e.owner == owner && key.matches(&e.key))
+    }
+
+    fn insert(
+        &mut self,
+        hash: u64,
+        owner: u32,
+        key: K,
+        now: Instant,
+        per_owner: usize,
+        per_shard: usize,
+    ) -> bool
+    where
+        K: Eq,
+    {
+        let generation = self.next_generation;
+        self.next_generation = generation.wrapping_add(1);
+        let held = self
+            .buckets
+            .get_mut(&hash)
+            .and_then(|b| b.iter_mut().find(|e| e.owner == owner && e.key == key));
+        if let Some(e) = held {
+            e.recorded = now;
+            e.generation = generation;
+        } else {
+            // The wheel sweeps on whole ticks, so grants that ended less
+            // than a tick ago still count; purge them before refusing.
+            if self.full(owner, per_owner, per_shard) {
+                self.purge(now);
+                if self.full(owner, per_owner, per_shard) {
+                    return false;
+                }
+            }
+            self.buckets.entry(hash).or_default().push(Entry {
+                key,
+                owner,
+                recorded: now,
+                generation,
+            });
+            *self.owners.entry(owner).or_default() += 1;
+            self.len += 1;
+        }
+        self.wheel
+            .schedule(now + MAX_REMEMBER, Handle { hash, generation });
+        true
+    }
+
+    fn full(&self, owner: u32, per_owner: usize, per_shard: usize) -> bool {
+        let held = self.owners.get(&owner).copied().unwrap_or(0);
+        held >= per_owner || self.len >= per_shard
+    }
+
+    /// Drop every grant past its lifetime at `now`, due on the wheel or
+    /// not. A scan of the shard, so only for a record at the quota;
+    /// the wheel handles of purged grants are ignored when they fire.
+    fn purge(&mut self, now: Instant) {
+        let (owners, len) = (&mut self.owners, &mut self.len);
+        self.buckets.retain(|_, bucket| {
+            bucket.retain(|e| {
+                let live = now.saturating_duration_since(e.recorded) < MAX_REMEMBER;
+                if !live {
+                    if let Some(n) = owners.get_mut(&e.owner) {
+                        *n -= 1;
+                        if *n == 0 {
+                            owners.remove(&e.owner);
+                        }
+                    }
+                    *len -= 1;
+                }
+                live
+            });
+            !bucket.is_empty()
+        });
+    }
+
+    /// Drop every grant whose [`MAX_REMEMBER`] lifetime ended by `now`.
+    fn expire(&mut self, now: Instant) {
+        let mut fired = std::mem::take(&mut self.fired);
+        self.wheel.advance(now, &mut fired);
+        for h in fired.drain(..) {
+            let Some(bucket) = self.buckets.get_mut(&h.hash) else {
+                continue;
+            };
+            let Some(i) = bucket.iter().position(|e| e.generation == h.generation) else {
+                continue;
+            };
+            if now.saturating_duration_since(bucket[i].recorded) < MAX_REMEMBER {
+                // Not due yet (the wheel rounds to whole ticks).
+                let at = bucket[i].recorded + MAX_REMEMBER;
+                self.wheel.schedule(at, h);
+                continue;
+            }
+            let e = bucket.swap_remove(i);
+            if bucket.is_empty() {
+                self.buckets.remove(&h.hash);
+            }
+            if let Some(n) = self.owners.get_mut(&e.owner) {
+                *n -= 1;
+                if *n == 0 {
+                    self.owners.remove(&e.owner);
+                }
+            }
+            self.len -= 1;
+        }
+        self.fired = fired;
+    }
+}
+
+#[derive(Clone, Copy)]
+struct Handle {
+    hash: u64,
+    generation: u32,
+}
+
+const WHEEL_SLOTS: u64 = 64;
+
+/// Two-level hashed timer wheel with 1 s ticks: level 0 covers the next
+/// 64 s one tick per slot, level 1 the next 4096 s (past
+/// [`MAX_REMEMBER`]) 64 ticks per slot, cascading into level 0 as its
+/// block comes up.
+struct Wheel {
+    epoch: Instant,
+    /// Last tick advanced through.
+    now: u64,
+    near: Vec<Vec<Handle>>,
+    far: Vec<Vec<(u64, Handle)>>,
+}
+
+impl Wheel {
+    fn new(epoch: Instant) -> Self {
+        Self {
+            epoch,
+            now: 0,
+            near: (0..WHEEL_SLOTS).map(|_| Vec::new()).collect(),
+            far: (0..WHEEL_SLOTS).map(|_| Vec::new()).collect(),
+        }
+    }
+
+    /// The first tick at or after `t`.
+    fn tick_of(&self, t: Instant) -> u64 {
+        let d = t.saturating_duration_since(self.epoch);
+        d.as_secs() + u64::from(d.subsec_nanos() > 0)
+    }
+
+    fn schedule(&mut self, at: Instant, h: Handle) {
+        let tick = self.tick_of(at).max(self.now + 1);
+        self.place(tick, h);
+    }
+
+    fn place(&mut self, tick: u64, h: Handle) {
+        if tick - self.now < WHEEL_SLOTS {
+            self.near[(tick % WHEEL_SLOTS) as usize].push(h);
+        } else {
+            self.far[((tick / WHEEL_SLOTS) % WHEEL_SLOTS) as usize].push((tick, h));
+        }
+    }
+
+    /// Move the wheel up to `now`, appending every handle that came due.
+    fn advance(&mut self, now: Instant, fired: &mut Vec<Handle>) {
+        // Tick `k` holds deadlines in `(k - 1, k]`: due once `k` has passed.
+        let to = now
+            .saturating_duration_since(self.epoch)
+            .as_secs()
+            .max(self.now);
+        if to - self.now >= WHEEL_SLOTS * WHEEL_SLOTS {
+            // Idle for longer than the wheel spans: everything is due.
+            fired.extend(self.near.iter_mut().flat_map(std::mem::take));
+            fired.extend(self.far.iter_mut().flat_map(std::mem::take).map(|(_, h)| h));
+            self.now = to;
+            return;
+        }
+        while self.now < to {
+            self.now += 1;
+            let t = self.now;
+            if t % WHEEL_SLOTS == 0 {
+                let block = ((t / WHEEL_SLOTS) % WHEEL_SLOTS) as usize;
+                for (tick, h) in std::mem::take(&mut self.far[block]) {
+                    self.near[(tick % WHEEL_SLOTS) as usize].push(h);
+                }
+            }
+            fired.append(&mut self.near[(t % WHEEL_SLOTS) as usize]);
+        }
+    }
+}
+
+/// Identity hasher for keys that already are hashes.
+#[derive(Default)]
+struct PrehashedHasher(u64);
+
+impl Hasher for PrehashedHasher {
+    fn finish(&self) -> u64 {
+        self.0
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for &b in bytes {
+            self.0 = self.0.rotate_left(8) ^ u64::from(b);
+        }
+    }
+
+    fn write_u64(&mut self, n: u64) {
+        self.0 = n;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[derive(Hash, PartialEq, Eq, Debug)]
+    struct Key {
+        action: String,
+        command: String,
+    }
+
+    /// Borrowed stand-in; hashes exactly like `Key`.
+    #[derive(Hash)]
+    struct KeyRef<'a> {
+        action: &'a str,
+        command: &'a str,
+    }
+
+    impl Probe<Key> for KeyRef<'_> {
+        fn matches(&self, k: &Key) -> bool {
+            self.action == k.action && self.command == k.command
+        }
+    }
+
+    fn key(cmd: &str) -> Key {
+        Key {
+            action: "act".into(),
+            command: cmd.into(),
+        }
+    }
+
+    const MIN: Duration = Duration::from_secs(60);
+
+    #[test]
+    fn record_then_fresh_until_ttl() {
+        let s = GrantStore::new();
+        let t0 = Instant::now();
+        assert!(!s.is_fresh_at(1000, &key("id"), MIN, t0));
+        assert!(s.record_at(1000, key("id"), t0));
+        assert!(s.is_fresh_at(1000, &key("id"), MIN, t0 + Duration::from_secs(59)));
+        assert!(!s.is_fresh_at(1000, &key("id"), MIN, t0 + MIN));
+        // Zero ttl never matches.
+        assert!(!s.is_fresh_at(1000, &key("id"), Duration::ZERO, t0));
+    }
+
+    #[test]
+    fn borrowed_probe_finds_owned_key() {
+        let s = GrantStore::new();
+        s.record(7, key("pacman -Syu"));
+        let probe = KeyRef {
+            action: "act",
+            command: "pacman -Syu",
+        };
+        assert!(s.is_fresh(7, &probe, MIN));
+        let other = KeyRef {
+            action: "act",
+            command: "pacman -U /tmp/evil",
+        };
+        assert!(!s.is_fresh(7, &other, MIN));
+    }
+
+    #[test]
+    fn owners_are_isolated() {
+        let s = GrantStore::new();
+        s.record(1000, key("id"));
+        assert!(!s.is_fresh(1001, &key("id"), MIN));
+        // Same shard (1000 + 16), still a different owner.
+        assert!(!s.is_fresh(1016, &key("id"), MIN));
+    }
+
+    #[test]
+    fn ttl_is_capped_at_max_remember() {
+        let s = GrantStore::new();
+        let t0 = Instant::now();
+        s.record_at(1, key("id"), t0);
+        let huge = Duration::from_secs(86_400);
+        assert!(s.is_fresh_at(1, &key("id"), huge, t0 + MAX_REMEMBER - MIN));
+        assert!(!s.is_fresh_at(1, &key("id"), huge, t0 + MAX_REMEMBER));
+    }
+
+    #[test]
+    fn expired_grants_are_swept_by_the_wheel() {
+        let s = GrantStore::new();
+        let t0 = Instant::now();
+        for i in 0..100 {
+            s.record_at(1, key(&format!("cmd {i}")), t0 + Duration::from_secs(i));
+        }
+        assert_eq!(s.len(), 100);
+        // Sweeps run at whole ticks, so up to a second late: 901.5 s after
+        // the first record, only the first one is gone.
+        let t = t0 + MAX_REMEMBER + Duration::from_millis(1500);
+        s.record_at(1, key("late"), t);
+        assert_eq!(s.len(), 100);
+        // Past everyone's lifetime (level-1 cascade included).
+        let t = t0 + MAX_REMEMBER + Duration::from_secs(200);
+        s.record_at(1, key("later"), t);
+        assert_eq!(s.len(), 2);
+    }
+
+    #[test]
+    fn refresh_extends_lifetime_and_stale_handles_are_ignored() {
+        let s = GrantStore::new();
+        let t0 = Instant::now();
+        s.record_at(1, key("id"), t0);
+        let t1 = t0 + Duration::from_secs(600);
+        s.record_at(1, key("id"), t1);
+        assert_eq!(s.len(), 1);
+        // The first record's expiry fires, but the grant was refreshed.
+        let t2 = t0 + MAX_REMEMBER + Duration::from_secs(5);
+        s.record_at(2, key("x"), t2);
+        s.record_at(1, key("other"), t2);
+        assert!(s.is_fresh_at(1, &key("id"), MAX_REMEMBER, t2));
+        assert_eq!(s.len(), 3);
+        let t3 = t1 + MAX_REMEMBER + Duration::from_secs(1);
+        s.record_at(1, key("y"), t3);
+        assert!(!s.is_fresh_at(1, &key("id"), MAX_REMEMBER, t3));
+    }
+
+    #[test]
+    fn long_idle_sweeps_everything() {
+        let s = GrantStore::new();
+        let t0 = Instant::now();
+        for i in 0..10 {
+            s.record_at(3, key(&i.to_string()), t0);
+        }
+        s.record_at(3, key("after"), t0 + Duration::from_secs(100_000));
+        assert_eq!(s.len(), 1);
+    }
+
+    #[test]
+    fn backdated_records_keep_their_age() {
+        // A grant handed over from a previous process: recorded before
+        // this store existed, it still expires MAX_REMEMBER after that.
+        let t0 = Instant::now();
+        let s = GrantStore::new();
+        let Some(then) = t0.checked_sub(Duration::from_secs(800)) else {
+            return; // booted less than 800 s ago
+        };
+        assert!(s.record_at(1, key("a"), then));
+        let ttl = Duration::from_secs(900);
+        assert!(s.is_fresh_at(1, &key("a"), ttl, t0));
+        assert!(!s.is_fresh_at(1, &key("a"), Duration::from_secs(60), t0));
+        assert!(!s.is_fresh_at(1, &key("a"), ttl, t0 + Duration::from_secs(100)));
+        s.record_at(1, key("b"), t0 + Duration::from_secs(102));
+        assert_eq!(s.len(), 1, "the backdated grant was swept on time");
+    }
+
+    #[test]
+    fn for_each_reports_live_grants_with_their_age() {
+        let t0 = Instant::now();
+        let s = GrantStore::new();
+        s.record_at(1, key("old"), t0);
+        s.record_at(2, key("new"), t0 + Duration::from_secs(600));
+        let mut seen = Vec::new();
+        s.for_each_at(t0 + Duration::from_secs(899), |owner, k, age| {
+            seen.push((owner, k.command.clone(), age.as_secs()))
+        });
+        seen.sort();
+        assert_eq!(seen, [(1, "old".into(), 899), (2, "new".into(), 299)]);
+        let mut n = 0;
+        s.for_each_at(t0 + MAX_REMEMBER, |_, _, _| n += 1);
+        assert_eq!(n, 1, "expired but unswept grants are skipped");
+    }
+
+    #[test]
+    fn per_owner_quota_refuses_new_keys_but_allows_refresh() {
+        let s = GrantStore::with_limits(3, 1024);
+        let t0 = Instant::now();
+        for i in 0..3 {
+            assert!(s.record_at(5, key(&i.to_string()), t0));
+        }
+        assert!(!s.record_at(5, key("3"), t0));
+        assert!(!s.is_fresh_at(5, &key("3"), MIN, t0));
+        // Refreshing a held grant is not a new one.
+        assert!(s.record_at(5, key("0"), t0));
+        // Other owners are unaffected.
+        assert!(s.record_at(6, key("3"), t0));
+        // Once the owner's grants expire, the quota frees up.
+        assert!(s.record_at(5, key("3"), t0 + MAX_REMEMBER + MIN));
+    }
+
+    #[test]
+    fn quota_counts_only_unexpired_grants() {
+        let s = GrantStore::with_limits(3, 1024);
+        let t0 = Instant::now();
+        for i in 0..3 {
+            assert!(s.record_at(5, key(&i.to_string()), t0));
+        }
+        // Expired, but the wheel's tick for them hasn't come yet.
+        let t = t0 + MAX_REMEMBER + Duration::from_millis(100);
+        assert!(s.record_at(5, key("3"), t));
+        assert_eq!(s.len(), 1);
+        assert!(s.is_fresh_at(5, &key("3"), MIN, t));
+        // Their stale wheel handles fire later and are ignored.
+        assert!(s.record_at(5, key("4"), t + Duration::from_secs(2)));
+        assert_eq!(s.len(), 2);
+    }
+
+    #[test]
+    fn total_cap_is_enforced() {
+        // 16 shards × 1 slot each.
+        let s = GrantStore::with_limits(100, 16);
+        assert!(s.record(1, key("a")));
+        assert!(!s.record(1, key("b")));
+        assert!(s.record(2, key("b")));
+    }
+
+    #[test]
+    fn concurrent_checks_and_records() {
+        let s = std::sync::Arc::new(GrantStore::with_limits(10_000, 100_000));
+        let threads: Vec<_> = (0..8u32)
+            .map(|t| {
+                let s = std::sync::Arc::clone(&s);
+                std::thread::spawn(move || {
+                    for i in 0..500 {
+                        let k = key(&format!("{t}/{i}"));
+                        assert!(s.record(t, k));
+                        assert!(s.is_fresh(t, &key(&format!("{t}/{i}")), MIN));
+                    }
+                })
+            })
+            .collect();
+        for t in threads {
+            t.join().unwrap();
+        }
+        assert_eq!(s.len(), 4000);
+    }
+}
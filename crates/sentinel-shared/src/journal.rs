@@ -0,0 +1,392 @@
+// SPDX-FileCopyrightText: 2026 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Native journald transport for the audit log.
+//!
+//! The syslog transport hands journald an RFC 3164 line, and anything
+//! downstream has to re-parse `MESSAGE` to find `event=` or `user=`.
+//! This one speaks journald's own protocol over
+//! `/run/systemd/journal/socket`. The line still goes out as `MESSAGE`,
+//! and for `event=` lines every `key=value` is also sent as a journal
+//! field of its own:
+//!
+//! ```text
+//! MESSAGE=event=auth.deny source=dialog user=alice latency_ms=2210
+//! EVENT=auth.deny
+//! SOURCE=dialog
+//! SENTINEL_USER=alice
+//! LATENCY_MS=2210
+//! ```
+//!
+//! Keys are upper-cased. A key that would shadow one of journald's own
+//! fields (`USER`, `UID`, `PID`, `EXE`, `MESSAGE`, ...) gets a
+//! `SENTINEL_` prefix. `PRIORITY`, `SYSLOG_FACILITY` (auth) and
+//! `SYSLOG_IDENTIFIER` match what the syslog transport produced, so
+//! `journalctl -t pam_sentinel` keeps working.
+//!
+//! Each entry is encoded into one reusable buffer and sent as one
+//! datagram. An entry too big for a datagram goes through a sealed
+//! memfd instead, as `sd_journal_send` does.
+
+use crate::log_kv;
+use nix::errno::Errno;
+use nix::fcntl::{FcntlArg, SealFlag, fcntl};
+use nix::sys::memfd::{MFdFlags, memfd_create};
+use nix::sys::socket::{ControlMessage, MsgFlags, UnixAddr, sendmsg};
+use std::fmt::Write as _;
+use std::fs::File;
+use std::io::{self, Write as _};
+use std::os::fd::AsRawFd;
+use std::os::unix::net::UnixDatagram;
+use std::path::Path;
+use std::sync::{Mutex, MutexGuard};
+
+/// journald's native protocol socket.
+pub const SOCKET: &str = "/run/systemd/journal/socket";
+
+/// `LOG_AUTH`, the facility the syslog transport logs under.
+const FACILITY: &str = "4";
+
+/// Longest field name journald accepts.
+const MAX_NAME: usize = 64;
+
+/// Buffers that grew past this for one huge entry are released after
+/// it, not kept for the life of the process.
+const KEEP_CAPACITY: usize = 16 * 1024;
+
+/// Field names journald itself fills in (with or without a leading
+/// `_`) or reads specially; an audit key with one of these names is
+/// sent as `SENTINEL_<NAME>`.
+const SHADOWED: &[&str] = &[
+    "MESSAGE",
+    "MESSAGE_ID",
+    "PRIORITY",
+    "SYSLOG_FACILITY",
+    "SYSLOG_IDENTIFIER",
+    "SYSLOG_PID",
+    "USER",
+    "UID",
+    "GID",
+    "PID",
+    "COMM",
+    "EXE",
+    "CMDLINE",
+    "HOSTNAME",
+];
+
+/// A connection to journald. Implements [`log::Log`].
+pub struct Journal {
+    sock: UnixDatagram,
+    ident: String,
+    bufs: Mutex<Bufs>,
+}
+
+#[derive(Default)]
+struct Bufs {
+    message: String,
+    entry: Vec<u8>,
+}
+
+impl Journal {
+    /// Connect to journald, logging as `ident`. Fails where there is no
+    /// journald (no systemd, or a container without the socket).
+    pub fn connect(ident: &str) -> io::Result<Self> {
+        Self::connect_to(Path::new(SOCKET), ident)
+    }
+
+    fn connect_to(path: &Path, ident: &str) -> io::Result<Self> {
+        let sock = UnixDatagram::unbound()?;
+        sock.connect(path)?;
+        Ok(Self {
+            sock,
+            ident: ident.to_owned(),
+            bufs: Mutex::default(),
+        })
+    }
+
+    fn lock(&self) -> MutexGuard<'_, Bufs> {
+        self.bufs.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// Send one entry at `level`.
+    pub fn send(&self, level: log::Level, message: std::fmt::Arguments<'_>) -> io::Result<()> {
+        let mut bufs = self.lock();
+        let Bufs {
+            message: msg,
+            entry,
+        } = &mut *bufs;
+        msg.clear();
+        entry.clear();
+        let _ = msg.write_fmt(message);
+        encode(entry, level, &self.ident, msg);
+        let sent = match self.sock.send(entry) {
+            Err(e) if too_big(&e) => self.send_memfd(entry),
+            other => other.map(drop),
+        };
+        if entry.capacity() > KEEP_CAPACITY {
+            *bufs = Bufs::default();
+        }
+        sent
+    }
+
+    /// An entry too large for one datagram: pass it as a sealed memfd.
+    fn send_memfd(&self, entry: &[u8]) -> io::Result<()> {
+        let fd = memfd_create(
+            c"sentinel-journal",
+            MFdFlags::MFD_CLOEXEC | MFdFlags::MFD_ALLOW_SEALING,
+        )?;
+        let mut file = File::from(fd);
+        file.write_all(entry)?;
+        fcntl(
+            &file,
+            FcntlArg::F_ADD_SEALS(
+                SealFlag::F_SEAL_SEAL
+                    | SealFlag::F_SEAL_SHRINK
+                    | SealFlag::F_SEAL_GROW
+                    | SealFlag::F_SEAL_WRITE,
+            ),
+        )?;
+        let fds = [file.as_raw_fd()];
+        sendmsg::<UnixAddr>(
+            self.sock.as_raw_fd(),
+            &[],
+            &[ControlMessage::ScmRights(&fds)],
+            MsgFlags::empty(),
+            None,
+        )?;
+        Ok(())
+    }
+}
+
+/// The datagram was over the socket's size limit.
+fn too_big(e: &io::Error) -> bool {
+    e.raw_os_error()
+        .is_some_and(|n| matches!(Errno::from_raw(n), Errno::EMSGSIZE | Errno::ENOBUFS))
+}
+
+impl log::Log for Journal {
+    fn enabled(&self, metadata: &log::Metadata<'_>) -> bool {
+        metadata.level() <= log::max_level()
+    }
+
+    fn log(&self, record: &log::Record<'_>) {
+        if self.enabled(record.metadata()) {
+            let _ = self.send(record.level(), *record.args());
+        }
+    }
+
+    fn flush(&self) {}
+}
+
+fn priority(level: log::Level) -> &'static str {
+    match level {
+        log::Level::Error => "3",
+        log::Level::Warn => "4",
+        log::Level::Info => "6",
+        log::Level::Debug | log::Level::Trace => "7",
+    }
+}
+
+/// One journal entry in the native protocol, into `out`.
+fn encode(out: &mut Vec<u8>, level: log::Level, ident: &str, message: &str) {
+    field(out, "PRIORITY", priority(level).as_bytes());
+    field(out, "SYSLOG_FACILITY", FACILITY.as_bytes());
+    field(out, "SYSLOG_IDENTIFIER", ident.as_bytes());
+    field(out, "MESSAGE", message.as_bytes());
+    if !message.starts_with("event=") {
+        return;
+    }
+    for (key, raw) in log_kv::fields(message) {
+        let start = out.len();
+        if !push_name(out, key) {
+            out.truncate(start);
+            continue;
+        }
+        if raw.contains('\n') {
+            // Binary form: name, newline, little-endian u64 length,
+            // data, newline. The length is patched in once known.
+            out.push(b'\n');
+            let len_at = out.len();
+            out.extend_from_slice(&[0; 8]);
+            log_kv::unquote_into(raw, out);
+            let len = (out.len() - len_at - 8) as u64;
+            out[len_at..len_at + 8].copy_from_slice(&len.to_le_bytes());
+        } else {
+            out.push(b'=');
+            log_kv::unquote_into(raw, out);
+        }
+        out.push(b'\n');
+    }
+}
+
+/// `NAME=value\n`, or the binary form if `value` has a newline.
+fn field(out: &mut Vec<u8>, name: &str, value: &[u8]) {
+    out.extend_from_slice(name.as_bytes());
+    if value.contains(&b'\n') {
+        out.push(b'\n');
+        out.extend_from_slice(&(value.len() as u64).to_le_bytes());
+    } else {
+        out.push(b'=');
+    }
+    out.extend_from_slice(value);
+    out.push(b'\n');
+}
+
+/// Append the journal field name for logfmt `key`. `false` if there
+/// is none (empty, or too long once prefixed).
+fn push_name(out: &mut Vec<u8>, key: &str) -> bool {
+    if key.is_empty() {
+        return false;
+    }
+    let start = out.len();
+    let upper = |b: u8| match b {
+        b'a'..=b'z' => b - b'a' + b'A',
+        b'A'..=b'Z' | b'0'..=b'9' => b,
+        _ => b'_',
+    };
+    let shadowed = SHADOWED
+        .iter()
+        .any(|s| s.len() == key.len() && s.bytes().zip(key.bytes()).all(|(s, k)| s == upper(k)));
+    let first = key.as_bytes()[0];
+    if shadowed || first.is_ascii_digit() || first == b'_' {
+        out.extend_from_slice(b"SENTINEL_");
+    }
+    out.extend(key.bytes().map(upper));
+    out.len() - start <= MAX_NAME
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use nix::sys::socket::{ControlMessageOwned, recvmsg};
+    use std::io::{IoSliceMut, Read, Seek, SeekFrom};
+    use std::os::fd::FromRawFd;
+
+    /// A stand-in journald: a datagram socket bound to a temp path.
+    fn server(tag: &str) -> (UnixDatagram, Journal) {
+        let path =
+            std::env::temp_dir().join(format!("sentinel-journal-{tag}-{}", std::process::id()));
+        let _ = std::fs::remove_file(&path);
+        let server = UnixDatagram::bind(&path).unwrap();
+        let journal = Journal::connect_to(&path, "pam_sentinel").unwrap();
+        let _ = std::fs::remove_file(&path);
+        (server, journal)
+    }
+
+    fn text_fields(entry: &[u8]) -> Vec<String> {
+        String::from_utf8(entry.to_vec())
+            .unwrap()
+            .lines()
+            .map(String::from)
+            .collect()
+    }
+
+    #[test]
+    fn event_keys_become_journal_fields() {
+        let (server, journal) = server("fields");
+        let mut line = log_kv::Line::new("auth.deny");
+        line.kv("source", "dialog")
+            .kv("user", "alice")
+            .kv("process", "Disk Utility")
+            .num("latency_ms", 2210);
+        journal
+            .send(log::Level::Info, format_args!("{line}"))
+            .unwrap();
+        let mut buf = vec![0; 4096];
+        let n = server.recv(&mut buf).unwrap();
+        assert_eq!(
+            text_fields(&buf[..n]),
+            [
+                "PRIORITY=6",
+                "SYSLOG_FACILITY=4",
+                "SYSLOG_IDENTIFIER=pam_sentinel",
+                r#"MESSAGE=event=auth.deny source=dialog user=alice process="Disk Utility" latency_ms=2210"#,
+                "EVENT=auth.deny",
+                "SOURCE=dialog",
+                "SENTINEL_USER=alice",
+                "PROCESS=Disk Utility",
+                "LATENCY_MS=2210",
+            ]
+        );
+    }
+
+    #[test]
+    fn diagnostics_carry_only_the_message() {
+        let (server, journal) = server("diag");
+        journal
+            .send(
+                log::Level::Warn,
+                format_args!("BeginAuthentication action=x"),
+            )
+            .unwrap();
+        let mut buf = vec![0; 4096];
+        let n = server.recv(&mut buf).unwrap();
+        let got = text_fields(&buf[..n]);
+        assert_eq!(got[0], "PRIORITY=4");
+        assert_eq!(got.len(), 4, "no fields split out of {got:?}");
+    }
+
+    #[test]
+    fn newlines_use_the_binary_form() {
+        let mut out = Vec::new();
+        encode(&mut out, log::Level::Info, "x", "event=e note=\"a\nb\"");
+        let tail = b"NOTE\n\x03\0\0\0\0\0\0\0a\nb\n";
+        assert!(out.ends_with(tail), "{out:?}");
+        // MESSAGE itself contains the newline too.
+        assert!(out.windows(8).any(|w| w == b"MESSAGE\n"));
+    }
+
+    #[test]
+    fn oversized_entries_go_through_a_sealed_memfd() {
+        let (server, journal) = server("memfd");
+        let big = "x".repeat(1 << 20);
+        journal
+            .send(log::Level::Info, format_args!("event=big data={big}"))
+            .unwrap();
+
+        let mut buf = [0u8; 16];
+        let mut iov = [IoSliceMut::new(&mut buf)];
+        let mut cmsg = nix::cmsg_space!([std::os::fd::RawFd; 1]);
+        let msg = recvmsg::<UnixAddr>(
+            server.as_raw_fd(),
+            &mut iov,
+            Some(&mut cmsg),
+            MsgFlags::empty(),
+        )
+        .unwrap();
+        assert_eq!(msg.bytes, 0);
+        let fd = msg
+            .cmsgs()
+            .unwrap()
+            .find_map(|c| match c {
+                ControlMessageOwned::ScmRights(fds) => fds.first().copied(),
+                _ => None,
+            })
+            .expect("memfd passed");
+        // SAFETY: the descriptor was just received and nothing else owns it.
+        let mut file = unsafe { File::from_raw_fd(fd) };
+        let held = SealFlag::from_bits_truncate(fcntl(&file, FcntlArg::F_GET_SEALS).unwrap());
+        assert!(held.contains(SealFlag::F_SEAL_WRITE));
+        // Shared offset: the sender left it at the end, and journald
+        // reads from 0 regardless.
+        file.seek(SeekFrom::Start(0)).unwrap();
+        let mut entry = Vec::new();
+        file.read_to_end(&mut entry).unwrap();
+        assert!(entry.ends_with(format!("DATA={big}\n").as_bytes()));
+        // The oversized buffer wasn't kept.
+        assert!(journal.lock().entry.capacity() <= KEEP_CAPACITY);
+    }
+
+    #[test]
+    fn names_are_journal_safe() {
+        let name = |k: &str| {
+            let mut out = Vec::new();
+            push_name(&mut out, k).then(|| String::from_utf8(out).unwrap())
+        };
+        assert_eq!(name("latency_ms").as_deref(), Some("LATENCY_MS"));
+        assert_eq!(name("user").as_deref(), Some("SENTINEL_USER"));
+        assert_eq!(name("session-type").as_deref(), Some("SESSION_TYPE"));
+        assert_eq!(name("2fa").as_deref(), Some("SENTINEL_2FA"));
+        assert_eq!(name(""), None);
+        assert_eq!(name(&"k".repeat(65)), None);
+    }
+}
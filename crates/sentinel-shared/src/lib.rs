@@ -28,12 +28,36 @@
 //! to silently revert your security settings without a trail in
 //! `journalctl -t pam_sentinel` (or the agent's syslog identifier).
 
-use serde::Deserialize;
-use std::collections::HashMap;
+use serde::{Deserialize, Serialize};
+use std::collections::{HashMap, HashSet};
 use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::Duration;
+
+/// Memoized passwd/group lookups (NSS), per auth or with a short ttl.
+pub mod accounts;
+
+/// `/proc/<pid>/cmdline` as a borrowed argument vector: elevation
+/// stripping and remember eligibility without splitting or allocating.
+pub mod argv;
 
 pub mod audit;
 
+/// journald's native protocol, the audit log's transport under systemd.
+pub mod journal;
+
+/// Typed request/response contract between the polkit agent and its
+/// persistent per-session dialog service (`sentinel-helper-kde --serve`).
+pub mod dialog;
+
+/// Expiring, quota-bounded "remember" grant store shared by the broker
+/// and the polkit agent.
+pub mod grants;
+
+/// Precompiled, stamp-validated binary form of the parsed config; lets
+/// [`load`] skip the TOML parse while the file is unchanged.
+pub mod snapshot;
+
 /// UI-string localization for the KDE helper: keyed lookups for the
 /// dialog's UI chrome, with English as the source/fallback.
 pub mod ui_i18n;
@@ -67,7 +91,8 @@ pub const POLKIT_PAM_SERVICE: &str = "polkit-1";
 /// The user's agent claims [`AGENT_BUS_NAME`]; `pam_sentinel` (running as
 /// root inside the helper) first checks the name's owner uid matches the user
 /// being authenticated — defeating a same-name squatter — then calls
-/// `TakeApproval` to consume a one-shot pre-approval.
+/// `TakeApprovalFor` to consume the one-shot pre-approval bound to its
+/// helper-1 connection.
 pub const AGENT_BUS_NAME: &str = "org.sentinel.Agent";
 /// Object path the bypass interface is published at.
 pub const AGENT_OBJECT_PATH: &str = "/org/sentinel/Agent";
@@ -78,7 +103,7 @@ pub const AGENT_INTERFACE: &str = "org.sentinel.Agent";
 /// module's pipe reader and the polkit agent's child-process line
 /// reader. The Display + FromStr impls are the *only* source of truth
 /// for the wire format — keep this enum and those impls in sync.
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
 pub enum Outcome {
     Allow,
     Deny,
@@ -129,20 +154,29 @@ impl Outcome {
 /// the user ticked the "remember" checkbox.
 ///
 /// Wire form (single line, whitespace-separated): the outcome token,
-/// optionally followed by `REMEMBER`. e.g. `ALLOW`, `ALLOW REMEMBER`,
-/// `DENY`. Old helpers that only write the bare outcome parse with
-/// `remember = false`, so the format is backward-compatible.
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+/// optionally followed by `REMEMBER`, optionally followed by the helper's
+/// startup [`Timings`] as `TIMING=<start>,<app>,<qml>,<frame>`. e.g.
+/// `ALLOW`, `ALLOW REMEMBER`, `DENY TIMING=81200,95100,141800,150300`.
+/// Old helpers that only write the bare outcome parse with
+/// `remember = false` and no timings; old readers ignore the tokens they
+/// don't know (and the PAM module's 16-byte read still sees the outcome
+/// and `REMEMBER` first), so the format is backward-compatible both ways.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
 pub struct Verdict {
     pub outcome: Outcome,
     /// User opted into the remember window. Only meaningful with
     /// `Outcome::Allow`; ignored otherwise.
     pub remember: bool,
+    /// When the helper reached its startup milestones, if it reported
+    /// them. Diagnostics only; never affects the decision.
+    pub timings: Option<Timings>,
 }
 
 impl Verdict {
     /// Marker token appended after the outcome when the user opted in.
     pub const REMEMBER_TOKEN: &str = "REMEMBER";
+    /// Key of the [`Timings`] token.
+    pub const TIMING_KEY: &str = "TIMING=";
 }
 
 impl std::fmt::Display for Verdict {
@@ -151,6 +185,18 @@ impl std::fmt::Display for Verdict {
         if self.remember && self.outcome.is_allow() {
             write!(f, " {}", Self::REMEMBER_TOKEN)?;
         }
+        if let Some(t) = &self.timings {
+            let mark = |v: Option<u64>| v.map(|v| v.to_string()).unwrap_or_default();
+            write!(
+                f,
+                " {}{},{},{},{}",
+                Self::TIMING_KEY,
+                t.start_us,
+                mark(t.app_us),
+                mark(t.qml_us),
+                mark(t.first_frame_us)
+            )?;
+        }
         Ok(())
     }
 }
@@ -160,11 +206,96 @@ impl std::str::FromStr for Verdict {
     fn from_str(s: &str) -> Result<Self, Self::Err> {
         let mut tokens = s.split_whitespace();
         let outcome = tokens.next().unwrap_or_default().parse::<Outcome>()?;
-        let remember = tokens.any(|t| t == Self::REMEMBER_TOKEN);
-        Ok(Self { outcome, remember })
+        let mut remember = false;
+        let mut timings = None;
+        for t in tokens {
+            if t == Self::REMEMBER_TOKEN {
+                remember = true;
+            } else if let Some(marks) = t.strip_prefix(Self::TIMING_KEY) {
+                timings = Timings::parse(marks);
+            }
+        }
+        Ok(Self {
+            outcome,
+            remember,
+            timings,
+        })
     }
 }
 
+/// Startup milestones of the dialog that produced a [`Verdict`], as
+/// [`monotonic_us`] readings. The clock is system-wide, so the caller
+/// subtracts its own reading from when it spawned the helper (or sent
+/// the request) and can tell startup cost apart from the time the user
+/// took to answer.
+///
+/// A dialog from the warm service (`--serve`) starts at the request and
+/// has no `app_us`: its `QApplication` predates the prompt.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Serialize, Deserialize)]
+pub struct Timings {
+    /// Helper `main` entered, or the service read the request.
+    pub start_us: u64,
+    /// `QApplication` constructed.
+    pub app_us: Option<u64>,
+    /// The dialog's QML component finished instantiating.
+    pub qml_us: Option<u64>,
+    /// The dialog's first frame was swapped to the screen.
+    pub first_frame_us: Option<u64>,
+}
+
+impl Timings {
+    /// Parse the value of a `TIMING=` token. `None` if malformed: the
+    /// timings are advisory, so a bad token only loses them.
+    fn parse(marks: &str) -> Option<Self> {
+        let mut it = marks.split(',').map(|m| {
+            if m.is_empty() {
+                Ok(None)
+            } else {
+                m.parse::<u64>().map(Some)
+            }
+        });
+        let mut next = || it.next()?.ok();
+        let timings = Self {
+            start_us: next()??,
+            app_us: next()?,
+            qml_us: next()?,
+            first_frame_us: next()?,
+        };
+        it.next().is_none().then_some(timings)
+    }
+
+    /// logfmt fields for the audit line, each in milliseconds since
+    /// `since_us` (the caller's [`monotonic_us`] reading when it started
+    /// the dialog): `spawn_ms` until the helper ran, then `app_ms`,
+    /// `qml_ms` and `first_frame_ms` until each milestone. Missing
+    /// milestones are left out. Starts with a space, like the other
+    /// optional suffixes of those lines.
+    pub fn logfmt(&self, since_us: u64) -> String {
+        let ms = |us: u64| us.saturating_sub(since_us) / 1000;
+        let mut out = format!(" spawn_ms={}", ms(self.start_us));
+        for (key, mark) in [
+            ("app_ms", self.app_us),
+            ("qml_ms", self.qml_us),
+            ("first_frame_ms", self.first_frame_us),
+        ] {
+            if let Some(us) = mark {
+                out.push_str(&format!(" {key}={}", ms(us)));
+            }
+        }
+        out
+    }
+}
+
+/// `CLOCK_MONOTONIC` in microseconds. Comparable across processes on the
+/// same boot, which [`std::time::Instant`] doesn't expose; [`Timings`]
+/// relies on that.
+pub fn monotonic_us() -> u64 {
+    use nix::time::{ClockId, clock_gettime};
+    clock_gettime(ClockId::CLOCK_MONOTONIC).map_or(0, |t| {
+        (t.tv_sec() as u64) * 1_000_000 + (t.tv_nsec() as u64) / 1000
+    })
+}
+
 /// What to do when no Wayland display is reachable from the PAM call site.
 #[derive(Debug, Clone, Copy, Default, Eq, PartialEq, Deserialize)]
 #[serde(rename_all = "lowercase")]
@@ -257,6 +388,12 @@ pub struct General {
     /// and the timestamp store in `pam-sentinel` for the security model.
     #[serde(default = "default_remember_seconds")]
     pub remember_seconds: u32,
+    /// Start `polkit-agent-helper-1` when the polkit dialog opens
+    /// instead of after the click, so its PAM stack is already waiting
+    /// in `TakeApprovalFor` when the verdict arrives. **polkit/GUI path
+    /// only**; off by default. See [`ServiceConfig::early_helper_wait`].
+    #[serde(default)]
+    pub early_helper: bool,
 }
 
 impl Default for General {
@@ -270,6 +407,7 @@ impl Default for General {
             log_attempts: true,
             min_display_time_ms: default_min_display_time(),
             remember_seconds: default_remember_seconds(),
+            early_helper: false,
         }
     }
 }
@@ -360,67 +498,196 @@ pub enum PolicyDecision {
 /// - the requesting executable's **resolved path** (`/proc/<pid>/exe`,
 ///   e.g. `/usr/bin/pacman`) — NOT the spoofable `argv[0]`;
 /// - that path's **basename** when the entry contains no `/`
-///   (e.g. `pacman`); or
+///   (e.g. `pacman`);
 /// - the **polkit action id** on the agent path
-///   (e.g. `org.freedesktop.color-manager.create-profile`).
+///   (e.g. `org.freedesktop.color-manager.create-profile`); or
+/// - for an entry ending in `.*` (e.g. `org.freedesktop.udisks2.*`),
+///   every action id under that prefix, one or more components deep.
+///   Such an entry never matches an executable.
 ///
 /// `deny` takes precedence over `allow` (fail-safe). An empty policy
 /// (the default) never matches, so behaviour is unchanged until an
 /// admin opts in.
 ///
+/// The lists are compiled once, when the config is parsed (or its
+/// snapshot decoded): exact entries into one hash set, wildcards into a
+/// trie of action-id components. A decision is then a few hash lookups
+/// however long the lists are; it used to compare every entry and take
+/// the exe's basename again for each. Clones share the compiled form.
+///
 /// # Security
 ///
 /// An `allow` entry means **passwordless elevation** for that target —
 /// it is exactly as load-bearing as a `sudoers` `NOPASSWD` line. Prefer
-/// absolute paths over basenames, and keep the list short.
-#[derive(Debug, Clone, Default, Deserialize)]
+/// absolute paths over basenames, and keep the list short. A wildcard
+/// allows every current and future action under its prefix.
+#[derive(Clone, Default, Deserialize)]
+#[serde(from = "PolicyLists")]
 pub struct Policy {
+    allow: Arc<PolicyMatcher>,
+    deny: Arc<PolicyMatcher>,
+}
+
+/// `[policy]` as written.
+#[derive(Deserialize)]
+struct PolicyLists {
     #[serde(default)]
-    pub allow: Vec<String>,
+    allow: Vec<String>,
     #[serde(default)]
-    pub deny: Vec<String>,
+    deny: Vec<String>,
+}
+
+impl From<PolicyLists> for Policy {
+    fn from(l: PolicyLists) -> Self {
+        Self::new(l.allow, l.deny)
+    }
 }
 
 impl Policy {
+    pub fn new(allow: Vec<String>, deny: Vec<String>) -> Self {
+        Self {
+            allow: Arc::new(PolicyMatcher::compile(allow)),
+            deny: Arc::new(PolicyMatcher::compile(deny)),
+        }
+    }
+
+    /// The `allow` entries, as configured.
+    pub fn allow(&self) -> &[String] {
+        &self.allow.entries
+    }
+
+    /// The `deny` entries, as configured.
+    pub fn deny(&self) -> &[String] {
+        &self.deny.entries
+    }
+
     /// Decide an outcome for a request identified by its resolved exe
     /// path (always available) and optional polkit action id (agent
     /// path only). `deny` wins over `allow`.
     pub fn decide(&self, exe: Option<&str>, action: Option<&str>) -> PolicyDecision {
-        if Self::list_matches(&self.deny, exe, action) {
+        if self.deny.matches(exe, action) {
             PolicyDecision::Deny
-        } else if Self::list_matches(&self.allow, exe, action) {
+        } else if self.allow.matches(exe, action) {
             PolicyDecision::Allow
         } else {
             PolicyDecision::Ask
         }
     }
+}
 
-    fn list_matches(list: &[String], exe: Option<&str>, action: Option<&str>) -> bool {
-        list.iter().any(|entry| {
-            // Exact polkit action id.
-            if action == Some(entry.as_str()) {
-                return true;
-            }
-            match exe {
-                Some(path) => {
-                    if entry.contains('/') {
-                        // Absolute/relative path: full-path match only.
-                        entry == path
-                    } else {
-                        // Bare name: match the exe's basename.
-                        process_basename(path) == Some(entry.as_str())
-                    }
+impl PartialEq for Policy {
+    fn eq(&self, other: &Self) -> bool {
+        self.allow() == other.allow() && self.deny() == other.deny()
+    }
+}
+
+impl Eq for Policy {}
+
+impl std::fmt::Debug for Policy {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.debug_struct("Policy")
+            .field("allow", &self.allow())
+            .field("deny", &self.deny())
+            .finish()
+    }
+}
+
+/// One compiled `[policy]` list.
+#[derive(Default)]
+struct PolicyMatcher {
+    entries: Vec<String>,
+    /// Every entry but the wildcards. An action id or a path can only
+    /// equal an entry of its own kind, and a basename has no `/`, so
+    /// one set answers all three.
+    exact: HashSet<Box<str>>,
+    /// The wildcards.
+    prefixes: ActionTrie,
+}
+
+impl PolicyMatcher {
+    fn compile(entries: Vec<String>) -> Self {
+        let mut exact = HashSet::with_capacity(entries.len());
+        let mut prefixes = ActionTrie::default();
+        for entry in &entries {
+            match action_wildcard(entry) {
+                Some(prefix) => prefixes.insert(prefix),
+                None => {
+                    exact.insert(entry.as_str().into());
                 }
-                None => false,
             }
-        })
+        }
+        Self {
+            entries,
+            exact,
+            prefixes,
+        }
+    }
+
+    fn matches(&self, exe: Option<&str>, action: Option<&str>) -> bool {
+        if self.entries.is_empty() {
+            return false;
+        }
+        let by_action = |a: &str| self.exact.contains(a) || self.prefixes.covers(a);
+        // Only a path with a `/` can equal a full-path entry; any exe is
+        // also tried by basename.
+        let by_exe = |p: &str| {
+            (p.contains('/') && self.exact.contains(p))
+                || process_basename(p).is_some_and(|b| self.exact.contains(b))
+        };
+        action.is_some_and(by_action) || exe.is_some_and(by_exe)
+    }
+}
+
+/// The prefix of a wildcard entry (`org.freedesktop.udisks2.*` →
+/// `org.freedesktop.udisks2`). Anything else — a bare `*`, a `*`
+/// mid-entry, an empty component, a path — is an ordinary entry.
+fn action_wildcard(entry: &str) -> Option<&str> {
+    let prefix = entry.strip_suffix(".*")?;
+    let plain = |c: &str| !c.is_empty() && !c.contains(['*', '/']);
+    prefix.split('.').all(plain).then_some(prefix)
+}
+
+/// Wildcard prefixes keyed by dot-separated component, so a lookup walks
+/// the action id once instead of testing every prefix.
+#[derive(Default)]
+struct ActionTrie {
+    /// A wildcard's prefix ends here: anything below matches.
+    wildcard: bool,
+    next: HashMap<Box<str>, ActionTrie>,
+}
+
+impl ActionTrie {
+    fn insert(&mut self, prefix: &str) {
+        let mut node = self;
+        for component in prefix.split('.') {
+            node = node.next.entry(component.into()).or_default();
+        }
+        node.wildcard = true;
+    }
+
+    /// Whether `action` is some wildcard's prefix, a dot, and at least
+    /// one more component.
+    fn covers(&self, action: &str) -> bool {
+        let mut node = self;
+        let mut rest = action;
+        while let Some((component, tail)) = rest.split_once('.') {
+            match node.next.get(component) {
+                Some(n) => node = n,
+                None => return false,
+            }
+            if node.wildcard && !tail.is_empty() {
+                return true;
+            }
+            rest = tail;
+        }
+        false
     }
 }
 
 /// Effective config for a single PAM service after applying overrides
 /// on top of `[general]` + `[appearance]` + `[audio]`. This is what
 /// consumers actually drive the dialog with.
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq, Eq)]
 pub struct ServiceConfig {
     pub enabled: bool,
     pub timeout: u32,
@@ -450,6 +717,26 @@ pub struct ServiceConfig {
     /// inherits `[general].remember_seconds`; terminal paths default to
     /// `0` unless opted in via `[services.<name>].remember_seconds`.
     pub remember_seconds: u32,
+    /// `[general].early_helper`, for the `polkit-1` service only.
+    pub early_helper: bool,
+}
+
+/// Longest an early helper-1 waits for a dialog that has no timeout.
+pub const EARLY_HELPER_MAX_WAIT: Duration = Duration::from_secs(300);
+
+impl ServiceConfig {
+    /// How long an early-started helper-1 (`early_helper`) may wait for
+    /// the user: the dialog's timeout plus time for it to come up, or
+    /// [`EARLY_HELPER_MAX_WAIT`] when it has none. Both the agent and
+    /// `pam_sentinel` derive their deadlines from it. `None` when the
+    /// mode is off.
+    pub fn early_helper_wait(&self) -> Option<Duration> {
+        const GRACE: Duration = Duration::from_secs(10);
+        self.early_helper.then(|| match self.timeout {
+            0 => EARLY_HELPER_MAX_WAIT,
+            secs => (Duration::from_secs(secs.into()) + GRACE).min(EARLY_HELPER_MAX_WAIT),
+        })
+    }
 }
 
 impl Document {
@@ -496,6 +783,7 @@ impl Document {
             } else {
                 0
             },
+            early_helper: service == POLKIT_PAM_SERVICE && self.general.early_helper,
         };
         if let Some(over) = self.services.get(service) {
             if let Some(v) = over.enabled {
@@ -525,40 +813,83 @@ impl Document {
     /// [`Document::load`]; intended for the settings app reading from a
     /// staging location, or for tests.
     pub fn load_from(path: &Path) -> Self {
-        match std::fs::read_to_string(path) {
-            Ok(contents) => match toml::from_str::<Document>(&contents) {
-                Ok(parsed) => parsed,
-                Err(e) => {
-                    log::warn!(
-                        "sentinel-shared: failed to parse {}: {e} — falling back to defaults",
-                        path.display()
-                    );
-                    Document::defaults()
-                }
-            },
-            Err(e) if e.kind() == std::io::ErrorKind::NotFound => {
-                log::debug!(
-                    "sentinel-shared: {} not present — using defaults",
+        Self::load_checked(path).0
+    }
+
+    /// [`Document::load_from`], plus whether the result faithfully
+    /// reflects the file: `true` when it parsed or is legitimately
+    /// absent, `false` when defaults stand in for a broken or unreadable
+    /// file. Only faithful results may be cached (see [`snapshot`]).
+    pub fn load_checked(path: &Path) -> (Self, bool) {
+        match Self::try_load_from(path) {
+            Ok(doc) => (doc, true),
+            Err(LoadError::Parse(e)) => {
+                log::warn!(
+                    "sentinel-shared: failed to parse {}: {e} — falling back to defaults",
                     path.display()
                 );
-                Document::defaults()
+                (Document::defaults(), false)
             }
-            Err(e) => {
+            Err(LoadError::Read(e)) => {
                 log::warn!(
                     "sentinel-shared: cannot read {}: {e} — using defaults",
                     path.display()
                 );
-                Document::defaults()
+                (Document::defaults(), false)
+            }
+        }
+    }
+
+    /// Read + parse `path`, saying why when the result wouldn't be
+    /// faithful. A missing file is the built-in defaults, not an error.
+    /// For callers that keep a previous config rather than fall back
+    /// (the agent's live reload).
+    pub fn try_load_from(path: &Path) -> Result<Self, LoadError> {
+        match std::fs::read_to_string(path) {
+            Ok(contents) => toml::from_str(&contents).map_err(LoadError::Parse),
+            Err(e) if e.kind() == std::io::ErrorKind::NotFound => {
+                log::debug!(
+                    "sentinel-shared: {} not present — using defaults",
+                    path.display()
+                );
+                Ok(Document::defaults())
             }
+            Err(e) => Err(LoadError::Read(e)),
         }
     }
 }
 
+/// Why [`Document::try_load_from`] has no config to offer.
+#[derive(Debug)]
+pub enum LoadError {
+    Read(std::io::Error),
+    Parse(toml::de::Error),
+}
+
+impl std::fmt::Display for LoadError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Self::Read(e) => write!(f, "cannot read: {e}"),
+            Self::Parse(e) => write!(f, "parse error: {e}"),
+        }
+    }
+}
+
+impl std::error::Error for LoadError {}
+
 /// Convenience: parse the system config and return the effective
 /// per-service config in one call. The hot path used by both
 /// `pam_sentinel.so` and `sentinel-polkit-agent`.
+///
+/// Goes through the compiled snapshot at [`snapshot::SNAPSHOT_PATH`]
+/// when it is trusted and still matches the config file; otherwise
+/// parses the TOML and (as root) refreshes the snapshot.
 pub fn load(service: &str) -> ServiceConfig {
-    Document::load().for_service(service)
+    snapshot::load_service(
+        Path::new(CONFIG_PATH),
+        Path::new(snapshot::SNAPSHOT_PATH),
+        service,
+    )
 }
 
 /// Where the system config file lives at runtime. Useful for the
@@ -650,7 +981,9 @@ const ELEVATION_FLAGS_WITH_VALUE: &[&str] = &[
 /// from a `/proc/<pid>/cmdline` reading, leaving the elevated
 /// command. Returns the joined remainder (whitespace-separated,
 /// matching what `procfs::read_cmdline` produces). Empty if nothing
-/// remains (e.g. `sudo -i` with no command).
+/// remains (e.g. `sudo -i` with no command). For a cmdline read from
+/// `/proc`, [`argv::Argv::elevated`] does the same without losing
+/// argument boundaries or allocating.
 ///
 /// `argv[0]` matching is by basename (so `/usr/bin/sudo-rs` and
 /// `sudo-rs` both qualify), against [`ELEVATION_TOOLS`].
@@ -669,14 +1002,14 @@ pub fn strip_elevation_prefix(cmdline: &str) -> String {
         return String::new();
     };
     let basename = process_basename(first).unwrap_or(first);
-    if !ELEVATION_TOOLS.contains(&basename) {
+    if !argv::ELEVATION_TOOLS.contains(basename.as_bytes()) {
         // Not an elevation tool — pass through unchanged.
         return cmdline.to_string();
     }
     let mut i = 1; // skip argv[0]
     while i < parts.len() {
         let p = parts[i];
-        if ELEVATION_FLAGS_WITH_VALUE.contains(&p) {
+        if argv::ELEVATION_FLAGS_WITH_VALUE.contains(p.as_bytes()) {
             i += 2;
         } else if p.starts_with('-') {
             // Standalone flag (-i, -s, -E, -n, -v, -l, -K, ...) or
@@ -739,7 +1072,7 @@ pub fn remember_eligible_command(cmd: &str) -> bool {
         return false;
     };
     let base = process_basename(first).unwrap_or(first);
-    !REMEMBER_INELIGIBLE.contains(&base)
+    !argv::REMEMBER_INELIGIBLE.contains(base.as_bytes())
 }
 
 /// Generic shield icon shown when the requesting binary's basename has
@@ -860,7 +1193,18 @@ pub mod logind {
 /// (missing pid, permission denied, decode failure) — these are
 /// diagnostic lookups whose absence is acceptable, not security
 /// checks.
+///
+/// The free functions are one-shot lookups. Code that needs several
+/// fields of the same process (the PAM module's per-auth path) should
+/// use [`procfs::Snapshot`], which opens `/proc/<pid>` once, reads each
+/// file at most once, and keeps every read anchored to the same process.
 pub mod procfs {
+    use crate::argv::Argv;
+    use std::cell::{OnceCell, RefCell};
+    use std::fs::File;
+    use std::io::Read;
+    use std::os::fd::AsRawFd;
+
     /// `/proc/<pid>/comm` — the kernel-tracked process name (15 chars
     /// max + NUL, kernel-truncated if longer). Trailing newline is
     /// stripped.
@@ -882,13 +1226,8 @@ pub mod procfs {
         if pid <= 0 {
             return None;
         }
-        let s = std::fs::read_to_string(format!("/proc/{pid}/status")).ok()?;
-        for line in s.lines() {
-            if let Some(rest) = line.strip_prefix("PPid:") {
-                return rest.trim().parse::<i32>().ok();
-            }
-        }
-        None
+        let s = std::fs::read(format!("/proc/{pid}/status")).ok()?;
+        parse_status(&s).ppid
     }
 
     /// `/proc/<pid>/exe` — readlink of the absolute path to the
@@ -921,17 +1260,7 @@ pub mod procfs {
         if pid <= 0 {
             return None;
         }
-        let bytes = std::fs::read(format!("/proc/{pid}/cmdline")).ok()?;
-        let parts: Vec<String> = bytes
-            .split(|&b| b == 0)
-            .filter(|s| !s.is_empty())
-            .map(|s| String::from_utf8_lossy(s).into_owned())
-            .collect();
-        if parts.is_empty() {
-            None
-        } else {
-            Some(parts.join(" "))
-        }
+        join_cmdline(&std::fs::read(format!("/proc/{pid}/cmdline")).ok()?)
     }
 
     /// Look up a single environment variable from
@@ -948,21 +1277,313 @@ pub mod procfs {
             return None;
         }
         let bytes = std::fs::read(format!("/proc/{pid}/environ")).ok()?;
-        for entry in bytes.split(|b| *b == 0) {
-            if entry.is_empty() {
-                continue;
+        scan_environ(&bytes, &[key]).pop().flatten()
+    }
+
+    /// The `/proc/<pid>/status` fields we use.
+    #[derive(Debug, Default, Clone, Copy)]
+    struct Status {
+        ppid: Option<i32>,
+        /// Real uid (first field of the `Uid:` line).
+        uid: Option<u32>,
+    }
+
+    fn parse_status(bytes: &[u8]) -> Status {
+        let mut out = Status::default();
+        for line in bytes.split(|&b| b == b'\n') {
+            if let Some(rest) = line.strip_prefix(b"PPid:") {
+                out.ppid = std::str::from_utf8(rest)
+                    .ok()
+                    .and_then(|s| s.trim().parse().ok());
+            } else if let Some(rest) = line.strip_prefix(b"Uid:") {
+                out.uid = std::str::from_utf8(rest)
+                    .ok()
+                    .and_then(|s| s.split_whitespace().next())
+                    .and_then(|s| s.parse().ok());
+                // `Uid:` follows `PPid:` in every kernel's layout.
+                break;
             }
-            let Ok(s) = std::str::from_utf8(entry) else {
-                continue;
-            };
-            let Some((k, v)) = s.split_once('=') else {
+        }
+        out
+    }
+
+    fn join_cmdline(bytes: &[u8]) -> Option<String> {
+        let argv = Argv::new(bytes);
+        (!argv.is_empty()).then(|| argv.to_string())
+    }
+
+    /// One pass over a NUL-separated environ block, returning the value
+    /// of each of `keys` (first occurrence wins, like `getenv`), in
+    /// `keys` order. Entries that aren't UTF-8 or lack `=` are skipped.
+    fn scan_environ(bytes: &[u8], keys: &[&str]) -> Vec<Option<String>> {
+        let mut out = vec![None; keys.len()];
+        let mut missing = keys.len();
+        let mut rest = bytes;
+        while missing > 0 && !rest.is_empty() {
+            let end = memchr::memchr(0, rest).unwrap_or(rest.len());
+            let entry = &rest[..end];
+            rest = rest.get(end + 1..).unwrap_or_default();
+            let Some(eq) = memchr::memchr(b'=', entry) else {
                 continue;
             };
-            if k == key {
-                return Some(v.to_string());
+            let (k, v) = (&entry[..eq], &entry[eq + 1..]);
+            if let Some(i) = keys.iter().position(|key| key.as_bytes() == k)
+                && out[i].is_none()
+                && let Ok(v) = std::str::from_utf8(v)
+            {
+                out[i] = Some(v.to_owned());
+                missing -= 1;
+            }
+        }
+        out
+    }
+
+    /// Lazily-read, read-once view of one process's `/proc/<pid>`.
+    ///
+    /// [`Snapshot::open`] opens the `/proc/<pid>` directory once; every
+    /// later read goes *through that descriptor* (`/proc/self/fd/<n>/…`),
+    /// never by pid again. If the process exits, reads fail instead of
+    /// silently landing on whatever reused the pid. Each file is read at
+    /// most once, into one reusable buffer, and `environ` is scanned
+    /// once for every key named at open time.
+    ///
+    /// Same fail-soft contract as the free functions: every accessor
+    /// returns `None` on any error, including a pid that couldn't be
+    /// opened at all.
+    pub struct Snapshot {
+        pid: i32,
+        dir: Option<File>,
+        env_keys: &'static [&'static str],
+        /// `/proc/self/fd/<n>/`; file names are appended and truncated
+        /// off again so no read formats a fresh path.
+        path: RefCell<String>,
+        buf: RefCell<Vec<u8>>,
+        status: OnceCell<Status>,
+        comm: OnceCell<Option<String>>,
+        exe: OnceCell<Option<String>>,
+        cwd: OnceCell<Option<String>>,
+        /// `cmdline` verbatim, for [`Snapshot::argv`].
+        argv: OnceCell<Option<Vec<u8>>>,
+        cmdline: OnceCell<Option<String>>,
+        loginuid: OnceCell<Option<u32>>,
+        sessionid: OnceCell<Option<u32>>,
+        env: OnceCell<Vec<Option<String>>>,
+    }
+
+    impl Snapshot {
+        /// Anchor a snapshot to `pid`. `env_keys` are the only variables
+        /// [`Snapshot::env`] can return — they're all extracted in the
+        /// single `environ` pass.
+        pub fn open(pid: i32, env_keys: &'static [&'static str]) -> Self {
+            let dir = (pid > 0)
+                .then(|| File::open(format!("/proc/{pid}")).ok())
+                .flatten();
+            let path = dir
+                .as_ref()
+                .map(|d| format!("/proc/self/fd/{}/", d.as_raw_fd()))
+                .unwrap_or_default();
+            Self {
+                pid,
+                dir,
+                env_keys,
+                path: RefCell::new(path),
+                buf: RefCell::new(Vec::with_capacity(4096)),
+                status: OnceCell::new(),
+                comm: OnceCell::new(),
+                exe: OnceCell::new(),
+                cwd: OnceCell::new(),
+                argv: OnceCell::new(),
+                cmdline: OnceCell::new(),
+                loginuid: OnceCell::new(),
+                sessionid: OnceCell::new(),
+                env: OnceCell::new(),
+            }
+        }
+
+        pub fn pid(&self) -> i32 {
+            self.pid
+        }
+
+        /// Read `name` (relative to the anchored directory) into the
+        /// shared buffer and hand it to `f`.
+        fn read<T>(&self, name: &str, f: impl FnOnce(&[u8]) -> T) -> Option<T> {
+            self.dir.as_ref()?;
+            let mut path = self.path.borrow_mut();
+            let base = path.len();
+            path.push_str(name);
+            let mut buf = self.buf.borrow_mut();
+            buf.clear();
+            let res = File::open(path.as_str()).and_then(|mut file| file.read_to_end(&mut buf));
+            path.truncate(base);
+            res.ok()?;
+            Some(f(&buf))
+        }
+
+        fn readlink(&self, name: &str) -> Option<String> {
+            self.dir.as_ref()?;
+            let mut path = self.path.borrow_mut();
+            let base = path.len();
+            path.push_str(name);
+            let res = std::fs::read_link(path.as_str());
+            path.truncate(base);
+            res.ok()?.into_os_string().into_string().ok()
+        }
+
+        fn read_u32(&self, name: &str) -> Option<u32> {
+            self.read(name, |b| {
+                std::str::from_utf8(b)
+                    .ok()
+                    .and_then(|s| s.trim().parse().ok())
+            })
+            .flatten()
+        }
+
+        fn status(&self) -> Status {
+            *self
+                .status
+                .get_or_init(|| self.read("status", parse_status).unwrap_or_default())
+        }
+
+        /// See [`read_ppid`].
+        pub fn ppid(&self) -> Option<i32> {
+            self.status().ppid
+        }
+
+        /// Real uid from the `Uid:` line of `status`.
+        pub fn uid(&self) -> Option<u32> {
+            self.status().uid
+        }
+
+        /// See [`read_comm`].
+        pub fn comm(&self) -> Option<&str> {
+            self.comm
+                .get_or_init(|| self.read("comm", |b| String::from_utf8_lossy(b).trim().to_owned()))
+                .as_deref()
+        }
+
+        /// See [`read_exe`].
+        pub fn exe(&self) -> Option<&str> {
+            self.exe.get_or_init(|| self.readlink("exe")).as_deref()
+        }
+
+        /// See [`read_cwd`].
+        pub fn cwd(&self) -> Option<&str> {
+            self.cwd.get_or_init(|| self.readlink("cwd")).as_deref()
+        }
+
+        /// `cmdline` with its argument boundaries, borrowed from this
+        /// snapshot (see [`crate::argv`]).
+        pub fn argv(&self) -> Option<Argv<'_>> {
+            self.argv
+                .get_or_init(|| self.read("cmdline", <[u8]>::to_vec))
+                .as_deref()
+                .map(Argv::new)
+        }
+
+        /// See [`read_cmdline`]. Joined from [`Snapshot::argv`]; `cmdline`
+        /// is read once for both.
+        pub fn cmdline(&self) -> Option<&str> {
+            self.cmdline
+                .get_or_init(|| {
+                    self.argv()
+                        .and_then(|a| (!a.is_empty()).then(|| a.to_string()))
+                })
+                .as_deref()
+        }
+
+        /// `/proc/<pid>/loginuid`, verbatim — `u32::MAX` is the
+        /// kernel's "not in a login session" value and is returned as-is.
+        pub fn loginuid(&self) -> Option<u32> {
+            *self.loginuid.get_or_init(|| self.read_u32("loginuid"))
+        }
+
+        /// `/proc/<pid>/sessionid`, verbatim (`u32::MAX` = unset).
+        pub fn sessionid(&self) -> Option<u32> {
+            *self.sessionid.get_or_init(|| self.read_u32("sessionid"))
+        }
+
+        /// Value of `key` in `environ`. `key` must be one of the
+        /// `env_keys` given to [`Snapshot::open`]; anything else is
+        /// `None`. Same caveat as [`read_environ_var`]: the value is
+        /// user-controlled.
+        pub fn env(&self, key: &str) -> Option<&str> {
+            let i = self.env_keys.iter().position(|k| *k == key)?;
+            let vals = self.env.get_or_init(|| {
+                self.read("environ", |b| scan_environ(b, self.env_keys))
+                    .unwrap_or_else(|| vec![None; self.env_keys.len()])
+            });
+            vals[i].as_deref()
+        }
+    }
+
+    #[cfg(test)]
+    mod tests {
+        use super::*;
+
+        #[test]
+        fn scan_environ_finds_all_keys_in_one_pass() {
+            let env = b"PATH=/bin\0LANG=tr_TR.UTF-8\0junk\0LANG=second\0X=a=b\0\0";
+            assert_eq!(
+                scan_environ(env, &["LANG", "X", "MISSING"]),
+                vec![Some("tr_TR.UTF-8".into()), Some("a=b".into()), None]
+            );
+        }
+
+        #[test]
+        fn scan_environ_handles_unterminated_tail() {
+            assert_eq!(scan_environ(b"A=1\0B=2", &["B"]), vec![Some("2".into())]);
+        }
+
+        #[test]
+        fn parse_status_reads_ppid_and_real_uid() {
+            let st = parse_status(b"Name:\tsudo\nPPid:\t42\nUid:\t1000\t0\t0\t0\n");
+            assert_eq!(st.ppid, Some(42));
+            assert_eq!(st.uid, Some(1000));
+        }
+
+        #[test]
+        fn snapshot_of_self_matches_free_functions() {
+            let pid = std::process::id() as i32;
+            let snap = Snapshot::open(pid, &["PATH", "HOME"]);
+            assert_eq!(snap.pid(), pid);
+            assert_eq!(snap.ppid(), read_ppid(pid));
+            assert_eq!(snap.exe().map(str::to_owned), read_exe(pid));
+            assert_eq!(snap.cwd().map(str::to_owned), read_cwd(pid));
+            assert_eq!(snap.cmdline().map(str::to_owned), read_cmdline(pid));
+            assert_eq!(snap.comm().map(str::to_owned), read_comm(pid));
+            assert_eq!(
+                snap.env("PATH").map(str::to_owned),
+                read_environ_var(pid, "PATH")
+            );
+            assert_eq!(
+                snap.env("HOME").map(str::to_owned),
+                read_environ_var(pid, "HOME")
+            );
+            // Not requested at open time.
+            assert_eq!(snap.env("USER"), None);
+        }
+
+        #[test]
+        fn snapshot_of_invalid_pid_is_empty() {
+            for pid in [-1, 0] {
+                let snap = Snapshot::open(pid, &["LANG"]);
+                assert_eq!(snap.exe(), None);
+                assert_eq!(snap.ppid(), None);
+                assert_eq!(snap.loginuid(), None);
+                assert_eq!(snap.env("LANG"), None);
             }
         }
-        None
+
+        #[test]
+        fn snapshot_does_not_follow_a_reaped_pid() {
+            let mut child = std::process::Command::new("true").spawn().unwrap();
+            let snap = Snapshot::open(child.id() as i32, &[]);
+            child.wait().unwrap();
+            // The directory handle still names the dead task, so reads
+            // fail even if the pid has already been handed out again.
+            assert_eq!(snap.cmdline(), None);
+            assert_eq!(snap.ppid(), None);
+        }
     }
 }
 
@@ -977,11 +1598,25 @@ pub mod procfs {
 /// `journalctl ... | grep session_remote=1` finds remote
 /// escalations across the whole system.
 pub fn logfmt_session_for_pid(pid: i32) -> String {
+    logfmt_session_for_sid(procfs::read_environ_var(pid, SESSION_ENV_KEY).as_deref())
+}
+
+/// [`logfmt_session_for_pid`] for a process already captured in a
+/// [`procfs::Snapshot`]; the snapshot must have been opened with
+/// [`SESSION_ENV_KEY`] among its env keys.
+pub fn logfmt_session(snap: &procfs::Snapshot) -> String {
+    logfmt_session_for_sid(snap.env(SESSION_ENV_KEY))
+}
+
+/// The environment variable logind session enrichment keys on.
+pub const SESSION_ENV_KEY: &str = "XDG_SESSION_ID";
+
+fn logfmt_session_for_sid(sid: Option<&str>) -> String {
     use std::fmt::Write;
-    let Some(sid) = procfs::read_environ_var(pid, "XDG_SESSION_ID") else {
+    let Some(sid) = sid else {
         return String::new();
     };
-    let Some(info) = logind::session_info(&sid) else {
+    let Some(info) = logind::session_info(sid) else {
         return String::new();
     };
     let mut out = String::new();
@@ -1000,12 +1635,14 @@ pub fn logfmt_session_for_pid(pid: i32) -> String {
 /// Logfmt-style helpers for structured audit log lines.
 ///
 /// We intentionally don't pull in a logfmt crate — the format is
-/// trivial and the helper is two functions. The output goes to
-/// syslog via the existing `log::info!` etc. calls, lands in the
-/// systemd journal, and is queryable with `journalctl -t pam_sentinel
-/// -t sentinel-polkit-agent --output=json` (the line ends up in the
-/// `MESSAGE` field; downstream tooling can split on whitespace +
-/// `key=value`).
+/// trivial. The output goes out through the existing `log::info!` etc.
+/// calls. Under systemd the audit transport (`crate::journal`) also
+/// files each `key=value` of an `event=` line as a journal field, so
+/// `journalctl EVENT=auth.deny SENTINEL_USER=alice` works without
+/// re-parsing `MESSAGE`.
+///
+/// [`Line`] builds an event into one buffer; [`quote`] is the
+/// standalone form for a value spliced into a `format!`.
 ///
 /// # Convention
 ///
@@ -1013,21 +1650,32 @@ pub fn logfmt_session_for_pid(pid: i32) -> String {
 /// plus a `source=` discriminator (`dialog` / `bypass` / `headless` /
 /// `agent` / `agent.bypass`). Diagnostic messages stay unstructured.
 pub mod log_kv {
+    use std::fmt::{self, Write};
+
     /// Quote a value for logfmt: bare token if it contains no
     /// whitespace / `"` / `=`, otherwise wrapped in double quotes
     /// with internal `"` and `\` escaped. Empty values become `""`
     /// so they're visually distinguishable from missing keys.
     pub fn quote(value: &str) -> String {
+        let mut out = String::with_capacity(value.len() + 2);
+        quote_into(&mut out, value);
+        out
+    }
+
+    /// [`quote`], appended to `out`.
+    pub fn quote_into(out: &mut String, value: &str) {
         if value.is_empty() {
-            return "\"\"".into();
+            out.push_str("\"\"");
+            return;
         }
         let needs_quoting = value
             .chars()
             .any(|c| c.is_whitespace() || c == '"' || c == '=');
         if !needs_quoting {
-            return value.to_string();
+            out.push_str(value);
+            return;
         }
-        let mut out = String::with_capacity(value.len() + 2);
+        out.reserve(value.len() + 2);
         out.push('"');
         for c in value.chars() {
             match c {
@@ -1037,7 +1685,136 @@ pub mod log_kv {
             }
         }
         out.push('"');
-        out
+    }
+
+    /// One `event=` line, built field by field into a single buffer:
+    /// values are quoted in place, with no `String` per field.
+    ///
+    /// ```
+    /// # use sentinel_shared::log_kv::Line;
+    /// let mut line = Line::new("auth.deny");
+    /// line.kv("user", "alice").kv("process", "Disk Utility").num("uid", 1000);
+    /// assert_eq!(line.as_str(), r#"event=auth.deny user=alice process="Disk Utility" uid=1000"#);
+    /// ```
+    pub struct Line {
+        buf: String,
+    }
+
+    impl Line {
+        pub fn new(event: &str) -> Self {
+            let mut buf = String::with_capacity(256);
+            buf.push_str("event=");
+            quote_into(&mut buf, event);
+            Self { buf }
+        }
+
+        /// ` key=value`, quoted as needed.
+        pub fn kv(&mut self, key: &str, value: &str) -> &mut Self {
+            self.key(key);
+            quote_into(&mut self.buf, value);
+            self
+        }
+
+        /// ` key=value` for a value that is always a bare token
+        /// (numbers, flags).
+        pub fn num(&mut self, key: &str, value: impl fmt::Display) -> &mut Self {
+            self.key(key);
+            let _ = write!(self.buf, "{value}");
+            self
+        }
+
+        /// An already formatted fragment (` a=1 b=2`, leading space
+        /// included), such as `logfmt_session`'s.
+        pub fn raw(&mut self, fragment: &str) -> &mut Self {
+            self.buf.push_str(fragment);
+            self
+        }
+
+        pub fn as_str(&self) -> &str {
+            &self.buf
+        }
+
+        fn key(&mut self, key: &str) {
+            self.buf.push(' ');
+            self.buf.push_str(key);
+            self.buf.push('=');
+        }
+    }
+
+    impl fmt::Display for Line {
+        fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+            f.write_str(&self.buf)
+        }
+    }
+
+    /// The `key=value` pairs of a logfmt line, values still quoted as
+    /// written (see [`unquote_into`]). Words without `=` are skipped.
+    pub fn fields(line: &str) -> Fields<'_> {
+        Fields { rest: line }
+    }
+
+    pub struct Fields<'a> {
+        rest: &'a str,
+    }
+
+    impl<'a> Iterator for Fields<'a> {
+        type Item = (&'a str, &'a str);
+
+        fn next(&mut self) -> Option<Self::Item> {
+            loop {
+                let s = self.rest.trim_start();
+                if s.is_empty() {
+                    return None;
+                }
+                let word_end = s.find(char::is_whitespace).unwrap_or(s.len());
+                let Some(eq) = s[..word_end].find('=') else {
+                    self.rest = &s[word_end..];
+                    continue;
+                };
+                let (key, after) = (&s[..eq], &s[eq + 1..]);
+                let len = if after.starts_with('"') {
+                    quoted_len(after)
+                } else {
+                    after.find(char::is_whitespace).unwrap_or(after.len())
+                };
+                self.rest = &after[len..];
+                return Some((key, &after[..len]));
+            }
+        }
+    }
+
+    /// Length of the quoted value `s` starts with, quotes included (all
+    /// of `s` if it is unterminated).
+    fn quoted_len(s: &str) -> usize {
+        let mut escaped = false;
+        for (i, b) in s.bytes().enumerate().skip(1) {
+            match b {
+                _ if escaped => escaped = false,
+                b'\\' => escaped = true,
+                b'"' => return i + 1,
+                _ => {}
+            }
+        }
+        s.len()
+    }
+
+    /// Append a value from [`fields`] to `out` as it was before
+    /// [`quote`].
+    pub fn unquote_into(raw: &str, out: &mut Vec<u8>) {
+        let Some(inner) = raw.strip_prefix('"') else {
+            out.extend_from_slice(raw.as_bytes());
+            return;
+        };
+        let inner = inner.strip_suffix('"').unwrap_or(inner);
+        let mut escaped = false;
+        for &b in inner.as_bytes() {
+            if !escaped && b == b'\\' {
+                escaped = true;
+                continue;
+            }
+            escaped = false;
+            out.push(b);
+        }
     }
 }
 
@@ -1077,10 +1854,10 @@ mod tests {
     // ---- Policy -----------------------------------------------------------
 
     fn policy(allow: &[&str], deny: &[&str]) -> Policy {
-        Policy {
-            allow: allow.iter().map(|s| s.to_string()).collect(),
-            deny: deny.iter().map(|s| s.to_string()).collect(),
-        }
+        Policy::new(
+            allow.iter().map(|s| s.to_string()).collect(),
+            deny.iter().map(|s| s.to_string()).collect(),
+        )
     }
 
     #[test]
@@ -1136,6 +1913,121 @@ mod tests {
         assert_eq!(p.decide(Some("/usr/bin/other"), None), PolicyDecision::Ask);
     }
 
+    #[test]
+    fn policy_wildcard_covers_actions_below_its_prefix() {
+        let p = policy(
+            &["org.freedesktop.udisks2.*"],
+            &["org.freedesktop.udisks2.modify-device.*"],
+        );
+        let act = |a| p.decide(Some("/usr/bin/udisksctl"), Some(a));
+        assert_eq!(
+            act("org.freedesktop.udisks2.filesystem-mount"),
+            PolicyDecision::Allow
+        );
+        assert_eq!(
+            act("org.freedesktop.udisks2.encrypted.unlock"),
+            PolicyDecision::Allow
+        );
+        // Deny still wins, also between wildcards.
+        assert_eq!(
+            act("org.freedesktop.udisks2.modify-device.system"),
+            PolicyDecision::Deny
+        );
+        // The prefix itself, a sibling and a lookalike are not covered.
+        assert_eq!(act("org.freedesktop.udisks2"), PolicyDecision::Ask);
+        assert_eq!(act("org.freedesktop.udisks2."), PolicyDecision::Ask);
+        assert_eq!(act("org.freedesktop.udisks22.mount"), PolicyDecision::Ask);
+        assert_eq!(act("org.freedesktop.login1.reboot"), PolicyDecision::Ask);
+        // Wildcards are for action ids only.
+        assert_eq!(
+            p.decide(Some("/usr/bin/org.freedesktop.udisks2.x"), None),
+            PolicyDecision::Ask
+        );
+    }
+
+    #[test]
+    fn policy_odd_wildcards_are_literal_entries() {
+        let p = policy(&["*", ".*", "org..*", "org.*.mount.*", "/usr/bin/*"], &[]);
+        for action in ["org.x", "org.a.mount.b", "anything"] {
+            assert_eq!(p.decide(None, Some(action)), PolicyDecision::Ask);
+        }
+        assert_eq!(p.decide(None, Some("org.*.mount.*")), PolicyDecision::Allow);
+        assert_eq!(
+            p.decide(Some("/usr/bin/*"), None),
+            PolicyDecision::Allow,
+            "still an exact path"
+        );
+    }
+
+    /// The compiled lists decide exactly like the linear scan they
+    /// replaced, for every entry without a wildcard.
+    #[test]
+    fn policy_compiled_matches_the_linear_scan() {
+        fn linear(list: &[&str], exe: Option<&str>, action: Option<&str>) -> bool {
+            list.iter().any(|entry| {
+                action == Some(*entry)
+                    || exe.is_some_and(|path| {
+                        if entry.contains('/') {
+                            *entry == path
+                        } else {
+                            process_basename(path) == Some(*entry)
+                        }
+                    })
+            })
+        }
+        let pool = [
+            "",
+            "pacman",
+            "/usr/bin/pacman",
+            "usr/bin/pacman",
+            "bin/",
+            "pacman/",
+            "org.example.act",
+            "a/b",
+            ".",
+            "/",
+        ];
+        let exes = [
+            None,
+            Some(""),
+            Some("pacman"),
+            Some("/usr/bin/pacman"),
+            Some("usr/bin/pacman"),
+            Some("/opt/pacman/"),
+            Some("/"),
+            Some("a/b"),
+            Some("org.example.act"),
+        ];
+        let actions = [
+            None,
+            Some(""),
+            Some("org.example.act"),
+            Some("pacman"),
+            Some("a/b"),
+        ];
+        for (i, deny) in pool.iter().enumerate() {
+            for allow in pool.windows(3).skip(i % 4) {
+                let p = policy(allow, &[deny]);
+                for exe in exes {
+                    for action in actions {
+                        let want = if linear(&[deny], exe, action) {
+                            PolicyDecision::Deny
+                        } else if linear(allow, exe, action) {
+                            PolicyDecision::Allow
+                        } else {
+                            PolicyDecision::Ask
+                        };
+                        assert_eq!(
+                            p.decide(exe, action),
+                            want,
+                            "allow={allow:?} deny={deny:?} exe={exe:?} action={action:?}"
+                        );
+                    }
+                }
+            }
+        }
+    }
+
     #[test]
     fn policy_parses_from_toml() {
         let doc: Document = toml::from_str(
@@ -1146,7 +2038,7 @@ mod tests {
             "#,
         )
         .unwrap();
-        assert_eq!(doc.policy.allow.len(), 2);
+        assert_eq!(doc.policy.allow().len(), 2);
         assert_eq!(
             doc.policy
                 .decide(None, Some("org.freedesktop.systemd1.manage-units")),
@@ -1341,6 +2233,25 @@ mod tests {
         assert_eq!(doc.for_service(POLKIT_PAM_SERVICE).remember_seconds, 0);
     }
 
+    #[test]
+    fn early_helper_is_polkit_only_and_bounded() {
+        let doc: Document = toml::from_str("[general]\nearly_helper = true\n").expect("parse");
+        let polkit = doc.for_service(POLKIT_PAM_SERVICE);
+        assert_eq!(polkit.early_helper_wait(), Some(Duration::from_secs(40)));
+        assert_eq!(doc.for_service("sudo").early_helper_wait(), None);
+        let forever = ServiceConfig {
+            timeout: 0,
+            ..polkit.clone()
+        };
+        assert_eq!(forever.early_helper_wait(), Some(EARLY_HELPER_MAX_WAIT));
+        assert_eq!(
+            Document::defaults()
+                .for_service(POLKIT_PAM_SERVICE)
+                .early_helper_wait(),
+            None
+        );
+    }
+
     #[test]
     fn service_override_unknown_field_is_a_parse_error() {
         // deny_unknown_fields: a typo'd per-service key fails loudly
@@ -1447,6 +2358,37 @@ mod tests {
         assert_eq!(log_kv::quote("a b\\c"), "\"a b\\\\c\""); // gets escaped when wrapping
     }
 
+    #[test]
+    fn log_kv_fields_round_trip_quoted_values() {
+        let mut line = log_kv::Line::new("auth.allow");
+        line.kv("user", "alice")
+            .kv("process", "a \"b\" c\\d")
+            .kv("empty", "")
+            .num("latency_ms", 12)
+            .raw(" session_remote=0");
+        let got: Vec<(String, String)> = log_kv::fields(line.as_str())
+            .map(|(k, v)| {
+                let mut out = Vec::new();
+                log_kv::unquote_into(v, &mut out);
+                (k.to_string(), String::from_utf8(out).unwrap())
+            })
+            .collect();
+        let want = [
+            ("event", "auth.allow"),
+            ("user", "alice"),
+            ("process", "a \"b\" c\\d"),
+            ("empty", ""),
+            ("latency_ms", "12"),
+            ("session_remote", "0"),
+        ];
+        assert_eq!(got.len(), want.len());
+        for ((k, v), (wk, wv)) in got.iter().zip(want) {
+            assert_eq!((k.as_str(), v.as_str()), (wk, wv));
+        }
+        // Words without `=` are not fields.
+        assert_eq!(log_kv::fields("BeginAuthentication action=x").count(), 1);
+    }
+
     // ---- Outcome ----------------------------------------------------------
 
     #[test]
@@ -1506,6 +2448,7 @@ mod tests {
         let v = Verdict {
             outcome: Outcome::Deny,
             remember: true,
+            timings: None,
         };
         assert_eq!(v.to_string(), "DENY");
         // round-trip + whitespace tolerance
@@ -1516,6 +2459,63 @@ mod tests {
         assert!("NONSENSE".parse::<Verdict>().is_err());
     }
 
+    #[test]
+    fn verdict_timings_round_trip() {
+        let v = Verdict {
+            outcome: Outcome::Allow,
+            remember: true,
+            timings: Some(Timings {
+                start_us: 1_000,
+                app_us: None,
+                qml_us: Some(41_000),
+                first_frame_us: Some(52_500),
+            }),
+        };
+        let line = v.to_string();
+        assert_eq!(line, "ALLOW REMEMBER TIMING=1000,,41000,52500");
+        assert_eq!(line.parse::<Verdict>(), Ok(v));
+        // Readers predating timings only look at the first 16 bytes and
+        // the REMEMBER token; both survive the extension.
+        let old = line[..16].parse::<Verdict>().unwrap();
+        assert_eq!(old.outcome, Outcome::Allow);
+        assert!(old.remember);
+    }
+
+    #[test]
+    fn verdict_malformed_timings_are_dropped_not_fatal() {
+        for line in [
+            "DENY TIMING=",
+            "DENY TIMING=1,2,3",
+            "DENY TIMING=1,2,3,4,5",
+            "DENY TIMING=x,2,3,4",
+            "DENY TIMING=,2,3,4",
+        ] {
+            let v: Verdict = line.parse().unwrap();
+            assert_eq!(v.outcome, Outcome::Deny, "{line}");
+            assert_eq!(v.timings, None, "{line}");
+        }
+    }
+
+    #[test]
+    fn timings_logfmt_is_relative_to_the_caller() {
+        let t = Timings {
+            start_us: 12_000,
+            app_us: Some(60_000),
+            qml_us: Some(150_400),
+            first_frame_us: None,
+        };
+        assert_eq!(t.logfmt(10_000), " spawn_ms=2 app_ms=50 qml_ms=140");
+        // A clock reading from before the caller's never goes negative.
+        assert_eq!(t.logfmt(20_000), " spawn_ms=0 app_ms=40 qml_ms=130");
+    }
+
+    #[test]
+    fn monotonic_us_is_monotonic() {
+        let a = monotonic_us();
+        assert!(a > 0);
+        assert!(monotonic_us() >= a);
+    }
+
     // ---- process_basename -------------------------------------------------
 
     #[test]
@@ -0,0 +1,630 @@
+// SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//! Precompiled config snapshot.
+//!
+//! [`crate::load`] runs on every `sm_authenticate`, and on a build host
+//! that drives `sudo` from automation that means thousands of full TOML
+//! parses an hour inside a root process — each one re-cloning every
+//! string into a fresh [`ServiceConfig`]. The config itself changes a few
+//! times a year.
+//!
+//! So the first load after an edit compiles the parsed [`Document`] into a
+//! compact binary blob with every per-service [`ServiceConfig`] already
+//! resolved, stamped with the config file's identity (`dev`, `ino`, size,
+//! `mtime`, `ctime`). Later loads `stat` the config, read the blob, and
+//! decode the one service they need. Any mismatch — stale stamp, other
+//! build, bad checksum, truncated blob — falls back to the TOML path,
+//! which then rewrites the snapshot.
+//!
+//! # Trust
+//!
+//! The blob decides security settings (policy lists, `remember_seconds`),
+//! so it gets the same protection as the config file: it is only ever
+//! **read** if it and its directory are root-owned and not group/world-
+//! writable, and it is only **written** by root (the PAM module). A
+//! non-root caller (the polkit agent) simply fails the write and keeps
+//! using the TOML path. The snapshot lives on `/run` (tmpfs), so a reboot
+//! always starts from the real config.
+//!
+//! Only a *faithful* view of the config is ever cached: a file that fails
+//! to parse is not snapshotted, so every auth keeps logging the parse
+//! warning until the admin fixes it (see the crate docs on failure
+//! handling).
+
+use crate::{Document, HeadlessAction, Policy, ServiceConfig};
+use std::fs;
+use std::io::Read as _;
+use std::io::Write;
+use std::os::unix::fs::{MetadataExt, OpenOptionsExt, PermissionsExt};
+use std::path::Path;
+
+/// Compile-time absolute path of the snapshot. Set by this crate's
+/// `build.rs` (`SENTINEL_SNAPSHOT_PATH`, default
+/// `/run/sentinel/config.snap`).
+pub const SNAPSHOT_PATH: &str = env!("SENTINEL_SNAPSHOT_PATH");
+
+const MAGIC: &[u8; 8] = b"SNTLSNAP";
+/// Bump on any change to the encoding below.
+const FORMAT_VERSION: u16 = 2;
+/// Upper bound on a snapshot we're willing to read. Real ones are a few
+/// hundred bytes; generated policy lists push that into the tens of KiB.
+const MAX_SNAPSHOT_LEN: u64 = 4 * 1024 * 1024;
+
+/// Identity of the config file a snapshot was compiled from. `ctime` is
+/// in there because, unlike `mtime`, it can't be set back with
+/// `utimes(2)`; size + nanosecond timestamps cover editors that rewrite
+/// in place.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Stamp {
+    /// No config file — the snapshot holds the built-in defaults.
+    Absent,
+    File {
+        dev: u64,
+        ino: u64,
+        size: u64,
+        mtime: (i64, i64),
+        ctime: (i64, i64),
+    },
+}
+
+impl Stamp {
+    /// Stamp the file at `path`. `None` when it exists but can't be
+    /// stat'ed — no snapshot is trusted (or written) then.
+    pub fn of(path: &Path) -> Option<Self> {
+        match fs::metadata(path) {
+            Ok(m) => Some(Self::File {
+                dev: m.dev(),
+                ino: m.ino(),
+                size: m.size(),
+                mtime: (m.mtime(), m.mtime_nsec()),
+                ctime: (m.ctime(), m.ctime_nsec()),
+            }),
+            Err(e) if e.kind() == std::io::ErrorKind::NotFound => Some(Self::Absent),
+            Err(_) => None,
+        }
+    }
+}
+
+/// The per-service knobs `[services.<name>]` can override, already
+/// resolved against `[general]` by [`Document::for_service`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct Resolved {
+    enabled: bool,
+    timeout: u32,
+    randomize_buttons: bool,
+    remember_seconds: u32,
+    early_helper: bool,
+}
+
+impl Resolved {
+    fn of(cfg: &ServiceConfig) -> Self {
+        Self {
+            enabled: cfg.enabled,
+            timeout: cfg.timeout,
+            randomize_buttons: cfg.randomize_buttons,
+            remember_seconds: cfg.remember_seconds,
+            early_helper: cfg.early_helper,
+        }
+    }
+}
+
+/// A compiled config: one shared base (everything that isn't per-service
+/// overridable) plus the resolved overridable knobs for each named
+/// service. Unknown services resolve to the base with `remember = 0`,
+/// exactly as [`Document::for_service`] does.
+#[derive(Debug, Clone)]
+pub struct Snapshot {
+    stamp: Stamp,
+    base: ServiceConfig,
+    services: Vec<(String, Resolved)>,
+}
+
+impl Snapshot {
+    /// Resolve every service named in `doc` (plus `polkit-1`, whose
+    /// remember default differs from an unknown service's).
+    pub fn compile(doc: &Document, stamp: Stamp) -> Self {
+        let base = doc.for_service("");
+        let mut names: Vec<&str> = doc.services.keys().map(String::as_str).collect();
+        if !doc.services.contains_key(crate::POLKIT_PAM_SERVICE) {
+            names.push(crate::POLKIT_PAM_SERVICE);
+        }
+        names.sort_unstable();
+        let services = names
+            .into_iter()
+            .map(|n| (n.to_owned(), Resolved::of(&doc.for_service(n))))
+            .collect();
+        Self {
+            stamp,
+            base,
+            services,
+        }
+    }
+
+    pub fn stamp(&self) -> Stamp {
+        self.stamp
+    }
+
+    /// Effective config for `service`; identical to
+    /// `Document::for_service` on the document this was compiled from.
+    pub fn for_service(&self, service: &str) -> ServiceConfig {
+        let mut cfg = self.base.clone();
+        if let Ok(i) = self
+            .services
+            .binary_search_by(|(n, _)| n.as_str().cmp(service))
+        {
+            let r = self.services[i].1;
+            cfg.enabled = r.enabled;
+            cfg.timeout = r.timeout;
+            cfg.randomize_buttons = r.randomize_buttons;
+            cfg.remember_seconds = r.remember_seconds;
+            cfg.early_helper = r.early_helper;
+        }
+        cfg
+    }
+
+    /// Serialize to the on-disk form: header (magic, format version,
+    /// build version, stamp, body checksum) followed by the body.
+    pub fn encode(&self) -> Vec<u8> {
+        let mut body = Enc::default();
+        encode_config(&mut body, &self.base);
+        body.u32(self.services.len() as u32);
+        for (name, r) in &self.services {
+            body.str(name);
+            body.bool(r.enabled);
+            body.u32(r.timeout);
+            body.bool(r.randomize_buttons);
+            body.u32(r.remember_seconds);
+            body.bool(r.early_helper);
+        }
+
+        let mut out = Enc::default();
+        out.0.extend_from_slice(MAGIC);
+        out.u16(FORMAT_VERSION);
+        out.str(env!("CARGO_PKG_VERSION"));
+        match self.stamp {
+            Stamp::Absent => out.u8(0),
+            Stamp::File {
+                dev,
+                ino,
+                size,
+                mtime,
+                ctime,
+            } => {
+                out.u8(1);
+                out.u64(dev);
+                out.u64(ino);
+                out.u64(size);
+                out.i64(mtime.0);
+                out.i64(mtime.1);
+                out.i64(ctime.0);
+                out.i64(ctime.1);
+            }
+        }
+        out.u64(fnv1a(&body.0));
+        out.0.extend_from_slice(&body.0);
+        out.0
+    }
+
+    /// Parse [`Snapshot::encode`] output. `None` for anything that isn't
+    /// a complete, checksum-clean snapshot from this exact build.
+    pub fn decode(bytes: &[u8]) -> Option<Self> {
+        let mut d = Dec(bytes);
+        if d.take(MAGIC.len())? != MAGIC
+            || d.u16()? != FORMAT_VERSION
+            || d.str()? != env!("CARGO_PKG_VERSION")
+        {
+            return None;
+        }
+        let stamp = match d.u8()? {
+            0 => Stamp::Absent,
+            1 => Stamp::File {
+                dev: d.u64()?,
+                ino: d.u64()?,
+                size: d.u64()?,
+                mtime: (d.i64()?, d.i64()?),
+                ctime: (d.i64()?, d.i64()?),
+            },
+            _ => return None,
+        };
+        let checksum = d.u64()?;
+        if fnv1a(d.0) != checksum {
+            return None;
+        }
+
+        let base = decode_config(&mut d)?;
+        let n = d.u32()? as usize;
+        // Each entry is at least 15 bytes; refuse counts the body can't hold.
+        if n > d.0.len() / 15 {
+            return None;
+        }
+        let mut services = Vec::with_capacity(n);
+        for _ in 0..n {
+            let name = d.str()?.to_owned();
+            let r = Resolved {
+                enabled: d.bool()?,
+                timeout: d.u32()?,
+                randomize_buttons: d.bool()?,
+                remember_seconds: d.u32()?,
+                early_helper: d.bool()?,
+            };
+            services.push((name, r));
+        }
+        // Trailing garbage or an unsorted table means this isn't our output.
+        if !d.0.is_empty() || !services.windows(2).all(|w| w[0].0 < w[1].0) {
+            return None;
+        }
+        Some(Self {
+            stamp,
+            base,
+            services,
+        })
+    }
+
+    /// Read the snapshot at `path`, but only if it passes the ownership
+    /// checks described in the module docs. `None` on any failure.
+    pub fn read_trusted(path: &Path) -> Option<Self> {
+        let dir = path.parent()?;
+        if !root_owned_not_shared_writable(&fs::metadata(dir).ok()?) {
+            return None;
+        }
+        // lstat first so a symlink is refused outright, then make sure
+        // the file we opened is the one we checked.
+        let link = fs::symlink_metadata(path).ok()?;
+        if !link.is_file() {
+            return None;
+        }
+        let file = fs::File::open(path).ok()?;
+        let meta = file.metadata().ok()?;
+        if (meta.dev(), meta.ino()) != (link.dev(), link.ino())
+            || !root_owned_not_shared_writable(&meta)
+            || meta.len() > MAX_SNAPSHOT_LEN
+        {
+            return None;
+        }
+        let mut bytes = Vec::with_capacity(meta.len() as usize);
+        file.take(MAX_SNAPSHOT_LEN).read_to_end(&mut bytes).ok()?;
+        Self::decode(&bytes)
+    }
+
+    /// Atomically (temp file + `rename`) write the snapshot to `path`,
+    /// mode `0644`, creating its directory `0755` if needed. Fails with
+    /// `EACCES` for non-root callers, which is the intended outcome.
+    pub fn store(&self, path: &Path) -> std::io::Result<()> {
+        let dir = path
+            .parent()
+            .ok_or_else(|| std::io::Error::from(std::io::ErrorKind::InvalidInput))?;
+        if !dir.exists() {
+            fs::create_dir_all(dir)?;
+            fs::set_permissions(dir, fs::Permissions::from_mode(0o755))?;
+        }
+        let tmp = dir.join(format!(".config.snap.{}", std::process::id()));
+        // A crashed writer that had our pid may have left its temp file
+        // behind; `create_new` would then fail every write with EEXIST.
+        let _ = fs::remove_file(&tmp);
+        let result = (|| {
+            let mut f = fs::OpenOptions::new()
+                .write(true)
+                .create_new(true)
+                .mode(0o644)
+                .open(&tmp)?;
+            f.write_all(&self.encode())?;
+            f.sync_data()?;
+            fs::rename(&tmp, path)
+        })();
+        if result.is_err() {
+            let _ = fs::remove_file(&tmp);
+        }
+        result
+    }
+}
+
+/// Effective config for `service`, through the snapshot when it is fresh
+/// for the config at `config` and the TOML path otherwise. A successful
+/// TOML load refreshes the snapshot (best-effort; root only).
+pub fn load_service(config: &Path, snapshot: &Path, service: &str) -> ServiceConfig {
+    let stamp = Stamp::of(config);
+    if let Some(stamp) = stamp
+        && let Some(snap) = Snapshot::read_trusted(snapshot)
+        && snap.stamp == stamp
+    {
+        return snap.for_service(service);
+    }
+
+    let (doc, faithful) = Document::load_checked(config);
+    // Stamped *before* the read: if the file changed in between, the
+    // snapshot carries the old stamp and the next load recompiles.
+    if faithful && let Some(stamp) = stamp {
+        if let Err(e) = Snapshot::compile(&doc, stamp).store(snapshot) {
+            log::debug!(
+                "sentinel-shared: not caching config snapshot at {}: {e}",
+                snapshot.display()
+            );
+        }
+    }
+    doc.for_service(service)
+}
+
+fn root_owned_not_shared_writable(m: &fs::Metadata) -> bool {
+    m.uid() == 0 && m.mode() & 0o022 == 0
+}
+
+/// 64-bit FNV-1a. Catches truncation and bit rot; tamper resistance
+/// comes from the ownership checks, not from this.
+fn fnv1a(bytes: &[u8]) -> u64 {
+    bytes.iter().fold(0xcbf2_9ce4_8422_2325, |h, &b| {
+        (h ^ u64::from(b)).wrapping_mul(0x0000_0100_0000_01b3)
+    })
+}
+
+fn encode_config(e: &mut Enc, c: &ServiceConfig) {
+    e.bool(c.enabled);
+    e.u32(c.timeout);
+    e.bool(c.randomize_buttons);
+    e.u8(match c.headless_action {
+        HeadlessAction::Allow => 0,
+        HeadlessAction::Deny => 1,
+        HeadlessAction::Password => 2,
+    });
+    e.bool(c.show_process_info);
+    e.bool(c.log_attempts);
+    e.u32(c.min_display_time_ms);
+    e.str(&c.title);
+    e.str(&c.message);
+    e.str(&c.secondary);
+    e.str(&c.sound_name);
+    for list in [c.policy.allow(), c.policy.deny()] {
+        e.u32(list.len() as u32);
+        for entry in list {
+            e.str(entry);
+        }
+    }
+    e.bool(c.notify_on_deny);
+    e.bool(c.notify_on_timeout);
+    e.u32(c.remember_seconds);
+    e.bool(c.early_helper);
+}
+
+fn decode_config(d: &mut Dec<'_>) -> Option<ServiceConfig> {
+    Some(ServiceConfig {
+        enabled: d.bool()?,
+        timeout: d.u32()?,
+        randomize_buttons: d.bool()?,
+        headless_action: match d.u8()? {
+            0 => HeadlessAction::Allow,
+            1 => HeadlessAction::Deny,
+            2 => HeadlessAction::Password,
+            _ => return None,
+        },
+        show_process_info: d.bool()?,
+        log_attempts: d.bool()?,
+        min_display_time_ms: d.u32()?,
+        title: d.str()?.to_owned(),
+        message: d.str()?.to_owned(),
+        secondary: d.str()?.to_owned(),
+        sound_name: d.str()?.to_owned(),
+        policy: {
+            let allow = d.str_list()?;
+            Policy::new(allow, d.str_list()?)
+        },
+        notify_on_deny: d.bool()?,
+        notify_on_timeout: d.bool()?,
+        remember_seconds: d.u32()?,
+        early_helper: d.bool()?,
+    })
+}
+
+/// Little-endian, length-prefixed encoder. Deliberately not a serde
+/// format: the blob is private to this module and ten lines of byte
+/// pushing beat a new dependency in the PAM module.
+#[derive(Default)]
+struct Enc(Vec<u8>);
+
+impl Enc {
+    fn u8(&mut self, v: u8) {
+        self.0.push(v);
+    }
+    fn bool(&mut self, v: bool) {
+        self.u8(v as u8);
+    }
+    fn u16(&mut self, v: u16) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn u32(&mut self, v: u32) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn u64(&mut self, v: u64) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn i64(&mut self, v: i64) {
+        self.0.extend_from_slice(&v.to_le_bytes());
+    }
+    fn str(&mut self, s: &str) {
+        self.u32(s.len() as u32);
+        self.0.extend_from_slice(s.as_bytes());
+    }
+}
+
+struct Dec<'a>(&'a [u8]);
+
+impl<'a> Dec<'a> {
+    fn take(&mut self, n: usize) -> Option<&'a [u8]> {
+        if self.0.len() < n {
+            return None;
+        }
+        let (head, rest) = self.0.split_at(n);
+        self.0 = rest;
+        Some(head)
+    }
+    fn array<const N: usize>(&mut self) -> Option<[u8; N]> {
+        self.take(N)?.try_into().ok()
+    }
+    fn u8(&mut self) -> Option<u8> {
+        Some(self.take(1)?[0])
+    }
+    fn bool(&mut self) -> Option<bool> {
+        match self.u8()? {
+            0 => Some(false),
+            1 => Some(true),
+            _ => None,
+        }
+    }
+    fn u16(&mut self) -> Option<u16> {
+        self.array().map(u16::from_le_bytes)
+    }
+    fn u32(&mut self) -> Option<u32> {
+        self.array().map(u32::from_le_bytes)
+    }
+    fn u64(&mut self) -> Option<u64> {
+        self.array().map(u64::from_le_bytes)
+    }
+    fn i64(&mut self) -> Option<i64> {
+        self.array().map(i64::from_le_bytes)
+    }
+    fn str(&mut self) -> Option<&'a str> {
+        let n = self.u32()? as usize;
+        std::str::from_utf8(self.take(n)?).ok()
+    }
+    fn str_list(&mut self) -> Option<Vec<String>> {
+        let n = self.u32()? as usize;
+        if n > self.0.len() / 4 {
+            return None;
+        }
+        (0..n).map(|_| self.str().map(str::to_owned)).collect()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const SRC: &str = r#"
+        [general]
+        timeout = 45
+        headless_action = "deny"
+        remember_seconds = 120
+        early_helper = true
+
+        [appearance]
+        title = "Custom %u"
+
+        [policy]
+        allow = ["pacman"]
+        deny = ["org.freedesktop.systemd1.manage-units"]
+
+        [services.sudo]
+        timeout = 5
+        remember_seconds = 60
+
+        [services.su]
+        enabled = false
+    "#;
+
+    fn stamp() -> Stamp {
+        Stamp::File {
+            dev: 1,
+            ino: 2,
+            size: 3,
+            mtime: (4, 5),
+            ctime: (6, 7),
+        }
+    }
+
+    #[test]
+    fn snapshot_matches_document_for_every_service() {
+        let doc: Document = toml::from_str(SRC).unwrap();
+        let snap = Snapshot::decode(&Snapshot::compile(&doc, stamp()).encode()).unwrap();
+        assert_eq!(snap.stamp(), stamp());
+        for svc in ["sudo", "su", "polkit-1", "sudo-i", "unknown", ""] {
+            assert_eq!(
+                snap.for_service(svc),
+                doc.for_service(svc),
+                "service {svc:?}"
+            );
+        }
+    }
+
+    #[test]
+    fn defaults_round_trip_with_absent_stamp() {
+        let doc = Document::defaults();
+        let snap = Snapshot::decode(&Snapshot::compile(&doc, Stamp::Absent).encode()).unwrap();
+        assert_eq!(snap.stamp(), Stamp::Absent);
+        assert_eq!(snap.for_service("polkit-1"), doc.for_service("polkit-1"));
+        assert_eq!(snap.for_service("sudo").remember_seconds, 0);
+    }
+
+    #[test]
+    fn corrupt_or_truncated_snapshots_are_rejected() {
+        let doc: Document = toml::from_str(SRC).unwrap();
+        let bytes = Snapshot::compile(&doc, stamp()).encode();
+        for n in 0..bytes.len() {
+            assert!(Snapshot::decode(&bytes[..n]).is_none(), "truncated at {n}");
+        }
+        let mut flipped = bytes.clone();
+        *flipped.last_mut().unwrap() ^= 0x40;
+        assert!(
+            Snapshot::decode(&flipped).is_none(),
+            "checksum must catch it"
+        );
+        let mut trailing = bytes;
+        trailing.push(0);
+        assert!(Snapshot::decode(&trailing).is_none());
+    }
+
+    #[test]
+    fn untrusted_snapshot_is_not_read() {
+        // The test runner isn't root, so a snapshot it writes fails the
+        // ownership check — exactly what a user-planted blob would.
+        let dir = std::env::temp_dir().join(format!("sentinel-snap-{}", std::process::id()));
+        let _ = fs::create_dir_all(&dir);
+        let path = dir.join("config.snap");
+        let snap = Snapshot::compile(&Document::defaults(), Stamp::Absent);
+        snap.store(&path).unwrap();
+        let readable = Snapshot::read_trusted(&path).is_some();
+        let _ = fs::remove_dir_all(&dir);
+        assert_eq!(readable, running_as_root());
+    }
+
+    #[test]
+    fn stale_temp_file_does_not_block_the_write() {
+        let dir = std::env::temp_dir().join(format!("sentinel-snap-stale-{}", std::process::id()));
+        let _ = fs::create_dir_all(&dir);
+        let path = dir.join("config.snap");
+        let stale = dir.join(format!(".config.snap.{}", std::process::id()));
+        fs::write(&stale, b"left by a crashed writer").unwrap();
+        let snap = Snapshot::compile(&Document::defaults(), Stamp::Absent);
+        let stored = snap.store(&path);
+        let (written, stale_left) = (path.exists(), stale.exists());
+        let _ = fs::remove_dir_all(&dir);
+        stored.unwrap();
+        assert!(written && !stale_left);
+    }
+
+    #[test]
+    fn load_service_falls_back_to_toml_without_a_trusted_snapshot() {
+        let dir = std::env::temp_dir().join(format!("sentinel-snap-load-{}", std::process::id()));
+        let _ = fs::create_dir_all(&dir);
+        let conf = dir.join("sentinel.conf");
+        fs::write(&conf, "[services.sudo]\ntimeout = 9\n").unwrap();
+        let cfg = load_service(&conf, &dir.join("config.snap"), "sudo");
+        let _ = fs::remove_dir_all(&dir);
+        assert_eq!(cfg.timeout, 9);
+    }
+
+    #[test]
+    fn stamp_tracks_content_changes() {
+        let dir = std::env::temp_dir().join(format!("sentinel-snap-stamp-{}", std::process::id()));
+        let _ = fs::create_dir_all(&dir);
+        let conf = dir.join("sentinel.conf");
+        assert_eq!(Stamp::of(&conf), Some(Stamp::Absent));
+        fs::write(&conf, "[general]\ntimeout = 1\n").unwrap();
+        let a = Stamp::of(&conf).unwrap();
+        fs::write(&conf, "[general]\ntimeout = 22\n").unwrap();
+        let b = Stamp::of(&conf).unwrap();
+        let _ = fs::remove_dir_all(&dir);
+        assert_ne!(a, b);
+    }
+
+    fn running_as_root() -> bool {
+        fs::metadata("/proc/self").is_ok_and(|m| m.uid() == 0)
+    }
+}
@@ -15,8 +15,15 @@
 /// locale environment (`LC_ALL` > `LC_MESSAGES` > `LANG`). Returns `"en"`
 /// for unset / `C` / `POSIX`.
 pub fn ui_lang() -> String {
+    ui_lang_from(|var| std::env::var(var).ok())
+}
+
+/// [`ui_lang`] over an arbitrary variable source. The dialog service uses
+/// it with the locale variables carried in each request, since its own
+/// environment is the session's rather than the requesting process's.
+pub fn ui_lang_from(get: impl Fn(&str) -> Option<String>) -> String {
     for var in ["LC_ALL", "LC_MESSAGES", "LANG"] {
-        if let Ok(v) = std::env::var(var) {
+        if let Some(v) = get(var) {
             let v = v.trim();
             if v.is_empty() || v == "C" || v == "POSIX" {
                 continue;
@@ -361,4 +368,25 @@ mod tests {
             .to_ascii_lowercase();
         assert_eq!(code, "pt");
     }
+
+    #[test]
+    fn ui_lang_from_honours_priority_and_skips_posix() {
+        let env = |pairs: &'static [(&'static str, &'static str)]| {
+            move |k: &str| {
+                pairs
+                    .iter()
+                    .find(|(key, _)| *key == k)
+                    .map(|(_, v)| v.to_string())
+            }
+        };
+        assert_eq!(
+            ui_lang_from(env(&[("LANG", "de_DE.UTF-8"), ("LC_ALL", "fr_FR")])),
+            "fr"
+        );
+        assert_eq!(
+            ui_lang_from(env(&[("LC_ALL", "C"), ("LANG", "ja_JP")])),
+            "ja"
+        );
+        assert_eq!(ui_lang_from(env(&[])), "en");
+    }
 }
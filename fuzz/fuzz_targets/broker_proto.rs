@@ -4,14 +4,42 @@
 //! Unix socket *inside the root broker*, so it must never panic and must
 //! never allocate on a hostile length prefix (the `MAX_FRAME_LEN` guard
 //! runs before the body buffer is sized).
+//!
+//! The zero-copy path the broker actually serves from (`split_frame` +
+//! `decode_borrowed`, and `read_frame_in` over a fixed buffer) walks the
+//! same bytes and must agree with the owned decoder frame for frame.
 #![no_main]
 
 use libfuzzer_sys::fuzz_target;
-use sentinel_broker_proto::{Request, read_frame};
+use sentinel_broker_proto::{
+    MAX_FRAME_LEN, Request, borrowed, decode, decode_borrowed, read_frame, read_frame_in,
+    split_frame,
+};
 
 fuzz_target!(|data: &[u8]| {
     let mut cur = std::io::Cursor::new(data);
     // Drain successive frames until the input is exhausted or errors —
     // exercises the length-prefix + postcard decode path repeatedly.
     while read_frame::<_, Request>(&mut cur).is_ok() {}
+
+    let mut rest = data;
+    while let Ok(Some((body, tail))) = split_frame(rest) {
+        assert!(body.len() <= MAX_FRAME_LEN);
+        let owned = decode::<Request>(body);
+        let view = decode_borrowed::<borrowed::Request<'_>>(body);
+        match (&owned, &view) {
+            (Ok(o), Ok(v)) => assert_eq!(o.as_borrowed(), *v),
+            (Err(_), Err(_)) => {}
+            _ => panic!("owned and borrowed decoders disagree"),
+        }
+        if view.is_err() {
+            break;
+        }
+        rest = tail;
+    }
+
+    // A small fixed buffer: bodies that don't fit must error, not panic.
+    let mut cur = std::io::Cursor::new(data);
+    let mut buf = [0u8; 256];
+    while read_frame_in::<_, borrowed::Request<'_>>(&mut cur, &mut buf).is_ok() {}
 });
@@ -5,14 +5,39 @@
 //! `su`/`pkexec`/`doas` wrapper. It feeds the remember key and the
 //! dialog's process name, so it must never panic on any input (embedded
 //! NULs, lone flags, multibyte, pathological whitespace, deep nesting).
+//!
+//! The same bytes also go through `argv::Argv`, the borrowed view that
+//! replaced it on the `/proc` paths. Where no argument contains
+//! whitespace (the only case where splitting the joined line recovers
+//! argv), both must agree on the elevated command and on remember
+//! eligibility.
 #![no_main]
 
 use libfuzzer_sys::fuzz_target;
-use sentinel_shared::strip_elevation_prefix;
+use sentinel_shared::argv::Argv;
+use sentinel_shared::{remember_eligible_command, strip_elevation_prefix};
 
 fuzz_target!(|data: &[u8]| {
     // cmdline is NUL-joined in /proc; callers pass it as a str, so fuzz
     // the str path (lossy-decoding arbitrary bytes exercises multibyte).
     let s = String::from_utf8_lossy(data);
     let _ = strip_elevation_prefix(&s);
+
+    let argv = Argv::new(data);
+    let elevated = argv.elevated();
+    let eligible = argv.remember_eligible();
+    let whitespace_free = argv
+        .iter()
+        .all(|arg| !String::from_utf8_lossy(arg).contains(char::is_whitespace));
+    if whitespace_free {
+        let joined = argv.to_string();
+        let old = strip_elevation_prefix(&joined);
+        let new = elevated.map_or_else(|| joined.clone(), |cmd| cmd.to_string());
+        assert_eq!(old, new, "elevated command for {argv:?}");
+        assert_eq!(
+            remember_eligible_command(&joined),
+            eligible,
+            "remember eligibility for {argv:?}"
+        );
+    }
 });
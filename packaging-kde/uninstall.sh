@@ -97,7 +97,7 @@ if [[ -f "$STATE_FILE" ]]; then
     # Restart polkit only if a prior install had dropped a polkit.service
     # override (older Sentinel did; current installs don't touch it).
     systemctl try-restart polkit.service 2>/dev/null || true
-    rm -rf -- /run/sentinel 2>/dev/null || true   # legacy runtime dir from older installs
+    rm -rf -- /run/sentinel 2>/dev/null || true   # config snapshot + legacy runtime dir
     rm -f -- "$STATE_FILE"
     rmdir --ignore-fail-on-non-empty "$STATE_DIR" 2>/dev/null || true
 
@@ -153,7 +153,7 @@ for p in "${FALLBACK_PATHS[@]}"; do
         fi
     fi
 done
-rm -rf -- /run/sentinel 2>/dev/null || true   # legacy runtime dir from older installs
+rm -rf -- /run/sentinel 2>/dev/null || true   # config snapshot + legacy runtime dir
 systemctl daemon-reload 2>/dev/null || true
 systemctl reload dbus.service 2>/dev/null || systemctl reload dbus-broker.service 2>/dev/null || true
 systemctl try-restart polkit.service 2>/dev/null || true   # only matters if an older install dropped a polkit override
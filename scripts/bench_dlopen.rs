@@ -0,0 +1,146 @@
+// SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// bench_dlopen.rs — on-disk size and cold dlopen(3) cost of one or more
+// `pam_sentinel.so` builds, side by side.
+//
+// Single-file program; build with:
+//     rustc -O scripts/bench_dlopen.rs -o target/sentinel-bench-dlopen
+//
+// Compare two builds (e.g. before/after a dependency change):
+//     git stash; cargo build --release -p pam-sentinel
+//     cp target/release/libpam_sentinel.so /tmp/old.so; git stash pop
+//     cargo build --release -p pam-sentinel
+//     target/sentinel-bench-dlopen /tmp/old.so target/release/libpam_sentinel.so
+//
+// Each sample is one dlopen(RTLD_NOW | RTLD_LOCAL) in a freshly
+// re-executed copy of this program, which is what libpam pays per auth
+// in a fresh `sudo`. Repeating dlopen in one process would measure
+// refcount bumps: a Rust module registers TLS destructors, so glibc
+// never really unloads it on dlclose. The report names each build by
+// its GNU build-id, so a result can be tied to the binary it measured.
+// No external crates.
+
+use std::ffi::{CString, c_char, c_int, c_void};
+use std::process::Command;
+use std::time::Instant;
+
+const RTLD_NOW: c_int = 2;
+const RTLD_LOCAL: c_int = 0;
+/// Cold loads per build; odd, so the median is a sample.
+const SAMPLES: usize = 51;
+
+unsafe extern "C" {
+    fn dlopen(filename: *const c_char, flag: c_int) -> *mut c_void;
+}
+
+fn main() {
+    let args: Vec<String> = std::env::args().skip(1).collect();
+    if let [flag, path] = &args[..] {
+        if flag == "--sample" {
+            sample(path);
+        }
+    }
+    if args.is_empty() {
+        eprintln!("usage: bench_dlopen <module.so>...");
+        std::process::exit(2);
+    }
+    let me = std::env::current_exe().unwrap_or_else(|e| {
+        eprintln!("current_exe: {e}");
+        std::process::exit(1);
+    });
+    println!(
+        "{:>10}  {:>10}  {:>10}  {:>10}  {:<16}  path",
+        "size", "min", "median", "p90", "build-id"
+    );
+    for path in &args {
+        let bytes = match std::fs::read(path) {
+            Ok(b) => b,
+            Err(e) => {
+                eprintln!("{path}: {e}");
+                std::process::exit(1);
+            }
+        };
+        let mut ns: Vec<u64> = (0..SAMPLES)
+            .map(|_| {
+                let out = Command::new(&me)
+                    .args(["--sample", path])
+                    .output()
+                    .unwrap_or_else(|e| {
+                        eprintln!("{path}: {e}");
+                        std::process::exit(1);
+                    });
+                let parsed = String::from_utf8_lossy(&out.stdout).trim().parse().ok();
+                match parsed {
+                    Some(ns) if out.status.success() => ns,
+                    _ => {
+                        eprintln!("{path}: dlopen failed");
+                        std::process::exit(1);
+                    }
+                }
+            })
+            .collect();
+        ns.sort_unstable();
+        let us = |ns: u64| format!("{:.1}µs", ns as f64 / 1000.0);
+        println!(
+            "{:>6} KiB  {:>10}  {:>10}  {:>10}  {:<16}  {path}",
+            bytes.len() / 1024,
+            us(ns[0]),
+            us(ns[SAMPLES / 2]),
+            us(ns[SAMPLES * 9 / 10]),
+            build_id(&bytes).unwrap_or_else(|| "-".into()),
+        );
+    }
+}
+
+/// Child side: time one cold dlopen of `path` and print nanoseconds.
+fn sample(path: &str) -> ! {
+    let c = CString::new(path).expect("path contains NUL");
+    let started = Instant::now();
+    // SAFETY: dlopen on a caller-supplied path; the handle is never used
+    // and the process exits right after.
+    let h = unsafe { dlopen(c.as_ptr(), RTLD_NOW | RTLD_LOCAL) };
+    let ns = started.elapsed().as_nanos();
+    if h.is_null() {
+        std::process::exit(1);
+    }
+    println!("{ns}");
+    std::process::exit(0);
+}
+
+/// First 8 bytes of the GNU build-id note, in hex, from a little-endian
+/// ELF64 file's `PT_NOTE` segments.
+fn build_id(elf: &[u8]) -> Option<String> {
+    // Little-endian unsigned integer of `n` bytes at `at`.
+    let int = |at: usize, n: usize| {
+        let bytes = elf.get(at..at + n)?;
+        Some(
+            bytes
+                .iter()
+                .rev()
+                .fold(0usize, |v, &b| v << 8 | usize::from(b)),
+        )
+    };
+    if elf.get(..6)? != b"\x7fELF\x02\x01" {
+        return None;
+    }
+    let (phoff, phentsize, phnum) = (int(0x20, 8)?, int(0x36, 2)?, int(0x38, 2)?);
+    for i in 0..phnum {
+        let ph = phoff + i * phentsize;
+        if int(ph, 4)? != 4 {
+            continue; // not PT_NOTE
+        }
+        let (mut at, end) = (int(ph + 8, 8)?, int(ph + 8, 8)? + int(ph + 32, 8)?);
+        while at + 12 <= end {
+            let (namesz, descsz, kind) = (int(at, 4)?, int(at + 4, 4)?, int(at + 8, 4)?);
+            let name = at + 12;
+            let desc = name + namesz.next_multiple_of(4);
+            if kind == 3 && elf.get(name..name + namesz)? == b"GNU\0" {
+                let id = elf.get(desc..desc + descsz.min(8))?;
+                return Some(id.iter().map(|b| format!("{b:02x}")).collect());
+            }
+            at = desc + descsz.next_multiple_of(4);
+        }
+    }
+    None
+}
@@ -1,16 +1,45 @@
 // SPDX-FileCopyrightText: 2025 Atay Özcan <atay@oezcan.me>
 // SPDX-License-Identifier: GPL-3.0-or-later
 //
-// pam_authtest.rs — minimal pam_authenticate() caller for dev-test.sh.
+// pam_authtest.rs — minimal pam_authenticate() caller for dev-test.sh,
+// and an end-to-end latency bench for pam_sentinel.so.
 //
 // Single-file program; build with:
 //     rustc -O scripts/pam_authtest.rs -l pam -o target/sentinel-authtest
 //
 // No external crates: just raw FFI against libpam. Equivalent to a tiny
 // pamtester(1).
+//
+// `--bench` runs real pam_authenticate() calls through a module built
+// with the `test-seam` feature (see crates/pam-sentinel/src/seam.rs),
+// with no desktop and without touching /etc/pam.d. Build it into its own
+// target dir, so it can never be picked up by install.sh, against a
+// private config dir under ROOT, with build.rs's explicit opt-ins:
+//     SENTINEL_ALLOW_TEST_SEAM=1 SENTINEL_BENCH_BUILD=1 \
+//     SENTINEL_SYSCONFDIR=/tmp/sentinel-bench/etc \
+//     SENTINEL_SNAPSHOT_PATH=/tmp/sentinel-bench/run/config.snap \
+//         cargo build --release --target-dir target/bench \
+//             -p pam-sentinel -p sentinel-broker --features pam-sentinel/test-seam
+//     sudo target/sentinel-authtest --bench /tmp/sentinel-bench "$USER"
+//
+// Under ROOT it writes the config and a PAM config dir (read through
+// pam_start_confdir(3), Linux-PAM >= 1.4), starts a private
+// sentinel-broker and a mock system bus, then times each path in a
+// child process: the agent bypass, a remember hit, a [policy] allow and
+// the dialog (a canned verdict in place of the helper). Each path
+// reports p50/p90/p99/max per module stage (the `event=auth.timing`
+// stages), the module's own total, and the caller's whole
+// pam_start..pam_end, which adds libpam's config parse and the module's
+// dlopen. An auth that ends at another stage than its path's fails the
+// run. Root is required: the broker serves root peers only.
 
 use std::ffi::{CStr, CString, c_char, c_int, c_void};
-use std::ptr;
+use std::io::{BufRead, BufReader, Read, Write};
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
+use std::process::{Child, Command, Stdio};
+use std::time::{Duration, Instant};
+use std::{fs, ptr, thread};
 
 #[repr(C)]
 struct PamMessage {
@@ -47,12 +76,33 @@ unsafe extern "C" {
         conv: *const PamConv,
         pamh: *mut *mut c_void,
     ) -> c_int;
+    fn pam_start_confdir(
+        service_name: *const c_char,
+        user: *const c_char,
+        conv: *const PamConv,
+        confdir: *const c_char,
+        pamh: *mut *mut c_void,
+    ) -> c_int;
     fn pam_authenticate(pamh: *mut c_void, flags: c_int) -> c_int;
     fn pam_end(pamh: *mut c_void, status: c_int) -> c_int;
     fn pam_strerror(pamh: *mut c_void, errnum: c_int) -> *const c_char;
     fn calloc(nmemb: usize, size: usize) -> *mut c_void;
 }
 
+/// Leading fields of `struct passwd`; only ever read through a pointer
+/// from getpwnam(3).
+#[repr(C)]
+struct Passwd {
+    _pw_name: *mut c_char,
+    _pw_passwd: *mut c_char,
+    pw_uid: u32,
+}
+
+unsafe extern "C" {
+    fn geteuid() -> u32;
+    fn getpwnam(name: *const c_char) -> *const Passwd;
+}
+
 unsafe extern "C" fn conv_fn(
     n: c_int,
     _msgs: *const *const PamMessage,
@@ -74,25 +124,25 @@ unsafe extern "C" fn conv_fn(
     PAM_SUCCESS
 }
 
-fn main() {
-    let argv: Vec<String> = std::env::args().collect();
-    if argv.len() != 3 {
-        eprintln!("usage: {} SERVICE USER", argv[0]);
-        std::process::exit(2);
-    }
-
-    let service = CString::new(argv[1].as_str()).expect("service name");
-    let user = CString::new(argv[2].as_str()).expect("user name");
+/// One pam_start..pam_end round; `confdir` selects pam_start_confdir(3).
+/// Returns pam_authenticate's code and its pam_strerror text.
+fn authenticate(service: &CStr, user: &CStr, confdir: Option<&CStr>) -> (c_int, String) {
     let pc = PamConv {
         conv: conv_fn,
         appdata_ptr: ptr::null_mut(),
     };
     let mut h: *mut c_void = ptr::null_mut();
 
-    let r = unsafe { pam_start(service.as_ptr(), user.as_ptr(), &pc, &mut h) };
+    let r = unsafe {
+        match confdir {
+            Some(dir) => {
+                pam_start_confdir(service.as_ptr(), user.as_ptr(), &pc, dir.as_ptr(), &mut h)
+            }
+            None => pam_start(service.as_ptr(), user.as_ptr(), &pc, &mut h),
+        }
+    };
     if r != PAM_SUCCESS {
-        eprintln!("pam_start: {r}");
-        std::process::exit(1);
+        return (r, format!("pam_start: {r}"));
     }
 
     let auth = unsafe { pam_authenticate(h, 0) };
@@ -107,7 +157,30 @@ fn main() {
     unsafe {
         pam_end(h, auth);
     }
+    (auth, err)
+}
 
+fn main() {
+    let argv: Vec<String> = std::env::args().collect();
+    match argv.get(1).map(String::as_str) {
+        Some("--bench") => bench(&argv[2..]),
+        Some("--bench-child") if argv.len() == 6 => {
+            bench_child(&argv[2], &argv[3], &argv[4], &argv[5])
+        }
+        _ => {}
+    }
+    if argv.len() != 3 {
+        eprintln!("usage: {} SERVICE USER", argv[0]);
+        eprintln!(
+            "       {} --bench [--iters N] [--module SO] [--broker BIN] ROOT USER",
+            argv[0]
+        );
+        std::process::exit(2);
+    }
+
+    let service = CString::new(argv[1].as_str()).expect("service name");
+    let user = CString::new(argv[2].as_str()).expect("user name");
+    let (auth, err) = authenticate(&service, &user, None);
     if auth == PAM_SUCCESS {
         println!("ALLOW");
         std::process::exit(0);
@@ -115,3 +188,431 @@ fn main() {
     println!("DENY ({err})");
     std::process::exit(1);
 }
+
+// ---- bench ----------------------------------------------------------------
+
+const DEFAULT_ITERS: usize = 1000;
+/// Leading auths dropped from every path: the remember path's first one
+/// is the dialog that records the grant, and the rest warm the caches.
+const WARMUP: usize = 10;
+
+/// One measured path: the module's host binary name (the bypass only
+/// runs inside `polkit-agent-helper-1`, and `[policy]` matches the exe),
+/// the PAM service, the canned helper verdict, and the stage every
+/// measured auth must end at. `DENY` marks paths that must never reach
+/// the dialog, so a miss fails loudly. The remember path needs an Allow
+/// to record its grant, so a miss there would still succeed; its
+/// `last` stage is what catches one.
+struct BenchPath {
+    name: &'static str,
+    exe: &'static str,
+    service: &'static str,
+    verdict: &'static str,
+    last: &'static str,
+}
+
+const PATHS: [BenchPath; 4] = [
+    BenchPath {
+        name: "bypass",
+        exe: "polkit-agent-helper-1",
+        service: "polkit-1",
+        verdict: "DENY",
+        last: "bypass",
+    },
+    BenchPath {
+        name: "remember",
+        exe: "sentinel-bench",
+        service: "sentinel-bench-remember",
+        verdict: "ALLOW REMEMBER",
+        last: "remember",
+    },
+    BenchPath {
+        name: "policy",
+        exe: "sentinel-bench-policy",
+        service: "sentinel-bench-policy",
+        verdict: "DENY",
+        last: "policy",
+    },
+    BenchPath {
+        name: "dialog",
+        exe: "sentinel-bench",
+        service: "sentinel-bench-dialog",
+        verdict: "ALLOW",
+        last: "dialog",
+    },
+];
+
+const BENCH_CONFIG: &str = "\
+# Written by pam_authtest --bench: one PAM service per measured path.
+[policy]
+allow = [\"sentinel-bench-policy\"]
+
+[services.sentinel-bench-remember]
+remember_seconds = 300
+";
+
+fn die(msg: impl std::fmt::Display) -> ! {
+    eprintln!("pam_authtest: {msg}");
+    std::process::exit(1);
+}
+
+fn bench(args: &[String]) -> ! {
+    let mut iters = DEFAULT_ITERS;
+    let mut module = PathBuf::from("target/bench/release/libpam_sentinel.so");
+    let mut broker = PathBuf::from("target/bench/release/sentinel-broker");
+    let mut positional = Vec::new();
+    let mut args = args.iter();
+    while let Some(arg) = args.next() {
+        let mut value = || {
+            args.next()
+                .unwrap_or_else(|| die(format!("{arg} needs a value")))
+        };
+        match arg.as_str() {
+            "--iters" => {
+                iters = value()
+                    .parse()
+                    .unwrap_or_else(|_| die("--iters wants a count"))
+            }
+            "--module" => module = value().into(),
+            "--broker" => broker = value().into(),
+            _ => positional.push(arg.as_str()),
+        }
+    }
+    let [root, user] = positional[..] else {
+        die("usage: --bench [--iters N] [--module SO] [--broker BIN] ROOT USER");
+    };
+    if unsafe { geteuid() } != 0 {
+        die("--bench must run as root: the broker serves root peers only");
+    }
+    let root = Path::new(root);
+    let module =
+        fs::canonicalize(&module).unwrap_or_else(|e| die(format!("{}: {e}", module.display())));
+    let uid = user_uid(user).unwrap_or_else(|| die(format!("{user}: no such user")));
+
+    let (pam_d, bin, run) = (root.join("pam.d"), root.join("bin"), root.join("run"));
+    for dir in [&root.join("etc/security"), &pam_d, &bin, &run] {
+        fs::create_dir_all(dir).unwrap_or_else(|e| die(format!("{}: {e}", dir.display())));
+    }
+    write(&root.join("etc/security/sentinel.conf"), BENCH_CONFIG);
+    let me = std::env::current_exe().unwrap_or_else(|e| die(format!("current_exe: {e}")));
+    for path in &PATHS {
+        let stack = format!("auth required {}\n", module.display());
+        write(&pam_d.join(path.service), &stack);
+        let exe = bin.join(path.exe);
+        fs::copy(&me, &exe).unwrap_or_else(|e| die(format!("{}: {e}", exe.display())));
+    }
+
+    let broker_sock = run.join("broker.sock");
+    let mut broker = start_broker(&broker, &broker_sock);
+    let bus_sock = run.join("system_bus_socket");
+    let _ = fs::remove_file(&bus_sock);
+    let bus = UnixListener::bind(&bus_sock)
+        .unwrap_or_else(|e| die(format!("{}: {e}", bus_sock.display())));
+    thread::spawn(move || {
+        for s in bus.incoming().flatten() {
+            thread::spawn(move || serve_bus(s, uid));
+        }
+    });
+
+    println!("{iters} auths per path after {WARMUP} warm-up; latencies in µs");
+    for path in &PATHS {
+        let timing = run.join(format!("{}.timing", path.name));
+        let _ = fs::remove_file(&timing);
+        let child = Command::new(bin.join(path.exe))
+            .args([
+                "--bench-child",
+                &pam_d.to_string_lossy(),
+                path.service,
+                user,
+            ])
+            .arg((iters + WARMUP).to_string())
+            .env("SENTINEL_BROKER_SOCK", &broker_sock)
+            .env("SENTINEL_TEST_SYSTEM_BUS", &bus_sock)
+            .env("SENTINEL_TEST_TIMING", &timing)
+            .env("SENTINEL_TEST_HELPER_OUTCOME", path.verdict)
+            .env("WAYLAND_DISPLAY", "sentinel-bench")
+            .stdin(Stdio::null())
+            .output()
+            .unwrap_or_else(|e| die(format!("{}: {e}", path.exe)));
+        if !child.status.success() {
+            let _ = broker.kill();
+            die(format!(
+                "{} path: {}is the module a test-seam build with SENTINEL_SYSCONFDIR={}?",
+                path.name,
+                String::from_utf8_lossy(&child.stderr),
+                root.join("etc").display()
+            ));
+        }
+        let mut stages = stage_samples(&timing);
+        if stages.is_empty() {
+            let _ = broker.kill();
+            die(format!(
+                "{}: no timings; not a test-seam build for this ROOT?",
+                timing.display()
+            ));
+        }
+        if let Some((i, stage)) = fell_through(&timing, path.last) {
+            let _ = broker.kill();
+            die(format!(
+                "{} path: auth {i} ended at stage {stage}, not {}",
+                path.name,
+                path.last
+            ));
+        }
+        let pam = String::from_utf8_lossy(&child.stdout)
+            .lines()
+            .filter_map(|l| l.parse().ok())
+            .skip(WARMUP)
+            .collect();
+        stages.push(("pam".into(), pam));
+        report(path, stages);
+    }
+    let _ = broker.kill();
+    let _ = broker.wait();
+    std::process::exit(0);
+}
+
+/// The child half: `iters` auths in a row, each one's wall time on
+/// stdout. Any failure ends the run, since it means the path under test
+/// fell through to another one.
+fn bench_child(confdir: &str, service: &str, user: &str, iters: &str) -> ! {
+    let confdir = CString::new(confdir).expect("confdir");
+    let service = CString::new(service).expect("service name");
+    let user = CString::new(user).expect("user name");
+    let iters: usize = iters.parse().unwrap_or_else(|_| die("bad iteration count"));
+    let mut out = std::io::stdout().lock();
+    for i in 0..iters {
+        let started = Instant::now();
+        let (auth, err) = authenticate(&service, &user, Some(&confdir));
+        let us = started.elapsed().as_micros();
+        if auth != PAM_SUCCESS {
+            die(format!("auth {i} denied ({err}); "));
+        }
+        let _ = writeln!(out, "{us}");
+    }
+    std::process::exit(0);
+}
+
+fn user_uid(name: &str) -> Option<u32> {
+    let c = CString::new(name).ok()?;
+    // SAFETY: getpwnam returns NULL or a pointer to static storage that
+    // stays valid until the next getpw* call; only `pw_uid` is read.
+    unsafe { getpwnam(c.as_ptr()).as_ref().map(|pw| pw.pw_uid) }
+}
+
+fn write(path: &Path, contents: &str) {
+    fs::write(path, contents).unwrap_or_else(|e| die(format!("{}: {e}", path.display())));
+}
+
+fn start_broker(bin: &Path, sock: &Path) -> Child {
+    let _ = fs::remove_file(sock);
+    let child = Command::new(bin)
+        .env("SENTINEL_BROKER_SOCK", sock)
+        .stdin(Stdio::null())
+        .stderr(Stdio::null())
+        .spawn()
+        .unwrap_or_else(|e| die(format!("{}: {e}", bin.display())));
+    let deadline = Instant::now() + Duration::from_secs(5);
+    while UnixStream::connect(sock).is_err() {
+        if Instant::now() > deadline {
+            die(format!("{}: broker never listened", sock.display()));
+        }
+        thread::sleep(Duration::from_millis(10));
+    }
+    child
+}
+
+/// Per-stage samples from the module's `event=auth.timing` lines, in the
+/// order the stages first appear, warm-up lines dropped.
+fn stage_samples(path: &Path) -> Vec<(String, Vec<u64>)> {
+    let Ok(f) = fs::File::open(path) else {
+        return Vec::new();
+    };
+    let mut stages: Vec<(String, Vec<u64>)> = Vec::new();
+    for line in BufReader::new(f).lines().map_while(Result::ok).skip(WARMUP) {
+        for (key, value) in line.split_whitespace().filter_map(|kv| kv.split_once('=')) {
+            let (Some(stage), Ok(us)) = (key.strip_suffix("_us"), value.parse()) else {
+                continue;
+            };
+            match stages.iter_mut().find(|(s, _)| s == stage) {
+                Some((_, samples)) => samples.push(us),
+                None => stages.push((stage.to_owned(), vec![us])),
+            }
+        }
+    }
+    stages
+}
+
+/// The first measured auth whose last stage isn't `last`, and the stage
+/// it ended at instead: the path under test fell through to another.
+fn fell_through(path: &Path, last: &str) -> Option<(usize, String)> {
+    let f = fs::File::open(path).ok()?;
+    BufReader::new(f)
+        .lines()
+        .map_while(Result::ok)
+        .enumerate()
+        .skip(WARMUP)
+        .find_map(|(i, line)| {
+            let ended = line
+                .split_whitespace()
+                .filter_map(|kv| kv.split_once('=')?.0.strip_suffix("_us"))
+                .filter(|&stage| stage != "total")
+                .last()
+                .unwrap_or("")
+                .to_owned();
+            (ended != last).then_some((i, ended))
+        })
+}
+
+fn report(path: &BenchPath, stages: Vec<(String, Vec<u64>)>) {
+    println!();
+    println!("{} (service {}, exe {})", path.name, path.service, path.exe);
+    println!(
+        "  {:<10} {:>6} {:>9} {:>9} {:>9} {:>9}",
+        "stage", "n", "p50", "p90", "p99", "max"
+    );
+    for (stage, mut samples) in stages {
+        samples.sort_unstable();
+        let at = |p: usize| samples[(samples.len() - 1) * p / 100];
+        println!(
+            "  {stage:<10} {:>6} {:>9} {:>9} {:>9} {:>9}",
+            samples.len(),
+            at(50),
+            at(90),
+            at(99),
+            at(100)
+        );
+    }
+}
+
+// ---- mock system bus ------------------------------------------------------
+
+const METHOD_RETURN: u8 = 2;
+const ERROR: u8 = 3;
+
+/// Just enough of a bus daemon for the module's bypass query: the SASL
+/// handshake, then `Hello`, `GetNameOwner`, `GetConnectionUnixUser` and
+/// `TakeApproval[For]`, answered as `uid`'s agent holding an approval.
+/// Anything else gets `UnknownMethod`. Little-endian only, which is all
+/// the module sends.
+fn serve_bus(mut s: UnixStream, uid: u32) {
+    let mut buf = Vec::new();
+    let mut chunk = [0u8; 4096];
+    let mut serial = 0;
+    let mut authed = false;
+    loop {
+        if !authed {
+            if let Some(at) = buf.windows(7).position(|w| w == b"BEGIN\r\n") {
+                buf.drain(..at + 7);
+                if s.write_all(b"OK 0123456789abcdef0123456789abcdef\r\n")
+                    .is_err()
+                {
+                    return;
+                }
+                authed = true;
+                continue;
+            }
+        } else if let Some(len) = message_len(&buf).filter(|&len| buf.len() >= len) {
+            let (call, member) = parse_call(&buf[..len]);
+            buf.drain(..len);
+            serial += 1;
+            let reply = match member.as_str() {
+                "Hello" => reply(METHOD_RETURN, serial, call, None, "s", &string(":1.1")),
+                "GetNameOwner" => reply(METHOD_RETURN, serial, call, None, "s", &string(":1.0")),
+                "GetConnectionUnixUser" => {
+                    reply(METHOD_RETURN, serial, call, None, "u", &uid.to_le_bytes())
+                }
+                "TakeApproval" | "TakeApprovalFor" => {
+                    reply(METHOD_RETURN, serial, call, None, "b", &1u32.to_le_bytes())
+                }
+                _ => reply(
+                    ERROR,
+                    serial,
+                    call,
+                    Some("org.freedesktop.DBus.Error.UnknownMethod"),
+                    "",
+                    &[],
+                ),
+            };
+            if s.write_all(&reply).is_err() {
+                return;
+            }
+            continue;
+        }
+        match s.read(&mut chunk) {
+            Ok(0) | Err(_) => return,
+            Ok(n) => buf.extend_from_slice(&chunk[..n]),
+        }
+    }
+}
+
+fn u32_at(buf: &[u8], at: usize) -> usize {
+    buf.get(at..at + 4)
+        .map_or(0, |b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]) as usize)
+}
+
+/// Length of the message at the front of `buf`, once its fixed header
+/// has arrived.
+fn message_len(buf: &[u8]) -> Option<usize> {
+    (buf.len() >= 16).then(|| (16 + u32_at(buf, 12)).next_multiple_of(8) + u32_at(buf, 4))
+}
+
+/// A call's serial and member name.
+fn parse_call(msg: &[u8]) -> (u32, String) {
+    let serial = u32_at(msg, 8) as u32;
+    let end = 16 + u32_at(msg, 12);
+    let mut member = String::new();
+    let mut at = 16;
+    while at + 4 <= end {
+        let (code, ty) = (msg[at], msg[at + 2]);
+        at += 4;
+        match ty {
+            b's' | b'o' => {
+                at = at.next_multiple_of(4);
+                let len = u32_at(msg, at);
+                if code == 3 {
+                    member = String::from_utf8_lossy(&msg[at + 4..at + 4 + len]).into_owned();
+                }
+                at += 4 + len + 1;
+            }
+            b'g' => at += 1 + msg[at] as usize + 1,
+            b'u' => at = at.next_multiple_of(4) + 4,
+            _ => break,
+        }
+        at = at.next_multiple_of(8);
+    }
+    (serial, member)
+}
+
+fn string(s: &str) -> Vec<u8> {
+    let mut body = (s.len() as u32).to_le_bytes().to_vec();
+    body.extend_from_slice(s.as_bytes());
+    body.push(0);
+    body
+}
+
+fn reply(kind: u8, serial: u32, to: u32, error: Option<&str>, sig: &str, body: &[u8]) -> Vec<u8> {
+    let pad = |out: &mut Vec<u8>| out.resize(out.len().next_multiple_of(8), 0);
+    let mut out = vec![b'l', kind, 0, 1];
+    out.extend_from_slice(&(body.len() as u32).to_le_bytes());
+    out.extend_from_slice(&serial.to_le_bytes());
+    out.extend_from_slice(&[0; 4]);
+    out.extend_from_slice(&[5, 1, b'u', 0]);
+    out.extend_from_slice(&to.to_le_bytes());
+    if let Some(name) = error {
+        pad(&mut out);
+        out.extend_from_slice(&[4, 1, b's', 0]);
+        out.extend_from_slice(&string(name));
+    }
+    if !sig.is_empty() {
+        pad(&mut out);
+        out.extend_from_slice(&[8, 1, b'g', 0, sig.len() as u8]);
+        out.extend_from_slice(sig.as_bytes());
+        out.push(0);
+    }
+    let fields = (out.len() - 16) as u32;
+    out[12..16].copy_from_slice(&fields.to_le_bytes());
+    pad(&mut out);
+    out.extend_from_slice(body);
+    out
+}
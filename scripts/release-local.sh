@@ -50,6 +50,8 @@ setup_repro_env() {
     export SOURCE_DATE_EPOCH="$(git -C "$REPO_ROOT" log -1 --format=%ct)"
     export SENTINEL_PREFIX=/usr SENTINEL_SYSCONFDIR=/etc SENTINEL_LIBEXECDIR=lib
     export SENTINEL_HELPER_PATH=/usr/lib/sentinel-helper-kde
+    # Never bundle a helper that compiles its QML at runtime.
+    export SENTINEL_REQUIRE_QML_AOT=1
     # Strip machine-specific paths from the binaries for reproducibility.
     local remap="--remap-path-prefix=$HOME=/ --remap-path-prefix=$REPO_ROOT=/src"
     local linker target_cpu=""